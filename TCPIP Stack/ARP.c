@@ -75,9 +75,26 @@
 #define ARP_IP                  (0x0800u)	// ARP IP packet type as defined by IEEE 802.3
 #endif
 
-#ifdef STACK_CLIENT_MODE
-static NODE_INFO Cache;						// Cache for one ARP response
-#endif
+// ARPProcess() states
+typedef enum
+{
+    SM_ARP_IDLE = 0,
+    SM_ARP_REPLY
+} SM_ARP;
+
+// ARP module state, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	#ifdef STACK_CLIENT_MODE
+	NODE_INFO Cache;			// Cache for one ARP response
+	#endif
+	NODE_INFO Target;			// Node an ARP reply is pending for
+	SM_ARP smARP;
+} ARP_CONTEXT;
+static ARP_CONTEXT STACK_INSTANCE_ARRAY(ARPContext);
+#define Cache		(STACK_INSTANCE(ARPContext).Cache)
+#define Target		(STACK_INSTANCE(ARPContext).Target)
+#define smARP		(STACK_INSTANCE(ARPContext).smARP)
 
 #ifdef STACK_USE_ZEROCONF_LINK_LOCAL
 #define MAX_REG_APPS            2           // MAX num allowed registrations of Modules/Apps
@@ -428,15 +445,9 @@ void ARPInit(void)
 BOOL ARPProcess(void)
 {
 	ARP_PACKET packet;
-	static NODE_INFO Target;
     #if defined(STACK_USE_AUTO_IP)
         BYTE i;
     #endif
-	static enum
-	{
-	    SM_ARP_IDLE = 0,
-	    SM_ARP_REPLY
-	} smARP = SM_ARP_IDLE;
 
     switch(smARP)
     {
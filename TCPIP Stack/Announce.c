@@ -67,9 +67,27 @@
 // The announce port
 #define ANNOUNCE_PORT	30303
 
+// DiscoveryTask() states
+typedef enum
+{
+	DISCOVERY_HOME = 0,
+	DISCOVERY_LISTEN,
+	DISCOVERY_REQUEST_RECEIVED,
+	DISCOVERY_DISABLED
+} SM_DISCOVERY;
+
+// State of DiscoveryTask(), one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	SM_DISCOVERY DiscoverySM;
+	UDP_SOCKET DiscoverySocket;
+} ANNOUNCE_CONTEXT;
+static ANNOUNCE_CONTEXT STACK_INSTANCE_ARRAY(AnnounceContext);
+#define DiscoverySM	(STACK_INSTANCE(AnnounceContext).DiscoverySM)
+#define DiscoverySocket	(STACK_INSTANCE(AnnounceContext).DiscoverySocket)
+
 
 
-extern NODE_INFO remoteNode;
 
 /****************************************************************************************************
   Function:
@@ -175,14 +193,6 @@ void AnnounceIP(void)
  ********************************************************************/
 void DiscoveryTask(void)
 {
-	static enum {
-		DISCOVERY_HOME = 0,
-		DISCOVERY_LISTEN,
-		DISCOVERY_REQUEST_RECEIVED,
-		DISCOVERY_DISABLED
-	} DiscoverySM = DISCOVERY_HOME;
-
-	static UDP_SOCKET	MySocket;
 	BYTE 				i;
 	
 	switch(DiscoverySM)
@@ -192,10 +202,10 @@ void DiscoveryTask(void)
 			// Since we expect to only receive broadcast packets and 
 			// only send unicast packets directly to the node we last 
 			// received from, the remote NodeInfo parameter can be anything
-			//MySocket = UDPOpen(ANNOUNCE_PORT, NULL, ANNOUNCE_PORT);
-			MySocket = UDPOpenEx(0,UDP_OPEN_SERVER,ANNOUNCE_PORT, ANNOUNCE_PORT);
+			//DiscoverySocket = UDPOpen(ANNOUNCE_PORT, NULL, ANNOUNCE_PORT);
+			DiscoverySocket = UDPOpenEx(0,UDP_OPEN_SERVER,ANNOUNCE_PORT, ANNOUNCE_PORT);
 
-			if(MySocket == INVALID_UDP_SOCKET)
+			if(DiscoverySocket == INVALID_UDP_SOCKET)
 				return;
 			else
 				DiscoverySM++;
@@ -203,7 +213,7 @@ void DiscoveryTask(void)
 
 		case DISCOVERY_LISTEN:
 			// Do nothing if no data is waiting
-			if(!UDPIsGetReady(MySocket))
+			if(!UDPIsGetReady(DiscoverySocket))
 				return;
 			
 			// See if this is a discovery query or reply
@@ -216,12 +226,12 @@ void DiscoveryTask(void)
 			DiscoverySM++;
 
 			// Change the destination to the unicast address of the last received packet
-        	memcpy((void*)&UDPSocketInfo[MySocket].remote.remoteNode, (const void*)&remoteNode, sizeof(remoteNode));
+        	memcpy((void*)&UDPSocketInfo[DiscoverySocket].remote.remoteNode, (const void*)&StackRemoteNode, sizeof(StackRemoteNode));
 			
 			// No break needed.  If we get down here, we are now ready for the DISCOVERY_REQUEST_RECEIVED state
 
 		case DISCOVERY_REQUEST_RECEIVED:
-			if(!UDPIsPutReady(MySocket))
+			if(!UDPIsPutReady(DiscoverySocket))
 				return;
 
 			// Begin sending our MAC address in human readable form.
@@ -137,7 +137,9 @@ static AUTOIP_CLIENT_VARS	*SelectedAutoIPClient;
 
 #else
 
-static AUTOIP_CLIENT_VARS AutoIPClient;
+// One copy per stack instance (see StackTsk.h)
+static AUTOIP_CLIENT_VARS STACK_INSTANCE_ARRAY(AutoIPClients);
+#define AutoIPClient	STACK_INSTANCE(AutoIPClients)
 #define LoadState(v)
 
 #endif
@@ -134,8 +134,6 @@ typedef struct
 	} validValues;
 } DHCP_CLIENT_VARS;
 
-BOOL DHCPClientInitializedOnce = FALSE;
-
 static BYTE _DHCPReceive(void);
 static void _DHCPSend(BYTE messageType, BOOL bRenewing);
 
@@ -172,6 +170,7 @@ extern void SetDhcpProgressState(void);
 ***************************************************************************/
 #if NETWORK_INTERFACES > 1
 
+BOOL DHCPClientInitializedOnce = FALSE;
 static DHCP_CLIENT_VARS	DHCPClients[NETWORK_INTERFACES];
 static DHCP_CLIENT_VARS	*SelectedDHCPClient;
 #define DHCPClient		(*SelectedDHCPClient)
@@ -179,7 +178,15 @@ static DHCP_CLIENT_VARS	*SelectedDHCPClient;
 
 #else
 
-static DHCP_CLIENT_VARS DHCPClient;
+// DHCP client state, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	BOOL bInitializedOnce;
+	DHCP_CLIENT_VARS Client;
+} DHCP_CONTEXT;
+static DHCP_CONTEXT STACK_INSTANCE_ARRAY(DHCPContext);
+#define DHCPClientInitializedOnce	(STACK_INSTANCE(DHCPContext).bInitializedOnce)
+#define DHCPClient					(STACK_INSTANCE(DHCPContext).Client)
 #define LoadState(v)
 
 #endif
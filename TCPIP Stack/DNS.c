@@ -68,26 +68,8 @@
 #define DNS_PORT		53u					// Default port for DNS resolutions
 #define DNS_TIMEOUT		(TICK_SECOND*1)		// Elapsed time after which a DNS resolution is considered to have timed out
 
-static UDP_SOCKET MySocket = INVALID_UDP_SOCKET;	// UDP socket to use for DNS queries
-static BYTE *DNSHostName;							// Host name in RAM to look up
-static ROM BYTE *DNSHostNameROM;					// Host name in ROM to look up
-static BYTE RecordType;								// Record type being queried
-static NODE_INFO ResolvedInfo;						// Node information about the resolved node
-
-// Semaphore flags for the DNS module
-static union
-{
-	BYTE Val;
-	struct
-	{
-		unsigned char DNSInUse 		: 1;	// Indicates the DNS module is in use
-		unsigned char AddressValid	: 1;	// Indicates that the address resolution is valid and complete
-		unsigned char filler 		: 6;
-	} bits;
-} Flags = {0x00};
-
 // State machine for a DNS query
-static enum
+typedef enum
 {
 	DNS_START = 0, 				// Initial state to reset client state variables
 	DNS_ARP_START_RESOLVE,		// Send ARP resolution of DNS server or gateway MAC address
@@ -97,7 +79,52 @@ static enum
 	DNS_GET_RESULT,				// Wait for response from DNS server
 	DNS_FAIL,					// ARP or DNS server not responding
 	DNS_DONE					// DNS query is finished
-} smDNS = DNS_DONE;
+} SM_DNS;
+
+// DNS client state, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	UDP_SOCKET MySocket;				// UDP socket to use for DNS queries
+	SM_DNS smDNS;
+	BYTE *DNSHostName;					// Host name in RAM to look up
+	ROM BYTE *DNSHostNameROM;			// Host name in ROM to look up
+	BYTE RecordType;					// Record type being queried
+	NODE_INFO ResolvedInfo;				// Node information about the resolved node
+
+	// Semaphore flags for the DNS module
+	union
+	{
+		BYTE Val;
+		struct
+		{
+			unsigned char DNSInUse 		: 1;	// Indicates the DNS module is in use
+			unsigned char AddressValid	: 1;	// Indicates that the address resolution is valid and complete
+			unsigned char filler 		: 6;
+		} bits;
+	} DNSFlags;
+
+	// Progress of the query in DNSIsResolved()
+	DWORD StartTime;
+	BYTE vARPAttemptCount;
+	BYTE vDNSAttemptCount;
+} DNS_CONTEXT;
+#define DNS_CONTEXT_INIT	{.MySocket = INVALID_UDP_SOCKET, .smDNS = DNS_DONE}
+static DNS_CONTEXT STACK_INSTANCE_ARRAY(DNSContext) = STACK_INSTANCE_INIT(DNS_CONTEXT_INIT);
+#define MySocket			(STACK_INSTANCE(DNSContext).MySocket)
+#define smDNS				(STACK_INSTANCE(DNSContext).smDNS)
+#define DNSHostName			(STACK_INSTANCE(DNSContext).DNSHostName)
+#define DNSHostNameROM		(STACK_INSTANCE(DNSContext).DNSHostNameROM)
+#define RecordType			(STACK_INSTANCE(DNSContext).RecordType)
+#define ResolvedInfo		(STACK_INSTANCE(DNSContext).ResolvedInfo)
+#define DNSFlags			(STACK_INSTANCE(DNSContext).DNSFlags)
+#define StartTime			(STACK_INSTANCE(DNSContext).StartTime)
+#define vARPAttemptCount	(STACK_INSTANCE(DNSContext).vARPAttemptCount)
+#define vDNSAttemptCount	(STACK_INSTANCE(DNSContext).vDNSAttemptCount)
+
+// Transaction ID of the last query.  Not cleared by a reset, so IDs aren't 
+// reused right after one.
+static WORD_VAL STACK_INSTANCE_ARRAY(DNSSentTransactionID) __attribute__((persistent));
+#define SentTransactionID	STACK_INSTANCE(DNSSentTransactionID)
 
 // Structure for the DNS header
 typedef struct
@@ -168,10 +195,10 @@ static void DNSDiscardName(void);
   ***************************************************************************/
 BOOL DNSBeginUsage(void)
 {
-	if(Flags.bits.DNSInUse)
+	if(DNSFlags.bits.DNSInUse)
 		return FALSE;
 
-	Flags.bits.DNSInUse = TRUE;
+	DNSFlags.bits.DNSInUse = TRUE;
 	return TRUE;
 }
 
@@ -211,9 +238,9 @@ BOOL DNSEndUsage(void)
 		MySocket = INVALID_UDP_SOCKET;
 	}
 	smDNS = DNS_DONE;
-	Flags.bits.DNSInUse = FALSE;
+	DNSFlags.bits.DNSInUse = FALSE;
 
-	return Flags.bits.AddressValid;
+	return DNSFlags.bits.AddressValid;
 }
 
 
@@ -252,7 +279,7 @@ void DNSResolve(BYTE* Hostname, BYTE Type)
 {
 	if(StringToIPAddress(Hostname, &ResolvedInfo.IPAddr))
 	{
-		Flags.bits.AddressValid = TRUE;
+		DNSFlags.bits.AddressValid = TRUE;
 		smDNS = DNS_DONE;
 	}
 	else
@@ -261,7 +288,7 @@ void DNSResolve(BYTE* Hostname, BYTE Type)
 		DNSHostNameROM = NULL;
 		smDNS = DNS_START;
 		RecordType = Type;
-		Flags.bits.AddressValid = FALSE;
+		DNSFlags.bits.AddressValid = FALSE;
 	}
 }
 
@@ -304,7 +331,7 @@ void DNSResolveROM(ROM BYTE* Hostname, BYTE Type)
 {
 	if(ROMStringToIPAddress(Hostname, &ResolvedInfo.IPAddr))
 	{
-		Flags.bits.AddressValid = TRUE;
+		DNSFlags.bits.AddressValid = TRUE;
 		smDNS = DNS_DONE;
 	}
 	else
@@ -313,7 +340,7 @@ void DNSResolveROM(ROM BYTE* Hostname, BYTE Type)
 		DNSHostNameROM = Hostname;
 		smDNS = DNS_START;
 		RecordType = Type;
-		Flags.bits.AddressValid = FALSE;
+		DNSFlags.bits.AddressValid = FALSE;
 	}
 }
 #endif
@@ -346,10 +373,6 @@ void DNSResolveROM(ROM BYTE* Hostname, BYTE Type)
   ***************************************************************************/
 BOOL DNSIsResolved(IP_ADDR* HostIP)
 {
-	static DWORD		StartTime;
-	static WORD_VAL		SentTransactionID __attribute__((persistent));
-	static BYTE			vARPAttemptCount;
-	static BYTE			vDNSAttemptCount;
 	BYTE 				i;
 	WORD_VAL			w;
 	DNS_HEADER			DNSHeader;
@@ -486,7 +509,7 @@ BOOL DNSIsResolved(IP_ADDR* HostIP)
 					DNSAnswerHeader.ResponseClass.Val	== 0x0001u && // Internet class
 					DNSAnswerHeader.ResponseLen.Val		== 0x0004u)
 				{
-					Flags.bits.AddressValid = TRUE;
+					DNSFlags.bits.AddressValid = TRUE;
 					UDPGet(&ResolvedInfo.IPAddr.v[0]);
 					UDPGet(&ResolvedInfo.IPAddr.v[1]);
 					UDPGet(&ResolvedInfo.IPAddr.v[2]);
@@ -523,7 +546,7 @@ BOOL DNSIsResolved(IP_ADDR* HostIP)
 					DNSAnswerHeader.ResponseClass.Val	== 0x0001u && // Internet class
 					DNSAnswerHeader.ResponseLen.Val		== 0x0004u)
 				{
-					Flags.bits.AddressValid = TRUE;
+					DNSFlags.bits.AddressValid = TRUE;
 					UDPGet(&ResolvedInfo.IPAddr.v[0]);
 					UDPGet(&ResolvedInfo.IPAddr.v[1]);
 					UDPGet(&ResolvedInfo.IPAddr.v[2]);
@@ -560,7 +583,7 @@ BOOL DNSIsResolved(IP_ADDR* HostIP)
 					DNSAnswerHeader.ResponseClass.Val	== 0x0001u && // Internet class
 					DNSAnswerHeader.ResponseLen.Val		== 0x0004u)
 				{
-					Flags.bits.AddressValid = TRUE;
+					DNSFlags.bits.AddressValid = TRUE;
 					UDPGet(&ResolvedInfo.IPAddr.v[0]);
 					UDPGet(&ResolvedInfo.IPAddr.v[1]);
 					UDPGet(&ResolvedInfo.IPAddr.v[2]);
@@ -587,7 +610,7 @@ DoneSearchingRecords:
 		case DNS_DONE:
 			// Return 0.0.0.0 if DNS resolution failed, otherwise return the 
 			// resolved IP address
-			if(!Flags.bits.AddressValid)
+			if(!DNSFlags.bits.AddressValid)
 				ResolvedInfo.IPAddr.Val = 0;
 			HostIP->Val = ResolvedInfo.IPAddr.Val;
 			return TRUE;
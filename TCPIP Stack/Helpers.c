@@ -60,7 +60,9 @@
 
 
 // Default Random Number Generator seed. 0x41FE9F9E corresponds to calling LFSRSeedRand(1)
-static DWORD dwLFSRRandSeed = 0x41FE9F9E;
+// One seed per stack instance (see StackTsk.h)
+static DWORD STACK_INSTANCE_ARRAY(LFSRRandSeeds) = STACK_INSTANCE_INIT(0x41FE9F9E);
+#define dwLFSRRandSeed	STACK_INSTANCE(LFSRRandSeeds)
 
 /*****************************************************************************
   Function:
@@ -211,16 +213,24 @@ WORD LFSRRand(void)
   ***************************************************************************/
 DWORD GenerateRandomDWORD(void)
 {
+#if !defined(COMPILER_GCC_HOST)
 	BYTE vBitCount;
 	WORD w, wTime, wLastValue;
 	DWORD dwTotalTime;
+#endif
 	union
 	{
 		DWORD	dw;
 		WORD	w[2];
 	} randomResult;
 
-#if defined __18CXX	
+#if defined(COMPILER_GCC_HOST)
+	// There is no A/D converter to take entropy from on a Linux host.  Use the 
+	// LFSR alone so replaying a capture after the same LFSRSeedRand() call 
+	// gives the same results every time.
+	randomResult.w[0] = LFSRRand();
+	randomResult.w[1] = LFSRRand();
+#elif defined __18CXX	
 {
 	BYTE ADCON0Save, ADCON2Save;
 	BYTE T0CONSave, TMR0HSave, TMR0LSave;
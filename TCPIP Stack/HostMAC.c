@@ -0,0 +1,845 @@
+/*********************************************************************
+ *
+ *	Linux Host MAC Layer for Microchip TCP/IP Stack
+ *
+ *********************************************************************
+ * FileName:        HostMAC.c
+ * Dependencies:    MAC.h
+ * Processor:       Linux PC (COMPILER_GCC_HOST)
+ * Compiler:        GCC
+ *
+ * Implements the MAC.h API on an array standing in for the MAC buffer
+ * RAM, so the stack can be built and run as an ordinary Linux process.
+ * Frames are exchanged with one of:
+ *  - A TAP interface (HostMACOpenTap()), so the whole stack, StackTask(),
+ *    StackApplications() and my_C_TCPIP_framework.c included, can be
+ *    load tested with ordinary clients and profiled with perf.  MACInit()
+ *    opens HOST_MAC_TAP_NAME if nothing else was opened first.
+ *  - Any file descriptor that keeps frame boundaries, such as one end of
+ *    a SOCK_SEQPACKET socketpair() (HostMACOpenFd()), for tests.
+ *  - A pcap file to replay (HostMACOpenPcap()), for benchmarking and for 
+ *    checking changes against a known capture.
+ *  - A port of the simulated network in HostNetSim.c (HostMACOpenNetSim()),
+ *    for reproducible runs over lossy, slow or reordering links in 
+ *    virtual time.
+ * Transmitted frames can also be captured to a pcap file in any case.
+ * With STACK_MULTI_INSTANCE, each stack instance has its own MAC buffer
+ * RAM and opens its own port, as my_C_TCPIP_fleet_host.c does.
+ *
+ * To run an application on a TAP interface:
+ *	ip tuntap add dev tap0 mode tap user $USER
+ *	ip addr add 169.254.1.2/16 dev tap0
+ *	ip link set tap0 up
+ *	gcc -no-pie -o my_app my_app.c my_C_TCPIP_framework_common.c my_C_TCPIP_framework.c my_function_queue.c 
+ *		"TCPIP Stack/"{StackTsk,Announce,NBNS,SNTP,DNS,DHCP,AutoIP,Helpers,
+ *		Delay,Tick,IP,TCP,UDP,ARP,ICMP,HostMAC,HostNetSim}.c
+ * my_C_TCPIP_tap_host.c is a minimal such application (an echo server).  
+ * The stack starts with DHCP enabled, so either serve DHCP on tap0 or 
+ * let it fall back to AutoIP/the default address.
+ *
+ * The RX side holds one frame at a time: MACGetHeader() loads the next
+ * frame to RXSTART and MACDiscardRx() releases it.  Everything else
+ * (TX buffer, TCP_ETH_RAM socket FIFOs) lives at the addresses MAC.h
+ * assigns, exactly as it would in the MRF24WB's RAM.
+ ********************************************************************/
+#define __HOSTMAC_C
+
+#include "includes/TCPIP.h"
+
+#if defined(COMPILER_GCC_HOST)
+
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+
+// TAP interface MACInit() opens when no frame source was chosen beforehand
+#if !defined(HOST_MAC_TAP_NAME)
+	#define HOST_MAC_TAP_NAME	"tap0"
+#endif
+
+
+// pcap file format magic numbers and link type
+#define PCAP_MAGIC			(0xA1B2C3D4ul)	// Microsecond timestamps
+#define PCAP_MAGIC_NSEC		(0xA1B23C4Dul)	// Nanosecond timestamps
+#define PCAP_LINKTYPE_ETHERNET	(1ul)
+
+// Largest frame (without FCS) that can be received or transmitted
+#define HOST_MAC_MAX_FRAME	(1514u)
+
+// pcap global file header
+typedef struct
+{
+	DWORD dwMagic;
+	WORD wVersionMajor;
+	WORD wVersionMinor;
+	LONG lThisZone;
+	DWORD dwSigFigs;
+	DWORD dwSnapLen;
+	DWORD dwLinkType;
+} PCAP_FILE_HEADER;
+
+// pcap per-frame record header
+typedef struct
+{
+	DWORD dwSeconds;
+	DWORD dwFraction;
+	DWORD dwCapturedLen;
+	DWORD dwOriginalLen;
+} PCAP_RECORD_HEADER;
+
+
+// State of the emulated MAC, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	// TAP or socket frames are exchanged with, or -1
+	int iFrameFd;
+
+	// Simulated network port frames are exchanged with, or NETSIM_INVALID_PORT
+	BYTE vNetSimPort;
+
+	// Read and write pointers into HostRAM (ERDPT and EWRPT on an ENC28J60)
+	PTR_BASE wReadPtr;
+	PTR_BASE wWritePtr;
+
+	// Length of the frame at RXSTART, and whether it still has to be discarded
+	WORD wRxFrameLen;
+	BOOL bRxPending;
+
+	// Length of the frame being built at BASE_TX_ADDR
+	WORD wTxFrameLen;
+	DWORD dwTxCount;
+
+	// Capture files
+	FILE *fRx;
+	FILE *fTx;
+	BOOL bRxSwapped;
+} HOST_MAC_CONTEXT;
+#define HOST_MAC_CONTEXT_INIT	{.iFrameFd = -1, .vNetSimPort = NETSIM_INVALID_PORT}
+static HOST_MAC_CONTEXT STACK_INSTANCE_ARRAY(HostMACContext) = STACK_INSTANCE_INIT(HOST_MAC_CONTEXT_INIT);
+#define iFrameFd		(STACK_INSTANCE(HostMACContext).iFrameFd)
+#define vNetSimPort		(STACK_INSTANCE(HostMACContext).vNetSimPort)
+#define wReadPtr		(STACK_INSTANCE(HostMACContext).wReadPtr)
+#define wWritePtr		(STACK_INSTANCE(HostMACContext).wWritePtr)
+#define wRxFrameLen		(STACK_INSTANCE(HostMACContext).wRxFrameLen)
+#define bRxPending		(STACK_INSTANCE(HostMACContext).bRxPending)
+#define wTxFrameLen		(STACK_INSTANCE(HostMACContext).wTxFrameLen)
+#define dwTxCount		(STACK_INSTANCE(HostMACContext).dwTxCount)
+#define fRx				(STACK_INSTANCE(HostMACContext).fRx)
+#define fTx				(STACK_INSTANCE(HostMACContext).fTx)
+#define bRxSwapped		(STACK_INSTANCE(HostMACContext).bRxSwapped)
+
+// The large buffers are kept out of HOST_MAC_CONTEXT so its initializer 
+// doesn't put them in the data section.  The capture files' stdio buffers 
+// are static so replaying frames never allocates memory.
+static BYTE STACK_INSTANCE_ARRAY(HostRAMs)[RAMSIZE];			// Emulated MAC buffer RAM
+static char STACK_INSTANCE_ARRAY(RxFileBuffers)[BUFSIZ];
+static char STACK_INSTANCE_ARRAY(TxFileBuffers)[BUFSIZ];
+#define HostRAM			STACK_INSTANCE(HostRAMs)
+#define vRxFileBuffer	STACK_INSTANCE(RxFileBuffers)
+#define vTxFileBuffer	STACK_INSTANCE(TxFileBuffers)
+
+#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	#if defined(STACK_MULTI_INSTANCE)
+	BYTE MACRxStages[STACK_MAX_INSTANCES][MAC_RX_STAGE_SIZE];
+	#else
+	BYTE MACRxStage[MAC_RX_STAGE_SIZE];
+	#endif
+#endif
+
+static void HostMACClosePcap(void);
+static WORD HostMACReadFrame(BYTE *vFrame);
+static BOOL HostMACWriteFrame(BYTE *vFrame, WORD wLen);
+
+
+/*****************************************************************************
+  Function:
+	BOOL HostMACOpenTap(const char *szInterface)
+
+  Summary:
+	Exchanges frames with a Linux TAP interface.
+
+  Description:
+	Attaches to the TAP interface szInterface, creating it if this process 
+	is allowed to.  Creating it beforehand with "ip tuntap add dev tap0 
+	mode tap user $USER" lets the stack run without root privileges.
+
+  Precondition:
+	None
+
+  Parameters:
+	szInterface - name of the TAP interface, such as "tap0"
+
+  Returns:
+  	TRUE if the interface was opened, FALSE otherwise.
+  ***************************************************************************/
+BOOL HostMACOpenTap(const char *szInterface)
+{
+	struct ifreq ifr;
+	int fd;
+
+	fd = open("/dev/net/tun", O_RDWR);
+	if(fd < 0)
+		return FALSE;
+
+	memset((void*)&ifr, 0x00, sizeof(ifr));
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	strncpy(ifr.ifr_name, szInterface, sizeof(ifr.ifr_name) - 1);
+	if(ioctl(fd, TUNSETIFF, (void*)&ifr) < 0)
+	{
+		close(fd);
+		return FALSE;
+	}
+
+	return HostMACOpenFd(fd);
+}
+
+
+/*****************************************************************************
+  Function:
+	BOOL HostMACOpenFd(int fd)
+
+  Summary:
+	Exchanges frames with an open file descriptor.
+
+  Description:
+	Each read() from fd must return one whole Ethernet frame and each 
+	write() sends one, as with a TAP device or a SOCK_SEQPACKET socket.  
+	fd is switched to non-blocking mode and is closed by HostMACClose().
+	A TX capture file opened with HostMACOpenPcap() stays open, so the 
+	frames sent to fd can be recorded too.
+
+  Precondition:
+	None
+
+  Parameters:
+	fd - file descriptor to read and write frames with
+
+  Returns:
+  	TRUE if fd could be used, FALSE otherwise.
+  ***************************************************************************/
+BOOL HostMACOpenFd(int fd)
+{
+	int iFlags;
+
+	iFlags = fcntl(fd, F_GETFL);
+	if((iFlags < 0) || (fcntl(fd, F_SETFL, iFlags | O_NONBLOCK) < 0))
+	{
+		close(fd);
+		return FALSE;
+	}
+
+	if(iFrameFd >= 0)
+		close(iFrameFd);
+	iFrameFd = fd;
+
+	return TRUE;
+}
+
+
+/*****************************************************************************
+  Function:
+	BOOL HostMACOpenNetSim(BYTE vPort)
+
+  Summary:
+	Exchanges frames with a port of the simulated network.
+
+  Description:
+	Frames are received from and sent to port vPort of HostNetSim.c 
+	instead of the TAP interface, file descriptor or RX capture file.  A 
+	TX capture file opened with HostMACOpenPcap() still records the 
+	frames sent.
+
+  Precondition:
+	vPort was returned by HostNetSimAddPort() for this stack's MAC address.
+
+  Parameters:
+	vPort - simulated network port
+
+  Returns:
+  	TRUE if vPort is a valid port, FALSE otherwise.
+  ***************************************************************************/
+BOOL HostMACOpenNetSim(BYTE vPort)
+{
+	if(vPort >= NETSIM_MAX_PORTS)
+		return FALSE;
+
+	vNetSimPort = vPort;
+	return TRUE;
+}
+
+
+/*****************************************************************************
+  Function:
+	BOOL HostMACOpenPcap(const char *szRxFile, const char *szTxFile)
+
+  Summary:
+	Selects the capture files frames are received from and transmitted to.
+
+  Description:
+	Opens szRxFile, which must be a little or big endian pcap file with an
+	Ethernet link type, as the source of received frames.  MACGetHeader()
+	returns one frame from it per call and FALSE at the end of the file.
+	It is not read while a TAP interface or file descriptor is open.
+	Every frame MACFlush() transmits is appended to szTxFile.
+
+  Precondition:
+	None
+
+  Parameters:
+	szRxFile - pcap file to replay, or NULL to receive nothing
+	szTxFile - pcap file to create for transmitted frames, or NULL to
+		drop them
+
+  Returns:
+  	TRUE if the files were opened, FALSE otherwise.
+  ***************************************************************************/
+BOOL HostMACOpenPcap(const char *szRxFile, const char *szTxFile)
+{
+	PCAP_FILE_HEADER Header;
+
+	HostMACClosePcap();
+
+	if(szRxFile)
+	{
+		fRx = fopen(szRxFile, "rb");
+		if(fRx == NULL)
+			return FALSE;
+		setvbuf(fRx, vRxFileBuffer, _IOFBF, sizeof(vRxFileBuffer));
+
+		if(fread(&Header, sizeof(Header), 1, fRx) != 1u)
+		{
+			HostMACClosePcap();
+			return FALSE;
+		}
+
+		bRxSwapped = (Header.dwMagic == swapl(PCAP_MAGIC)) || (Header.dwMagic == swapl(PCAP_MAGIC_NSEC));
+		if(bRxSwapped)
+			Header.dwLinkType = swapl(Header.dwLinkType);
+		else if((Header.dwMagic != PCAP_MAGIC) && (Header.dwMagic != PCAP_MAGIC_NSEC))
+			Header.dwLinkType = 0;
+
+		if(Header.dwLinkType != PCAP_LINKTYPE_ETHERNET)
+		{
+			HostMACClosePcap();
+			return FALSE;
+		}
+	}
+
+	if(szTxFile)
+	{
+		fTx = fopen(szTxFile, "wb");
+		if(fTx == NULL)
+		{
+			HostMACClosePcap();
+			return FALSE;
+		}
+		setvbuf(fTx, vTxFileBuffer, _IOFBF, sizeof(vTxFileBuffer));
+
+		memset((void*)&Header, 0x00, sizeof(Header));
+		Header.dwMagic = PCAP_MAGIC;
+		Header.wVersionMajor = 2;
+		Header.wVersionMinor = 4;
+		Header.dwSnapLen = 65535ul;
+		Header.dwLinkType = PCAP_LINKTYPE_ETHERNET;
+		fwrite(&Header, sizeof(Header), 1, fTx);
+	}
+
+	return TRUE;
+}
+
+
+/*****************************************************************************
+  Function:
+	void HostMACClose(void)
+
+  Summary:
+	Closes the TAP interface, file descriptor, simulated network port and 
+	capture files in use.
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostMACClose(void)
+{
+	HostMACClosePcap();
+	if(iFrameFd >= 0)
+		close(iFrameFd);
+	iFrameFd = -1;
+	vNetSimPort = NETSIM_INVALID_PORT;
+}
+
+static void HostMACClosePcap(void)
+{
+	if(fRx)
+		fclose(fRx);
+	if(fTx)
+		fclose(fTx);
+	fRx = NULL;
+	fTx = NULL;
+}
+
+
+/*****************************************************************************
+  Function:
+	void HostMACRewind(void)
+
+  Summary:
+	Starts replaying the RX capture file from its first frame again.
+
+  Precondition:
+	HostMACOpenPcap() returned TRUE.
+
+  Parameters:
+	None
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostMACRewind(void)
+{
+	if(fRx)
+		fseek(fRx, (long)sizeof(PCAP_FILE_HEADER), SEEK_SET);
+}
+
+
+/*****************************************************************************
+  Function:
+	DWORD HostMACGetTxCount(void)
+
+  Summary:
+	Returns how many frames MACFlush() has sent since MACInit().
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+
+  Returns:
+  	Number of transmitted frames.
+  ***************************************************************************/
+DWORD HostMACGetTxCount(void)
+{
+	return dwTxCount;
+}
+
+
+/*****************************************************************************
+  Function:
+	static WORD HostMACReadFrame(BYTE *vFrame)
+
+  Summary:
+	Reads the next received frame.
+
+  Description:
+	Reads from the simulated network, TAP interface or file descriptor if 
+	one is open, or else from the RX capture file.  Frames longer than HOST_MAC_MAX_FRAME 
+	are truncated.
+
+  Precondition:
+	None
+
+  Parameters:
+	vFrame - HOST_MAC_MAX_FRAME byte buffer to read the frame into
+
+  Returns:
+  	Length of the frame, or 0 if no frame is waiting.
+  ***************************************************************************/
+static WORD HostMACReadFrame(BYTE *vFrame)
+{
+	PCAP_RECORD_HEADER Record;
+	DWORD dwLen;
+	ssize_t iRead;
+
+	if(vNetSimPort != NETSIM_INVALID_PORT)
+		return HostNetSimReceive(vNetSimPort, vFrame, HOST_MAC_MAX_FRAME);
+
+	if(iFrameFd >= 0)
+	{
+		iRead = read(iFrameFd, vFrame, HOST_MAC_MAX_FRAME);
+		return (iRead > 0) ? (WORD)iRead : 0;
+	}
+
+	if(fRx == NULL)
+		return 0;
+
+	if(fread(&Record, sizeof(Record), 1, fRx) != 1u)
+		return 0;
+	dwLen = bRxSwapped ? swapl(Record.dwCapturedLen) : Record.dwCapturedLen;
+
+	if(dwLen > HOST_MAC_MAX_FRAME)
+	{
+		if(fread(vFrame, HOST_MAC_MAX_FRAME, 1, fRx) != 1u)
+			return 0;
+		fseek(fRx, (long)(dwLen - HOST_MAC_MAX_FRAME), SEEK_CUR);
+		return HOST_MAC_MAX_FRAME;
+	}
+
+	if(dwLen && (fread(vFrame, dwLen, 1, fRx) != 1u))
+		return 0;
+
+	return (WORD)dwLen;
+}
+
+
+/*****************************************************************************
+  Function:
+	static BOOL HostMACWriteFrame(BYTE *vFrame, WORD wLen)
+
+  Summary:
+	Sends a frame and appends it to the TX capture file.
+
+  Description:
+	Frames go out on the simulated network, TAP interface or file 
+	descriptor if one is open.  If the interface can't take the frame 
+	right now it is dropped, as on a busy medium.
+
+  Precondition:
+	None
+
+  Parameters:
+	vFrame - frame to write, starting with the Ethernet header
+	wLen - length of the frame
+
+  Returns:
+  	FALSE if the frame was dropped, TRUE otherwise.
+  ***************************************************************************/
+static BOOL HostMACWriteFrame(BYTE *vFrame, WORD wLen)
+{
+	PCAP_RECORD_HEADER Record;
+	struct timespec ts;
+
+	if(vNetSimPort != NETSIM_INVALID_PORT)
+		HostNetSimSend(vNetSimPort, vFrame, wLen);
+	else if((iFrameFd >= 0) && (write(iFrameFd, vFrame, wLen) != (ssize_t)wLen))
+		return FALSE;
+
+	if(fTx == NULL)
+		return TRUE;
+
+	// Captures of a simulation are stamped with its virtual time
+	if(vNetSimPort != NETSIM_INVALID_PORT)
+	{
+		ts.tv_sec = (time_t)(HostNetSimGetTime()/1000000000ull);
+		ts.tv_nsec = (long)(HostNetSimGetTime()%1000000000ull);
+	}
+	else
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+	}
+	Record.dwSeconds = (DWORD)ts.tv_sec;
+	Record.dwFraction = (DWORD)(ts.tv_nsec/1000);
+	Record.dwCapturedLen = wLen;
+	Record.dwOriginalLen = wLen;
+	fwrite(&Record, sizeof(Record), 1, fTx);
+	fwrite(vFrame, wLen, 1, fTx);
+
+	return TRUE;
+}
+
+
+void MACInit(void)
+{
+	if((vNetSimPort == NETSIM_INVALID_PORT) && (iFrameFd < 0) && (fRx == NULL) && (fTx == NULL))
+		HostMACOpenTap(HOST_MAC_TAP_NAME);
+
+	wReadPtr = RXSTART;
+	wWritePtr = BASE_TX_ADDR;
+	wRxFrameLen = 0;
+	bRxPending = FALSE;
+	wTxFrameLen = 0;
+	dwTxCount = 0;
+}
+
+void MACProcess(void)
+{
+}
+
+BOOL MACIsLinked(void)
+{
+	return (vNetSimPort != NETSIM_INVALID_PORT) || (iFrameFd >= 0) || (fRx != NULL);
+}
+
+void MACPowerDown(void)
+{
+}
+
+void MACEDPowerDown(void)
+{
+}
+
+void MACPowerUp(void)
+{
+}
+
+void SetRXHashTableEntry(MAC_ADDR DestMACAddr)
+{
+}
+
+
+/*****************************************************************************
+  Function:
+	BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
+
+  Summary:
+	Loads the next received frame into the RX buffer.
+
+  Description:
+	Discards any frame still held, reads the next one to RXSTART and leaves the read pointer at the first byte after the
+	Ethernet header.  Runt frames are skipped.
+
+  Precondition:
+	None
+
+  Parameters:
+	remote - Location to store the frame's source MAC address
+	type - Location to store MAC_IP, MAC_ARP or MAC_UNKNOWN
+
+  Returns:
+  	TRUE if a frame was received, FALSE if none is waiting.
+  ***************************************************************************/
+BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
+{
+	ETHER_HEADER *header;
+
+	MACDiscardRx();
+
+	do
+	{
+		wRxFrameLen = HostMACReadFrame(&HostRAM[RXSTART]);
+		if(wRxFrameLen == 0u)
+			return FALSE;
+	} while(wRxFrameLen < sizeof(ETHER_HEADER));
+
+	header = (ETHER_HEADER*)&HostRAM[RXSTART];
+	memcpy((void*)remote->v, (void*)header->SourceMACAddr.v, sizeof(*remote));
+
+	*type = MAC_UNKNOWN;
+	if((header->Type.v[0] == 0x08u) && ((header->Type.v[1] == MAC_IP) || (header->Type.v[1] == MAC_ARP)))
+		*type = header->Type.v[1];
+
+	wReadPtr = RXSTART + sizeof(ETHER_HEADER);
+	bRxPending = TRUE;
+
+	return TRUE;
+}
+
+void MACDiscardRx(void)
+{
+	bRxPending = FALSE;
+}
+
+// Frames wait in the capture, TAP device or simulated network, not in 
+// the MAC's RAM, which only ever holds the one being read.  So the MAC never 
+// runs low on RX space, and 0xFFFF tells TCP not to shrink its window.
+WORD MACGetFreeRxSize(void)
+{
+	return 0xFFFFu;
+}
+
+void MACSetReadPtrInRx(WORD offset)
+{
+	wReadPtr = RXSTART + sizeof(ETHER_HEADER) + offset;
+}
+
+PTR_BASE MACSetWritePtr(PTR_BASE address)
+{
+	PTR_BASE oldVal = wWritePtr;
+
+	wWritePtr = address;
+	return oldVal;
+}
+
+PTR_BASE MACSetReadPtr(PTR_BASE address)
+{
+	PTR_BASE oldVal = wReadPtr;
+
+	wReadPtr = address;
+	return oldVal;
+}
+
+BYTE MACGet(void)
+{
+	return HostRAM[wReadPtr++];
+}
+
+WORD MACGetArray(BYTE *val, WORD len)
+{
+	if(val)
+		memcpy((void*)val, (void*)&HostRAM[wReadPtr], len);
+	wReadPtr += len;
+
+	return len;
+}
+
+void MACSkipArray(WORD len)
+{
+	wReadPtr += len;
+}
+
+
+/*****************************************************************************
+  Function:
+	void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len)
+
+  Summary:
+	Copies bytes within the MAC buffer RAM.
+
+  Description:
+	As on the ENC28J60 and MRF24WB, an address with bit 15 set means "use
+	the current write (destAddr) or read (sourceAddr) pointer", and that
+	pointer is then advanced past the copied bytes.  The copy completes
+	before this function returns.
+
+  Precondition:
+	None
+
+  Parameters:
+	destAddr - Destination address, or -1 for the write pointer
+	sourceAddr - Source address, or -1 for the read pointer
+	len - Number of bytes to copy
+
+  Returns:
+  	None
+  ***************************************************************************/
+void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len)
+{
+	PTR_BASE wDest, wSource;
+
+	wDest = (destAddr & 0x8000u) ? wWritePtr : destAddr;
+	wSource = (sourceAddr & 0x8000u) ? wReadPtr : sourceAddr;
+
+	memmove((void*)&HostRAM[wDest], (void*)&HostRAM[wSource], len);
+
+	if(destAddr & 0x8000u)
+		wWritePtr += len;
+	if(sourceAddr & 0x8000u)
+		wReadPtr += len;
+}
+
+BOOL MACIsMemCopyDone(void)
+{
+	return TRUE;
+}
+
+
+/*****************************************************************************
+  Function:
+	void MACPutHeader(MAC_ADDR *remote, BYTE type, WORD dataLen)
+
+  Summary:
+	Writes the Ethernet header of a frame to be transmitted.
+
+  Precondition:
+	None
+
+  Parameters:
+	remote - Destination MAC address
+	type - MAC_IP or MAC_ARP
+	dataLen - Length of the Ethernet payload
+
+  Returns:
+  	None
+  ***************************************************************************/
+void MACPutHeader(MAC_ADDR *remote, BYTE type, WORD dataLen)
+{
+	ETHER_HEADER *header;
+
+	wTxFrameLen = dataLen + (WORD)sizeof(ETHER_HEADER);
+
+	header = (ETHER_HEADER*)&HostRAM[BASE_TX_ADDR];
+	memcpy((void*)header->DestMACAddr.v, (void*)remote->v, sizeof(*remote));
+	memcpy((void*)header->SourceMACAddr.v, (void*)AppConfig.MyMACAddr.v, sizeof(AppConfig.MyMACAddr));
+	header->Type.v[0] = 0x08;
+	header->Type.v[1] = (type == MAC_IP) ? MAC_IP : MAC_ARP;
+
+	wWritePtr = BASE_TX_ADDR + sizeof(ETHER_HEADER);
+}
+
+BOOL MACIsTxReady(void)
+{
+	return TRUE;
+}
+
+void MACPut(BYTE val)
+{
+	HostRAM[wWritePtr++] = val;
+}
+
+void MACPutArray(BYTE *val, WORD len)
+{
+	memcpy((void*)&HostRAM[wWritePtr], (void*)val, len);
+	wWritePtr += len;
+}
+
+void MACFlush(void)
+{
+	if(wTxFrameLen > HOST_MAC_MAX_FRAME)
+		wTxFrameLen = HOST_MAC_MAX_FRAME;
+
+	if(HostMACWriteFrame(&HostRAM[BASE_TX_ADDR], wTxFrameLen))
+		dwTxCount++;
+}
+
+
+/*****************************************************************************
+  Function:
+	WORD CalcIPBufferChecksum(WORD len)
+
+  Summary:
+	Calculates an IP checksum in the MAC buffer itself.
+
+  Description:
+	Sums len bytes starting at the read pointer and advances the read
+	pointer past them, like the MRF24WB version does.
+
+  Precondition:
+	The MAC read pointer is set to the start of the data.
+
+  Parameters:
+	len - number of bytes to be checksummed
+
+  Returns:
+	The calculated checksum.
+  ***************************************************************************/
+WORD CalcIPBufferChecksum(WORD len)
+{
+	WORD wChecksum;
+
+	wChecksum = CalcIPChecksum(&HostRAM[wReadPtr], len);
+	wReadPtr += len;
+
+	return wChecksum;
+}
+
+WORD MACCalcRxChecksum(WORD offset, WORD len)
+{
+	PTR_BASE rdSave;
+	WORD wChecksum;
+
+	rdSave = wReadPtr;
+	wReadPtr = RXSTART + sizeof(ETHER_HEADER) + offset;
+	wChecksum = CalcIPBufferChecksum(len);
+	wReadPtr = rdSave;
+
+	return wChecksum;
+}
+
+WORD MACGetArrayChecksum(BYTE *val, WORD len)
+{
+	MACGetArray(val, len);
+
+	return CalcIPChecksum(val, len);
+}
+
+#endif	// #if defined(COMPILER_GCC_HOST)
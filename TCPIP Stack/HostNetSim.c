@@ -0,0 +1,515 @@
+/*********************************************************************
+ *
+ *	Simulated Network for the Linux Host Build of the Stack
+ *
+ *********************************************************************
+ * FileName:        HostNetSim.c
+ * Dependencies:    HostNetSim.h, Tick.h
+ * Processor:       Linux PC (COMPILER_GCC_HOST)
+ * Compiler:        GCC
+ *
+ * Connects stations inside one process through a switch whose links lose,
+ * delay, jitter, duplicate, reorder and rate limit frames.  A station is
+ * either the stack, through HostMACOpenNetSim(), or test code calling
+ * HostNetSimSend() and HostNetSimReceive() directly as a reference peer.
+ *
+ * Nothing here reads a real clock.  Time only moves when
+ * HostNetSimAdvance() is called, which also sets the Tick module's time
+ * with TickSetHostTime(), and every random decision comes from a
+ * generator seeded by HostNetSimInit().  The same seed, configuration and
+ * sequence of calls therefore always gives the same frames at the same
+ * virtual times, however fast or loaded the host is, so TCP timer and
+ * recovery changes can be compared run for run.
+ *
+ * Frames are switched by destination MAC address.  Broadcasts, multicasts
+ * and frames for unknown addresses go to every other port.
+ ********************************************************************/
+#define __HOSTNETSIM_C
+
+#include "includes/TCPIP.h"
+
+#if defined(COMPILER_GCC_HOST)
+
+// Largest frame (without FCS) the switch carries
+#define NETSIM_MAX_FRAME		(1514u)
+
+// Preamble, FCS and interframe gap, which take link time but aren't part
+// of the frames passed in
+#define NETSIM_FRAME_OVERHEAD	(24u)
+
+// A frame on its way to a port
+typedef struct
+{
+	QWORD qwDueAt;				// Virtual time it can be received
+	QWORD qwLinkDoneAt;			// Virtual time it finished going onto the link
+	DWORD dwSequence;			// Keeps frames due at the same time in order
+	WORD wLen;
+	BYTE vPort;					// Destination port, NETSIM_INVALID_PORT if unused
+	BYTE vFrame[NETSIM_MAX_FRAME];
+} NETSIM_FRAME;
+
+typedef struct
+{
+	BOOL bUsed;
+	MAC_ADDR MAC;
+	NETSIM_LINK_CONFIG Config;
+	QWORD qwLinkFreeAt;			// Virtual time the link finishes its last frame
+	NETSIM_PORT_STATS Stats;
+} NETSIM_PORT;
+
+// With STACK_MULTI_INSTANCE every thread has a network of its own, for 
+// the stack instances it runs
+static STACK_THREAD_LOCAL NETSIM_FRAME Frames[NETSIM_MAX_FRAMES];
+static STACK_THREAD_LOCAL NETSIM_PORT Ports[NETSIM_MAX_PORTS];
+static STACK_THREAD_LOCAL QWORD qwNow;
+static STACK_THREAD_LOCAL QWORD qwRandomState;
+static STACK_THREAD_LOCAL DWORD dwNextSequence;
+
+static DWORD HostNetSimRandom(void);
+static BOOL HostNetSimChance(DWORD dwPPM);
+static void HostNetSimQueue(BYTE vPort, BYTE *vFrame, WORD wLen);
+
+
+/*****************************************************************************
+  Function:
+	void HostNetSimInit(QWORD qwSeed)
+
+  Summary:
+	Empties the network and restarts virtual time at zero.
+
+  Description:
+	Removes all ports and frames in flight, seeds the random number
+	generator used for loss, jitter, duplication and reordering, and
+	switches the Tick module to virtual time.  The generator is separate
+	from the stack's LFSRRand(), so a simulation doesn't change the
+	sequence numbers and ports the stack picks.
+
+  Precondition:
+	None
+
+  Parameters:
+	qwSeed - seed for the link impairments
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostNetSimInit(QWORD qwSeed)
+{
+	WORD i;
+
+	memset((void*)Ports, 0x00, sizeof(Ports));
+	for(i = 0; i < NETSIM_MAX_FRAMES; i++)
+		Frames[i].vPort = NETSIM_INVALID_PORT;
+
+	// xorshift can't leave the all zeros state
+	qwRandomState = qwSeed ? qwSeed : 0x9E3779B97F4A7C15ull;
+	dwNextSequence = 0;
+	qwNow = 0;
+	TickSetHostTime(qwNow);
+}
+
+
+/*****************************************************************************
+  Function:
+	BYTE HostNetSimAddPort(MAC_ADDR *MAC, NETSIM_LINK_CONFIG *Config)
+
+  Summary:
+	Connects a station to the switch.
+
+  Precondition:
+	HostNetSimInit() has been called.
+
+  Parameters:
+	MAC - the station's MAC address, used to switch frames to it
+	Config - impairments of the link to the station, or NULL for a
+		perfect link
+
+  Returns:
+  	The new port number, or NETSIM_INVALID_PORT if all ports are in use.
+  ***************************************************************************/
+BYTE HostNetSimAddPort(MAC_ADDR *MAC, NETSIM_LINK_CONFIG *Config)
+{
+	BYTE i;
+
+	for(i = 0; i < NETSIM_MAX_PORTS; i++)
+	{
+		if(Ports[i].bUsed)
+			continue;
+
+		memset((void*)&Ports[i], 0x00, sizeof(Ports[i]));
+		Ports[i].bUsed = TRUE;
+		memcpy((void*)&Ports[i].MAC, (void*)MAC, sizeof(MAC_ADDR));
+		HostNetSimSetLink(i, Config);
+		return i;
+	}
+
+	return NETSIM_INVALID_PORT;
+}
+
+
+/*****************************************************************************
+  Function:
+	void HostNetSimSetLink(BYTE vPort, NETSIM_LINK_CONFIG *Config)
+
+  Summary:
+	Changes the impairments of the link to a port.
+
+  Description:
+	Frames already in flight keep the delay they were given.  Frames sent
+	from now on use the new configuration, so a scenario can, for
+	example, start a loss burst part way through a transfer.
+
+  Precondition:
+	vPort was returned by HostNetSimAddPort().
+
+  Parameters:
+	vPort - port to reconfigure
+	Config - new impairments, or NULL for a perfect link
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostNetSimSetLink(BYTE vPort, NETSIM_LINK_CONFIG *Config)
+{
+	if(Config)
+		memcpy((void*)&Ports[vPort].Config, (void*)Config, sizeof(NETSIM_LINK_CONFIG));
+	else
+		memset((void*)&Ports[vPort].Config, 0x00, sizeof(NETSIM_LINK_CONFIG));
+}
+
+
+/*****************************************************************************
+  Function:
+	void HostNetSimSend(BYTE vPort, BYTE *vFrame, WORD wLen)
+
+  Summary:
+	Sends a frame from a port into the switch.
+
+  Description:
+	Copies the frame to each port it is switched to, after the link to
+	that port decides whether it is lost, duplicated or held back and
+	when it arrives.
+
+  Precondition:
+	vPort was returned by HostNetSimAddPort().
+
+  Parameters:
+	vPort - port the frame comes from
+	vFrame - frame starting with the Ethernet header, without FCS
+	wLen - length of the frame
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostNetSimSend(BYTE vPort, BYTE *vFrame, WORD wLen)
+{
+	BYTE i;
+	BYTE vDest;
+
+	if((wLen < sizeof(MAC_ADDR)) || (wLen > NETSIM_MAX_FRAME))
+		return;
+
+	Ports[vPort].Stats.dwSent++;
+
+	// Find the one port a unicast frame is for
+	vDest = NETSIM_INVALID_PORT;
+	if((vFrame[0] & 0x01) == 0u)
+	{
+		for(i = 0; i < NETSIM_MAX_PORTS; i++)
+		{
+			if(Ports[i].bUsed && (i != vPort) && (memcmp((void*)&Ports[i].MAC, (void*)vFrame, sizeof(MAC_ADDR)) == 0))
+			{
+				vDest = i;
+				break;
+			}
+		}
+	}
+
+	if(vDest != NETSIM_INVALID_PORT)
+	{
+		HostNetSimQueue(vDest, vFrame, wLen);
+		return;
+	}
+
+	// Flood everything else
+	for(i = 0; i < NETSIM_MAX_PORTS; i++)
+	{
+		if(Ports[i].bUsed && (i != vPort))
+			HostNetSimQueue(i, vFrame, wLen);
+	}
+}
+
+
+/*****************************************************************************
+  Function:
+	WORD HostNetSimReceive(BYTE vPort, BYTE *vFrame, WORD wMaxLen)
+
+  Summary:
+	Receives the next frame that has arrived at a port.
+
+  Description:
+	Returns the frame with the earliest arrival time that is not later
+	than the current virtual time.  Frames longer than wMaxLen are
+	truncated.
+
+  Precondition:
+	vPort was returned by HostNetSimAddPort().
+
+  Parameters:
+	vPort - port to receive on
+	vFrame - buffer for the frame
+	wMaxLen - size of vFrame
+
+  Returns:
+  	Length of the frame, or 0 if none has arrived.
+  ***************************************************************************/
+WORD HostNetSimReceive(BYTE vPort, BYTE *vFrame, WORD wMaxLen)
+{
+	NETSIM_FRAME *Next;
+	WORD i;
+	WORD wLen;
+
+	Next = NULL;
+	for(i = 0; i < NETSIM_MAX_FRAMES; i++)
+	{
+		if((Frames[i].vPort != vPort) || (Frames[i].qwDueAt > qwNow))
+			continue;
+		if((Next == NULL) || (Frames[i].qwDueAt < Next->qwDueAt) ||
+			((Frames[i].qwDueAt == Next->qwDueAt) && ((LONG)(Frames[i].dwSequence - Next->dwSequence) < 0)))
+			Next = &Frames[i];
+	}
+
+	if(Next == NULL)
+		return 0;
+
+	wLen = (Next->wLen > wMaxLen) ? wMaxLen : Next->wLen;
+	memcpy((void*)vFrame, (void*)Next->vFrame, wLen);
+	Next->vPort = NETSIM_INVALID_PORT;
+	Ports[vPort].Stats.dwDelivered++;
+
+	return wLen;
+}
+
+
+/*****************************************************************************
+  Function:
+	void HostNetSimAdvance(QWORD qwNanoseconds)
+
+  Summary:
+	Moves virtual time forward.
+
+  Description:
+	Advances the network and the Tick module together.  Callers normally
+	step by a fixed amount, or straight to HostNetSimGetNextEvent() when
+	they know nothing else will happen before then.
+
+  Precondition:
+	HostNetSimInit() has been called.
+
+  Parameters:
+	qwNanoseconds - how far to move time forward
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostNetSimAdvance(QWORD qwNanoseconds)
+{
+	qwNow += qwNanoseconds;
+	TickSetHostTime(qwNow);
+}
+
+
+/*****************************************************************************
+  Function:
+	QWORD HostNetSimGetTime(void)
+
+  Summary:
+	Returns the current virtual time.
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+
+  Returns:
+  	Nanoseconds since HostNetSimInit().
+  ***************************************************************************/
+QWORD HostNetSimGetTime(void)
+{
+	return qwNow;
+}
+
+
+/*****************************************************************************
+  Function:
+	QWORD HostNetSimGetNextEvent(void)
+
+  Summary:
+	Returns when the next frame in flight arrives.
+
+  Precondition:
+	None
+
+  Parameters:
+	None
+
+  Returns:
+  	Virtual time of the earliest arrival, which may already have passed,
+  	or NETSIM_NO_EVENT if no frames are in flight.
+  ***************************************************************************/
+QWORD HostNetSimGetNextEvent(void)
+{
+	QWORD qwNext;
+	WORD i;
+
+	qwNext = NETSIM_NO_EVENT;
+	for(i = 0; i < NETSIM_MAX_FRAMES; i++)
+	{
+		if((Frames[i].vPort != NETSIM_INVALID_PORT) && (Frames[i].qwDueAt < qwNext))
+			qwNext = Frames[i].qwDueAt;
+	}
+
+	return qwNext;
+}
+
+
+/*****************************************************************************
+  Function:
+	void HostNetSimGetStats(BYTE vPort, NETSIM_PORT_STATS *Stats)
+
+  Summary:
+	Reads a port's frame counters.
+
+  Precondition:
+	vPort was returned by HostNetSimAddPort().
+
+  Parameters:
+	vPort - port to read
+	Stats - where to copy the counters
+
+  Returns:
+  	None
+  ***************************************************************************/
+void HostNetSimGetStats(BYTE vPort, NETSIM_PORT_STATS *Stats)
+{
+	memcpy((void*)Stats, (void*)&Ports[vPort].Stats, sizeof(NETSIM_PORT_STATS));
+}
+
+
+/*****************************************************************************
+  Function:
+	static void HostNetSimQueue(BYTE vPort, BYTE *vFrame, WORD wLen)
+
+  Summary:
+	Puts a frame on the link to a port.
+
+  Description:
+	The link sends frames one after another at dwBandwidthBps, so a frame
+	can't start until the previous one is done and frames that are still
+	waiting for the link count against wQueueFrames.  Once on the link,
+	each copy is delayed by dwDelayUs plus its own random jitter and,
+	sometimes, dwReorderDelayUs.  Since jitter is drawn per frame, large
+	jitter on a fast link reorders frames too, as it does on real paths
+	with several routes.
+
+  Precondition:
+	None
+
+  Parameters:
+	vPort - destination port
+	vFrame - frame to queue
+	wLen - length of the frame
+
+  Returns:
+  	None
+  ***************************************************************************/
+static void HostNetSimQueue(BYTE vPort, BYTE *vFrame, WORD wLen)
+{
+	NETSIM_PORT *Port;
+	NETSIM_FRAME *Slot;
+	QWORD qwStart;
+	BYTE vCopies;
+	WORD wWaiting;
+	WORD i;
+
+	Port = &Ports[vPort];
+
+	if(HostNetSimChance(Port->Config.dwLossPPM))
+	{
+		Port->Stats.dwLost++;
+		return;
+	}
+
+	vCopies = 1;
+	if(HostNetSimChance(Port->Config.dwDuplicatePPM))
+	{
+		Port->Stats.dwDuplicated++;
+		vCopies = 2;
+	}
+
+	while(vCopies--)
+	{
+		// Find a free slot and count the frames still waiting for the link
+		Slot = NULL;
+		wWaiting = 0;
+		for(i = 0; i < NETSIM_MAX_FRAMES; i++)
+		{
+			if(Frames[i].vPort == NETSIM_INVALID_PORT)
+			{
+				if(Slot == NULL)
+					Slot = &Frames[i];
+			}
+			else if((Frames[i].vPort == vPort) && (Frames[i].qwLinkDoneAt > qwNow))
+			{
+				wWaiting++;
+			}
+		}
+
+		if((Slot == NULL) || (Port->Config.wQueueFrames && (wWaiting >= Port->Config.wQueueFrames)))
+		{
+			Port->Stats.dwQueueDrops++;
+			continue;
+		}
+
+		qwStart = (Port->qwLinkFreeAt > qwNow) ? Port->qwLinkFreeAt : qwNow;
+		if(Port->Config.dwBandwidthBps)
+			qwStart += ((QWORD)(wLen + NETSIM_FRAME_OVERHEAD) * 8000000000ull) / Port->Config.dwBandwidthBps;
+		Port->qwLinkFreeAt = qwStart;
+
+		Slot->qwLinkDoneAt = qwStart;
+		Slot->qwDueAt = qwStart + (QWORD)Port->Config.dwDelayUs*1000ull;
+		if(Port->Config.dwJitterUs)
+			Slot->qwDueAt += (QWORD)(HostNetSimRandom() % (Port->Config.dwJitterUs + 1ul))*1000ull;
+		if(HostNetSimChance(Port->Config.dwReorderPPM))
+		{
+			Port->Stats.dwReordered++;
+			Slot->qwDueAt += (QWORD)Port->Config.dwReorderDelayUs*1000ull;
+		}
+		Slot->dwSequence = dwNextSequence++;
+		Slot->wLen = wLen;
+		Slot->vPort = vPort;
+		memcpy((void*)Slot->vFrame, (void*)vFrame, wLen);
+	}
+}
+
+
+// xorshift64*: fast, and the same sequence on every host for a given seed
+static DWORD HostNetSimRandom(void)
+{
+	qwRandomState ^= qwRandomState >> 12;
+	qwRandomState ^= qwRandomState << 25;
+	qwRandomState ^= qwRandomState >> 27;
+	return (DWORD)((qwRandomState * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// TRUE dwPPM times in a million.  No random number is drawn for a zero
+// rate, so an unimpaired link doesn't use up the sequence.
+static BOOL HostNetSimChance(DWORD dwPPM)
+{
+	if(dwPPM == 0u)
+		return FALSE;
+	return (HostNetSimRandom() % 1000000ul) < dwPPM;
+}
+
+#endif	// #if defined(COMPILER_GCC_HOST)
@@ -73,32 +73,8 @@ typedef struct
 	WORD wData;
 } ICMP_PACKET;
 
-// ICMP Sequence Number
-static WORD wICMPSequenceNumber;
-// ICMP tick timer variable
-static DWORD ICMPTimer;
-
-// ICMP Flag structure
-static struct
-{
-	unsigned char bICMPInUse:1;         // Indicates that the ICMP Client is in use
-	unsigned char bReplyValid:1;        // Indicates that a correct Ping response to one of our pings was received
-	unsigned char bRemoteHostIsROM:1;   // Indicates that a remote host name was passed as a ROM pointer argument
-} ICMPFlags = {0x00};
-
-// ICMP Static Variables
-static union
-{
-	union
-	{
-		ROM BYTE *szROM;
-		BYTE *szRAM;
-	} RemoteHost;
-	NODE_INFO ICMPRemote;
-} StaticVars;
-
 // ICMP State Machine Enumeration
-static enum
+typedef enum
 {
 	SM_IDLE = 0,
 	SM_DNS_SEND_QUERY,
@@ -107,7 +83,43 @@ static enum
 	SM_ARP_GET_RESPONSE,
 	SM_ICMP_SEND_ECHO_REQUEST,
 	SM_ICMP_GET_ECHO_RESPONSE
-} ICMPState;
+} SM_ICMP;
+
+// ICMP client state, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	// ICMP Sequence Number
+	WORD wICMPSequenceNumber;
+	// ICMP tick timer variable
+	DWORD ICMPTimer;
+
+	// ICMP Flag structure
+	struct
+	{
+		unsigned char bICMPInUse:1;         // Indicates that the ICMP Client is in use
+		unsigned char bReplyValid:1;        // Indicates that a correct Ping response to one of our pings was received
+		unsigned char bRemoteHostIsROM:1;   // Indicates that a remote host name was passed as a ROM pointer argument
+	} ICMPFlags;
+
+	// ICMP Static Variables
+	union
+	{
+		union
+		{
+			ROM BYTE *szROM;
+			BYTE *szRAM;
+		} RemoteHost;
+		NODE_INFO ICMPRemote;
+	} StaticVars;
+
+	SM_ICMP ICMPState;
+} ICMP_CONTEXT;
+static ICMP_CONTEXT STACK_INSTANCE_ARRAY(ICMPContext);
+#define wICMPSequenceNumber	(STACK_INSTANCE(ICMPContext).wICMPSequenceNumber)
+#define ICMPTimer			(STACK_INSTANCE(ICMPContext).ICMPTimer)
+#define ICMPFlags			(STACK_INSTANCE(ICMPContext).ICMPFlags)
+#define StaticVars			(STACK_INSTANCE(ICMPContext).StaticVars)
+#define ICMPState			(STACK_INSTANCE(ICMPContext).ICMPState)
 
 #endif
 
@@ -98,8 +98,15 @@
 
 
 
-static WORD _Identifier = 0;
-static BYTE IPHeaderLen;
+// IP module state, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	WORD _Identifier;		// Identification field of the next datagram sent
+	BYTE IPHeaderLen;		// Length of the header of the datagram being received
+} IP_CONTEXT;
+static IP_CONTEXT STACK_INSTANCE_ARRAY(IPContext);
+#define _Identifier		(STACK_INSTANCE(IPContext)._Identifier)
+#define IPHeaderLen		(STACK_INSTANCE(IPContext).IPHeaderLen)
 
 
 static void SwapIPHeader(IP_HEADER* h);
@@ -167,11 +174,19 @@ BOOL IPGetHeader(IP_ADDR *localIP,
 	// Validate the IP header.  If it is correct, the checksum 
 	// will come out to 0x0000 (because the header contains a 
 	// precomputed checksum).  A corrupt header will have a 
-	// nonzero checksum.
-	CalcChecksum.Val = MACCalcRxChecksum(0, IPHeaderLen);
-
-	// Seek to the end of the IP header
-	MACSetReadPtrInRx(IPHeaderLen);
+	// nonzero checksum.  Without options, the copy already read 
+	// holds the whole header and needn't be read from the MAC again.
+	if(IPHeaderLen == sizeof(header))
+	{
+		CalcChecksum.Val = CalcIPChecksum((BYTE*)&header, sizeof(header));
+	}
+	else
+	{
+		CalcChecksum.Val = MACCalcRxChecksum(0, IPHeaderLen);
+
+		// Seek to the end of the IP header
+		MACSetReadPtrInRx(IPHeaderLen);
+	}
 
     if(CalcChecksum.Val)
 #else
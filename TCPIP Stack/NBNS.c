@@ -75,10 +75,27 @@ typedef struct _NBNS_HEADER
 	WORD_VAL AdditionalRecords;
 } NBNS_HEADER;
 
+// NBNSTask() states
+typedef enum
+{
+	NBNS_HOME = 0,
+	NBNS_OPEN_SOCKET,
+	NBNS_LISTEN
+} SM_NBNS;
+
+// State of NBNSTask(), one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	UDP_SOCKET MySocket;
+	SM_NBNS smNBNS;
+} NBNS_CONTEXT;
+static NBNS_CONTEXT STACK_INSTANCE_ARRAY(NBNSContext);
+#define MySocket	(STACK_INSTANCE(NBNSContext).MySocket)
+#define smNBNS		(STACK_INSTANCE(NBNSContext).smNBNS)
+
 static void NBNSPutName(BYTE *String);
 static void NBNSGetName(BYTE *String);
 
-extern NODE_INFO remoteNode;
 
 
 /*********************************************************************
@@ -98,17 +115,10 @@ extern NODE_INFO remoteNode;
  ********************************************************************/
 void NBNSTask(void)
 {
-	static UDP_SOCKET	MySocket;
 	BYTE 				i;
 	WORD_VAL			Type, Class;
 	NBNS_HEADER			NBNSHeader;
 	BYTE				NameString[16];
-	static enum
-	{
-		NBNS_HOME = 0,
-		NBNS_OPEN_SOCKET,
-		NBNS_LISTEN
-	} smNBNS = NBNS_HOME;
 
 	switch(smNBNS)
 	{
@@ -132,7 +142,7 @@ void NBNSTask(void)
 			// Respond only to name requests sent to us from nodes on the same subnet
 			// This prevents us from sending out the wrong IP address information if 
 			// we haven't gotten a DHCP lease yet.
-        	if((remoteNode.IPAddr.Val & AppConfig.MyMask.Val) != (AppConfig.MyIPAddr.Val & AppConfig.MyMask.Val))
+        	if((StackRemoteNode.IPAddr.Val & AppConfig.MyMask.Val) != (AppConfig.MyIPAddr.Val & AppConfig.MyMask.Val))
 			{
 				UDPDiscard();
 				break;
@@ -201,7 +211,7 @@ void NBNSTask(void)
 					UDPPut(AppConfig.MyIPAddr.v[3]);
 
 					// Change the destination address to the unicast address of the last received packet
-		        	memcpy((void*)&UDPSocketInfo[MySocket].remote.remoteNode, (const void*)&remoteNode, sizeof(remoteNode));
+		        	memcpy((void*)&UDPSocketInfo[MySocket].remote.remoteNode, (const void*)&StackRemoteNode, sizeof(StackRemoteNode));
 					UDPFlush();				
 				}
 
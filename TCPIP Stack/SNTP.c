@@ -124,11 +124,41 @@ typedef struct
 	DWORD tx_ts_fraq;				// Time at which request left sender (fractions)
 } NTP_PACKET;
 
-// Seconds value obtained by last update
-static DWORD dwSNTPSeconds = 0;
-
-// Tick count of last update
-static DWORD dwLastUpdateTick = 0;
+// SNTPClient() states
+typedef enum
+{
+	SM_HOME = 0,
+	SM_UDP_IS_OPENED,
+	//SM_NAME_RESOLVE,
+	//SM_ARP_START_RESOLVE,
+	//SM_ARP_RESOLVE,
+	//SM_ARP_START_RESOLVE2,
+	//SM_ARP_RESOLVE2,
+	//SM_ARP_START_RESOLVE3,
+	//SM_ARP_RESOLVE3,
+	//SM_ARP_RESOLVE_FAIL,
+	SM_UDP_SEND,
+	SM_UDP_RECV,
+	SM_SHORT_WAIT,
+	SM_WAIT
+} SM_SNTP;
+
+// SNTP client state, one copy per stack instance (see StackTsk.h)
+typedef struct
+{
+	UDP_SOCKET MySocket;		// Socket of the query in progress, or INVALID_UDP_SOCKET
+	SM_SNTP SNTPState;
+	DWORD dwTimer;
+	DWORD dwSNTPSeconds;		// Seconds value obtained by last update
+	DWORD dwLastUpdateTick;		// Tick count of last update
+} SNTP_CONTEXT;
+#define SNTP_CONTEXT_INIT	{.MySocket = INVALID_UDP_SOCKET}
+static SNTP_CONTEXT STACK_INSTANCE_ARRAY(SNTPContext) = STACK_INSTANCE_INIT(SNTP_CONTEXT_INIT);
+#define MySocket			(STACK_INSTANCE(SNTPContext).MySocket)
+#define SNTPState			(STACK_INSTANCE(SNTPContext).SNTPState)
+#define dwTimer				(STACK_INSTANCE(SNTPContext).dwTimer)
+#define dwSNTPSeconds		(STACK_INSTANCE(SNTPContext).dwSNTPSeconds)
+#define dwLastUpdateTick	(STACK_INSTANCE(SNTPContext).dwLastUpdateTick)
 
 /*****************************************************************************
   Function:
@@ -159,25 +189,6 @@ void SNTPClient(void)
 	NTP_PACKET			pkt;
 	WORD		 		w;
 //	static NODE_INFO	Server;
-	static DWORD		dwTimer;
-	static UDP_SOCKET	MySocket = INVALID_UDP_SOCKET;
-	static enum
-	{
-		SM_HOME = 0,
-		SM_UDP_IS_OPENED,
-		//SM_NAME_RESOLVE,
-		//SM_ARP_START_RESOLVE,
-		//SM_ARP_RESOLVE,
-		//SM_ARP_START_RESOLVE2,
-		//SM_ARP_RESOLVE2,
-		//SM_ARP_START_RESOLVE3,
-		//SM_ARP_RESOLVE3,
-		//SM_ARP_RESOLVE_FAIL,
-		SM_UDP_SEND,
-		SM_UDP_RECV,
-		SM_SHORT_WAIT,
-		SM_WAIT
-	} SNTPState = SM_HOME;
 
 
 	switch(SNTPState)
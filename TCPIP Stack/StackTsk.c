@@ -65,19 +65,16 @@
 	#include "includes/WFApi.h"
 #endif
 
-// Stack FSM states.
-typedef enum
-{
-    SM_STACK_IDLE,
-    SM_STACK_MAC,
-    SM_STACK_IP,
-    SM_STACK_ARP,
-    SM_STACK_TCP,
-    SM_STACK_UDP
-} SM_STACK;
-static SM_STACK smStack;
-
-NODE_INFO remoteNode;
+STACK_CONTEXT STACK_INSTANCE_ARRAY(StackContext);
+#define smStack			(STACK_INSTANCE(StackContext).smStack)
+#define once			(STACK_INSTANCE(StackContext).once)
+#define bLastLinkState	(STACK_INSTANCE(StackContext).bLastLinkState)
+#define remoteNode		StackRemoteNode
+
+#if defined(STACK_MULTI_INSTANCE)
+// Stack instance the calling thread is working on, see StackSetInstance()
+__thread WORD wStackInstance;
+#endif
 
 #if defined (WF_CS_TRIS) && defined (STACK_USE_DHCP_CLIENT)
 BOOL g_DhcpRenew = FALSE;
@@ -103,7 +100,6 @@ UINT32 g_DhcpRetryTimer = 0;
  ********************************************************************/
 void StackInit(void)
 {
-	static BOOL once = FALSE;
     smStack                     = SM_STACK_IDLE;
 
 #if defined(STACK_USE_IP_GLEANING) || defined(STACK_USE_DHCP_CLIENT)
@@ -271,7 +267,6 @@ void StackTask(void)
 	// address if link is removed.
 	if(AppConfig.Flags.bIsDHCPEnabled)
 	{
-		static BOOL bLastLinkState = FALSE;
 		BOOL bCurrentLinkState;
 		
 		bCurrentLinkState = MACIsLinked();
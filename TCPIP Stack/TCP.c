@@ -113,7 +113,9 @@
 #define TCP_MAX_SEG_SIZE_RX			(536u)
 
 // TCP Timeout and retransmit numbers
-#define TCP_START_TIMEOUT_VAL   	((DWORD)TICK_SECOND*1)	// Timeout to retransmit unacked data
+#define TCP_START_TIMEOUT_VAL   	((DWORD)TICK_SECOND*1)	// Timeout to retransmit unacked data before any round trip time has been measured
+#define TCP_MIN_RTO					((DWORD)TICK_SECOND/5)	// Lower clamp for the computed retransmission timeout
+#define TCP_MAX_RTO					((DWORD)TICK_SECOND*60)	// Upper clamp for the computed and backed off retransmission timeout
 #define TCP_DELAYED_ACK_TIMEOUT		((DWORD)TICK_SECOND/10)	// Timeout for delayed-acknowledgement algorithm
 #define TCP_FIN_WAIT_2_TIMEOUT		((DWORD)TICK_SECOND*5)	// Timeout for FIN WAIT 2 state
 #define TCP_KEEP_ALIVE_TIMEOUT		((DWORD)TICK_SECOND*10)	// Timeout for keep-alive messages when no traffic is sent
@@ -121,13 +123,63 @@
 #define TCP_MAX_RETRIES			    (5u)					// Maximum number of retransmission attempts
 #define TCP_MAX_UNACKED_KEEP_ALIVES	(6u)					// Maximum number of keep-alive messages that can be sent without receiving a response before automatically closing the connection
 #define TCP_MAX_SYN_RETRIES			(2u)	// Smaller than all other retries to reduce SYN flood DoS duration
+#define TCP_DUP_ACK_THRESHOLD		(3u)	// Number of duplicate ACKs that trigger a fast retransmit
 
 #define TCP_AUTO_TRANSMIT_TIMEOUT_VAL	(TICK_SECOND/25ull)	// Timeout before automatically transmitting unflushed data
 #define TCP_WINDOW_UPDATE_TIMEOUT_VAL	(TICK_SECOND/5ull)	// Timeout before automatically transmitting a window update due to a TCPGet() or TCPGetArray() function call
 
-#define TCP_SYN_QUEUE_MAX_ENTRIES	(3u) 					// Number of TCP RX SYN packets to save if they cannot be serviced immediately
+#define TCP_SYN_QUEUE_MAX_ENTRIES	(8u) 					// Number of TCP RX SYN packets to save if they cannot be serviced immediately
 #define TCP_SYN_QUEUE_TIMEOUT		((DWORD)TICK_SECOND*3)	// Timeout for when SYN queue entries are deleted if unserviceable
 
+// Answer SYNs for busy server ports with a stateless SYN cookie when the SYN 
+// queue is full.  If a listening socket frees up before the cookie expires 
+// (64 to 128 seconds), the client's ACK alone completes the connection.  
+// The cookie encodes the client's MSS (rounded down), whether it offered 
+// SACK, and its window scale, so connections opened this way lose only our 
+// own window scaling.  Comment this out to drop such SYNs instead.
+#define TCP_SYN_COOKIES
+
+// Number of slots in the hash table used to find the socket that an incoming 
+// segment belongs to.  Must be a power of 2 and at least twice the number of 
+// TCP sockets (four times if STACK_USE_SSL_SERVER is defined, since listening 
+// sockets are also indexed by their SSL port).  The build stops if this is 
+// not.
+#define TCP_HASH_TABLE_SIZE			(16u)
+
+// Number of full TCBs that SyncTCB() keeps in PIC RAM.  A TCB is only copied 
+// back to its memory medium when it is evicted, and only if it was synced 
+// for writing since it was loaded.  Each entry costs sizeof(TCB) bytes of 
+// RAM.  Must be at least 1.
+#define TCP_TCB_CACHE_SIZE			(2u)
+
+// Number of TCPPutIov() buffers each socket can have queued.  Each entry 
+// costs about 28 bytes of PIC RAM per socket.  Set to 0 to remove 
+// TCPPutIov() support.
+#define TCP_MAX_IOVS				(4u)
+
+// Bytes of the RX FIFO TCPFindArrayEx() reads into RAM at a time.  The 
+// buffer lives on the stack.  Patterns no longer than this are compared 
+// entirely from RAM.
+#if defined(__18CXX)
+	#define TCP_FIND_BUFFER_SIZE		(32u)
+#else
+	#define TCP_FIND_BUFFER_SIZE		(128u)
+#endif
+
+// Shortest pattern TCPFindArrayEx() builds a Boyer-Moore-Horspool skip 
+// table for.  Shorter patterns are tried at every position, which is 
+// cheaper than filling the 256 byte table.
+#define TCP_FIND_SKIP_MIN_LEN		(4u)
+
+// Size of the bounce buffer TCPRAMCopy() uses between memory mediums that 
+// can't be addressed directly (e.g. SPI RAM to Ethernet RAM).  The buffer 
+// lives on the stack and is DWORD aligned.  Must be a multiple of 4.
+#if defined(__18CXX)
+	#define TCP_COPY_CHUNK_SIZE		(16u)
+#else
+	#define TCP_COPY_CHUNK_SIZE		(64u)
+#endif
+
 /****************************************************************************
   Section:
 	TCP Header Data Types
@@ -177,12 +229,12 @@ typedef struct
 #define TCP_OPTIONS_END_OF_LIST     (0x00u)		// End of List TCP Option Flag
 #define TCP_OPTIONS_NO_OP           (0x01u)		// No Op TCP Option
 #define TCP_OPTIONS_MAX_SEG_SIZE    (0x02u)		// Maximum segment size TCP flag
-typedef struct
-{
-	BYTE        Kind;							// Type of option
-	BYTE        Length;							// Length
-	WORD_VAL    MaxSegSize;						// Maximum segment size
-} TCP_OPTIONS;									// TCP Options data structure							
+#define TCP_OPTIONS_WINDOW_SCALE    (0x03u)		// Window scale TCP Option (SYN only)
+#define TCP_OPTIONS_SACK_PERMITTED  (0x04u)		// SACK permitted TCP Option (SYN only)
+#define TCP_OPTIONS_SACK            (0x05u)		// Selective acknowledgement TCP Option
+#define TCP_MAX_WINDOW_SHIFT        (14u)		// Largest window scale shift count allowed by RFC 7323
+#define TCP_MAX_OPTIONS_LEN         (40u)		// Most option bytes a TCP header can hold
+#define TCP_MAX_SACK_BLOCKS_RX      (4u)		// Most SACK blocks read from an incoming segment
 
 // Structure containing all the important elements of an incomming 
 // SYN packet in order to establish a connection at a future time 
@@ -195,11 +247,19 @@ typedef struct
 	DWORD		dwSourceSEQ;	// Remote TCP SEQuence number that must be ACKnowledged when we send our response SYN
 	WORD		wDestPort;		// Local TCP port which the original SYN was destined for
 	WORD		wTimestamp;		// Timer to expire old SYN packets that can't be serviced at all
+	WORD		wRemoteMSS;		// Maximum segment size option from the SYN (536 if it had none)
+	BYTE		vRemoteWindowShift;	// Window scale shift count from the SYN, or 0
+	struct
+	{
+		unsigned char bSACKPermitted : 1;	// The SYN offered selective acknowledgements
+		unsigned char bWindowScale : 1;	// The SYN carried the window scale option
+	} Flags;
 } TCP_SYN_QUEUE;
 
 
 #if defined(STACK_CLIENT_MODE)
-static WORD NextPort __attribute__((persistent));	// Tracking variable for next local client port number
+static WORD STACK_INSTANCE_ARRAY(TCPNextPort) __attribute__((persistent));	// Tracking variable for next local client port number
+#define NextPort	STACK_INSTANCE(TCPNextPort)
 #endif
 
 /****************************************************************************
@@ -210,22 +270,136 @@ static WORD NextPort __attribute__((persistent));	// Tracking variable for next
 // Determines the number of defined TCP sockets
 #define TCP_SOCKET_COUNT	(sizeof(TCPSocketInitializer)/sizeof(TCPSocketInitializer[0]))
 
+// Socket demultiplexing hash table.  Every socket that is not TCP_CLOSED has 
+// an entry keyed on its remoteHash, which is the local port for listening 
+// sockets and a hash of the remote IP, remote port, and local port for all 
+// others.  Collisions are resolved by linear probing, so lookups must still 
+// verify the state and the full address of each candidate.
+#if defined(STACK_USE_SSL_SERVER)
+	#define TCP_HASH_KEYS_PER_SOCKET	(2u)	// remoteHash and SSL listening port
+#else
+	#define TCP_HASH_KEYS_PER_SOCKET	(1u)	// remoteHash only
+#endif
+typedef struct
+{
+	WORD		wKey;			// Hash key this entry was inserted with
+	TCP_SOCKET	hTCP;			// Socket owning this entry, or INVALID_SOCKET if the slot is empty
+} TCP_HASH_ENTRY;
+
+// Home slot for a hash key
+#define TCPHashSlot(wKey)	((WORD)((wKey) ^ ((wKey)>>7)) & (TCP_HASH_TABLE_SIZE-1))
+
+// TCPHashSlot() masks with TCP_HASH_TABLE_SIZE-1, and probing relies on an 
+// empty slot always being found.  TCP_SOCKET_COUNT is a sizeof(), which the 
+// preprocessor can't evaluate, so the size check is an array that gets a 
+// negative size (a compile error) if the table is too small.
+#if (TCP_HASH_TABLE_SIZE == 0u) || (TCP_HASH_TABLE_SIZE & (TCP_HASH_TABLE_SIZE-1u))
+	#error "TCP_HASH_TABLE_SIZE in TCP.c must be a power of 2"
+#endif
+typedef BYTE TCP_HASH_TABLE_SIZE_TOO_SMALL_FOR_TCPSocketInitializer[(TCP_HASH_TABLE_SIZE >= 2u*TCP_HASH_KEYS_PER_SOCKET*TCP_SOCKET_COUNT) ? 1 : -1];
+
+#if TCP_MAX_IOVS
+// A buffer queued with TCPPutIov().  TX FIFO space is reserved for its bytes 
+// as space frees up, but nothing is written there.  SendTCP() reads those 
+// bytes from pData instead, so retransmissions work until they are ACKed.
+typedef struct
+{
+	ROM BYTE* pData;			// Caller's buffer
+	DWORD dwLen;				// Number of bytes at pData
+	DWORD dwOffset;				// Offset in pData of the byte reserved at ptrStart
+	PTR_BASE ptrStart;			// TX FIFO position of the first reserved, unacknowledged byte
+	TCP_FIFO_SIZE wLive;		// Number of reserved bytes not acknowledged yet
+	TCP_IOV_RELEASE fRelease;	// Called when pData is no longer needed, or NULL
+	void* pContext;				// Passed to fRelease
+} TCP_IOV_ENTRY;
+#endif
+
+// All TCP module state.  There is one TCPContext, except in a host build 
+// with STACK_MULTI_INSTANCE where each stack instance has its own (see 
+// StackTsk.h).  The code uses the names #defined after the structure, 
+// which refer to the current instance's copy.
+typedef struct
+{
+	TCP_SOCKET hCurrentTCP;								// Current TCP socket
+	TCB* pMyTCB;										// Currently loaded TCB
+	#if defined(TCP_OPTIMIZE_FOR_SIZE)
+	TCB_STUB MyTCBStub;									// Copy of TCBStubs[hCurrentTCP], see SyncTCBStub()
+	#endif
+	TCB_STUB TCBStubs[TCP_SOCKET_COUNT];
+	TCB TCBCache[TCP_TCB_CACHE_SIZE];					// Write-back cache of full TCBs, see TCPLoadTCB()
+	TCP_SOCKET TCBCacheOwner[TCP_TCB_CACHE_SIZE];		// Socket held by each TCBCache[] entry, or INVALID_SOCKET
+	BYTE TCBCacheDirty[TCP_TCB_CACHE_SIZE];				// Nonzero if the entry may differ from the copy in its memory medium
+	BYTE TCBCacheLRU[TCP_TCB_CACHE_SIZE];				// TCBCache[] indices, most recently used first
+
+	// Options parsed out of the segment currently being processed by GetTCPOptions()
+	BOOL bRXSACKPermitted;								// SYN offered SACK
+	BOOL bRXWindowScale;								// SYN carried the window scale option
+	BYTE vRXWindowShift;								// Window scale shift count from the SYN, or 0
+	BYTE vRXSACKBlocks;									// Number of valid SACK blocks below
+	DWORD dwRXSACKLeft[TCP_MAX_SACK_BLOCKS_RX];			// First sequence number of each SACK block
+	DWORD dwRXSACKRight[TCP_MAX_SACK_BLOCKS_RX];		// Sequence number following each SACK block
+	TCP_FIFO_SIZE wFastRetransmitLen;					// Most bytes a SENDTCP_FAST_RETRANSMIT may resend
+	#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	BOOL bRXStaged;										// The segment being processed is also in MACRxStage[]
+	#endif
+
+	#if defined(STACK_USE_TCP_STATS)
+	TCP_SOCKET_STATS TCPStats[TCP_SOCKET_COUNT];		// Counters returned by TCPGetStats()
+	TCP_STACK_STATS TCPStackStats;						// Totals returned by TCPGetStats()
+	DWORD TCPStatsStateTime[TCP_SOCKET_COUNT];			// Tick up to which TCPStats[].dwStateTicks[] has been credited
+	BYTE TCPStatsState[TCP_SOCKET_COUNT];				// State the socket was in at that tick
+	#endif
+
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+	TCP_SYN_QUEUE SYNQueue[TCP_SYN_QUEUE_MAX_ENTRIES];	// Ring of saved incoming SYN requests that need to be serviced later (wDestPort == 0 for a free slot)
+	WORD SYNQueueTail;									// Index of the slot after the newest entry, where the search for a free slot starts
+	WORD SYNQueueCount;									// Number of SYNs waiting in SYNQueue[]
+	#endif
+	#if defined(TCP_SYN_COOKIES)
+	DWORD dwSYNCookieSecret;							// Random key mixed into every SYN cookie, chosen by TCPInit()
+	#endif
+
+	TCP_HASH_ENTRY TCPHashTable[TCP_HASH_TABLE_SIZE];
+	WORD TCPHashKeys[TCP_SOCKET_COUNT][TCP_HASH_KEYS_PER_SOCKET];	// Keys each socket is currently inserted with
+	BYTE TCPHashKeyCount[TCP_SOCKET_COUNT];				// Number of valid keys in TCPHashKeys[] for each socket
+
+	// Timer queue used by TCPTick().  Every socket with a pending timed 
+	// event sits in a binary min-heap ordered by the TickGet() time of its 
+	// earliest event, so TCPTick() only visits sockets whose timers have 
+	// fired.  Instead of hooking every place that arms a timer, 
+	// SyncTCBStub() records each socket it loads in TCPTimerTouched[], and 
+	// TCPTick() recomputes the heap position of those sockets before 
+	// checking for expired events.
+	DWORD TCPTimerDue[TCP_SOCKET_COUNT];				// TickGet() time the next event of each socket is due
+	TCP_SOCKET TCPTimerHeap[TCP_SOCKET_COUNT];			// Min-heap of sockets ordered by TCPTimerDue[]
+	BYTE TCPTimerHeapPos[TCP_SOCKET_COUNT];				// Index+1 of each socket in TCPTimerHeap[], or 0 if not queued
+	BYTE TCPTimerHeapCount;								// Number of sockets in TCPTimerHeap[]
+	TCP_SOCKET TCPTimerTouched[TCP_SOCKET_COUNT];		// Sockets synced since the last TCPTick()
+	BYTE TCPTimerIsTouched[TCP_SOCKET_COUNT];			// Nonzero if the socket is already listed in TCPTimerTouched[]
+	BYTE TCPTimerTouchedCount;							// Number of entries in TCPTimerTouched[]
+
+	#if TCP_MAX_IOVS
+	TCP_IOV_ENTRY TCPIovQueue[TCP_SOCKET_COUNT][TCP_MAX_IOVS];	// Queued buffers of each socket, oldest first
+	BYTE TCPIovCount[TCP_SOCKET_COUNT];					// Number of valid entries in TCPIovQueue[]
+	#endif
+} TCP_CONTEXT;
 
 #if defined(HI_TECH_C)
-	// The initializer forces this large array out of the bss section 
+	// The initializer forces this large structure out of the bss section 
 	// so we can link correctly.
 	#pragma psect bigdata=TCB_uRAM_BIG
 	#pragma psect data=TCB_uRAM
-	static TCB_STUB TCBStubs[TCP_SOCKET_COUNT] = {'\0'};	
+	static TCP_CONTEXT TCPContext = {0};	
 	#pragma psect data=ordinary_data_sect
 	#pragma psect bigdata=ordinary_data_sect_big
 #else
-	// The TCB array is very large.  With the C18 compiler, one must 
-	// modify the linker script to make an array that spans more than 
+	// The TCP context is very large.  With the C18 compiler, one must 
+	// modify the linker script to make an object that spans more than 
 	// one memory bank.  To do this, make the necessary changes to your 
 	// processor's linker script (.lkr).  Here is an example showing 
 	// gpr11 and 128 bytes of gpr12 being combined into one 384 byte 
-	// block used exclusively by the TCB_uRAM data section:
+	// block used exclusively by the TCB_uRAM data section (size it for 
+	// sizeof(TCP_CONTEXT)):
 	// ...
 	// //DATABANK   NAME=gpr11      START=0xB00          END=0xBFF
 	// //DATABANK   NAME=gpr12      START=0xC00          END=0xCFF
@@ -237,22 +411,68 @@ static WORD NextPort __attribute__((persistent));	// Tracking variable for next
 	#if defined(__18CXX) && !defined(HI_TECH_C)	
 		#pragma udata TCB_uRAM
 	#endif
-	static TCB_STUB TCBStubs[TCP_SOCKET_COUNT];
+	static TCP_CONTEXT STACK_INSTANCE_ARRAY(TCPContext);
 	#if defined(__18CXX) && !defined(HI_TECH_C)	
 		#pragma udata					// Return to any other RAM section
 	#endif
 #endif
 
-static TCB MyTCB;									// Currently loaded TCB
-static TCP_SOCKET hCurrentTCP = INVALID_SOCKET;		// Current TCP socket
+#define hCurrentTCP				(STACK_INSTANCE(TCPContext).hCurrentTCP)
+#define pMyTCB					(STACK_INSTANCE(TCPContext).pMyTCB)
+#define MyTCB					(*pMyTCB)
+#define TCBStubs				(STACK_INSTANCE(TCPContext).TCBStubs)
+#define TCBCache				(STACK_INSTANCE(TCPContext).TCBCache)
+#define TCBCacheOwner			(STACK_INSTANCE(TCPContext).TCBCacheOwner)
+#define TCBCacheDirty			(STACK_INSTANCE(TCPContext).TCBCacheDirty)
+#define TCBCacheLRU				(STACK_INSTANCE(TCPContext).TCBCacheLRU)
+#define bRXSACKPermitted		(STACK_INSTANCE(TCPContext).bRXSACKPermitted)
+#define bRXWindowScale			(STACK_INSTANCE(TCPContext).bRXWindowScale)
+#define vRXWindowShift			(STACK_INSTANCE(TCPContext).vRXWindowShift)
+#define vRXSACKBlocks			(STACK_INSTANCE(TCPContext).vRXSACKBlocks)
+#define dwRXSACKLeft			(STACK_INSTANCE(TCPContext).dwRXSACKLeft)
+#define dwRXSACKRight			(STACK_INSTANCE(TCPContext).dwRXSACKRight)
+#define wFastRetransmitLen		(STACK_INSTANCE(TCPContext).wFastRetransmitLen)
+#define bRXStaged				(STACK_INSTANCE(TCPContext).bRXStaged)
+#define TCPStats				(STACK_INSTANCE(TCPContext).TCPStats)
+#define TCPStackStats			(STACK_INSTANCE(TCPContext).TCPStackStats)
+#define TCPStatsStateTime		(STACK_INSTANCE(TCPContext).TCPStatsStateTime)
+#define TCPStatsState			(STACK_INSTANCE(TCPContext).TCPStatsState)
+#define SYNQueue				(STACK_INSTANCE(TCPContext).SYNQueue)
+#define SYNQueueTail			(STACK_INSTANCE(TCPContext).SYNQueueTail)
+#define SYNQueueCount			(STACK_INSTANCE(TCPContext).SYNQueueCount)
+#define dwSYNCookieSecret		(STACK_INSTANCE(TCPContext).dwSYNCookieSecret)
+#define TCPHashTable			(STACK_INSTANCE(TCPContext).TCPHashTable)
+#define TCPHashKeys				(STACK_INSTANCE(TCPContext).TCPHashKeys)
+#define TCPHashKeyCount			(STACK_INSTANCE(TCPContext).TCPHashKeyCount)
+#define TCPTimerDue				(STACK_INSTANCE(TCPContext).TCPTimerDue)
+#define TCPTimerHeap			(STACK_INSTANCE(TCPContext).TCPTimerHeap)
+#define TCPTimerHeapPos			(STACK_INSTANCE(TCPContext).TCPTimerHeapPos)
+#define TCPTimerHeapCount		(STACK_INSTANCE(TCPContext).TCPTimerHeapCount)
+#define TCPTimerTouched			(STACK_INSTANCE(TCPContext).TCPTimerTouched)
+#define TCPTimerIsTouched		(STACK_INSTANCE(TCPContext).TCPTimerIsTouched)
+#define TCPTimerTouchedCount	(STACK_INSTANCE(TCPContext).TCPTimerTouchedCount)
+#define TCPIovQueue				(STACK_INSTANCE(TCPContext).TCPIovQueue)
+#define TCPIovCount				(STACK_INSTANCE(TCPContext).TCPIovCount)
+
+// Scratch space, only used within one call, so one copy per thread is enough
+static STACK_THREAD_LOCAL BYTE TCPFindSkip[256];	// Boyer-Moore-Horspool shift for each byte value, capped at 255
+
 #if TCP_SYN_QUEUE_MAX_ENTRIES
-	#if defined(__18CXX) && !defined(HI_TECH_C)	
-		#pragma udata SYN_QUEUE_RAM_SECT
-	#endif
-	static TCP_SYN_QUEUE SYNQueue[TCP_SYN_QUEUE_MAX_ENTRIES];	// Array of saved incoming SYN requests that need to be serviced later
-	#if defined(__18CXX) && !defined(HI_TECH_C)	
-		#pragma udata
-	#endif
+	// Index into SYNQueue[] of the k-th slot after the newest entry.  Slots 
+	// are filled in this order, so it visits older entries first.
+	#define SYNQueueIndex(k)	((SYNQueueTail + (k)) % TCP_SYN_QUEUE_MAX_ENTRIES)
+#endif
+#if defined(TCP_SYN_COOKIES)
+	// MSS values a SYN cookie can encode.  Must not exceed TCP_MAX_SEG_SIZE_TX, 
+	// and there is only room in the cookie for 4 of them.
+	static ROM WORD wSYNCookieMSS[4] = {536u, 1024u, 1220u, 1460u};
+
+	// SYN options a SYN cookie encodes besides the MSS
+	#define TCP_SYN_COOKIE_SACK			(0x10u)	// The SYN offered SACK
+	#define TCP_SYN_COOKIE_WS_MASK		(0x0Fu)	// The SYN's window scale shift plus 1, or 0 if it had no window scale option
+
+	// SYN cookie time counter, advancing every 64 seconds
+	#define TCPSYNCookieTime()	((BYTE)(TickGet()/(TICK_SECOND*64ull)) & 0x1Fu)
 #endif
 
 /****************************************************************************
@@ -260,12 +480,12 @@ static TCP_SOCKET hCurrentTCP = INVALID_SOCKET;		// Current TCP socket
 	Function Prototypes
   ***************************************************************************/
 
-static void TCPRAMCopy(PTR_BASE wDest, BYTE vDestType, PTR_BASE wSource, BYTE vSourceType, WORD wLength);
+static void TCPRAMCopy(PTR_BASE wDest, BYTE vDestType, PTR_BASE wSource, BYTE vSourceType, TCP_FIFO_SIZE wLength);
 
 #if defined(__18CXX)
 	static void TCPRAMCopyROM(PTR_BASE wDest, BYTE wDestType, ROM BYTE* wSource, WORD wLength);
 #else
-	#define TCPRAMCopyROM(a,b,c,d)	TCPRAMCopy(a,b,c,TCP_PIC_RAM,d)
+	#define TCPRAMCopyROM(a,b,c,d)	TCPRAMCopy(a,b,(PTR_BASE)(c),TCP_PIC_RAM,d)
 #endif
 
 static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags);
@@ -273,7 +493,55 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len);
 static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote);
 static void SwapTCPHeader(TCP_HEADER* header);
 static void CloseSocket(void);
-static void SyncTCB(void);
+static void TCPLoadTCB(BOOL bWrite);
+static void TCPHashSync(void);
+static void TCPUpdateRTT(DWORD dwAckNumber);
+static void TCPCancelRTTSample(void);
+static TCP_FIFO_SIZE TCPGetBytesInFlight(void);
+static void TCPResetCongestionWindow(void);
+static void TCPCongestionAck(TCP_FIFO_SIZE wAcked, DWORD dwAckNumber);
+static void TCPCongestionDupAck(DWORD dwAckNumber);
+static void TCPCongestionTimeout(void);
+static BOOL TCPRetransmitNextHole(void);
+static void TCPScheduleNewData(void);
+static TCP_FIFO_SIZE TCPRangeAdvance(TCP_SEQ_RANGE* vRanges, BYTE* vCount, TCP_FIFO_SIZE wLen);
+static void TCPRangeInsert(TCP_SEQ_RANGE* vRanges, BYTE* vCount, BYTE vMaxCount, TCP_FIFO_SIZE wStart, TCP_FIFO_SIZE wEnd);
+static BYTE TCPFormatOptions(BYTE vTCPFlags, BYTE* vOptions);
+static void TCPSACKUpdate(TCP_FIFO_SIZE wAcked);
+static WORD GetTCPOptions(void);
+static WORD TCPFindArrayCore(TCP_SOCKET hTCP, BYTE* cFindArray, ROM BYTE* cFindROMArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare);
+static void TCPCopySegmentData(PTR_BASE ptrDest, WORD wOffset, TCP_FIFO_SIZE wLength);
+static void TCPPutComplete(TCP_SOCKET hTCP, BOOL bFIFOFull);
+static void TCPCopyTxData(PTR_BASE ptrDest, PTR_BASE ptrSource, TCP_FIFO_SIZE wLength);
+#if TCP_MAX_IOVS
+static BOOL TCPIovMap(void);
+static void TCPIovAck(TCP_FIFO_SIZE wAcked);
+static void TCPIovReleaseAll(void);
+#endif
+#if defined(STACK_USE_TCP_STATS)
+static void TCPStatsReset(void);
+static void TCPStatsSyncState(void);
+static void TCPStatsWindow(DWORD dwWindow);
+#endif
+static TCP_SOCKET TCPTimerTouch(TCP_SOCKET hTCP);
+static void TCPTimerSchedule(BOOL bNextTick);
+static void TCPTimerHeapFix(WORD i);
+static void TCPTickSocket(TCP_SOCKET hTCP);
+#if defined(TCP_SYN_COOKIES)
+static DWORD TCPSYNCookie(DWORD dwRemoteIP, WORD wRemotePort, WORD wLocalPort, DWORD dwRemoteISN, BYTE vTime, BYTE vMSSIndex, BYTE vOptions);
+static void TCPSendSYNCookie(TCP_HEADER* h, NODE_INFO* remote);
+static WORD TCPCheckSYNCookie(DWORD dwCookie, DWORD dwRemoteISN, BYTE* vOptions);
+#endif
+
+// Bytes past the RX head pointer up to the end of the last out-of-order range, or 0
+#define TCPGetOOODataEnd()	(MyTCB.vOOORangeCount ? MyTCB.OOORanges[MyTCB.vOOORangeCount-1].wEnd : 0u)
+
+// Counts an event against the current socket and the stack-wide totals
+#if defined(STACK_USE_TCP_STATS)
+	#define TCPStatsCount(f)	do{TCPStats[hCurrentTCP].f++; TCPStackStats.f++;}while(0)
+#else
+	#define TCPStatsCount(f)	do{}while(0)
+#endif
 
 #if defined(WF_CS_TRIS)
 UINT16 WFGetTCBSize(void);
@@ -283,6 +551,10 @@ UINT16 WFGetTCBSize(void);
 #define SENDTCP_RESET_TIMERS	0x01
 // Instead of transmitting normal data, a garbage octet is transmitted according to RFC 1122 section 4.2.3.6
 #define SENDTCP_KEEP_ALIVE		0x02
+// Resend one segment (at most wFastRetransmitLen bytes) from a hole, ignoring the congestion window
+#define SENDTCP_FAST_RETRANSMIT	0x04
+// Push all queued data, so that a corked socket may send it in a segment shorter than the MSS (TCPFlush())
+#define SENDTCP_PUSH			0x08
 
 
 /****************************************************************************
@@ -291,12 +563,15 @@ UINT16 WFGetTCBSize(void);
   ***************************************************************************/
 
 #if defined(TCP_OPTIMIZE_FOR_SIZE)
-	static TCB_STUB MyTCBStub;
+	#define MyTCBStub		(STACK_INSTANCE(TCPContext).MyTCBStub)
 	
 	// Flushes MyTCBStub cache and loads up the specified TCB_STUB.
 	// Does nothing on cache hit.
 	static void SyncTCBStub(TCP_SOCKET hTCP)
 	{
+		if(hTCP != INVALID_SOCKET)
+			TCPTimerTouch(hTCP);
+
 		if(hCurrentTCP == hTCP)
 			return;
 	
@@ -317,31 +592,87 @@ UINT16 WFGetTCBSize(void);
 #else
 	// Flushes MyTCBStub cache and loads up the specified TCB_STUB.
 	// Does nothing on cache hit.
-	#define SyncTCBStub(a)	hCurrentTCP = (a)
+	#define SyncTCBStub(a)	hCurrentTCP = TCPTimerTouch(a)
 	// Alias to current TCP stub.
 	#define MyTCBStub		TCBStubs[hCurrentTCP]
 #endif
 
 
 
-// Flushes MyTCB cache and loads up the specified TCB.
-// Does nothing on cache hit.
-static void SyncTCB(void)
+// Loads the TCB of the current stub into MyTCB so it can be modified.  
+// Does nothing on cache hit except mark the cached copy as modified.
+#define SyncTCB()			TCPLoadTCB(TRUE)
+// Loads the TCB of the current stub into MyTCB for reading only.  Code that 
+// later writes to MyTCB must call SyncTCB() first.
+#define SyncTCBForRead()	TCPLoadTCB(FALSE)
+
+/*****************************************************************************
+  Function:
+	static void TCPLoadTCB(BOOL bWrite)
+
+  Summary:
+	Points MyTCB at the cached TCB of the current socket.
+
+  Description:
+	Full TCBs live in the socket's memory medium (often Ethernet or SPI 
+	RAM), so up to TCP_TCB_CACHE_SIZE of them are cached in PIC RAM.  On a 
+	miss the least recently used entry is evicted, and it is copied back to 
+	its medium only if it was marked dirty.  Entries are marked dirty by 
+	write syncs and stay dirty until evicted, so interleaving a few sockets 
+	costs no TCPRAMCopy() round trips at all, and sockets that are only 
+	inspected are never written back.
+
+  Precondition:
+	MyTCBStub is synced.
+
+  Parameters:
+	bWrite - TRUE if the caller may modify MyTCB.
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPLoadTCB(BOOL bWrite)
 {
-	static TCP_SOCKET hLastTCB = INVALID_SOCKET;
-	
-	if(hLastTCB == hCurrentTCP)
-		return;
+	BYTE i;
+	BYTE vSlot;
+	TCP_SOCKET hOwner;
 
-	if(hLastTCB != INVALID_SOCKET)
+	vSlot = TCBCacheLRU[0];
+	if(TCBCacheOwner[vSlot] != hCurrentTCP)
 	{
-		// Save the current TCB
-		TCPRAMCopy(TCBStubs[hLastTCB].bufferTxStart - sizeof(MyTCB), TCBStubs[hLastTCB].vMemoryMedium, (PTR_BASE)&MyTCB, TCP_PIC_RAM, sizeof(MyTCB));
+		// Look further down the LRU list.  If the TCB isn't cached, vSlot 
+		// ends up as the least recently used entry.
+		for(i = 1; i < TCP_TCB_CACHE_SIZE; i++)
+		{
+			vSlot = TCBCacheLRU[i];
+			if(TCBCacheOwner[vSlot] == hCurrentTCP)
+				break;
+		}
+
+		if(i == TCP_TCB_CACHE_SIZE)
+		{
+			i--;
+			
+			// Save the evicted TCB, if it was modified
+			hOwner = TCBCacheOwner[vSlot];
+			if((hOwner != INVALID_SOCKET) && TCBCacheDirty[vSlot])
+				TCPRAMCopy(TCBStubs[hOwner].bufferTxStart - sizeof(TCB), TCBStubs[hOwner].vMemoryMedium, (PTR_BASE)&TCBCache[vSlot], TCP_PIC_RAM, sizeof(TCB));
+
+			// Load up the new TCB
+			TCPRAMCopy((PTR_BASE)&TCBCache[vSlot], TCP_PIC_RAM, MyTCBStub.bufferTxStart - sizeof(TCB), MyTCBStub.vMemoryMedium, sizeof(TCB));
+			TCBCacheOwner[vSlot] = hCurrentTCP;
+			TCBCacheDirty[vSlot] = 0;
+		}
+
+		// Make this entry the most recently used one
+		for(; i; i--)
+			TCBCacheLRU[i] = TCBCacheLRU[i-1];
+		TCBCacheLRU[0] = vSlot;
+		pMyTCB = &TCBCache[vSlot];
 	}
 
-	// Load up the new TCB
-	hLastTCB = hCurrentTCP;
-	TCPRAMCopy((PTR_BASE)&MyTCB, TCP_PIC_RAM, MyTCBStub.bufferTxStart - sizeof(MyTCB), MyTCBStub.vMemoryMedium, sizeof(MyTCB));
+	if(bWrite)
+		TCBCacheDirty[vSlot] = 1;
 }
 
 
@@ -374,7 +705,8 @@ void TCPInit(void)
 {
 	BYTE i;
 	BYTE vSocketsAllocated;
-	WORD wTXSize, wRXSize;
+	WORD w;
+	TCP_FIFO_SIZE wTXSize, wRXSize;
 	PTR_BASE ptrBaseAddress;
 	BYTE vMedium;
 	#if TCP_ETH_RAM_SIZE > 0
@@ -387,6 +719,8 @@ void TCPInit(void)
 	WORD wCurrentSPIAddress = TCP_SPI_RAM_BASE_ADDRESS;
 	#endif
 
+	hCurrentTCP = INVALID_SOCKET;
+
 	#if defined(STACK_CLIENT_MODE)
 		// Initialize NextPort to a random value if it is zero (such as after 
 		// reset on a PIC32 or PIC18 when the static memory initializer is 
@@ -401,6 +735,44 @@ void TCPInit(void)
 	// Mark all SYN Queue entries as invalid by zeroing the memory
 	#if TCP_SYN_QUEUE_MAX_ENTRIES
 		memset((void*)SYNQueue, 0x00, sizeof(SYNQueue));
+		SYNQueueTail = 0;
+		SYNQueueCount = 0;
+	#endif
+
+	// Pick a new SYN cookie key so cookies from before a reset are rejected
+	#if defined(TCP_SYN_COOKIES)
+		dwSYNCookieSecret = GenerateRandomDWORD();
+	#endif
+
+	// Empty the socket hash table
+	for(w = 0; w < TCP_HASH_TABLE_SIZE; w++)
+		TCPHashTable[w].hTCP = INVALID_SOCKET;
+	memset((void*)TCPHashKeyCount, 0x00, sizeof(TCPHashKeyCount));
+
+	// Empty the TCB cache.  Nothing is written back since the socket memory 
+	// is about to be laid out again.
+	for(i = 0; i < TCP_TCB_CACHE_SIZE; i++)
+	{
+		TCBCacheOwner[i] = INVALID_SOCKET;
+		TCBCacheDirty[i] = 0;
+		TCBCacheLRU[i] = i;
+	}
+	pMyTCB = &TCBCache[0];
+
+	// Empty the timer queue.  Every socket is touched by the loop below, so 
+	// the first TCPTick() call will queue whichever ones need it.
+	TCPTimerHeapCount = 0;
+	TCPTimerTouchedCount = 0;
+	memset((void*)TCPTimerHeapPos, 0x00, sizeof(TCPTimerHeapPos));
+	memset((void*)TCPTimerIsTouched, 0x00, sizeof(TCPTimerIsTouched));
+
+	// Forget any TCPPutIov() buffers without releasing them
+	#if TCP_MAX_IOVS
+	memset((void*)TCPIovCount, 0x00, sizeof(TCPIovCount));
+	#endif
+
+	#if defined(STACK_USE_TCP_STATS)
+	memset((void*)&TCPStackStats, 0x00, sizeof(TCPStackStats));
 	#endif
 	
 	// Allocate all socket FIFO addresses
@@ -460,9 +832,16 @@ void TCPInit(void)
 		MyTCBStub.bufferEnd		= MyTCBStub.bufferRxStart + wRXSize;
 		MyTCBStub.smState		= TCP_CLOSED;
 		MyTCBStub.Flags.bServer	= FALSE;
+		MyTCBStub.wAutoFlushTime = TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
+		MyTCBStub.Options.bNoDelay = 0;
+		MyTCBStub.Options.bQuickACK = 0;
+		MyTCBStub.Options.bCork = 0;
 		#if defined(STACK_USE_SSL)
 		MyTCBStub.sslStubID = SSL_INVALID_ID;
 		#endif		
+		#if defined(STACK_USE_TCP_STATS)
+		TCPStatsReset();
+		#endif
 
 		SyncTCB();
 		MyTCB.vSocketPurpose = TCPSocketInitializer[i].vSocketPurpose;
@@ -595,6 +974,9 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vS
 {
 	TCP_SOCKET hTCP;
 
+	// Host builds must be able to pass pointers in dwRemoteHost
+	CheckDWORDPointer("TCPOpen()");
+
 	// Find an available socket that matches the specified socket type
 	for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++)
 	{
@@ -604,16 +986,28 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vS
 		if(MyTCBStub.smState != TCP_CLOSED)
 			continue;
 
-		SyncTCB();
+		SyncTCBForRead();
 
 		// See if this socket matches the desired type
 		if(MyTCB.vSocketPurpose != vSocketPurpose)
 			continue;
+		SyncTCB();
+
+		#if defined(STACK_USE_TCP_STATS)
+		TCPStatsReset();
+		#endif
 
 		// Start out assuming worst case Maximum Segment Size (changes when MSS 
 		// option is received from remote node)
 		MyTCB.wRemoteMSS = 536;
 
+		// Start out with the default transmit and acknowledgement policy.  
+		// The application can change it with TCPSetOption().
+		MyTCBStub.wAutoFlushTime = TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
+		MyTCBStub.Options.bNoDelay = 0;
+		MyTCBStub.Options.bQuickACK = 0;
+		MyTCBStub.Options.bCork = 0;
+
 		// See if this is a server socket
 		if(vRemoteHostType == TCP_OPEN_SERVER)
 		{
@@ -680,6 +1074,10 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vS
 			#endif
 		}
 		
+		#if defined(STACK_USE_TCP_STATS)
+		TCPStatsSyncState();
+		#endif
+		TCPHashSync();
 		return hTCP;		
 	}
 
@@ -876,13 +1274,15 @@ void TCPDisconnect(TCP_SOCKET hTCP)
 			// more data wating in the TX FIFO than can be sent in a single 
 			// packet (due to the remote Max Segment Size packet size limit), 
 			// we will keep generating more packets until either all data gets 
-			// transmitted or the remote node's receive window fills up.
+			// transmitted or the remote node's receive window or the 
+			// congestion window fills up.  The rest goes out from TCPTick() as 
+			// ACKs make room.
 			do
 			{
 				SendTCP(FIN | ACK, SENDTCP_RESET_TIMERS);
-				if(MyTCB.remoteWindow == 0u)
+				if((MyTCB.remoteWindow == 0u) || (MyTCB.wCwnd <= TCPGetBytesInFlight()))
 					break;
-			} while(MyTCBStub.txHead != MyTCB.txUnackedTail);
+			} while(MyTCBStub.txHead != MyTCBStub.txUnackedTail);
 			
 			MyTCBStub.smState = TCP_FIN_WAIT_1;
 			break;
@@ -892,13 +1292,15 @@ void TCPDisconnect(TCP_SOCKET hTCP)
 			// more data wating in the TX FIFO than can be sent in a single 
 			// packet (due to the remote Max Segment Size packet size limit), 
 			// we will keep generating more packets until either all data gets 
-			// transmitted or the remote node's receive window fills up.
+			// transmitted or the remote node's receive window or the 
+			// congestion window fills up.  The rest goes out from TCPTick() as 
+			// ACKs make room.
 			do
 			{
 				SendTCP(FIN | ACK, SENDTCP_RESET_TIMERS);
-				if(MyTCB.remoteWindow == 0u)
+				if((MyTCB.remoteWindow == 0u) || (MyTCB.wCwnd <= TCPGetBytesInFlight()))
 					break;
-			} while(MyTCBStub.txHead != MyTCB.txUnackedTail);
+			} while(MyTCBStub.txHead != MyTCBStub.txUnackedTail);
 
 			MyTCBStub.smState = TCP_LAST_ACK;
 			break;
@@ -912,6 +1314,7 @@ void TCPDisconnect(TCP_SOCKET hTCP)
 
 		case TCP_CLOSED_BUT_RESERVED:
 			MyTCBStub.smState = TCP_CLOSED;
+			TCPHashSync();
 			break;
 
 		// These states will close themselves after some delay, however, 
@@ -995,7 +1398,7 @@ void TCPClose(TCP_SOCKET hTCP)
   ***************************************************************************/
 SOCKET_INFO* TCPGetRemoteInfo(TCP_SOCKET hTCP)
 {
-	static SOCKET_INFO	RemoteInfo;
+	static STACK_THREAD_LOCAL SOCKET_INFO	RemoteInfo;
 
 	if(hTCP >= TCP_SOCKET_COUNT)
     {
@@ -1003,7 +1406,7 @@ SOCKET_INFO* TCPGetRemoteInfo(TCP_SOCKET hTCP)
     }
     
 	SyncTCBStub(hTCP);
-	SyncTCB();
+	SyncTCBForRead();
 	memcpy((void*)&RemoteInfo.remote, (void*)&MyTCB.remote, sizeof(NODE_INFO));
 	RemoteInfo.remotePort.Val = MyTCB.remotePort.Val;
 
@@ -1028,7 +1431,13 @@ SOCKET_INFO* TCPGetRemoteInfo(TCP_SOCKET hTCP)
 	This function immediately transmits all pending TX data with a PSH 
 	flag.  If this function is not called, data will automatically be sent
 	when either a) the TX buffer is half full or b) the 
-	TCP_AUTO_TRANSMIT_TIMEOUT_VAL (default: 40ms) has elapsed.
+	TCP_AUTO_TRANSMIT_TIMEOUT_VAL (default: 40ms) has elapsed.  Both rules 
+	can be changed per socket with TCPSetOption(): TCP_OPT_NODELAY sends 
+	every write immediately, TCP_OPT_CORK waits for a full segment instead, 
+	and TCP_OPT_AUTOFLUSH_MS changes the timeout.  This function always 
+	transmits, regardless of these options.  On a corked socket it also 
+	lets everything queued so far go out in a segment shorter than the MSS, 
+	however many segments that takes.
 
   Precondition:
 	TCP is initialized and the socket is connected.
@@ -1051,21 +1460,154 @@ void TCPFlush(TCP_SOCKET hTCP)
     }
     
 	SyncTCBStub(hTCP);
-	SyncTCB();
 
 	// NOTE: Pending SSL data will NOT be transferred here
 
-	if(MyTCBStub.txHead != MyTCB.txUnackedTail)
+	if(MyTCBStub.txHead != MyTCBStub.txUnackedTail)
 	{
 		// Send the TCP segment with all unacked bytes
-		SendTCP(ACK, SENDTCP_RESET_TIMERS);
+		SendTCP(ACK, SENDTCP_RESET_TIMERS | SENDTCP_PUSH);
+	}
+}
+
+
+/*****************************************************************************
+  Function:
+	BOOL TCPSetOption(TCP_SOCKET hTCP, BYTE vOption, WORD wValue)
+
+  Summary:
+	Sets a per-socket transmit or acknowledgement policy option.
+
+  Description:
+	Lets each socket pick its own latency versus efficiency trade-off 
+	instead of the global TCP_AUTO_TRANSMIT_TIMEOUT_VAL and 
+	TCP_DELAYED_ACK_TIMEOUT behavior.  The supported options are:
+	 - TCP_OPT_NODELAY: nonzero sends the data of every TCPPut*() call 
+	   right away, as if TCPFlush() were called after each write.
+	 - TCP_OPT_QUICKACK: nonzero acknowledges every received data segment 
+	   immediately instead of using delayed acknowledgements.
+	 - TCP_OPT_CORK: nonzero disables the half full flush and the 
+	   auto-transmit timer.  Only full segments are sent, even with an ACK or 
+	   window update, until the TX FIFO fills or TCPFlush() is called.  
+	   Clearing the option flushes any data still held.
+	 - TCP_OPT_AUTOFLUSH_MS: milliseconds to wait before unflushed TX data is 
+	   sent automatically (default 40).  The value is rounded to the 
+	   TickGetDiv256() resolution and limited to what the 16-bit timer can 
+	   hold.  It takes effect the next time the timer is started.
+
+	Options are reset to their defaults by TCPOpen() and are kept when a 
+	server socket returns to the listening state.
+
+  Precondition:
+	TCP is initialized and the socket has been opened with TCPOpen().
+
+  Parameters:
+	hTCP - The socket to configure.
+	vOption - One of the TCP_OPT_* values.
+	wValue - The new option value.
+
+  Return Values:
+	TRUE - The option was set.
+	FALSE - The socket or option is invalid.
+  ***************************************************************************/
+BOOL TCPSetOption(TCP_SOCKET hTCP, BYTE vOption, WORD wValue)
+{
+	DWORD dwTime;
+
+	if(hTCP >= TCP_SOCKET_COUNT)
+    {
+        return FALSE;
+    }
+    
+	SyncTCBStub(hTCP);
+
+	switch(vOption)
+	{
+		case TCP_OPT_NODELAY:
+			MyTCBStub.Options.bNoDelay = (wValue != 0u);
+			break;
+
+		case TCP_OPT_QUICKACK:
+			MyTCBStub.Options.bQuickACK = (wValue != 0u);
+			break;
+
+		case TCP_OPT_CORK:
+			MyTCBStub.Options.bCork = (wValue != 0u);
+			
+			// Send whatever was held back while corked
+			if(!MyTCBStub.Options.bCork)
+				TCPFlush(hTCP);
+			break;
+
+		case TCP_OPT_AUTOFLUSH_MS:
+			// Convert to TickGetDiv256() units, rounding to nearest.  
+			// Timer comparisons are signed, so keep below 0x8000.
+			dwTime = (DWORD)(((QWORD)wValue*TICK_SECOND + 128000ull)/256000ull);
+			if(dwTime > 0x7FFFul)
+				dwTime = 0x7FFFul;
+			MyTCBStub.wAutoFlushTime = (WORD)dwTime;
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*****************************************************************************
+  Function:
+	WORD TCPGetOption(TCP_SOCKET hTCP, BYTE vOption)
+
+  Summary:
+	Reads back a per-socket option set with TCPSetOption().
+
+  Description:
+	Returns the current value of a TCP_OPT_* option.  Boolean options read 
+	as 0 or 1.  TCP_OPT_AUTOFLUSH_MS is returned in milliseconds, converted 
+	back from the timer resolution it is stored in.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to query.
+	vOption - One of the TCP_OPT_* values.
+
+  Returns:
+	The option value, or 0 if the socket or option is invalid.
+  ***************************************************************************/
+WORD TCPGetOption(TCP_SOCKET hTCP, BYTE vOption)
+{
+	if(hTCP >= TCP_SOCKET_COUNT)
+    {
+        return 0;
+    }
+    
+	SyncTCBStub(hTCP);
+
+	switch(vOption)
+	{
+		case TCP_OPT_NODELAY:
+			return MyTCBStub.Options.bNoDelay;
+
+		case TCP_OPT_QUICKACK:
+			return MyTCBStub.Options.bQuickACK;
+
+		case TCP_OPT_CORK:
+			return MyTCBStub.Options.bCork;
+
+		case TCP_OPT_AUTOFLUSH_MS:
+			return (WORD)(((QWORD)MyTCBStub.wAutoFlushTime*256000ull + TICK_SECOND/2)/TICK_SECOND);
 	}
+
+	return 0;
 }
 
 
 /*****************************************************************************
   Function:
-	WORD TCPIsPutReady(TCP_SOCKET hTCP)
+	TCP_FIFO_SIZE TCPIsPutReady(TCP_SOCKET hTCP)
 
   Summary:
 	Determines how much free space is available in the TCP TX buffer.
@@ -1085,7 +1627,7 @@ void TCPFlush(TCP_SOCKET hTCP)
   Returns:
 	The number of bytes available to be written in the TCP TX buffer.
   ***************************************************************************/
-WORD TCPIsPutReady(TCP_SOCKET hTCP)
+TCP_FIFO_SIZE TCPIsPutReady(TCP_SOCKET hTCP)
 {
 	BYTE i;
 
@@ -1102,11 +1644,21 @@ WORD TCPIsPutReady(TCP_SOCKET hTCP)
 	if(!( (i == (BYTE)TCP_ESTABLISHED) || (i == (BYTE)TCP_CLOSE_WAIT) ))
 		return 0;
 
+	// New data has to wait until space is reserved for every queued 
+	// TCPPutIov() buffer so that it goes out after them
+	#if TCP_MAX_IOVS
+	if(TCPIovCount[hTCP])
+	{
+		if(TCPIovQueue[hTCP][TCPIovCount[hTCP]-1].dwOffset + TCPIovQueue[hTCP][TCPIovCount[hTCP]-1].wLive != TCPIovQueue[hTCP][TCPIovCount[hTCP]-1].dwLen)
+			return 0;
+	}
+	#endif
+
 	// Calculate the free space in this socket's TX FIFO
 	#if defined(STACK_USE_SSL)
 	if(MyTCBStub.sslStubID != SSL_INVALID_ID)
 	{// Use sslTxHead as the head pointer when SSL is active
-		WORD rem;
+		TCP_FIFO_SIZE rem;
 		
 		// Find out raw free space
 		if(MyTCBStub.sslTxHead >= MyTCBStub.txTail)
@@ -1149,7 +1701,7 @@ WORD TCPIsPutReady(TCP_SOCKET hTCP)
   ***************************************************************************/
 BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 {
-	WORD wFreeTXSpace;
+	TCP_FIFO_SIZE wFreeTXSpace;
 
 	if(hTCP >= TCP_SOCKET_COUNT)
     {
@@ -1166,8 +1718,9 @@ BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 
 	// Send all current bytes if we are crossing half full
 	// This is required to improve performance with the delayed 
-	// acknowledgement algorithm
-	if((!MyTCBStub.Flags.bHalfFullFlush) && (wFreeTXSpace <= ((MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart)>>1)))
+	// acknowledgement algorithm.  Corked sockets wait for full segments 
+	// instead (see TCPPutComplete()).
+	if((!MyTCBStub.Flags.bHalfFullFlush) && (!MyTCBStub.Options.bCork) && (wFreeTXSpace <= ((MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart)>>1)))
 	{
 		TCPFlush(hTCP);	
 		MyTCBStub.Flags.bHalfFullFlush = TRUE;
@@ -1193,26 +1746,16 @@ BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 	#endif
 	
 
-	// Send the last byte as a separate packet (likely will make the remote node send back ACK faster)
-	if(wFreeTXSpace == 1u)
-	{
-		TCPFlush(hTCP);
-	}
-	// If not already enabled, start a timer so this data will 
-	// eventually get sent even if the application doens't call
-	// TCPFlush()
-	else if(!MyTCBStub.Flags.bTimer2Enabled)
-	{
-		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
-	}
+	// Send the last byte as a separate packet (likely will make the remote 
+	// node send back ACK faster), otherwise apply the socket's transmit policy
+	TCPPutComplete(hTCP, wFreeTXSpace == 1u);
 
 	return TRUE;
 }
 
 /*****************************************************************************
   Function:
-	WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
+	TCP_FIFO_SIZE TCPPutArray(TCP_SOCKET hTCP, BYTE* data, TCP_FIFO_SIZE len)
 
   Description:
 	Writes an array from RAM to a TCP socket.
@@ -1229,11 +1772,11 @@ BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte)
 	The number of bytes written to the socket.  If less than len, the
 	buffer became full or the socket is not conected.
   ***************************************************************************/
-WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
+TCP_FIFO_SIZE TCPPutArray(TCP_SOCKET hTCP, BYTE* data, TCP_FIFO_SIZE len)
 {
-	WORD wActualLen;
-	WORD wFreeTXSpace;
-	WORD wRightLen = 0;
+	TCP_FIFO_SIZE wActualLen;
+	TCP_FIFO_SIZE wFreeTXSpace;
+	TCP_FIFO_SIZE wRightLen = 0;
 
 	if(hTCP >= TCP_SOCKET_COUNT)
     {
@@ -1255,8 +1798,9 @@ WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
 
 	// Send all current bytes if we are crossing half full
 	// This is required to improve performance with the delayed 
-	// acknowledgement algorithm
-	if((!MyTCBStub.Flags.bHalfFullFlush) && (wFreeTXSpace <= ((MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart)>>1)))
+	// acknowledgement algorithm.  Corked sockets wait for full segments 
+	// instead (see TCPPutComplete()).
+	if((!MyTCBStub.Flags.bHalfFullFlush) && (!MyTCBStub.Options.bCork) && (wFreeTXSpace <= ((MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart)>>1)))
 	{
 		TCPFlush(hTCP);	
 		MyTCBStub.Flags.bHalfFullFlush = TRUE;
@@ -1308,19 +1852,9 @@ WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
 	MyTCBStub.txHead += wActualLen;
 	#endif
 
-	// Send these bytes right now if we are out of TX buffer space
-	if(wFreeTXSpace <= len)
-	{
-		TCPFlush(hTCP);
-	}
-	// If not already enabled, start a timer so this data will 
-	// eventually get sent even if the application doens't call
-	// TCPFlush()
-	else if(!MyTCBStub.Flags.bTimer2Enabled)
-	{
-		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
-	}
+	// Send these bytes right now if we are out of TX buffer space, 
+	// otherwise apply the socket's transmit policy
+	TCPPutComplete(hTCP, wFreeTXSpace <= len);
 
 	return wActualLen + wRightLen;
 }
@@ -1370,8 +1904,9 @@ WORD TCPPutROMArray(TCP_SOCKET hTCP, ROM BYTE* data, WORD len)
 
 	// Send all current bytes if we are crossing half full
 	// This is required to improve performance with the delayed 
-	// acknowledgement algorithm
-	if((!MyTCBStub.Flags.bHalfFullFlush) && (wFreeTXSpace <= ((MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart)>>1)))
+	// acknowledgement algorithm.  Corked sockets wait for full segments 
+	// instead (see TCPPutComplete()).
+	if((!MyTCBStub.Flags.bHalfFullFlush) && (!MyTCBStub.Options.bCork) && (wFreeTXSpace <= ((MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart)>>1)))
 	{
 		TCPFlush(hTCP);	
 		MyTCBStub.Flags.bHalfFullFlush = TRUE;
@@ -1427,19 +1962,9 @@ WORD TCPPutROMArray(TCP_SOCKET hTCP, ROM BYTE* data, WORD len)
 	MyTCBStub.txHead += wActualLen;
 	#endif
 
-	// Send these bytes right now if we are out of TX buffer space
-	if(wFreeTXSpace <= len)
-	{
-		TCPFlush(hTCP);
-	}
-	// If not already enabled, start a timer so this data will 
-	// eventually get sent even if the application doens't call
-	// TCPFlush()
-	else if(!MyTCBStub.Flags.bTimer2Enabled)
-	{
-		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_AUTO_TRANSMIT_TIMEOUT_VAL/256ull;
-	}
+	// Send these bytes right now if we are out of TX buffer space, 
+	// otherwise apply the socket's transmit policy
+	TCPPutComplete(hTCP, wFreeTXSpace <= len);
 
 	return wActualLen + wRightLen;
 }
@@ -1447,92 +1972,106 @@ WORD TCPPutROMArray(TCP_SOCKET hTCP, ROM BYTE* data, WORD len)
 
 /*****************************************************************************
   Function:
-	BYTE* TCPPutString(TCP_SOCKET hTCP, BYTE* data)
+	static void TCPPutComplete(TCP_SOCKET hTCP, BOOL bFIFOFull)
+
+  Summary:
+	Decides when data just written to the TX FIFO gets transmitted.
 
   Description:
-	Writes a null-terminated string from RAM to a TCP socket.  The 
-	null-terminator is not copied to the socket.
+	Called at the end of each TCPPut*() function to apply the socket's 
+	transmit policy (see TCPSetOption()).  Data is flushed immediately when 
+	the FIFO is full or TCP_OPT_NODELAY is set.  A corked socket sends 
+	only once at least one maximum size segment of unsent data is queued, 
+	and then only the full segments.  Otherwise the auto-transmit timer is 
+	started, if it isn't running already, so the data eventually goes out 
+	even if the application never calls TCPFlush().
 
   Precondition:
-	TCP is initialized.
+	MyTCBStub is synced to hTCP.
 
   Parameters:
-	hTCP - The socket to which data is to be written.
-	data - Pointer to the string to be written.
+	hTCP - The socket that was written to.
+	bFIFOFull - TRUE if the write used up the TX FIFO.
 
   Returns:
-	Pointer to the byte following the last byte written to the socket.  If
-	this pointer does not dereference to a NUL byte, the buffer became full
-	or the socket is not connected.
-
-  Remarks:
-	The return value of this function differs from that of TCPPutArray.  To
-	write long strings in a single state, initialize the *data pointer to the
-	first byte, then call this function repeatedly (breaking to the main 
-	stack loop after each call) until the return value dereferences to a NUL
-	byte.  Save the return value as the new starting *data pointer otherwise.
+	None
   ***************************************************************************/
-BYTE* TCPPutString(TCP_SOCKET hTCP, BYTE* data)
+static void TCPPutComplete(TCP_SOCKET hTCP, BOOL bFIFOFull)
 {
-	return data + TCPPutArray(hTCP, data, strlen((char*)data));
+	TCP_FIFO_SIZE wUnsent;
+
+	#if defined(STACK_USE_TCP_STATS)
+	if(bFIFOFull)
+		TCPStats[hTCP].dwTXFIFOFull++;
+	#endif
+
+	if(bFIFOFull || MyTCBStub.Options.bNoDelay)
+	{
+		TCPFlush(hTCP);
+	}
+	else if(MyTCBStub.Options.bCork)
+	{
+		SyncTCBForRead();
+		wUnsent = MyTCBStub.txHead - MyTCBStub.txUnackedTail;
+		if(MyTCBStub.txHead < MyTCBStub.txUnackedTail)
+			wUnsent += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+		if(wUnsent >= MyTCB.wRemoteMSS)
+			SendTCP(ACK, SENDTCP_RESET_TIMERS);
+	}
+	else if(!MyTCBStub.Flags.bTimer2Enabled)
+	{
+		MyTCBStub.Flags.bTimer2Enabled = TRUE;
+		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + MyTCBStub.wAutoFlushTime;
+	}
 }
 
 /*****************************************************************************
   Function:
-	BYTE* TCPPutROMString(TCP_SOCKET hTCP, ROM BYTE* data)
+	BYTE TCPPutIov(TCP_SOCKET hTCP, TCP_IOV* vIov, BYTE vCount)
+
+  Summary:
+	Queues buffers for transmission without copying them into the TX FIFO.
 
   Description:
-	Writes a null-terminated string from ROM to a TCP socket.  The 
-	null-terminator is not copied to the socket.
+	Queues up to TCP_MAX_IOVS buffers per socket to be transmitted in order 
+	after any data already in the TX FIFO.  Instead of copying the data, 
+	TX FIFO space is reserved for it as space becomes available and 
+	SendTCP() reads each segment straight from the caller's buffer into the 
+	MAC.  Retransmissions read the buffer again, so it must stay valid and 
+	unchanged until its fRelease callback is called.  That happens once 
+	the remote node has acknowledged every byte, or when the connection is 
+	closed or reset or the TX FIFO is discarded by TCPAdjustFIFOSize().  
+	Bytes that have no FIFO space reserved yet when TCPDisconnect() is 
+	called are never sent.
+	
+	While any queued buffer still needs FIFO space, TCPIsPutReady() returns 
+	0 and TCPPut*() writes nothing, so later data can't overtake it.  The 
+	socket's transmit options (see TCPSetOption()) apply as for TCPPut*().
 
   Precondition:
 	TCP is initialized.
 
   Parameters:
 	hTCP - The socket to which data is to be written.
-	data - Pointer to the string to be written.
+	vIov - Array of buffers to queue, in transmission order.  The array 
+		itself is copied and needn't stay valid.
+	vCount - Number of entries in vIov.
 
   Returns:
-	Pointer to the byte following the last byte written to the socket.  If
-	this pointer does not dereference to a NUL byte, the buffer became full
-	or the socket is not connected.
+	The number of buffers queued, starting with vIov[0].  Zero if the socket 
+	is not connected, uses SSL, or has no free queue entries.
 
   Remarks:
-	The return value of this function differs from that of TCPPutArray.  To
-	write long strings in a single state, initialize the *data pointer to the
-	first byte, then call this function repeatedly (breaking to the main 
-	stack loop after each call) until the return value dereferences to a NUL
-	byte.  Save the return value as the new starting *data pointer otherwise.
-	
-	This function is aliased to TCPPutString on non-PIC18 platforms.
+	fRelease is called from inside the stack (usually from StackTask()) and 
+	must not call any TCP API functions.  On PIC32, RAM buffers may be 
+	passed as pData too.  Zero length buffers are released immediately.
   ***************************************************************************/
-#if defined(__18CXX)
-ROM BYTE* TCPPutROMString(TCP_SOCKET hTCP, ROM BYTE* data)
+BYTE TCPPutIov(TCP_SOCKET hTCP, TCP_IOV* vIov, BYTE vCount)
 {
-	return data + TCPPutROMArray(hTCP, data, strlenpgm((ROM char*)data));
-}
-#endif
-
-/*****************************************************************************
-  Function:
-	WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP)
-
-  Description:
-	Determines how many bytes are pending in the TCP TX FIFO.
-
-  Precondition:
-	TCP is initialized.
-
-  Parameters:
-	hTCP - The socket to check.
-
-  Returns:
-	Number of bytes pending to be flushed in the TCP TX FIFO.
-  ***************************************************************************/
-WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP)
-{
-	WORD wDataLen;
-	WORD wFIFOSize;
+	#if TCP_MAX_IOVS
+	TCP_IOV_ENTRY* e;
+	BYTE i;
+	BOOL bQueued = FALSE;
 
 	if(hTCP >= TCP_SOCKET_COUNT)
     {
@@ -1541,1646 +2080,3465 @@ WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP)
     
 	SyncTCBStub(hTCP);
 
-	// Calculate total usable FIFO size
-	wFIFOSize = MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart - 1;
+	// Unconnected sockets shouldn't be transmitting anything, and SSL 
+	// records have to be encrypted in place in the TX FIFO
+	if(!( (MyTCBStub.smState == (BYTE)TCP_ESTABLISHED) || (MyTCBStub.smState == (BYTE)TCP_CLOSE_WAIT) ))
+		return 0;
+	#if defined(STACK_USE_SSL)
+	if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+		return 0;
+	#endif
 
-	// Find out how many data bytes are free in the TX FIFO
-	wDataLen = TCPIsPutReady(hTCP);
+	for(i = 0; i < vCount; i++)
+	{
+		if(vIov[i].dwLen == 0u)
+		{
+			if(vIov[i].fRelease)
+				vIov[i].fRelease(hTCP, vIov[i].pContext);
+			continue;
+		}
 
-	return wFIFOSize - wDataLen;
-}
+		if(TCPIovCount[hTCP] >= TCP_MAX_IOVS)
+			break;
 
+		e = &TCPIovQueue[hTCP][TCPIovCount[hTCP]++];
+		e->pData = vIov[i].pData;
+		e->dwLen = vIov[i].dwLen;
+		e->dwOffset = 0;
+		e->ptrStart = MyTCBStub.txHead;
+		e->wLive = 0;
+		e->fRelease = vIov[i].fRelease;
+		e->pContext = vIov[i].pContext;
+		bQueued = TRUE;
+	}
 
+	// Reserve as much FIFO space as possible and send it like any other 
+	// written data.  A call that queued nothing leaves the socket alone, 
+	// or retrying while the queue is full would flush an empty ACK every 
+	// time.
+	if(bQueued)
+		TCPPutComplete(hTCP, !TCPIovMap());
 
-/****************************************************************************
-  Section:
-	Receive Functions
-  ***************************************************************************/
+	return i;
+	#else
+	return 0;
+	#endif
+}
 
 /*****************************************************************************
   Function:
-	void TCPDiscard(TCP_SOCKET hTCP)
+	static void TCPCopyTxData(PTR_BASE ptrDest, PTR_BASE ptrSource, 
+								TCP_FIFO_SIZE wLength)
+
+  Summary:
+	Copies TX FIFO data into the MAC TX buffer.
 
   Description:
-	Discards any pending data in the TCP RX FIFO.
+	Copies wLength bytes starting at ptrSource in the current socket's TX 
+	FIFO to ptrDest in the MAC.  Parts of the range that are reserved for 
+	TCPPutIov() buffers are read from those buffers instead.
 
   Precondition:
-	TCP is initialized.
+	The current TCP stub is synced.  The source range does not wrap past 
+	the end of the TX FIFO.
 
   Parameters:
-	hTCP - The socket whose RX FIFO is to be cleared.
+	ptrDest - MAC TX buffer address to write to
+	ptrSource - TX FIFO address to copy from
+	wLength - Number of bytes to copy
 
   Returns:
 	None
   ***************************************************************************/
-void TCPDiscard(TCP_SOCKET hTCP)
+static void TCPCopyTxData(PTR_BASE ptrDest, PTR_BASE ptrSource, TCP_FIFO_SIZE wLength)
 {
-	if(TCPIsGetReady(hTCP))
-	{
-		SyncTCBStub(hTCP);
-	
-		// Delete all data in the RX buffer
-		MyTCBStub.rxTail = MyTCBStub.rxHead;
-	
-		// Send a Window update message to the remote node
-		SendTCP(ACK, SENDTCP_RESET_TIMERS);
-	}
-}
-
+	#if TCP_MAX_IOVS
+	TCP_IOV_ENTRY* e;
+	BYTE i;
+	TCP_FIFO_SIZE wPos, wStart, wLen;
 
-/*****************************************************************************
-  Function:
-	void WORD TCPIsGetReady(TCP_SOCKET hTCP)
+	// Work with offsets from txTail so that no range wraps
+	wPos = ptrSource - MyTCBStub.txTail;
+	if(ptrSource < MyTCBStub.txTail)
+		wPos += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
 
-  Summary:
-	Determines how many bytes can be read from the TCP RX buffer.
+	for(i = 0; (i < TCPIovCount[hCurrentTCP]) && wLength; i++)
+	{
+		e = &TCPIovQueue[hCurrentTCP][i];
+		if(e->wLive == 0u)
+			break;
 
-  Description:
-	Call this function to determine how many bytes can be read from the 
-	TCP RX buffer.  If this function returns zero, the application must 
-	return to the main stack loop before continuing in order to wait for
-	more data to arrive.
+		wStart = e->ptrStart - MyTCBStub.txTail;
+		if(e->ptrStart < MyTCBStub.txTail)
+			wStart += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+		if(wStart + e->wLive <= wPos)
+			continue;
+		if(wStart >= wPos + wLength)
+			break;
 
-  Precondition:
-	TCP is initialized.
+		// Real FIFO data ahead of this buffer
+		if(wStart > wPos)
+		{
+			wLen = wStart - wPos;
+			TCPRAMCopy(ptrDest, TCP_ETH_RAM, ptrSource, MyTCBStub.vMemoryMedium, wLen);
+			ptrDest += wLen;
+			ptrSource += wLen;
+			wPos += wLen;
+			wLength -= wLen;
+		}
 
-  Parameters:
-	hTCP - The socket to check.
+		// Reserved bytes come straight from the caller's buffer
+		wLen = wStart + e->wLive - wPos;
+		if(wLen > wLength)
+			wLen = wLength;
+		TCPRAMCopyROM(ptrDest, TCP_ETH_RAM, e->pData + e->dwOffset + (wPos - wStart), wLen);
+		ptrDest += wLen;
+		ptrSource += wLen;
+		wPos += wLen;
+		wLength -= wLen;
+	}
+	#endif
 
-  Returns:
-	The number of bytes available to be read from the TCP RX buffer.
-  ***************************************************************************/
-WORD TCPIsGetReady(TCP_SOCKET hTCP)
-{
-	if(hTCP >= TCP_SOCKET_COUNT)
-    {
-        return 0;
-    }
-    
-	SyncTCBStub(hTCP);
-		
-	if(MyTCBStub.rxHead >= MyTCBStub.rxTail)
-		return MyTCBStub.rxHead - MyTCBStub.rxTail;
-	else
-		return (MyTCBStub.bufferEnd - MyTCBStub.rxTail + 1) + (MyTCBStub.rxHead - MyTCBStub.bufferRxStart);
+	if(wLength)
+		TCPRAMCopy(ptrDest, TCP_ETH_RAM, ptrSource, MyTCBStub.vMemoryMedium, wLength);
 }
 
-
+#if TCP_MAX_IOVS
 /*****************************************************************************
   Function:
-	BOOL TCPGet(TCP_SOCKET hTCP, BYTE* byte)
+	static BOOL TCPIovMap(void)
+
+  Summary:
+	Reserves TX FIFO space for queued TCPPutIov() buffers.
 
   Description:
-	Retrieves a single byte to a TCP socket.
+	Advances txHead over as many not yet reserved bytes of the queued 
+	buffers as the TX FIFO has room for, in queue order.  Nothing is 
+	written to the reserved space.
 
   Precondition:
-	TCP is initialized.
+	The current TCP stub is synced.
 
   Parameters:
-	hTCP - The socket from which to read.
-	byte - Pointer to location in which the read byte should be stored.
+	None
 
-  Return Values:
-	TRUE - A byte was read from the buffer.
-	FALSE - The buffer was empty, or the socket is not connected.
+  Returns:
+	TRUE if every queued byte now has space reserved, FALSE if the TX FIFO 
+	filled up first.
   ***************************************************************************/
-BOOL TCPGet(TCP_SOCKET hTCP, BYTE* byte)
+static BOOL TCPIovMap(void)
 {
-	WORD wGetReadyCount;
+	TCP_IOV_ENTRY* e;
+	BYTE i;
+	TCP_FIFO_SIZE wFree;
+	DWORD dwUnmapped;
 
-	// See if there is any data which can be read
-	wGetReadyCount = TCPIsGetReady(hTCP);
-	if(wGetReadyCount == 0u)
+	// Nothing may follow a FIN queued by TCPDisconnect()
+	if(MyTCBStub.Flags.bTXFIN)
 		return FALSE;
 
-	SyncTCBStub(hTCP);
-	
-	if(byte)
-		TCPRAMCopy((PTR_BASE)byte, TCP_PIC_RAM, MyTCBStub.rxTail, MyTCBStub.vMemoryMedium, 1);
-	if(++MyTCBStub.rxTail > MyTCBStub.bufferEnd)
-		MyTCBStub.rxTail = MyTCBStub.bufferRxStart;
-
-	// Send a window update if we've run out of data
-	if(wGetReadyCount == 1u)
-	{
-		MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
-	}
-	// If not already enabled, start a timer so a window 
-	// update will get sent to the remote node at some point
-	else if(!MyTCBStub.Flags.bTimer2Enabled)
+	for(i = 0; i < TCPIovCount[hCurrentTCP]; i++)
 	{
-		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
-	}
+		e = &TCPIovQueue[hCurrentTCP][i];
+		dwUnmapped = e->dwLen - e->dwOffset - e->wLive;
+		if(dwUnmapped == 0u)
+			continue;
 
+		if(MyTCBStub.txHead >= MyTCBStub.txTail)
+			wFree = (MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart - 1) - (MyTCBStub.txHead - MyTCBStub.txTail);
+		else
+			wFree = MyTCBStub.txTail - MyTCBStub.txHead - 1;
+		if(wFree == 0u)
+			return FALSE;
+		if(dwUnmapped < wFree)
+			wFree = (TCP_FIFO_SIZE)dwUnmapped;
+
+		// Nothing else is written between two reservations for the same 
+		// buffer, so its reserved bytes stay contiguous
+		if(e->wLive == 0u)
+			e->ptrStart = MyTCBStub.txHead;
+		e->wLive += wFree;
+		MyTCBStub.txHead += wFree;
+		if(MyTCBStub.txHead >= MyTCBStub.bufferRxStart)
+			MyTCBStub.txHead -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+
+		if(wFree != dwUnmapped)
+			return FALSE;
+	}
 
 	return TRUE;
 }
 
-
 /*****************************************************************************
   Function:
-	WORD TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, WORD len)
+	static void TCPIovAck(TCP_FIFO_SIZE wAcked)
+
+  Summary:
+	Accounts for acknowledged bytes of queued TCPPutIov() buffers.
 
   Description:
-	Reads an array of data bytes from a TCP socket's receive FIFO.  The data 
-	is removed from the FIFO in the process.
+	Drops the first wAcked bytes after txTail from the reserved ranges of 
+	the queued buffers.  Buffers that have been fully reserved and 
+	acknowledged are removed from the queue and released.
 
   Precondition:
-	TCP is initialized.
+	The current TCP stub is synced and txTail has not been advanced yet.
 
   Parameters:
-	hTCP - The socket from which data is to be read.
-	buffer - Pointer to the array to store data that was read.
-	len  - Number of bytes to be read.
+	wAcked - Number of bytes newly acknowledged
 
   Returns:
-	The number of bytes read from the socket.  If less than len, the
-	RX FIFO buffer became empty or the socket is not conected.
+	None
   ***************************************************************************/
-WORD TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, WORD len)
+static void TCPIovAck(TCP_FIFO_SIZE wAcked)
 {
-	WORD wGetReadyCount;
-	WORD RightLen = 0;
-
-	// See if there is any data which can be read
-	wGetReadyCount = TCPIsGetReady(hTCP);
-	if(wGetReadyCount == 0u)
-		return 0x0000u;
-
-	SyncTCBStub(hTCP);
-
-	// Make sure we don't try to read more data than is available
-	if(len > wGetReadyCount)
-		len = wGetReadyCount;
+	TCP_IOV_ENTRY* e;
+	TCP_IOV_ENTRY vDone;
+	TCP_FIFO_SIZE wStart, wLen;
+	BYTE i;
 
-	// See if we need a two part get
-	if(MyTCBStub.rxTail + len > MyTCBStub.bufferEnd)
+	while(TCPIovCount[hCurrentTCP])
 	{
-		RightLen = MyTCBStub.bufferEnd - MyTCBStub.rxTail + 1;
-		if(buffer)
+		e = &TCPIovQueue[hCurrentTCP][0];
+		if(e->wLive)
 		{
-			TCPRAMCopy((PTR_BASE)buffer, TCP_PIC_RAM, MyTCBStub.rxTail, MyTCBStub.vMemoryMedium, RightLen);
-			buffer += RightLen;
+			wStart = e->ptrStart - MyTCBStub.txTail;
+			if(e->ptrStart < MyTCBStub.txTail)
+				wStart += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+			if(wStart >= wAcked)
+				return;
+
+			wLen = wAcked - wStart;
+			if(wLen > e->wLive)
+				wLen = e->wLive;
+			e->wLive -= wLen;
+			e->dwOffset += wLen;
+			e->ptrStart += wLen;
+			if(e->ptrStart >= MyTCBStub.bufferRxStart)
+				e->ptrStart -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
 		}
-		len -= RightLen;
-		MyTCBStub.rxTail = MyTCBStub.bufferRxStart;
-	}
 
-	if(buffer)
-		TCPRAMCopy((PTR_BASE)buffer, TCP_PIC_RAM, MyTCBStub.rxTail, MyTCBStub.vMemoryMedium, len);
-	MyTCBStub.rxTail += len;
-	len += RightLen;
+		if(e->wLive || (e->dwOffset != e->dwLen))
+			return;
 
-	// Send a window update if we've run low on data
-	if(wGetReadyCount - len <= len)
-	{
-		MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
-	}
-	else if(!MyTCBStub.Flags.bTimer2Enabled)
-	// If not already enabled, start a timer so a window 
-	// update will get sent to the remote node at some point
-	{
-		MyTCBStub.Flags.bTimer2Enabled = TRUE;
-		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
+		// Remove it from the queue before releasing it
+		vDone = *e;
+		TCPIovCount[hCurrentTCP]--;
+		for(i = 0; i < TCPIovCount[hCurrentTCP]; i++)
+			TCPIovQueue[hCurrentTCP][i] = TCPIovQueue[hCurrentTCP][i+1];
+		if(vDone.fRelease)
+			vDone.fRelease(hCurrentTCP, vDone.pContext);
 	}
-
-	return len;
 }
 
-
 /*****************************************************************************
   Function:
-	WORD TCPGetRxFIFOFree(TCP_SOCKET hTCP)
+	static void TCPIovReleaseAll(void)
+
+  Summary:
+	Releases every queued TCPPutIov() buffer of the current socket.
 
   Description:
-	Determines how many bytes are free in the RX FIFO.
+	Empties the current socket's TCPPutIov() queue, calling each buffer's 
+	release callback, oldest first.  Any space they had reserved in the TX 
+	FIFO must be discarded by the caller.
 
   Precondition:
-	TCP is initialized.
+	The current TCP stub is synced.
 
   Parameters:
-	hTCP - The socket to check.
+	None
 
   Returns:
-	The number of bytes free in the TCP RX FIFO.  If zero, no additional 
-	data can be received until the application removes some data using one
-	of the TCPGet family functions.
+	None
   ***************************************************************************/
-WORD TCPGetRxFIFOFree(TCP_SOCKET hTCP)
+static void TCPIovReleaseAll(void)
 {
-	WORD wDataLen;
-	WORD wFIFOSize;
-	
-	if(hTCP >= TCP_SOCKET_COUNT)
-    {
-        return 0;
-    }
-    
-	SyncTCBStub(hTCP);
-	
-	// Calculate total usable FIFO size
-	wFIFOSize = MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart;
-
-	#if defined(STACK_USE_SSL)
-	{
-		PTR_BASE SSLtemp = MyTCBStub.rxHead;
-
-		// Move SSL pointer to determine full buffer size
-		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
-			MyTCBStub.rxHead = MyTCBStub.sslRxHead;
+	TCP_IOV_ENTRY vDone;
+	BYTE i;
 
-		// Find out how many data bytes are actually in the RX FIFO
-		wDataLen = TCPIsGetReady(hTCP);
-		
-		// Move SSL pointer back to proper location (if we changed it)
-		MyTCBStub.rxHead = SSLtemp;
-	}
-	#else
+	while(TCPIovCount[hCurrentTCP])
 	{
-		// Find out how many data bytes are actually in the RX FIFO
-		wDataLen = TCPIsGetReady(hTCP);
+		vDone = TCPIovQueue[hCurrentTCP][0];
+		TCPIovCount[hCurrentTCP]--;
+		for(i = 0; i < TCPIovCount[hCurrentTCP]; i++)
+			TCPIovQueue[hCurrentTCP][i] = TCPIovQueue[hCurrentTCP][i+1];
+		if(vDone.fRelease)
+			vDone.fRelease(hCurrentTCP, vDone.pContext);
 	}
-	#endif
-	
-	// Perform the calculation	
-	return wFIFOSize - wDataLen;
 }
+#endif
 
 /*****************************************************************************
   Function:
-	WORD TCPPeekArray(TCP_SOCKET hTCP, BYTE *vBuffer, WORD wLen, WORD wStart)
-
-  Summary:
-  	Reads a specified number of data bytes from the TCP RX FIFO without 
-  	removing them from the buffer.
+	BYTE* TCPPutString(TCP_SOCKET hTCP, BYTE* data)
 
   Description:
-	Reads a specified number of data bytes from the TCP RX FIFO without 
-  	removing them from the buffer.  No TCP control actions are taken as a 
-  	result of this function (ex: no window update is sent to the remote node).
-  	
+	Writes a null-terminated string from RAM to a TCP socket.  The 
+	null-terminator is not copied to the socket.
+
   Precondition:
 	TCP is initialized.
 
   Parameters:
-	hTCP - The socket to peak from (read without removing from stream).
-	vBuffer - Destination to write the peeked data bytes.
-	wLen - Length of bytes to peak from the RX FIFO and copy to vBuffer.
-	wStart - Zero-indexed starting position within the FIFO to start peeking 
-		from.
+	hTCP - The socket to which data is to be written.
+	data - Pointer to the string to be written.
 
-  Return Values:
-	Number of bytes actually peeked from the stream and copied to vBuffer.  
-	This value can be less than wLen if wStart + wLen is greater than the 
-	deepest possible character in the RX FIFO.
+  Returns:
+	Pointer to the byte following the last byte written to the socket.  If
+	this pointer does not dereference to a NUL byte, the buffer became full
+	or the socket is not connected.
 
   Remarks:
-  	None
+	The return value of this function differs from that of TCPPutArray.  To
+	write long strings in a single state, initialize the *data pointer to the
+	first byte, then call this function repeatedly (breaking to the main 
+	stack loop after each call) until the return value dereferences to a NUL
+	byte.  Save the return value as the new starting *data pointer otherwise.
   ***************************************************************************/
-WORD TCPPeekArray(TCP_SOCKET hTCP, BYTE *vBuffer, WORD wLen, WORD wStart)
+BYTE* TCPPutString(TCP_SOCKET hTCP, BYTE* data)
 {
-	PTR_BASE ptrRead;
-	WORD w;
-	WORD wBytesUntilWrap;
-
-	if(hTCP >= TCP_SOCKET_COUNT || wLen == 0)
-    {
-        return 0;
-    }
-    
-	SyncTCBStub(hTCP);
-
-	// Find out how many bytes are in the RX FIFO and decrease read length 
-	// if the start offset + read length is beyond the end of the FIFO
-	w = TCPIsGetReady(hTCP);
-	if(wStart + wLen > w)
-		wLen = w - wStart;
-
-	// Find the read start location
-	ptrRead = MyTCBStub.rxTail + wStart;
-	if(ptrRead > MyTCBStub.bufferEnd)
-		ptrRead -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;
-
-	// Calculate how many bytes can be read in a single go
-	wBytesUntilWrap = MyTCBStub.bufferEnd - ptrRead + 1;
-	if(wLen <= wBytesUntilWrap)
-	{
-		// Read all at once
-		TCPRAMCopy((PTR_BASE)vBuffer, TCP_PIC_RAM, ptrRead, MyTCBStub.vMemoryMedium, wLen);
-	}
-	else
-	{
-		// Read all bytes up to the wrap position and then read remaining bytes 
-		// at the start of the buffer
-		TCPRAMCopy((PTR_BASE)vBuffer, TCP_PIC_RAM, ptrRead, MyTCBStub.vMemoryMedium, wBytesUntilWrap);
-		TCPRAMCopy((PTR_BASE)vBuffer+wBytesUntilWrap, TCP_PIC_RAM, MyTCBStub.bufferRxStart, MyTCBStub.vMemoryMedium, wLen - wBytesUntilWrap);
-	}
-	
-	return wLen;
+	return data + TCPPutArray(hTCP, data, strlen((char*)data));
 }
 
 /*****************************************************************************
   Function:
-	BYTE TCPPeek(TCP_SOCKET hTCP, WORD wStart)
-
-  Summary:
-  	Peaks at one byte in the TCP RX FIFO without removing it from the buffer.
+	BYTE* TCPPutROMString(TCP_SOCKET hTCP, ROM BYTE* data)
 
   Description:
-	Peaks at one byte in the TCP RX FIFO without removing it from the buffer.
-  	
+	Writes a null-terminated string from ROM to a TCP socket.  The 
+	null-terminator is not copied to the socket.
+
   Precondition:
 	TCP is initialized.
 
   Parameters:
-	hTCP - The socket to peak from (read without removing from stream).
-	wStart - Zero-indexed starting position within the FIFO to peek from.
+	hTCP - The socket to which data is to be written.
+	data - Pointer to the string to be written.
 
-  Return Values:
-	Byte peeked from the RX FIFO.  If there is no data in the buffer or an 
-	illegal wStart starting offset is given, then an indeterminate value is 
-	returned.  The caller must ensure that valid parameters are passed to avoid 
-	(i.e ensure that TCPIsGetReady() returns a number that is less than wStart 
-	before calling TCPPeek()).
+  Returns:
+	Pointer to the byte following the last byte written to the socket.  If
+	this pointer does not dereference to a NUL byte, the buffer became full
+	or the socket is not connected.
 
   Remarks:
-  	Use the TCPPeekArray() function to read more than one byte.  It will 
-  	perform better than calling TCPPeek() in a loop.
+	The return value of this function differs from that of TCPPutArray.  To
+	write long strings in a single state, initialize the *data pointer to the
+	first byte, then call this function repeatedly (breaking to the main 
+	stack loop after each call) until the return value dereferences to a NUL
+	byte.  Save the return value as the new starting *data pointer otherwise.
+	
+	This function is aliased to TCPPutString on non-PIC18 platforms.
   ***************************************************************************/
-BYTE TCPPeek(TCP_SOCKET hTCP, WORD wStart)
+#if defined(__18CXX)
+ROM BYTE* TCPPutROMString(TCP_SOCKET hTCP, ROM BYTE* data)
 {
-	BYTE i;
-	
-	TCPPeekArray(hTCP, &i, 1, wStart);
-	return i;
+	return data + TCPPutROMArray(hTCP, data, strlenpgm((ROM char*)data));
 }
-
-
-/****************************************************************************
-  Section:
-	Search Functions
-  ***************************************************************************/
+#endif
 
 /*****************************************************************************
   Function:
-	WORD TCPFindArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, 
-						WORD wStart, WORD wSearchLen, BOOL bTextCompare)
-
-  Summary:
-  	Searches for a string in the TCP RX buffer.
+	TCP_FIFO_SIZE TCPGetTxFIFOFull(TCP_SOCKET hTCP)
 
   Description:
-	This function finds the first occurrance of an array of bytes in the
-	TCP RX buffer.  It can be used by an application to abstract searches 
-	out of their own application code.  For increased efficiency, the 
-	function is capable of limiting the scope of search to a specific
-	range of bytes.  It can also perform a case-insensitive search if
-	required.
-	
-	For example, if the buffer contains "I love PIC MCUs!" and the search
-	array is "love" with a length of 4, a value of 2 will be returned.
+	Determines how many bytes are pending in the TCP TX FIFO.
 
   Precondition:
 	TCP is initialized.
 
   Parameters:
-	hTCP - The socket to search within.
-	cFindArray - The array of bytes to find in the buffer.
-	wLen - Length of cFindArray.
-	wStart - Zero-indexed starting position within the buffer.
-	wSearchLen - Length from wStart to search in the buffer.
-	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
-
-  Return Values:
-	0xFFFF - Search array not found
-	Otherwise - Zero-indexed position of the first occurrance
+	hTCP - The socket to check.
 
-  Remarks:
-	Since this function usually must transfer data from external storage
-	to internal RAM for comparison, its performance degrades significantly
-	when the buffer is full and the array is not found.  For better 
-	performance, try to search for characters that are expected to exist or
-	limit the scope of the search as much as possible.  The HTTP2 module, 
-	for example, uses this function to parse headers.  However, it searches 
-	for newlines, then the separating colon, then reads the header name to 
-	RAM for final comparison.  This has proven to be significantly faster  
-	than searching for full header name strings outright.
+  Returns:
+	Number of bytes pending to be flushed in the TCP TX FIFO.
   ***************************************************************************/
-WORD TCPFindArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+TCP_FIFO_SIZE TCPGetTxFIFOFull(TCP_SOCKET hTCP)
 {
-	PTR_BASE ptrRead;
-	WORD wDataLen;
-	WORD wBytesUntilWrap;
-	PTR_BASE ptrLocation;
-	WORD wLenStart;
-	BYTE *cFindArrayStart;
-	BYTE i, j, k;
-	BOOL isFinding;
-	BYTE buffer[32];
+	TCP_FIFO_SIZE wDataLen;
+	TCP_FIFO_SIZE wFIFOSize;
 
-	if(hTCP >= TCP_SOCKET_COUNT || wLen == 0)
+	if(hTCP >= TCP_SOCKET_COUNT)
     {
         return 0;
     }
     
 	SyncTCBStub(hTCP);
 
-	// Find out how many bytes are in the RX FIFO and return 
-	// immediately if we won't possibly find a match
-	wDataLen = TCPIsGetReady(hTCP) - wStart;
-	if(wDataLen < wLen)
-		return 0xFFFFu;
-	if(wSearchLen && (wDataLen > wSearchLen))
-		wDataLen = wSearchLen;
+	// Calculate total usable FIFO size
+	wFIFOSize = MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart - 1;
 
-	ptrLocation = MyTCBStub.rxTail + wStart;
-	if(ptrLocation > MyTCBStub.bufferEnd)
-		ptrLocation -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;
-	ptrRead = ptrLocation;
-	wBytesUntilWrap = MyTCBStub.bufferEnd - ptrLocation + 1;
-	ptrLocation = wStart;
-	wLenStart = wLen;
-	cFindArrayStart = cFindArray;
-	j = *cFindArray++;
-	isFinding = FALSE;
-	if(bTextCompare)
-	{
-		if(j >= 'a' && j <= 'z')
-			j += 'A'-'a';
-	}
+	// Find out how many data bytes are free in the TX FIFO
+	wDataLen = TCPIsPutReady(hTCP);
 
-	// Search for the array
-	while(1)
-	{
-		// Figure out how big of a chunk to read
-		k = sizeof(buffer);
-		if(k > wBytesUntilWrap)
-			k = wBytesUntilWrap;
-		if((WORD)k > wDataLen)
-			k = wDataLen;
+	return wFIFOSize - wDataLen;
+}
 
-		// Read a chunk of data into the buffer
-		TCPRAMCopy((PTR_BASE)buffer, TCP_PIC_RAM, ptrRead, MyTCBStub.vMemoryMedium, (WORD)k);
-		ptrRead += k;
-		wBytesUntilWrap -= k;
+/*****************************************************************************
+  Function:
+	DWORD TCPGetRTT(TCP_SOCKET hTCP)
 
-		if(wBytesUntilWrap == 0u)
-		{
-			ptrRead = MyTCBStub.bufferRxStart;
-			wBytesUntilWrap = 0xFFFFu;
-		}
+  Summary:
+	Determines the smoothed round trip time of a connection.
 
-		// Convert everything to uppercase
-		if(bTextCompare)
-		{
-			for(i = 0; i < k; i++)
-			{
-				if(buffer[i] >= 'a' && buffer[i] <= 'z')
-					buffer[i] += 'A'-'a';
+  Description:
+	Returns the smoothed round trip time (SRTT) that the retransmission 
+	timeout for this socket is currently based on.  The estimate is updated 
+	from one timed segment per round trip, following RFC 6298.  Segments 
+	that have been retransmitted are never timed (Karn's algorithm).
 
-				if(j == buffer[i])
-				{
-					if(--wLen == 0u)
-						return ptrLocation-wLenStart + i + 1;
-					j = *cFindArray++;
-					isFinding = TRUE;
-					if(j >= 'a' && j <= 'z')
-						j += 'A'-'a';
-				}
-				else
-				{
-					wLen = wLenStart;
-					if(isFinding)
-					{
-						cFindArray = cFindArrayStart;
-						j = *cFindArray++;
-						if(j >= 'a' && j <= 'z')
-							j += 'A'-'a';
-						isFinding = FALSE;
-					}
-				}
-			}
-		}
-		else	// Compare as is
-		{
-			for(i = 0; i < k; i++)
-			{
-				if(j == buffer[i])
-				{
-					if(--wLen == 0u)
-						return ptrLocation-wLenStart + i + 1;
-					j = *cFindArray++;
-					isFinding = TRUE;
-				}
-				else
-				{
-					wLen = wLenStart;
-					if(isFinding)
-					{
-						cFindArray = cFindArrayStart;
-						j = *cFindArray++;
-						isFinding = FALSE;
-					}
-				}
-			}
-		}
+  Precondition:
+	TCP is initialized.
 
-		// Check to see if it is impossible to find a match
-		wDataLen -= k;
-		if(wDataLen < wLen)
-			return 0xFFFFu;
+  Parameters:
+	hTCP - The socket to check.
 
-		ptrLocation += k;
-	}
+  Returns:
+	Smoothed round trip time in ticks, or 0 if no sample has been taken 
+	yet on the current connection.
+  ***************************************************************************/
+DWORD TCPGetRTT(TCP_SOCKET hTCP)
+{
+	if(hTCP >= TCP_SOCKET_COUNT)
+    {
+        return 0;
+    }
+
+	SyncTCBStub(hTCP);
+	SyncTCBForRead();
+
+	return MyTCB.dwSRTT >> 3;
 }
 
+#if defined(STACK_USE_TCP_STATS)
 /*****************************************************************************
   Function:
-	WORD TCPFindROMArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, 
-						WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+	BOOL TCPGetStats(TCP_SOCKET hTCP, TCP_SOCKET_STATS* pStats, 
+						TCP_STACK_STATS* pTotals)
 
   Summary:
-  	Searches for a ROM string in the TCP RX buffer.
+	Reads the TCP statistics counters.
 
   Description:
-	This function finds the first occurrance of an array of bytes in the
-	TCP RX buffer.  It can be used by an application to abstract searches 
-	out of their own application code.  For increased efficiency, the 
-	function is capable of limiting the scope of search to a specific
-	range of bytes.  It can also perform a case-insensitive search if
-	required.
+	Copies the counters kept for hTCP into pStats and the stack-wide totals 
+	into pTotals.  The time spent in the current state is credited up to 
+	now first, and the window, RTT and FIFO fields are filled in with their 
+	current values.  Either pointer may be NULL.
 	
-	For example, if the buffer contains "I love PIC MCUs!" and the search
-	array is "love" with a length of 4, a value of 2 will be returned.
+	The counters are meant to tell where throughput is lost: many 
+	retransmissions or duplicate ACKs point at the network, zero windows 
+	at a slow remote reader, and frequent dwTXFIFOFull at a TX FIFO that 
+	is too small for the round trip time.
 
   Precondition:
 	TCP is initialized.
 
   Parameters:
-	hTCP - The socket to search within.
-	cFindArray - The array of bytes to find in the buffer.
-	wLen - Length of cFindArray.
-	wStart - Zero-indexed starting position within the buffer.
-	wSearchLen - Length from wStart to search in the buffer.
-	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
+	hTCP - The socket to read, ignored if pStats is NULL
+	pStats - Where to store the socket's counters, or NULL
+	pTotals - Where to store the stack-wide totals, or NULL
 
   Return Values:
-	0xFFFF - Search array not found
-	Otherwise - Zero-indexed position of the first occurrance
+	TRUE - The counters were copied
+	FALSE - hTCP is invalid
 
   Remarks:
-	Since this function usually must transfer data from external storage
-	to internal RAM for comparison, its performance degrades significantly
-	when the buffer is full and the array is not found.  For better 
-	performance, try to search for characters that are expected to exist or
-	limit the scope of the search as much as possible.  The HTTP2 module, 
-	for example, uses this function to parse headers.  However, it searches 
-	for newlines, then the separating colon, then reads the header name to 
-	RAM for final comparison.  This has proven to be significantly faster  
-	than searching for full header name strings outright.
-	
-	This function is aliased to TCPFindArrayEx on non-PIC18 platforms.
+	Only available when STACK_USE_TCP_STATS is defined.  Otherwise this 
+	function is a macro that evaluates to FALSE and leaves the structures 
+	untouched.  TCP_SOCKET_STATS and TCP_STACK_STATS are declared either 
+	way.
   ***************************************************************************/
-#if defined(__18CXX)
-WORD TCPFindROMArrayEx(TCP_SOCKET hTCP, ROM BYTE* cFindArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+BOOL TCPGetStats(TCP_SOCKET hTCP, TCP_SOCKET_STATS* pStats, TCP_STACK_STATS* pTotals)
 {
-	PTR_BASE ptrRead;
-	WORD wDataLen;
-	WORD wBytesUntilWrap;
-	PTR_BASE ptrLocation;
-	WORD wLenStart;
-	ROM BYTE *cFindArrayStart;
-	BYTE i, j, k;
-	BOOL isFinding;
-	BYTE buffer[32];
+	if(pTotals)
+		memcpy((void*)pTotals, (void*)&TCPStackStats, sizeof(TCP_STACK_STATS));
 
-	if(hTCP >= TCP_SOCKET_COUNT || wLen == 0)
+	if(!pStats)
+		return TRUE;
+
+	if(hTCP >= TCP_SOCKET_COUNT)
     {
-        return 0;
+        return FALSE;
     }
-    
+
 	SyncTCBStub(hTCP);
+	SyncTCBForRead();
+	TCPStatsSyncState();
 
-	// Find out how many bytes are in the RX FIFO and return 
-	// immediately if we won't possibly find a match
-	wDataLen = TCPIsGetReady(hTCP) - wStart;
-	if(wDataLen < wLen)
-		return 0xFFFFu;
-	if(wSearchLen && (wDataLen > wSearchLen))
-		wDataLen = wSearchLen;
+	memcpy((void*)pStats, (void*)&TCPStats[hTCP], sizeof(TCP_SOCKET_STATS));
+	pStats->dwSRTT = MyTCB.dwSRTT >> 3;
+	pStats->dwRTO = MyTCB.dwRTO;
+	pStats->wTXUsed = TCPGetTxFIFOFull(hTCP);
+	pStats->wRXUsed = TCPIsGetReady(hTCP);
 
-	ptrLocation = MyTCBStub.rxTail + wStart;
-	if(ptrLocation > MyTCBStub.bufferEnd)
-		ptrLocation -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;
-	ptrRead = ptrLocation;
-	wBytesUntilWrap = MyTCBStub.bufferEnd - ptrLocation + 1;
-	ptrLocation = wStart;
-	wLenStart = wLen;
-	cFindArrayStart = cFindArray;
-	j = *cFindArray++;
-	isFinding = FALSE;
-	if(bTextCompare)
-	{
-		if(j >= 'a' && j <= 'z')
-			j += 'A'-'a';
-	}
+	return TRUE;
+}
 
-	// Search for the array
-	while(1)
-	{
-		// Figure out how big of a chunk to read
-		k = sizeof(buffer);
-		if(k > wBytesUntilWrap)
-			k = wBytesUntilWrap;
-		if((WORD)k > wDataLen)
-			k = wDataLen;
-
-		// Read a chunk of data into the buffer
-		TCPRAMCopy((PTR_BASE)buffer, TCP_PIC_RAM, ptrRead, MyTCBStub.vMemoryMedium, (WORD)k);
-		ptrRead += k;
-		wBytesUntilWrap -= k;
+/*****************************************************************************
+  Function:
+	static void TCPStatsReset(void)
 
-		if(wBytesUntilWrap == 0u)
-		{
-			ptrRead = MyTCBStub.bufferRxStart;
-			wBytesUntilWrap = 0xFFFFu;
-		}
+  Summary:
+	Clears the current socket's statistics.
 
-		// Convert everything to uppercase
-		if(bTextCompare)
-		{
-			for(i = 0; i < k; i++)
-			{
-				if(buffer[i] >= 'a' && buffer[i] <= 'z')
-					buffer[i] += 'A'-'a';
+  Description:
+	Zeroes the current socket's counters and starts timing its current 
+	state.  Called by TCPInit() and TCPOpen().
 
-				if(j == buffer[i])
-				{
-					if(--wLen == 0u)
-						return ptrLocation-wLenStart + i + 1;
-					j = *cFindArray++;
-					isFinding = TRUE;
-					if(j >= 'a' && j <= 'z')
-						j += 'A'-'a';
-				}
-				else
-				{
-					wLen = wLenStart;
-					if(isFinding)
-					{
-						cFindArray = cFindArrayStart;
-						j = *cFindArray++;
-						if(j >= 'a' && j <= 'z')
-							j += 'A'-'a';
-						isFinding = FALSE;
-					}
-				}
-			}
-		}
-		else	// Compare as is
-		{
-			for(i = 0; i < k; i++)
-			{
-				if(j == buffer[i])
-				{
-					if(--wLen == 0u)
-						return ptrLocation-wLenStart + i + 1;
-					j = *cFindArray++;
-					isFinding = TRUE;
-				}
-				else
-				{
-					wLen = wLenStart;
-					if(isFinding)
-					{
-						cFindArray = cFindArrayStart;
-						j = *cFindArray++;
-						isFinding = FALSE;
-					}
-				}
-			}
-		}
+  Precondition:
+	The current TCP stub is already synced.
 
-		// Check to see if it is impossible to find a match
-		wDataLen -= k;
-		if(wDataLen < wLen)
-			return 0xFFFFu;
+  Parameters:
+	None
 
-		ptrLocation += k;
-	}
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPStatsReset(void)
+{
+	memset((void*)&TCPStats[hCurrentTCP], 0x00, sizeof(TCP_SOCKET_STATS));
+	TCPStats[hCurrentTCP].dwMinRemoteWindow = 0xFFFFFFFFul;
+	TCPStatsStateTime[hCurrentTCP] = TickGet();
+	TCPStatsState[hCurrentTCP] = MyTCBStub.smState;
 }
-#endif
-
 
 /*****************************************************************************
   Function:
-	WORD TCPFindEx(TCP_SOCKET hTCP, BYTE cFind,
-						WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+	static void TCPStatsSyncState(void)
 
   Summary:
-  	Searches for a byte in the TCP RX buffer.
+	Credits the time since the last call to the state it was spent in.
 
   Description:
-	This function finds the first occurrance of a byte in the TCP RX
-	buffer.  It can be used by an application to abstract searches 
-	out of their own application code.  For increased efficiency, the 
-	function is capable of limiting the scope of search to a specific
-	range of bytes.  It can also perform a case-insensitive search if
-	required.
-	
-	For example, if the buffer contains "I love PIC MCUs!" and the cFind
-	byte is ' ', a value of 1 will be returned.
+	Adds the ticks since the current socket's state was last checked to 
+	the state it was in then, and records the state it is in now.  Called 
+	after anything that can change smState: SendTCP(), HandleTCPSeg(), 
+	TCPTickSocket(), TCPOpen() and CloseSocket().  A state change made 
+	elsewhere, such as by TCPDisconnect() without sending, is credited the 
+	next time one of these runs for the socket.
 
   Precondition:
-	TCP is initialized.
+	The current TCP stub is already synced.
 
   Parameters:
-	hTCP - The socket to search within.
-	cFind - The byte to find in the buffer.
-	wStart - Zero-indexed starting position within the buffer.
-	wSearchLen - Length from wStart to search in the buffer.
-	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
+	None
 
-  Return Values:
-	0xFFFF - Search array not found
-	Otherwise - Zero-indexed position of the first occurrance
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPStatsSyncState(void)
+{
+	DWORD dwNow;
 
-  Remarks:
-	Since this function usually must transfer data from external storage
-	to internal RAM for comparison, its performance degrades significantly
-	when the buffer is full and the array is not found.  For better 
-	performance, try to search for characters that are expected to exist or
-	limit the scope of the search as much as possible.  The HTTP2 module, 
-	for example, uses this function to parse headers.  However, it searches 
-	for newlines, then the separating colon, then reads the header name to 
-	RAM for final comparison.  This has proven to be significantly faster  
-	than searching for full header name strings outright.
+	dwNow = TickGet();
+	TCPStats[hCurrentTCP].dwStateTicks[TCPStatsState[hCurrentTCP]] += dwNow - TCPStatsStateTime[hCurrentTCP];
+	TCPStatsStateTime[hCurrentTCP] = dwNow;
+	TCPStatsState[hCurrentTCP] = MyTCBStub.smState;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPStatsWindow(DWORD dwWindow)
+
+  Summary:
+	Records a window advertised by the remote node.
+
+  Description:
+	Updates the current socket's current, smallest and largest remote 
+	window and counts a zero window event if the window just closed.
+
+  Precondition:
+	The current TCP stub is already synced.
+
+  Parameters:
+	dwWindow - Advertised window, after window scaling
+
+  Returns:
+	None
   ***************************************************************************/
-WORD TCPFindEx(TCP_SOCKET hTCP, BYTE cFind, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+static void TCPStatsWindow(DWORD dwWindow)
 {
-	return TCPFindArrayEx(hTCP, &cFind, sizeof(cFind), wStart, wSearchLen, bTextCompare);
+	TCP_SOCKET_STATS* pStats;
+
+	pStats = &TCPStats[hCurrentTCP];
+	if((dwWindow == 0u) && (pStats->dwRemoteWindow || (pStats->dwMinRemoteWindow == 0xFFFFFFFFul)))
+		TCPStatsCount(dwZeroWindows);
+	pStats->dwRemoteWindow = dwWindow;
+	if(dwWindow < pStats->dwMinRemoteWindow)
+		pStats->dwMinRemoteWindow = dwWindow;
+	if(dwWindow > pStats->dwMaxRemoteWindow)
+		pStats->dwMaxRemoteWindow = dwWindow;
 }
+#endif
+
 
 
 
 /****************************************************************************
   Section:
-	Data Processing Functions
+	Receive Functions
   ***************************************************************************/
 
 /*****************************************************************************
   Function:
-	void TCPTick(void)
-
-  Summary:
-  	Performs periodic TCP tasks.
+	void TCPDiscard(TCP_SOCKET hTCP)
 
   Description:
-	This function performs any required periodic TCP tasks.  Each 
-	socket's state machine is checked, and any elapsed timeout periods
-	are handled.
+	Discards any pending data in the TCP RX FIFO.
 
   Precondition:
 	TCP is initialized.
 
   Parameters:
-	None
+	hTCP - The socket whose RX FIFO is to be cleared.
 
   Returns:
 	None
   ***************************************************************************/
-void TCPTick(void)
+void TCPDiscard(TCP_SOCKET hTCP)
 {
-	TCP_SOCKET hTCP;
-	BOOL bRetransmit;
-	BOOL bCloseSocket;
-	BYTE vFlags;
-	WORD w;
-
-	// Periodically all "not closed" sockets must perform timed operations
-	for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++)
+	if(TCPIsGetReady(hTCP))
 	{
 		SyncTCBStub(hTCP);
-		
-		// Handle any SSL Processing and Message Transmission
-		#if defined(STACK_USE_SSL)
-		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
-		{
-			// Handle any periodic tasks, such as RSA operations
-			SSLPeriodic(hTCP, MyTCBStub.sslStubID);
-			
-			// If unsent data is waiting, transmit it as an application record
-			if(MyTCBStub.sslTxHead != MyTCBStub.txHead && TCPSSLGetPendingTxSize(hTCP) != 0u)
-				SSLTxRecord(hTCP, MyTCBStub.sslStubID, SSL_APPLICATION);
-			
-			// If an SSL message is requested, send it now
-			if(MyTCBStub.sslReqMessage != SSL_NO_MESSAGE)
-				SSLTxMessage(hTCP, MyTCBStub.sslStubID, MyTCBStub.sslReqMessage);
-		}
-		#endif
-		
-		vFlags = 0x00;
-		bRetransmit = FALSE;
-		bCloseSocket = FALSE;
+	
+		// Delete all data in the RX buffer
+		MyTCBStub.rxTail = MyTCBStub.rxHead;
+	
+		// Send a Window update message to the remote node
+		SendTCP(ACK, SENDTCP_RESET_TIMERS);
+	}
+}
 
-		// Transmit ASAP data if the medium is available
-		if(MyTCBStub.Flags.bTXASAP || MyTCBStub.Flags.bTXASAPWithoutTimerReset)
-		{
-			if(MACIsTxReady())
-			{
-				vFlags = ACK;
-				bRetransmit = MyTCBStub.Flags.bTXASAPWithoutTimerReset;
-			}
-		}
 
-		// Perform any needed window updates and data transmissions
-		if(MyTCBStub.Flags.bTimer2Enabled)
-		{
-			// See if the timeout has occured, and we need to send a new window update and pending data
-			if((SHORT)(MyTCBStub.eventTime2 - (WORD)TickGetDiv256()) <= (SHORT)0)
-				vFlags = ACK;
-		}
+/*****************************************************************************
+  Function:
+	TCP_FIFO_SIZE TCPIsGetReady(TCP_SOCKET hTCP)
 
-		// Process Delayed ACKnowledgement timer
-		if(MyTCBStub.Flags.bDelayedACKTimerEnabled)
-		{
-			// See if the timeout has occured and delayed ACK needs to be sent
-			if((SHORT)(MyTCBStub.OverlappedTimers.delayedACKTime - (WORD)TickGetDiv256()) <= (SHORT)0)
-				vFlags = ACK;
-		}
-		
-		// Process TCP_CLOSE_WAIT timer
-		if(MyTCBStub.smState == TCP_CLOSE_WAIT)
-		{
-			// Automatically close the socket on our end if the application 
-			// fails to call TCPDisconnect() is a reasonable amount of time.
-			if((SHORT)(MyTCBStub.OverlappedTimers.closeWaitTime - (WORD)TickGetDiv256()) <= (SHORT)0)
-			{
-				vFlags = FIN | ACK;
-				MyTCBStub.smState = TCP_LAST_ACK;
-			}
-		}
+  Summary:
+	Determines how many bytes can be read from the TCP RX buffer.
 
-		// Process listening server sockets that might have a SYN waiting in the SYNQueue[]
-		#if TCP_SYN_QUEUE_MAX_ENTRIES
-			if(MyTCBStub.smState == TCP_LISTEN)
-			{
-				for(w = 0; w < TCP_SYN_QUEUE_MAX_ENTRIES; w++)
-				{
-					// Abort search if there are no more valid records
-					if(SYNQueue[w].wDestPort == 0u)
-						break;
-					
-					// Stop searching if this SYN queue entry can be used by this socket
-					#if defined(STACK_USE_SSL_SERVER)
-					if(SYNQueue[w].wDestPort == MyTCBStub.remoteHash.Val || SYNQueue[w].wDestPort == MyTCBStub.sslTxHead)
-					#else
-					if(SYNQueue[w].wDestPort == MyTCBStub.remoteHash.Val)
-					#endif
-					{
-						// Set up our socket and generate a reponse SYN+ACK packet
-						SyncTCB();
-						
-						#if defined(STACK_USE_SSL_SERVER)
-						// If this matches the SSL port, make sure that can be configured
-						// before continuing.  If not, break and leave this in the queue
-						if(SYNQueue[w].wDestPort == MyTCBStub.sslTxHead && !TCPStartSSLServer(hTCP))
-							break;
-						#endif
-						
-						memcpy((void*)&MyTCB.remote.niRemoteMACIP, (void*)&SYNQueue[w].niSourceAddress, sizeof(NODE_INFO));
-						MyTCB.remotePort.Val = SYNQueue[w].wSourcePort;
-						MyTCB.RemoteSEQ = SYNQueue[w].dwSourceSEQ + 1;
-						MyTCBStub.remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1] + MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
-						vFlags = SYN | ACK;
-						MyTCBStub.smState = TCP_SYN_RECEIVED;
-						
-						// Delete this SYN from the SYNQueue and compact the SYNQueue[] array
-						TCPRAMCopy((PTR_BASE)&SYNQueue[w], TCP_PIC_RAM, (PTR_BASE)&SYNQueue[w+1], TCP_PIC_RAM, (TCP_SYN_QUEUE_MAX_ENTRIES-1u-w)*sizeof(TCP_SYN_QUEUE));
-						SYNQueue[TCP_SYN_QUEUE_MAX_ENTRIES-1].wDestPort = 0u;
-	
-						break;
-					}
-				}
-			}
-		#endif
+  Description:
+	Call this function to determine how many bytes can be read from the 
+	TCP RX buffer.  If this function returns zero, the application must 
+	return to the main stack loop before continuing in order to wait for
+	more data to arrive.
 
-		if(vFlags)
-			SendTCP(vFlags, bRetransmit ? 0 : SENDTCP_RESET_TIMERS);
+  Precondition:
+	TCP is initialized.
 
-		// The TCP_CLOSED, TCP_LISTEN, and sometimes the TCP_ESTABLISHED 
-		// state don't need any timeout events, so see if the timer is enabled
-		if(!MyTCBStub.Flags.bTimerEnabled)
-		{
-			#if defined(TCP_KEEP_ALIVE_TIMEOUT)
-				// Only the established state has any use for keep-alives
-				if(MyTCBStub.smState == TCP_ESTABLISHED)
-				{
-					// If timeout has not occured, do not do anything.
-					if((LONG)(TickGet() - MyTCBStub.eventTime) < (LONG)0)
-						continue;
-		
-					// If timeout has occured and the connection appears to be dead (no 
-					// responses from remote node at all), close the connection so the 
-					// application doesn't sit around indefinitely with a useless socket 
-					// that it thinks is still open
-					if(MyTCBStub.Flags.vUnackedKeepalives == TCP_MAX_UNACKED_KEEP_ALIVES)
-					{
-						vFlags = MyTCBStub.Flags.bServer;
+  Parameters:
+	hTCP - The socket to check.
 
-						// Force an immediate FIN and RST transmission
-						// Double calling TCPDisconnect() will also place us 
-						// back in the listening state immediately if a server socket.
-						TCPDisconnect(hTCP);
-						TCPDisconnect(hTCP);
-						
-						// Prevent client mode sockets from getting reused by other applications.  
-						// The application must call TCPDisconnect() with the handle to free this 
-						// socket (and the handle associated with it)
-						if(!vFlags)
-							MyTCBStub.smState = TCP_CLOSED_BUT_RESERVED;
-						
-						continue;
-					}
-					
-					// Otherwise, if a timeout occured, simply send a keep-alive packet
-					SyncTCB();
-					SendTCP(ACK, SENDTCP_KEEP_ALIVE);
-					MyTCBStub.eventTime = TickGet() + TCP_KEEP_ALIVE_TIMEOUT;
-				}
-			#endif
-			continue;
-		}
+  Returns:
+	The number of bytes available to be read from the TCP RX buffer.
+  ***************************************************************************/
+TCP_FIFO_SIZE TCPIsGetReady(TCP_SOCKET hTCP)
+{
+	if(hTCP >= TCP_SOCKET_COUNT)
+    {
+        return 0;
+    }
+    
+	SyncTCBStub(hTCP);
+		
+	if(MyTCBStub.rxHead >= MyTCBStub.rxTail)
+		return MyTCBStub.rxHead - MyTCBStub.rxTail;
+	else
+		return (MyTCBStub.bufferEnd - MyTCBStub.rxTail + 1) + (MyTCBStub.rxHead - MyTCBStub.bufferRxStart);
+}
 
-		// If timeout has not occured, do not do anything.
-		if((LONG)(TickGet() - MyTCBStub.eventTime) < (LONG)0)
-			continue;
 
-		// Load up extended TCB information
-		SyncTCB();
+/*****************************************************************************
+  Function:
+	BOOL TCPGet(TCP_SOCKET hTCP, BYTE* byte)
 
-		// A timeout has occured.  Respond to this timeout condition
-		// depending on what state this socket is in.
-		switch(MyTCBStub.smState)
-		{
-			#if defined(STACK_CLIENT_MODE)
-			#if defined(STACK_USE_DNS)
-			case TCP_GET_DNS_MODULE:
-				if(DNSBeginUsage())
-				{
-					MyTCBStub.smState = TCP_DNS_RESOLVE;
-					if(MyTCB.flags.bRemoteHostIsROM)
-						DNSResolveROM((ROM BYTE*)(ROM_PTR_BASE)MyTCB.remote.dwRemoteHost, DNS_TYPE_A);
-					else
-						DNSResolve((BYTE*)(PTR_BASE)MyTCB.remote.dwRemoteHost, DNS_TYPE_A);
-				}
-				break;
-				
-			case TCP_DNS_RESOLVE:
-			{
-				IP_ADDR ipResolvedDNSIP;
-
-				// See if DNS resolution has finished.  Note that if the DNS 
-				// fails, the &ipResolvedDNSIP will be written with 0x00000000. 
-				// MyTCB.remote.dwRemoteHost is unioned with 
-				// MyTCB.remote.niRemoteMACIP.IPAddr, so we can't directly write 
-				// the DNS result into MyTCB.remote.niRemoteMACIP.IPAddr.  We 
-				// must copy it over only if the DNS is resolution step was 
-				// successful.
-				if(DNSIsResolved(&ipResolvedDNSIP))
-				{
-					if(DNSEndUsage())
-					{
-						MyTCB.remote.niRemoteMACIP.IPAddr.Val = ipResolvedDNSIP.Val;
-						MyTCBStub.smState = TCP_GATEWAY_SEND_ARP;
-						MyTCBStub.remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1]+MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
-						MyTCB.retryCount = 0;
-						MyTCB.retryInterval = (TICK_SECOND/4)/256;
-					}
-					else
-					{
-						MyTCBStub.eventTime = TickGet() + 10*TICK_SECOND;
-						MyTCBStub.smState = TCP_GET_DNS_MODULE;
-					}
-				}
-				break;
-			}
-			#endif // #if defined(STACK_USE_DNS)
-				
-			case TCP_GATEWAY_SEND_ARP:
-				// Obtain the MAC address associated with the server's IP address (either direct MAC address on same subnet, or the MAC address of the Gateway machine)
-				MyTCBStub.eventTime2 = (WORD)TickGetDiv256();
-				ARPResolve(&MyTCB.remote.niRemoteMACIP.IPAddr);
-				MyTCBStub.smState = TCP_GATEWAY_GET_ARP;
-				break;
+  Description:
+	Retrieves a single byte to a TCP socket.
 
-			case TCP_GATEWAY_GET_ARP:
-				// Wait for the MAC address to finish being obtained
-				if(!ARPIsResolved(&MyTCB.remote.niRemoteMACIP.IPAddr, &MyTCB.remote.niRemoteMACIP.MACAddr))
-				{
-					// Time out if too much time is spent in this state
-					// Note that this will continuously send out ARP 
-					// requests for an infinite time if the Gateway 
-					// never responds
-					if((WORD)TickGetDiv256() - MyTCBStub.eventTime2 > (WORD)MyTCB.retryInterval)
-					{
-						// Exponentially increase timeout until we reach 6 attempts then stay constant
-						if(MyTCB.retryCount < 6u)
-						{
-							MyTCB.retryCount++;
-							MyTCB.retryInterval <<= 1;
-						}
-
-						// Retransmit ARP request
-						MyTCBStub.smState = TCP_GATEWAY_SEND_ARP;
-					}
-					break;
-				}
-				
-				// Send out SYN connection request to remote node
-				// This automatically disables the Timer from 
-				// continuously firing for this socket
-				vFlags = SYN;
-				bRetransmit = FALSE;
-				MyTCBStub.smState = TCP_SYN_SENT;
-				break;
-			#endif // #if defined(STACK_CLIENT_MODE)
-			
-			case TCP_SYN_SENT:
-				// Keep sending SYN until we hear from remote node.
-				// This may be for infinite time, in that case
-				// caller must detect it and do something.
-				vFlags = SYN;
-				bRetransmit = TRUE;
+  Precondition:
+	TCP is initialized.
 
-				// Exponentially increase timeout until we reach TCP_MAX_RETRIES attempts then stay constant
-				if(MyTCB.retryCount >= (TCP_MAX_RETRIES - 1))
-				{
-					MyTCB.retryCount = TCP_MAX_RETRIES - 1;
-					MyTCB.retryInterval = TCP_START_TIMEOUT_VAL<<(TCP_MAX_RETRIES-1);
-				}
-				break;
+  Parameters:
+	hTCP - The socket from which to read.
+	byte - Pointer to location in which the read byte should be stored.
+
+  Return Values:
+	TRUE - A byte was read from the buffer.
+	FALSE - The buffer was empty, or the socket is not connected.
+  ***************************************************************************/
+BOOL TCPGet(TCP_SOCKET hTCP, BYTE* byte)
+{
+	TCP_FIFO_SIZE wGetReadyCount;
+
+	// See if there is any data which can be read
+	wGetReadyCount = TCPIsGetReady(hTCP);
+	if(wGetReadyCount == 0u)
+		return FALSE;
+
+	SyncTCBStub(hTCP);
 	
-			case TCP_SYN_RECEIVED:
-				// We must receive ACK before timeout expires.
-				// If not, resend SYN+ACK.
-				// Abort, if maximum attempts counts are reached.
-				if(MyTCB.retryCount < TCP_MAX_SYN_RETRIES)
-				{
-					vFlags = SYN | ACK;
-					bRetransmit = TRUE;
-				}
-				else
-				{
-					if(MyTCBStub.Flags.bServer)
-					{
-						vFlags = RST | ACK;
-						bCloseSocket = TRUE;
-					}
-					else
-					{
-						vFlags = SYN;
-					}
-				}
-				break;
+	if(byte)
+		TCPRAMCopy((PTR_BASE)byte, TCP_PIC_RAM, MyTCBStub.rxTail, MyTCBStub.vMemoryMedium, 1);
+	if(++MyTCBStub.rxTail > MyTCBStub.bufferEnd)
+		MyTCBStub.rxTail = MyTCBStub.bufferRxStart;
+
+	// Send a window update if we've run out of data
+	if(wGetReadyCount == 1u)
+	{
+		MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
+	}
+	// If not already enabled, start a timer so a window 
+	// update will get sent to the remote node at some point
+	else if(!MyTCBStub.Flags.bTimer2Enabled)
+	{
+		MyTCBStub.Flags.bTimer2Enabled = TRUE;
+		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
+	}
+
+
+	return TRUE;
+}
+
+
+/*****************************************************************************
+  Function:
+	TCP_FIFO_SIZE TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, TCP_FIFO_SIZE len)
+
+  Description:
+	Reads an array of data bytes from a TCP socket's receive FIFO.  The data 
+	is removed from the FIFO in the process.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket from which data is to be read.
+	buffer - Pointer to the array to store data that was read.
+	len  - Number of bytes to be read.
+
+  Returns:
+	The number of bytes read from the socket.  If less than len, the
+	RX FIFO buffer became empty or the socket is not conected.
+  ***************************************************************************/
+TCP_FIFO_SIZE TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, TCP_FIFO_SIZE len)
+{
+	TCP_FIFO_SIZE wGetReadyCount;
+	TCP_FIFO_SIZE RightLen = 0;
+
+	// See if there is any data which can be read
+	wGetReadyCount = TCPIsGetReady(hTCP);
+	if(wGetReadyCount == 0u)
+		return 0x0000u;
+
+	SyncTCBStub(hTCP);
+
+	// Make sure we don't try to read more data than is available
+	if(len > wGetReadyCount)
+		len = wGetReadyCount;
+
+	// See if we need a two part get
+	if(MyTCBStub.rxTail + len > MyTCBStub.bufferEnd)
+	{
+		RightLen = MyTCBStub.bufferEnd - MyTCBStub.rxTail + 1;
+		if(buffer)
+		{
+			TCPRAMCopy((PTR_BASE)buffer, TCP_PIC_RAM, MyTCBStub.rxTail, MyTCBStub.vMemoryMedium, RightLen);
+			buffer += RightLen;
+		}
+		len -= RightLen;
+		MyTCBStub.rxTail = MyTCBStub.bufferRxStart;
+	}
+
+	if(buffer)
+		TCPRAMCopy((PTR_BASE)buffer, TCP_PIC_RAM, MyTCBStub.rxTail, MyTCBStub.vMemoryMedium, len);
+	MyTCBStub.rxTail += len;
+	len += RightLen;
+
+	// Send a window update if we've run low on data
+	if(wGetReadyCount - len <= len)
+	{
+		MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
+	}
+	else if(!MyTCBStub.Flags.bTimer2Enabled)
+	// If not already enabled, start a timer so a window 
+	// update will get sent to the remote node at some point
+	{
+		MyTCBStub.Flags.bTimer2Enabled = TRUE;
+		MyTCBStub.eventTime2 = (WORD)TickGetDiv256() + TCP_WINDOW_UPDATE_TIMEOUT_VAL/256ull;
+	}
+
+	return len;
+}
+
+
+/*****************************************************************************
+  Function:
+	TCP_FIFO_SIZE TCPGetRxFIFOFree(TCP_SOCKET hTCP)
+
+  Description:
+	Determines how many bytes are free in the RX FIFO.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to check.
+
+  Returns:
+	The number of bytes free in the TCP RX FIFO.  If zero, no additional 
+	data can be received until the application removes some data using one
+	of the TCPGet family functions.
+  ***************************************************************************/
+TCP_FIFO_SIZE TCPGetRxFIFOFree(TCP_SOCKET hTCP)
+{
+	TCP_FIFO_SIZE wDataLen;
+	TCP_FIFO_SIZE wFIFOSize;
 	
-			case TCP_ESTABLISHED:
-			case TCP_CLOSE_WAIT:
-				// Retransmit any unacknowledged data
-				if(MyTCB.retryCount < TCP_MAX_RETRIES)
-				{
-					vFlags = ACK;
-					bRetransmit = TRUE;
-				}
-				else
-				{
-					// No response back for too long, close connection
-					// This could happen, for instance, if the communication 
-					// medium was lost
-					MyTCBStub.smState = TCP_FIN_WAIT_1;
-					vFlags = FIN | ACK;
-				}
-				break;
+	if(hTCP >= TCP_SOCKET_COUNT)
+    {
+        return 0;
+    }
+    
+	SyncTCBStub(hTCP);
 	
-			case TCP_FIN_WAIT_1:
-				if(MyTCB.retryCount < TCP_MAX_RETRIES)
-				{
-					// Send another FIN
-					vFlags = FIN | ACK;
-					bRetransmit = TRUE;
-				}
-				else
-				{
-					// Close on our own, we can't seem to communicate 
-					// with the remote node anymore
-					vFlags = RST | ACK;
-					bCloseSocket = TRUE;
-				}
-				break;
+	// Calculate total usable FIFO size
+	wFIFOSize = MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart;
+
+	#if defined(STACK_USE_SSL)
+	{
+		PTR_BASE SSLtemp = MyTCBStub.rxHead;
+
+		// Move SSL pointer to determine full buffer size
+		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+			MyTCBStub.rxHead = MyTCBStub.sslRxHead;
+
+		// Find out how many data bytes are actually in the RX FIFO
+		wDataLen = TCPIsGetReady(hTCP);
+		
+		// Move SSL pointer back to proper location (if we changed it)
+		MyTCBStub.rxHead = SSLtemp;
+	}
+	#else
+	{
+		// Find out how many data bytes are actually in the RX FIFO
+		wDataLen = TCPIsGetReady(hTCP);
+	}
+	#endif
 	
-			case TCP_FIN_WAIT_2:
-				// Close on our own, we can't seem to communicate 
-				// with the remote node anymore
-				vFlags = RST | ACK;
-				bCloseSocket = TRUE;
-				break;
+	// Perform the calculation	
+	return wFIFOSize - wDataLen;
+}
+
+/*****************************************************************************
+  Function:
+	TCP_FIFO_SIZE TCPPeekArray(TCP_SOCKET hTCP, BYTE *vBuffer, TCP_FIFO_SIZE wLen, TCP_FIFO_SIZE wStart)
+
+  Summary:
+  	Reads a specified number of data bytes from the TCP RX FIFO without 
+  	removing them from the buffer.
+
+  Description:
+	Reads a specified number of data bytes from the TCP RX FIFO without 
+  	removing them from the buffer.  No TCP control actions are taken as a 
+  	result of this function (ex: no window update is sent to the remote node).
+  	
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to peak from (read without removing from stream).
+	vBuffer - Destination to write the peeked data bytes.
+	wLen - Length of bytes to peak from the RX FIFO and copy to vBuffer.
+	wStart - Zero-indexed starting position within the FIFO to start peeking 
+		from.
+
+  Return Values:
+	Number of bytes actually peeked from the stream and copied to vBuffer.  
+	This value can be less than wLen if wStart + wLen is greater than the 
+	deepest possible character in the RX FIFO.
+
+  Remarks:
+  	None
+  ***************************************************************************/
+TCP_FIFO_SIZE TCPPeekArray(TCP_SOCKET hTCP, BYTE *vBuffer, TCP_FIFO_SIZE wLen, TCP_FIFO_SIZE wStart)
+{
+	PTR_BASE ptrRead;
+	TCP_FIFO_SIZE w;
+	TCP_FIFO_SIZE wBytesUntilWrap;
+
+	if(hTCP >= TCP_SOCKET_COUNT || wLen == 0)
+    {
+        return 0;
+    }
+    
+	SyncTCBStub(hTCP);
+
+	// Find out how many bytes are in the RX FIFO and decrease read length 
+	// if the start offset + read length is beyond the end of the FIFO
+	w = TCPIsGetReady(hTCP);
+	if(wStart + wLen > w)
+		wLen = w - wStart;
+
+	// Find the read start location
+	ptrRead = MyTCBStub.rxTail + wStart;
+	if(ptrRead > MyTCBStub.bufferEnd)
+		ptrRead -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;
+
+	// Calculate how many bytes can be read in a single go
+	wBytesUntilWrap = MyTCBStub.bufferEnd - ptrRead + 1;
+	if(wLen <= wBytesUntilWrap)
+	{
+		// Read all at once
+		TCPRAMCopy((PTR_BASE)vBuffer, TCP_PIC_RAM, ptrRead, MyTCBStub.vMemoryMedium, wLen);
+	}
+	else
+	{
+		// Read all bytes up to the wrap position and then read remaining bytes 
+		// at the start of the buffer
+		TCPRAMCopy((PTR_BASE)vBuffer, TCP_PIC_RAM, ptrRead, MyTCBStub.vMemoryMedium, wBytesUntilWrap);
+		TCPRAMCopy((PTR_BASE)vBuffer+wBytesUntilWrap, TCP_PIC_RAM, MyTCBStub.bufferRxStart, MyTCBStub.vMemoryMedium, wLen - wBytesUntilWrap);
+	}
+	
+	return wLen;
+}
+
+/*****************************************************************************
+  Function:
+	BYTE TCPPeek(TCP_SOCKET hTCP, TCP_FIFO_SIZE wStart)
+
+  Summary:
+  	Peaks at one byte in the TCP RX FIFO without removing it from the buffer.
+
+  Description:
+	Peaks at one byte in the TCP RX FIFO without removing it from the buffer.
+  	
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to peak from (read without removing from stream).
+	wStart - Zero-indexed starting position within the FIFO to peek from.
+
+  Return Values:
+	Byte peeked from the RX FIFO.  If there is no data in the buffer or an 
+	illegal wStart starting offset is given, then an indeterminate value is 
+	returned.  The caller must ensure that valid parameters are passed to avoid 
+	(i.e ensure that TCPIsGetReady() returns a number that is less than wStart 
+	before calling TCPPeek()).
+
+  Remarks:
+  	Use the TCPPeekArray() function to read more than one byte.  It will 
+  	perform better than calling TCPPeek() in a loop.
+  ***************************************************************************/
+BYTE TCPPeek(TCP_SOCKET hTCP, TCP_FIFO_SIZE wStart)
+{
+	BYTE i;
+	
+	TCPPeekArray(hTCP, &i, 1, wStart);
+	return i;
+}
+
+
+/****************************************************************************
+  Section:
+	Search Functions
+  ***************************************************************************/
+
+/*****************************************************************************
+  Function:
+	WORD TCPFindArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, 
+						WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+
+  Summary:
+  	Searches for a string in the TCP RX buffer.
+
+  Description:
+	This function finds the first occurrance of an array of bytes in the
+	TCP RX buffer.  It can be used by an application to abstract searches 
+	out of their own application code.  For increased efficiency, the 
+	function is capable of limiting the scope of search to a specific
+	range of bytes.  It can also perform a case-insensitive search if
+	required.
+	
+	For example, if the buffer contains "I love PIC MCUs!" and the search
+	array is "love" with a length of 4, a value of 2 will be returned.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to search within.
+	cFindArray - The array of bytes to find in the buffer.
+	wLen - Length of cFindArray.
+	wStart - Zero-indexed starting position within the buffer.
+	wSearchLen - Length from wStart to search in the buffer.
+	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
+
+  Return Values:
+	0xFFFF - Search array not found
+	Otherwise - Zero-indexed position of the first occurrance
+
+  Remarks:
+	The FIFO is read TCP_FIND_BUFFER_SIZE bytes at a time and searched with 
+	Boyer-Moore-Horspool, so longer arrays generally skip over more of the 
+	buffer per comparison.  The search still has to read most of the 
+	range when the array is not found, so limit the scope of the search as 
+	much as possible.
+  ***************************************************************************/
+WORD TCPFindArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+{
+	return TCPFindArrayCore(hTCP, cFindArray, NULL, wLen, wStart, wSearchLen, bTextCompare);
+}
+
+/*****************************************************************************
+  Function:
+	WORD TCPFindROMArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, 
+						WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+
+  Summary:
+  	Searches for a ROM string in the TCP RX buffer.
+
+  Description:
+	This function finds the first occurrance of an array of bytes in the
+	TCP RX buffer.  It can be used by an application to abstract searches 
+	out of their own application code.  For increased efficiency, the 
+	function is capable of limiting the scope of search to a specific
+	range of bytes.  It can also perform a case-insensitive search if
+	required.
+	
+	For example, if the buffer contains "I love PIC MCUs!" and the search
+	array is "love" with a length of 4, a value of 2 will be returned.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to search within.
+	cFindArray - The array of bytes to find in the buffer.
+	wLen - Length of cFindArray.
+	wStart - Zero-indexed starting position within the buffer.
+	wSearchLen - Length from wStart to search in the buffer.
+	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
+
+  Return Values:
+	0xFFFF - Search array not found
+	Otherwise - Zero-indexed position of the first occurrance
+
+  Remarks:
+	Since this function usually must transfer data from external storage
+	to internal RAM for comparison, its performance degrades significantly
+	when the buffer is full and the array is not found.  For better 
+	performance, try to search for characters that are expected to exist or
+	limit the scope of the search as much as possible.  The HTTP2 module, 
+	for example, uses this function to parse headers.  However, it searches 
+	for newlines, then the separating colon, then reads the header name to 
+	RAM for final comparison.  This has proven to be significantly faster  
+	than searching for full header name strings outright.
+	
+	This function is aliased to TCPFindArrayEx on non-PIC18 platforms.
+  ***************************************************************************/
+#if defined(__18CXX)
+WORD TCPFindROMArrayEx(TCP_SOCKET hTCP, ROM BYTE* cFindArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+{
+	return TCPFindArrayCore(hTCP, NULL, cFindArray, wLen, wStart, wSearchLen, bTextCompare);
+}
+#endif
+
+/*****************************************************************************
+  Function:
+	static WORD TCPFindArrayCore(TCP_SOCKET hTCP, BYTE* cFindArray, 
+						ROM BYTE* cFindROMArray, WORD wLen, WORD wStart, 
+						WORD wSearchLen, BOOL bTextCompare)
+
+  Summary:
+  	Boyer-Moore-Horspool search of the TCP RX buffer.
+
+  Description:
+	Implements TCPFindArrayEx() and TCPFindROMArrayEx().  The search range 
+	is read TCP_FIND_BUFFER_SIZE bytes at a time with TCPPeekArray(), which 
+	takes care of the FIFO wrap.  Each alignment is checked by comparing 
+	its last byte first, and the byte found there picks how far the next 
+	alignment moves from TCPFindSkip[].  For text compares, the buffer and 
+	the array are both folded to upper case.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to search within.
+	cFindArray - The RAM array to find, or NULL to use cFindROMArray
+	cFindROMArray - The ROM array to find if cFindArray is NULL
+	wLen - Length of the array.
+	wStart - Zero-indexed starting position within the buffer.
+	wSearchLen - Length from wStart to search in the buffer.
+	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
+
+  Return Values:
+	0xFFFF - Search array not found
+	Otherwise - Zero-indexed position of the first occurrance
+
+  Remarks:
+	Arrays longer than TCP_FIND_BUFFER_SIZE only have their tail in the 
+	buffer.  Once the tail matches, the rest of the candidate is read into 
+	the buffer TCP_FIND_BUFFER_SIZE bytes at a time, going backwards.
+  ***************************************************************************/
+#if defined(__18CXX)
+	#define TCPFindPattern(i)	(cFindArray ? cFindArray[i] : cFindROMArray[i])
+#else
+	#define TCPFindPattern(i)	(cFindArray[i])
+#endif
+#define TCPFindUpper(c)			(((c) >= 'a' && (c) <= 'z') ? (BYTE)((c) + 'A' - 'a') : (BYTE)(c))
+
+static WORD TCPFindArrayCore(TCP_SOCKET hTCP, BYTE* cFindArray, ROM BYTE* cFindROMArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+{
+	TCP_FIFO_SIZE wDataLen;
+	WORD wPos, wEnd, wLast;
+	WORD wBufStart, wBufLen;
+	WORD i, j;
+	BYTE c, cData, cLast;
+	BOOL bUseSkip;
+	BYTE buffer[TCP_FIND_BUFFER_SIZE];
+
+	#if !defined(__18CXX)
+	// Only PIC18 has a separate ROM array to search for
+	(void)cFindROMArray;
+	#endif
+
+	if(hTCP >= TCP_SOCKET_COUNT || wLen == 0u)
+    {
+        return 0;
+    }
+    
+	SyncTCBStub(hTCP);
+
+	// Find out how many bytes are in the RX FIFO and return 
+	// immediately if we won't possibly find a match
+	wDataLen = TCPIsGetReady(hTCP);
+	if(wDataLen < (TCP_FIFO_SIZE)wStart + wLen)
+		return 0xFFFFu;
+	wDataLen -= wStart;
+	if(wSearchLen && (wDataLen > wSearchLen))
+		wDataLen = wSearchLen;
+	#if defined(TCP_LARGE_FIFOS)
+	// Positions are returned as a WORD, so only the first 64KB of a large RX 
+	// FIFO can be searched
+	if(wDataLen > 0xFFFFu - wStart)
+		wDataLen = 0xFFFFu - wStart;
+	#endif
+
+	// Build the skip table.  A byte's shift is the distance from its last 
+	// occurrence in all but the final byte of the array to the end of the 
+	// array, or the whole length if it doesn't occur there.  Shifts are 
+	// capped at 255 so they fit in a BYTE; a shorter shift is always safe.
+	bUseSkip = (wLen >= TCP_FIND_SKIP_MIN_LEN);
+	if(bUseSkip)
+	{
+		memset((void*)TCPFindSkip, (wLen > 255u) ? 255 : (BYTE)wLen, sizeof(TCPFindSkip));
+		for(i = (wLen > 256u) ? wLen - 256u : 0u; i < wLen - 1u; i++)
+		{
+			c = TCPFindPattern(i);
+			if(bTextCompare)
+				c = TCPFindUpper(c);
+			TCPFindSkip[c] = (BYTE)(wLen - 1u - i);
+		}
+	}
+	cLast = TCPFindPattern(wLen - 1u);
+	if(bTextCompare)
+		cLast = TCPFindUpper(cLast);
+
+	// Search for the array
+	wPos = wStart;
+	wEnd = wStart + (WORD)wDataLen;
+	wBufStart = wPos;
+	wBufLen = 0;
+	while((WORD)(wEnd - wPos) >= wLen)
+	{
+		// Make sure the last byte of this alignment, and as much of the rest 
+		// of it as fits, is in the buffer
+		wLast = wPos + wLen - 1u;
+		if((WORD)(wLast - wBufStart) >= wBufLen)
+		{
+			wBufStart = wPos;
+			if(wLen > sizeof(buffer))
+				wBufStart = wLast - (sizeof(buffer) - 1u);
+			wBufLen = wEnd - wBufStart;
+			if(wBufLen > sizeof(buffer))
+				wBufLen = sizeof(buffer);
+			TCPPeekArray(hTCP, buffer, wBufLen, wBufStart);
+
+			if(bTextCompare)
+			{
+				for(i = 0; i < wBufLen; i++)
+					buffer[i] = TCPFindUpper(buffer[i]);
+			}
+		}
+		c = buffer[wLast - wBufStart];
+
+		// Compare the rest of the alignment from the back
+		if(c == cLast)
+		{
+			i = wLen - 1u;
+			while(1)
+			{
+				if(i == 0u)
+					return wPos;
+				i--;
+
+				// An array longer than the buffer continues before it, so 
+				// read the next buffer's worth of the alignment, going 
+				// backwards.  The buffer still holds the FIFO bytes from 
+				// wBufStart, so later alignments only reload it if needed.
+				if(wPos + i < wBufStart)
+				{
+					wBufLen = (i < sizeof(buffer)) ? i + 1u : sizeof(buffer);
+					wBufStart = wPos + i + 1u - wBufLen;
+					TCPPeekArray(hTCP, buffer, wBufLen, wBufStart);
+
+					if(bTextCompare)
+					{
+						for(j = 0; j < wBufLen; j++)
+							buffer[j] = TCPFindUpper(buffer[j]);
+					}
+				}
+				cData = buffer[wPos + i - wBufStart];
+
+				if(bTextCompare)
+				{
+					if(cData != TCPFindUpper(TCPFindPattern(i)))
+						break;
+				}
+				else if(cData != TCPFindPattern(i))
+				{
+					break;
+				}
+			}
+		}
+
+		wPos += bUseSkip ? TCPFindSkip[c] : 1u;
+	}
+
+	return 0xFFFFu;
+}
+
+#undef TCPFindPattern
+#undef TCPFindUpper
+
+
+/*****************************************************************************
+  Function:
+	WORD TCPFindEx(TCP_SOCKET hTCP, BYTE cFind,
+						WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+
+  Summary:
+  	Searches for a byte in the TCP RX buffer.
+
+  Description:
+	This function finds the first occurrance of a byte in the TCP RX
+	buffer.  It can be used by an application to abstract searches 
+	out of their own application code.  For increased efficiency, the 
+	function is capable of limiting the scope of search to a specific
+	range of bytes.  It can also perform a case-insensitive search if
+	required.
+	
+	For example, if the buffer contains "I love PIC MCUs!" and the cFind
+	byte is ' ', a value of 1 will be returned.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to search within.
+	cFind - The byte to find in the buffer.
+	wStart - Zero-indexed starting position within the buffer.
+	wSearchLen - Length from wStart to search in the buffer.
+	bTextCompare - TRUE for case-insensitive text search, FALSE for binary search
+
+  Return Values:
+	0xFFFF - Search array not found
+	Otherwise - Zero-indexed position of the first occurrance
+
+  Remarks:
+	The FIFO is read TCP_FIND_BUFFER_SIZE bytes at a time and searched with 
+	Boyer-Moore-Horspool, so longer arrays generally skip over more of the 
+	buffer per comparison.  The search still has to read most of the 
+	range when the array is not found, so limit the scope of the search as 
+	much as possible.
+  ***************************************************************************/
+WORD TCPFindEx(TCP_SOCKET hTCP, BYTE cFind, WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+{
+	return TCPFindArrayEx(hTCP, &cFind, sizeof(cFind), wStart, wSearchLen, bTextCompare);
+}
+
+
+
+/****************************************************************************
+  Section:
+	Data Processing Functions
+  ***************************************************************************/
+
+/*****************************************************************************
+  Function:
+	void TCPTick(void)
+
+  Summary:
+  	Performs periodic TCP tasks.
+
+  Description:
+	This function performs any required periodic TCP tasks.  Sockets are 
+	kept in a queue ordered by the time of their next timed event, and 
+	only those whose events have come due are serviced by 
+	TCPTickSocket().  The cost of a call therefore depends on the number 
+	of sockets with expired timers or recent activity, not on 
+	TCP_SOCKET_COUNT.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+void TCPTick(void)
+{
+	TCP_SOCKET hTCP;
+	DWORD dwNow;
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+	WORD w;
+	#endif
+
+	// Bring the timer queue up to date for every socket that was used since 
+	// the last call.  Timers are only ever checked here, so it doesn't 
+	// matter that new deadlines weren't queued at the moment they were set.
+	while(TCPTimerTouchedCount)
+	{
+		hTCP = TCPTimerTouched[--TCPTimerTouchedCount];
+		SyncTCBStub(hTCP);
+		TCPTimerIsTouched[hTCP] = 0;
+		TCPTimerSchedule(FALSE);
+	}
+
+	// Service only the sockets whose earliest event has come due.  Sockets 
+	// that still have immediate work pending afterwards are deferred to the 
+	// next tick so this loop always terminates.
+	dwNow = TickGet();
+	while(TCPTimerHeapCount && ((LONG)(dwNow - TCPTimerDue[TCPTimerHeap[0]]) >= (LONG)0))
+	{
+		hTCP = TCPTimerHeap[0];
+		TCPTickSocket(hTCP);
+		SyncTCBStub(hTCP);
+		TCPTimerSchedule(TRUE);
+	}
+	
+	
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+		// Process SYN Queue entry timeouts.  Serviced entries leave holes 
+		// that are reused out of arrival order, so check every slot.
+		for(w = 0; SYNQueueCount && (w < TCP_SYN_QUEUE_MAX_ENTRIES); w++)
+		{
+			if(SYNQueue[w].wDestPort == 0u)
+				continue;
+			if((WORD)TickGetDiv256() - SYNQueue[w].wTimestamp > (WORD)(TCP_SYN_QUEUE_TIMEOUT/256ull))
+			{
+				SYNQueue[w].wDestPort = 0u;
+				SYNQueueCount--;
+			}
+		}
+	#endif
+}
+
+
+/*****************************************************************************
+  Function:
+	static void TCPTickSocket(TCP_SOCKET hTCP)
+
+  Summary:
+	Performs the periodic tasks of one socket.
+
+  Description:
+	Checks the given socket's state machine and handles any elapsed 
+	timeout periods: pending transmissions, window updates, delayed 
+	acknowledgements, the TCP_CLOSE_WAIT timeout, queued SYNs for listening 
+	sockets, keep-alives, and state machine retransmissions.  Called by 
+	TCPTick() for each socket whose timer queue entry has come due.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	hTCP - The socket to service.
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPTickSocket(TCP_SOCKET hTCP)
+{
+	BOOL bRetransmit;
+	BOOL bCloseSocket;
+	BYTE vFlags;
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+	WORD w, k, wOldest;
+	#endif
+	TCP_FIFO_SIZE wInFlight;
+
+	SyncTCBStub(hTCP);
+	
+	// Handle any SSL Processing and Message Transmission
+	#if defined(STACK_USE_SSL)
+	if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+	{
+		// Handle any periodic tasks, such as RSA operations
+		SSLPeriodic(hTCP, MyTCBStub.sslStubID);
+		
+		// If unsent data is waiting, transmit it as an application record
+		if(MyTCBStub.sslTxHead != MyTCBStub.txHead && TCPSSLGetPendingTxSize(hTCP) != 0u)
+			SSLTxRecord(hTCP, MyTCBStub.sslStubID, SSL_APPLICATION);
+		
+		// If an SSL message is requested, send it now
+		if(MyTCBStub.sslReqMessage != SSL_NO_MESSAGE)
+			SSLTxMessage(hTCP, MyTCBStub.sslStubID, MyTCBStub.sslReqMessage);
+	}
+	#endif
+	
+	vFlags = 0x00;
+	bRetransmit = FALSE;
+	bCloseSocket = FALSE;
+
+	// Transmit ASAP data if the medium is available
+	if(MyTCBStub.Flags.bTXASAP || MyTCBStub.Flags.bTXASAPWithoutTimerReset)
+	{
+		if(MACIsTxReady())
+		{
+			vFlags = ACK;
+			bRetransmit = MyTCBStub.Flags.bTXASAPWithoutTimerReset;
+		}
+	}
+
+	// Perform any needed window updates and data transmissions
+	if(MyTCBStub.Flags.bTimer2Enabled)
+	{
+		// See if the timeout has occured, and we need to send a new window update and pending data
+		if((SHORT)(MyTCBStub.eventTime2 - (WORD)TickGetDiv256()) <= (SHORT)0)
+			vFlags = ACK;
+	}
+
+	// Process Delayed ACKnowledgement timer
+	if(MyTCBStub.Flags.bDelayedACKTimerEnabled)
+	{
+		// See if the timeout has occured and delayed ACK needs to be sent
+		if((SHORT)(MyTCBStub.OverlappedTimers.delayedACKTime - (WORD)TickGetDiv256()) <= (SHORT)0)
+			vFlags = ACK;
+	}
+	
+	// Process TCP_CLOSE_WAIT timer
+	if(MyTCBStub.smState == TCP_CLOSE_WAIT)
+	{
+		// Automatically close the socket on our end if the application 
+		// fails to call TCPDisconnect() is a reasonable amount of time.
+		if((SHORT)(MyTCBStub.OverlappedTimers.closeWaitTime - (WORD)TickGetDiv256()) <= (SHORT)0)
+		{
+			vFlags = FIN | ACK;
+			MyTCBStub.smState = TCP_LAST_ACK;
+		}
+	}
+
+	// Process listening server sockets that might have a SYN waiting in the SYNQueue[]
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+		if((MyTCBStub.smState == TCP_LISTEN) && SYNQueueCount)
+		{
+			// Find the oldest SYN that this socket can take.  Freed slots 
+			// are reused, so ring order isn't quite arrival order and the 
+			// timestamps decide.
+			wOldest = TCP_SYN_QUEUE_MAX_ENTRIES;
+			for(k = 0; k < TCP_SYN_QUEUE_MAX_ENTRIES; k++)
+			{
+				w = SYNQueueIndex(k);
+				#if defined(STACK_USE_SSL_SERVER)
+				if(SYNQueue[w].wDestPort == 0u || (SYNQueue[w].wDestPort != MyTCBStub.remoteHash.Val && SYNQueue[w].wDestPort != MyTCBStub.sslTxHead))
+				#else
+				if(SYNQueue[w].wDestPort == 0u || SYNQueue[w].wDestPort != MyTCBStub.remoteHash.Val)
+				#endif
+					continue;
+				
+				if((wOldest == TCP_SYN_QUEUE_MAX_ENTRIES) || ((WORD)(SYNQueue[w].wTimestamp - SYNQueue[wOldest].wTimestamp) & 0x8000u))
+					wOldest = w;
+			}
+
+			if(wOldest != TCP_SYN_QUEUE_MAX_ENTRIES)
+			{
+				// Set up our socket and generate a reponse SYN+ACK packet
+				w = wOldest;
+				SyncTCB();
+				
+				// If this matches the SSL port, make sure that can be configured
+				// before continuing.  If not, leave this in the queue
+				#if defined(STACK_USE_SSL_SERVER)
+				if(SYNQueue[w].wDestPort != MyTCBStub.sslTxHead || TCPStartSSLServer(hTCP))
+				#endif
+				{
+					memcpy((void*)&MyTCB.remote.niRemoteMACIP, (void*)&SYNQueue[w].niSourceAddress, sizeof(NODE_INFO));
+					MyTCB.remotePort.Val = SYNQueue[w].wSourcePort;
+					MyTCB.RemoteSEQ = SYNQueue[w].dwSourceSEQ + 1;
+
+					// Use the options that came with the queued SYN, just as 
+					// if it had been answered right away
+					MyTCB.wRemoteMSS = SYNQueue[w].wRemoteMSS;
+					MyTCB.flags.bSACKPermitted = SYNQueue[w].Flags.bSACKPermitted;
+					TCPResetCongestionWindow();
+					MyTCB.flags.bWindowScale = SYNQueue[w].Flags.bWindowScale;
+					MyTCB.vRemoteWindowShift = SYNQueue[w].vRemoteWindowShift;
+					if(!SYNQueue[w].Flags.bWindowScale)
+						MyTCB.vLocalWindowShift = 0;
+					MyTCBStub.remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1] + MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
+					vFlags = SYN | ACK;
+					MyTCBStub.smState = TCP_SYN_RECEIVED;
+					TCPHashSync();
+					
+					// Delete this SYN from the SYNQueue.  The slot is free 
+					// for the next SYN that has to wait.
+					SYNQueue[w].wDestPort = 0u;
+					SYNQueueCount--;
+				}
+			}
+		}
+	#endif
+
+	if(vFlags)
+		SendTCP(vFlags, bRetransmit ? 0 : SENDTCP_RESET_TIMERS);
+
+	// The TCP_CLOSED, TCP_LISTEN, and sometimes the TCP_ESTABLISHED 
+	// state don't need any timeout events, so see if the timer is enabled
+	if(!MyTCBStub.Flags.bTimerEnabled)
+	{
+		#if defined(TCP_KEEP_ALIVE_TIMEOUT)
+			// Only the established state has any use for keep-alives
+			if(MyTCBStub.smState == TCP_ESTABLISHED)
+			{
+				// If timeout has not occured, do not do anything.
+				if((LONG)(TickGet() - MyTCBStub.eventTime) < (LONG)0)
+					return;
+	
+				// If timeout has occured and the connection appears to be dead (no 
+				// responses from remote node at all), close the connection so the 
+				// application doesn't sit around indefinitely with a useless socket 
+				// that it thinks is still open
+				if(MyTCBStub.Flags.vUnackedKeepalives == TCP_MAX_UNACKED_KEEP_ALIVES)
+				{
+					vFlags = MyTCBStub.Flags.bServer;
+
+					// Force an immediate FIN and RST transmission
+					// Double calling TCPDisconnect() will also place us 
+					// back in the listening state immediately if a server socket.
+					TCPDisconnect(hTCP);
+					TCPDisconnect(hTCP);
+					
+					// Prevent client mode sockets from getting reused by other applications.  
+					// The application must call TCPDisconnect() with the handle to free this 
+					// socket (and the handle associated with it)
+					if(!vFlags)
+					{
+						MyTCBStub.smState = TCP_CLOSED_BUT_RESERVED;
+						TCPHashSync();
+					}
+					
+					return;
+				}
+				
+				// Otherwise, if a timeout occured, simply send a keep-alive packet
+				SyncTCB();
+				SendTCP(ACK, SENDTCP_KEEP_ALIVE);
+				MyTCBStub.eventTime = TickGet() + TCP_KEEP_ALIVE_TIMEOUT;
+			}
+		#endif
+		return;
+	}
+
+	// If timeout has not occured, do not do anything.
+	if((LONG)(TickGet() - MyTCBStub.eventTime) < (LONG)0)
+		return;
+
+	// Load up extended TCB information
+	SyncTCB();
+
+	// A timeout has occured.  Respond to this timeout condition
+	// depending on what state this socket is in.
+	switch(MyTCBStub.smState)
+	{
+		#if defined(STACK_CLIENT_MODE)
+		#if defined(STACK_USE_DNS)
+		case TCP_GET_DNS_MODULE:
+			if(DNSBeginUsage())
+			{
+				MyTCBStub.smState = TCP_DNS_RESOLVE;
+				if(MyTCB.flags.bRemoteHostIsROM)
+					DNSResolveROM((ROM BYTE*)(ROM_PTR_BASE)MyTCB.remote.dwRemoteHost, DNS_TYPE_A);
+				else
+					DNSResolve((BYTE*)(PTR_BASE)MyTCB.remote.dwRemoteHost, DNS_TYPE_A);
+			}
+			break;
+			
+		case TCP_DNS_RESOLVE:
+		{
+			IP_ADDR ipResolvedDNSIP;
+
+			// See if DNS resolution has finished.  Note that if the DNS 
+			// fails, the &ipResolvedDNSIP will be written with 0x00000000. 
+			// MyTCB.remote.dwRemoteHost is unioned with 
+			// MyTCB.remote.niRemoteMACIP.IPAddr, so we can't directly write 
+			// the DNS result into MyTCB.remote.niRemoteMACIP.IPAddr.  We 
+			// must copy it over only if the DNS is resolution step was 
+			// successful.
+			if(DNSIsResolved(&ipResolvedDNSIP))
+			{
+				if(DNSEndUsage())
+				{
+					MyTCB.remote.niRemoteMACIP.IPAddr.Val = ipResolvedDNSIP.Val;
+					MyTCBStub.smState = TCP_GATEWAY_SEND_ARP;
+					MyTCBStub.remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1]+MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
+					TCPHashSync();
+					MyTCB.retryCount = 0;
+					MyTCB.retryInterval = (TICK_SECOND/4)/256;
+				}
+				else
+				{
+					MyTCBStub.eventTime = TickGet() + 10*TICK_SECOND;
+					MyTCBStub.smState = TCP_GET_DNS_MODULE;
+				}
+			}
+			break;
+		}
+		#endif // #if defined(STACK_USE_DNS)
+			
+		case TCP_GATEWAY_SEND_ARP:
+			// Obtain the MAC address associated with the server's IP address (either direct MAC address on same subnet, or the MAC address of the Gateway machine)
+			MyTCBStub.eventTime2 = (WORD)TickGetDiv256();
+			ARPResolve(&MyTCB.remote.niRemoteMACIP.IPAddr);
+			MyTCBStub.smState = TCP_GATEWAY_GET_ARP;
+			break;
+
+		case TCP_GATEWAY_GET_ARP:
+			// Wait for the MAC address to finish being obtained
+			if(!ARPIsResolved(&MyTCB.remote.niRemoteMACIP.IPAddr, &MyTCB.remote.niRemoteMACIP.MACAddr))
+			{
+				// Time out if too much time is spent in this state
+				// Note that this will continuously send out ARP 
+				// requests for an infinite time if the Gateway 
+				// never responds
+				if((WORD)TickGetDiv256() - MyTCBStub.eventTime2 > (WORD)MyTCB.retryInterval)
+				{
+					// Exponentially increase timeout until we reach 6 attempts then stay constant
+					if(MyTCB.retryCount < 6u)
+					{
+						MyTCB.retryCount++;
+						MyTCB.retryInterval <<= 1;
+					}
+
+					// Retransmit ARP request
+					MyTCBStub.smState = TCP_GATEWAY_SEND_ARP;
+				}
+				break;
+			}
+			
+			// Send out SYN connection request to remote node
+			// This automatically disables the Timer from 
+			// continuously firing for this socket
+			vFlags = SYN;
+			bRetransmit = FALSE;
+			MyTCBStub.smState = TCP_SYN_SENT;
+			break;
+		#endif // #if defined(STACK_CLIENT_MODE)
+		
+		case TCP_SYN_SENT:
+			// Keep sending SYN until we hear from remote node.
+			// This may be for infinite time, in that case
+			// caller must detect it and do something.
+			vFlags = SYN;
+			bRetransmit = TRUE;
+
+			// Exponentially increase timeout until we reach TCP_MAX_RETRIES attempts then stay constant
+			if(MyTCB.retryCount >= (TCP_MAX_RETRIES - 1))
+			{
+				MyTCB.retryCount = TCP_MAX_RETRIES - 1;
+				MyTCB.retryInterval = TCP_START_TIMEOUT_VAL<<(TCP_MAX_RETRIES-1);
+			}
+			break;
+
+		case TCP_SYN_RECEIVED:
+			// We must receive ACK before timeout expires.
+			// If not, resend SYN+ACK.
+			// Abort, if maximum attempts counts are reached.
+			if(MyTCB.retryCount < TCP_MAX_SYN_RETRIES)
+			{
+				vFlags = SYN | ACK;
+				bRetransmit = TRUE;
+			}
+			else
+			{
+				if(MyTCBStub.Flags.bServer)
+				{
+					vFlags = RST | ACK;
+					bCloseSocket = TRUE;
+				}
+				else
+				{
+					vFlags = SYN;
+				}
+			}
+			break;
+
+		case TCP_ESTABLISHED:
+		case TCP_CLOSE_WAIT:
+			// Retransmit any unacknowledged data
+			if(MyTCB.retryCount < TCP_MAX_RETRIES)
+			{
+				vFlags = ACK;
+				bRetransmit = TRUE;
+			}
+			else
+			{
+				// No response back for too long, close connection
+				// This could happen, for instance, if the communication 
+				// medium was lost
+				MyTCBStub.smState = TCP_FIN_WAIT_1;
+				vFlags = FIN | ACK;
+			}
+			break;
+
+		case TCP_FIN_WAIT_1:
+			if(MyTCB.retryCount < TCP_MAX_RETRIES)
+			{
+				// Send another FIN
+				vFlags = FIN | ACK;
+				bRetransmit = TRUE;
+			}
+			else
+			{
+				// Close on our own, we can't seem to communicate 
+				// with the remote node anymore
+				vFlags = RST | ACK;
+				bCloseSocket = TRUE;
+			}
+			break;
+
+		case TCP_FIN_WAIT_2:
+			// Close on our own, we can't seem to communicate 
+			// with the remote node anymore
+			vFlags = RST | ACK;
+			bCloseSocket = TRUE;
+			break;
+
+		case TCP_CLOSING:
+			if(MyTCB.retryCount < TCP_MAX_RETRIES)
+			{
+				// Send another ACK+FIN (the FIN is retransmitted 
+				// automatically since it hasn't been acknowledged by 
+				// the remote node yet)
+				vFlags = ACK;
+				bRetransmit = TRUE;
+			}
+			else
+			{
+				// Close on our own, we can't seem to communicate 
+				// with the remote node anymore
+				vFlags = RST | ACK;
+				bCloseSocket = TRUE;
+			}
+			break;
+
+//			case TCP_TIME_WAIT:
+//				// Wait around for a while (2MSL) and then goto closed state
+//				bCloseSocket = TRUE;
+//				break;
+//			
+
+		case TCP_LAST_ACK:
+			// Send some more FINs or close anyway
+			if(MyTCB.retryCount < TCP_MAX_RETRIES)
+			{
+				vFlags = FIN | ACK;
+				bRetransmit = TRUE;
+			}
+			else
+			{
+				vFlags = RST | ACK;
+				bCloseSocket = TRUE;
+			}
+			break;
+		
+		default:
+			break;
+	}
+
+	if(vFlags)
+	{
+		// Transmit all unacknowledged data over again
+		if(bRetransmit)
+		{
+			TCPStatsCount(dwRetransmits);
+
+			// Set the appropriate retry time
+			MyTCB.retryCount++;
+			MyTCB.retryInterval <<= 1;
+			if(MyTCB.retryInterval > TCP_MAX_RTO)
+				MyTCB.retryInterval = TCP_MAX_RTO;
+
+			// Anything in flight is about to be sent again, so it can 
+			// no longer produce a trustworthy RTT sample
+			TCPCancelRTTSample();
+
+			// A timeout means the network dropped more than fast 
+			// recovery could repair, so start over from one segment
+			TCPCongestionTimeout();
+	
+			// Calculate how many bytes we have to roll back and retransmit
+			wInFlight = TCPGetBytesInFlight();
+			
+			// Perform roll back of local SEQuence counter, remote window 
+			// adjustment, and cause all unacknowledged data to be 
+			// retransmitted by moving the unacked tail pointer.
+			MyTCB.MySEQ -= wInFlight;
+			MyTCB.remoteWindow += wInFlight;
+			MyTCBStub.txUnackedTail = MyTCBStub.txTail;		
+			SendTCP(vFlags, 0);
+		}
+		else
+			SendTCP(vFlags, SENDTCP_RESET_TIMERS);
+
+	}
+	
+	if(bCloseSocket)
+		CloseSocket();
+
+	#if defined(STACK_USE_TCP_STATS)
+	TCPStatsSyncState();
+	#endif
+}
+
+/*****************************************************************************
+  Function:
+	static TCP_SOCKET TCPTimerTouch(TCP_SOCKET hTCP)
+
+  Summary:
+	Marks a socket as needing its timer queue entry recomputed.
+
+  Description:
+	Called by SyncTCBStub() for every socket it loads.  Any code that arms, 
+	changes, or cancels a timer has to sync the socket first, so listing the 
+	socket here guarantees that TCPTick() picks up the new deadline.
+
+  Precondition:
+	None
+
+  Parameters:
+	hTCP - The socket being loaded.  Must be valid.
+
+  Returns:
+	hTCP, so SyncTCBStub() can be used as a single expression.
+  ***************************************************************************/
+static TCP_SOCKET TCPTimerTouch(TCP_SOCKET hTCP)
+{
+	if(!TCPTimerIsTouched[hTCP])
+	{
+		TCPTimerIsTouched[hTCP] = 1;
+		TCPTimerTouched[TCPTimerTouchedCount++] = hTCP;
+	}
+	
+	return hTCP;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPTimerSchedule(BOOL bNextTick)
+
+  Summary:
+	Updates the timer queue entry of the current socket.
+
+  Description:
+	Finds the earliest pending event of MyTCBStub and moves the socket to 
+	the matching place in the timer queue, or removes it from the queue if 
+	nothing is pending.  Pending transmissions, active SSL sessions, and 
+	listening sockets with SYNs waiting in the SYN queue are due immediately.  
+	The WORD timers in TickGetDiv256() units are converted to TickGet() 
+	times, rounding up so the socket is never serviced before the timer 
+	has actually expired.
+
+  Precondition:
+	MyTCBStub is synced to the socket.
+
+  Parameters:
+	bNextTick - TRUE to schedule nothing earlier than the next TickGet() 
+		value.  TCPTick() uses this after servicing a socket so that sockets 
+		with immediate work pending are handled on the following call.
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPTimerSchedule(BOOL bNextTick)
+{
+	DWORD dwNow;
+	DWORD dwDue;
+	DWORD dwEvent;
+	WORD wNow;
+	BOOL bPending;
+	WORD i;
+	TCP_SOCKET hTCP;
+
+	dwNow = TickGet();
+	wNow = (WORD)TickGetDiv256();
+	dwDue = dwNow;
+	bPending = FALSE;
+
+	// Work that TCPTick() retries until it succeeds
+	if(MyTCBStub.Flags.bTXASAP || MyTCBStub.Flags.bTXASAPWithoutTimerReset)
+		bPending = TRUE;
+	#if defined(STACK_USE_SSL)
+	if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+		bPending = TRUE;
+	#endif
+	#if TCP_SYN_QUEUE_MAX_ENTRIES
+	if((MyTCBStub.smState == TCP_LISTEN) && SYNQueueCount)
+		bPending = TRUE;
+	#endif
+
+	if(!bPending)
+	{
+		// Start far enough in the future that any armed timer is earlier
+		dwDue = dwNow + 0x7FFFFFFFul;
+
+		if(MyTCBStub.Flags.bTimer2Enabled)
+		{
+			dwEvent = dwNow + (LONG)(SHORT)(MyTCBStub.eventTime2 - wNow)*256 + 255;
+			if((LONG)(dwEvent - dwDue) < (LONG)0)
+				dwDue = dwEvent;
+			bPending = TRUE;
+		}
+
+		if(MyTCBStub.Flags.bDelayedACKTimerEnabled)
+		{
+			dwEvent = dwNow + (LONG)(SHORT)(MyTCBStub.OverlappedTimers.delayedACKTime - wNow)*256 + 255;
+			if((LONG)(dwEvent - dwDue) < (LONG)0)
+				dwDue = dwEvent;
+			bPending = TRUE;
+		}
+
+		if(MyTCBStub.smState == TCP_CLOSE_WAIT)
+		{
+			dwEvent = dwNow + (LONG)(SHORT)(MyTCBStub.OverlappedTimers.closeWaitTime - wNow)*256 + 255;
+			if((LONG)(dwEvent - dwDue) < (LONG)0)
+				dwDue = dwEvent;
+			bPending = TRUE;
+		}
+
+		#if defined(TCP_KEEP_ALIVE_TIMEOUT)
+		if(MyTCBStub.Flags.bTimerEnabled || (MyTCBStub.smState == TCP_ESTABLISHED))
+		#else
+		if(MyTCBStub.Flags.bTimerEnabled)
+		#endif
+		{
+			// eventTime may already be long past (TCPOpen() arms it with the
+			// current time), which would compare as later than dwDue
+			dwEvent = MyTCBStub.eventTime;
+			if((LONG)(dwEvent - dwNow) < (LONG)0)
+				dwEvent = dwNow;
+			if((LONG)(dwEvent - dwDue) < (LONG)0)
+				dwDue = dwEvent;
+			bPending = TRUE;
+		}
+	}
+
+	if(bNextTick && ((LONG)(dwDue - dwNow) <= (LONG)0))
+		dwDue = dwNow + 1;
+
+	hTCP = hCurrentTCP;
+	if(!bPending)
+	{
+		// Nothing to do for this socket, so take it out of the queue
+		if(TCPTimerHeapPos[hTCP])
+		{
+			i = TCPTimerHeapPos[hTCP] - 1;
+			TCPTimerHeapPos[hTCP] = 0;
+			if(i != --TCPTimerHeapCount)
+			{
+				TCPTimerHeap[i] = TCPTimerHeap[TCPTimerHeapCount];
+				TCPTimerHeapPos[TCPTimerHeap[i]] = i + 1;
+				TCPTimerHeapFix(i);
+			}
+		}
+		return;
+	}
+
+	TCPTimerDue[hTCP] = dwDue;
+	if(!TCPTimerHeapPos[hTCP])
+	{
+		TCPTimerHeap[TCPTimerHeapCount] = hTCP;
+		TCPTimerHeapPos[hTCP] = ++TCPTimerHeapCount;
+	}
+	TCPTimerHeapFix(TCPTimerHeapPos[hTCP] - 1);
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPTimerHeapFix(WORD i)
+
+  Summary:
+	Restores the timer queue ordering after an entry changed.
+
+  Description:
+	Moves the socket at index i of TCPTimerHeap[] up or down until its 
+	parent is due no later, and its children no earlier, than it is.  
+	TCPTimerHeapPos[] is kept up to date for every socket that moves.
+
+  Precondition:
+	i < TCPTimerHeapCount
+
+  Parameters:
+	i - Index of the entry whose due time changed.
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPTimerHeapFix(WORD i)
+{
+	WORD j;
+	WORD wCount;
+	TCP_SOCKET hTCP;
+	DWORD dwDue;
+
+	// The heap never holds more than TCP_SOCKET_COUNT entries.  Bounding 
+	// every index by that as well lets the compiler see they are all in 
+	// range, even with a single socket.
+	wCount = TCPTimerHeapCount;
+	if(wCount > TCP_SOCKET_COUNT)
+		wCount = TCP_SOCKET_COUNT;
+	if(i >= wCount)
+		return;
+
+	hTCP = TCPTimerHeap[i];
+	dwDue = TCPTimerDue[hTCP];
+
+	// Move toward the root while the parent is due later
+	while(i)
+	{
+		j = (i-1)>>1;
+		if((LONG)(dwDue - TCPTimerDue[TCPTimerHeap[j]]) >= (LONG)0)
+			break;
+		TCPTimerHeap[i] = TCPTimerHeap[j];
+		TCPTimerHeapPos[TCPTimerHeap[i]] = i + 1;
+		i = j;
+	}
+
+	// Move toward the leaves while a child is due earlier
+	while(1)
+	{
+		j = (i<<1) + 1;
+		if(j >= wCount)
+			break;
+		if((j+1 < wCount) && ((LONG)(TCPTimerDue[TCPTimerHeap[j+1]] - TCPTimerDue[TCPTimerHeap[j]]) < (LONG)0))
+			j++;
+		if((LONG)(TCPTimerDue[TCPTimerHeap[j]] - dwDue) >= (LONG)0)
+			break;
+		TCPTimerHeap[i] = TCPTimerHeap[j];
+		TCPTimerHeapPos[TCPTimerHeap[i]] = i + 1;
+		i = j;
+	}
+
+	TCPTimerHeap[i] = hTCP;
+	TCPTimerHeapPos[hTCP] = i + 1;
+}
+
+
+/*****************************************************************************
+  Function:
+	BOOL TCPProcess(NODE_INFO* remote, IP_ADDR* localIP, WORD len)
+
+  Summary:
+  	Handles incoming TCP segments.
+
+  Description:
+	This function handles incoming TCP segments.  When a segment arrives, it
+	is compared to open sockets using a hash of the remote port and IP.  
+	On a match, the data is passed to HandleTCPSeg for further processing.
+
+  Precondition:
+	TCP is initialized and a TCP segment is ready in the MAC buffer.
+
+  Parameters:
+	remote - Remote NODE_INFO structure
+	localIP - This stack's IP address (for header checking)
+	len - Total length of the waiting TCP segment
+
+  Return Values:
+	TRUE - the segment was properly handled.
+	FALSE - otherwise
+  ***************************************************************************/
+BOOL TCPProcess(NODE_INFO* remote, IP_ADDR* localIP, WORD len)
+{
+	TCP_HEADER      TCPHeader;
+	PSEUDO_HEADER   pseudoHeader;
+	WORD_VAL        checksum1;
+	WORD_VAL        checksum2;
+	BYTE            optionsSize;
+
+	// Calculate IP pseudoheader checksum.
+	pseudoHeader.SourceAddress      = remote->IPAddr;
+	pseudoHeader.DestAddress        = *localIP;
+	pseudoHeader.Zero               = 0x0;
+	pseudoHeader.Protocol           = IP_PROT_TCP;
+	pseudoHeader.Length          	= len;
+
+	SwapPseudoHeader(pseudoHeader);
+
+	checksum1.Val = ~CalcIPChecksum((BYTE*)&pseudoHeader,
+		sizeof(pseudoHeader));
+
+	// Now calculate TCP packet checksum in NIC RAM - should match
+	// pesudo header checksum
+	IPSetRxBuffer(0);
+	#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	// Keep the copy so the header and any data for sockets outside of 
+	// TCP_ETH_RAM needn't be read from the MAC again
+	bRXStaged = (len <= sizeof(MACRxStage));
+	if(bRXStaged)
+		checksum2.Val = MACGetArrayChecksum(MACRxStage, len);
+	else
+	#endif
+		checksum2.Val = CalcIPBufferChecksum(len);
+
+	// Compare checksums.
+	if(checksum1.Val != checksum2.Val)
+	{
+		#if defined(STACK_USE_TCP_STATS)
+		TCPStackStats.dwChecksumErrors++;
+		#endif
+		MACDiscardRx();
+		return TRUE;
+	}
+
+#if defined(DEBUG_GENERATE_RX_LOSS)
+	// Throw RX packets away randomly
+	if(LFSRRand() > DEBUG_GENERATE_RX_LOSS)
+	{
+		MACDiscardRx();
+		return TRUE;
+	}
+#endif
+
+	// Retrieve TCP header.
+	#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	if(bRXStaged)
+	{
+		memcpy((void*)&TCPHeader, (void*)MACRxStage, sizeof(TCPHeader));
+		IPSetRxBuffer(sizeof(TCPHeader));
+	}
+	else
+	#endif
+	{
+		IPSetRxBuffer(0);
+		MACGetArray((BYTE*)&TCPHeader, sizeof(TCPHeader));
+	}
+	SwapTCPHeader(&TCPHeader);
+	#if defined(STACK_USE_TCP_STATS)
+	TCPStackStats.dwSegmentsIn++;
+	#endif
+
+
+	// Skip over options to retrieve data bytes
+	optionsSize = (BYTE)((TCPHeader.DataOffset.Val << 2)-
+		sizeof(TCPHeader));
+	len = len - optionsSize - sizeof(TCPHeader);
+
+	// Find matching socket.
+	if(FindMatchingSocket(&TCPHeader, remote))
+	{
+		#if defined(STACK_USE_SSL)
+		PTR_BASE prevRxHead;
+		#endif
+
+		#if defined(STACK_USE_TCP_STATS)
+		TCPStats[hCurrentTCP].dwSegmentsIn++;
+		#endif
+
+		#if defined(STACK_USE_SSL)
+		// For SSL connections, show HandleTCPSeg() the full data buffer
+		prevRxHead = MyTCBStub.rxHead;
+		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+			MyTCBStub.rxHead = MyTCBStub.sslRxHead;
+		#endif
+		
+		HandleTCPSeg(&TCPHeader, len);
+		#if defined(STACK_USE_TCP_STATS)
+		TCPStatsSyncState();
+		#endif
+		
+		#if defined(STACK_USE_SSL)
+		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+		{
+			// Restore the buffer state
+			MyTCBStub.sslRxHead = MyTCBStub.rxHead;
+			MyTCBStub.rxHead = prevRxHead;
+
+			// Process the new SSL data, using the currently loaded stub
+			TCPSSLHandleIncoming(hCurrentTCP);
+		}
+		#endif
+	}
+	#if defined(STACK_USE_TCP_STATS)
+	else
+	{
+		TCPStackStats.dwNoSocket++;
+	}
+	#endif
+//	else
+//	{
+//		// NOTE: RFC 793 specifies that if the socket is closed and a segment 
+//		// arrives, we should send back a RST if the RST bit in the incoming 
+//		// packet is not set.  Instead, we will just silently ignore such a 
+//		// packet since this is what firewalls do on purpose to enhance 
+//		// security.
+//		//if(!TCPHeader.Flags.bits.flagRST)
+//		//	SendTCP(RST, SENDTCP_RESET_TIMERS);
+//	}
+
+	// Finished with this packet, discard it and free the Ethernet RAM for new packets
+	MACDiscardRx();
+
+	return TRUE;
+}
+
+
+/*****************************************************************************
+  Function:
+	static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
+
+  Summary:
+	Transmits a TPC segment.
+
+  Description:
+	This function assembles and transmits a TCP segment, including any 
+	pending data.  It also supports retransmissions, keep-alives, and 
+	other packet types.
+
+  Precondition:
+	TCP is initialized.
+
+  Parameters:
+	vTCPFlags - Additional TCP flags to include
+	vSendFlags - Any combinations of SENDTCP_* constants to modify the
+				 transmit behavior or contents.
+
+  Returns:
+	None
+  ***************************************************************************/
+static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
+{
+	WORD_VAL        wVal;
+	TCP_HEADER      header;
+	BYTE			vOptions[TCP_MAX_OPTIONS_LEN];
+	BYTE			vOptionsLen;
+	PSEUDO_HEADER   pseudoHeader;
+	TCP_FIFO_SIZE	len;
+	TCP_FIFO_SIZE	wCwndRoom;
+	TCP_FIFO_SIZE	wPushed;
+	TCP_FIFO_SIZE	wWindow;
+	WORD			wMSS;
+	
+	SyncTCB();
+
+	// FINs must be handled specially
+	if(vTCPFlags & FIN)
+	{
+		MyTCBStub.Flags.bTXFIN = 1;
+		vTCPFlags &= ~FIN;
+	}
+
+	// Status will now be synched, disable automatic future 
+	// status transmissions
+	MyTCBStub.Flags.bTimer2Enabled = 0;
+	MyTCBStub.Flags.bDelayedACKTimerEnabled = 0;
+	MyTCBStub.Flags.bOneSegmentReceived = 0;
+	MyTCBStub.Flags.bTXASAP = 0;
+	MyTCBStub.Flags.bTXASAPWithoutTimerReset = 0;
+	MyTCBStub.Flags.bHalfFullFlush = 0;
+
+	//  Make sure that we can write to the MAC transmit area
+	while(!IPIsTxReady());
+
+	// Build the TCP options up front, since they sit between the header and 
+	// the data and every option byte is one less data byte per segment
+	vOptionsLen = TCPFormatOptions(vTCPFlags, vOptions);
+	wMSS = MyTCB.wRemoteMSS - vOptionsLen;
+
+	// Find out how many more bytes the congestion window allows in flight.  
+	// A fast retransmission resends one segment from a hole regardless.
+	if(vSendFlags & SENDTCP_FAST_RETRANSMIT)
+	{
+		wCwndRoom = wFastRetransmitLen;
+	}
+	else
+	{
+		wCwndRoom = TCPGetBytesInFlight();
+		wCwndRoom = (MyTCB.wCwnd > wCwndRoom) ? MyTCB.wCwnd - wCwndRoom : 0;
+	}
+
+	// Find out how much data may go in a segment shorter than the MSS.  A 
+	// corked socket sends such a segment only for data that was pushed 
+	// by TCPFlush() or has been sent before, or to get its FIN out.
+	if(vSendFlags & SENDTCP_PUSH)
+	{
+		wPushed = MyTCBStub.txHead - MyTCBStub.txUnackedTail;
+		if(MyTCBStub.txHead < MyTCBStub.txUnackedTail)
+			wPushed += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+		MyTCB.dwPushSeq = MyTCB.MySEQ + wPushed;
+	}
+	wPushed = TCP_FIFO_SIZE_MAX;
+	if(MyTCBStub.Options.bCork && !MyTCBStub.Flags.bTXFIN)
+		wPushed = ((LONG)(MyTCB.dwPushSeq - MyTCB.MySEQ) > (LONG)0) ? (TCP_FIFO_SIZE)(MyTCB.dwPushSeq - MyTCB.MySEQ) : 0;
+
+	// Put all socket application data in the TX space
+	if(vTCPFlags & (SYN | RST))
+	{
+		// Don't put any data in SYN and RST messages
+		len = 0;
+	}
+	else
+	{
+		// Begin copying any application data over to the TX space
+		if(MyTCBStub.txHead == MyTCBStub.txUnackedTail)
+		{
+			// All caught up on data TX, no real data for this packet
+			len = 0;
+		}
+		else if(MyTCBStub.txHead > MyTCBStub.txUnackedTail)
+		{
+			len = MyTCBStub.txHead - MyTCBStub.txUnackedTail;
+
+			if(len > MyTCB.remoteWindow)
+				len = MyTCB.remoteWindow;
+
+			if(len > wCwndRoom)
+				len = wCwndRoom;
+
+			if(len > wMSS)
+			{
+				len = wMSS;
+				MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
+			}
+			else if((len < wMSS) && (len > wPushed))
+				len = wPushed;
+
+			// Copy application data into the raw TX buffer
+			TCPCopyTxData(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+vOptionsLen, MyTCBStub.txUnackedTail, len);
+			MyTCBStub.txUnackedTail += len;
+		}
+		else
+		{
+			len = (MyTCBStub.bufferRxStart - MyTCBStub.txUnackedTail) + (MyTCBStub.txHead - MyTCBStub.bufferTxStart);
+
+			if(len > MyTCB.remoteWindow)
+				len = MyTCB.remoteWindow;
+
+			if(len > wCwndRoom)
+				len = wCwndRoom;
+
+			if(len > wMSS)
+			{
+				len = wMSS;
+				MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
+			}
+			else if((len < wMSS) && (len > wPushed))
+				len = wPushed;
+
+			// Find how much of it comes before the wrap
+			pseudoHeader.Length = len;
+			if(MyTCBStub.bufferRxStart - MyTCBStub.txUnackedTail < len)
+				pseudoHeader.Length = MyTCBStub.bufferRxStart - MyTCBStub.txUnackedTail;
+
+			// Copy application data into the raw TX buffer
+			TCPCopyTxData(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+vOptionsLen, MyTCBStub.txUnackedTail, pseudoHeader.Length);
+			pseudoHeader.Length = len - pseudoHeader.Length;
+	
+			// Copy any left over chunks of application data over
+			if(pseudoHeader.Length)
+			{
+				TCPCopyTxData(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+vOptionsLen+(MyTCBStub.bufferRxStart-MyTCBStub.txUnackedTail), MyTCBStub.bufferTxStart, pseudoHeader.Length);
+			}
+
+			MyTCBStub.txUnackedTail += len;
+			if(MyTCBStub.txUnackedTail >= MyTCBStub.bufferRxStart)
+				MyTCBStub.txUnackedTail -= MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart;
+		}
+
+		// If we are to transmit a FIN, make sure we can put one in this packet
+		if(MyTCBStub.Flags.bTXFIN)
+		{
+			if((len != MyTCB.remoteWindow) && (len != wMSS) && (MyTCBStub.txUnackedTail == MyTCBStub.txHead))
+				vTCPFlags |= FIN;
+		}
+	}
+
+	// Ensure that all packets with data of some kind are 
+	// retransmitted by TCPTick() until acknowledged
+	// Pure ACK packets with no data are not ACKed back in TCP
+	if(len || (vTCPFlags & (SYN | FIN)))
+	{
+		// Transmitting data, update remote window variable to reflect smaller 
+		// window.
+		MyTCB.remoteWindow -= len;
+
+		// Push (PSH) all data for enhanced responsiveness on 
+		// the remote end, especially with GUIs
+		if(len)
+			vTCPFlags |= PSH;
+
+		// Data sent once is never held back by TCP_OPT_CORK when resent
+		if((LONG)(MyTCB.MySEQ + len - MyTCB.dwPushSeq) > (LONG)0)
+			MyTCB.dwPushSeq = MyTCB.MySEQ + len;
+
+		if(vSendFlags & SENDTCP_RESET_TIMERS)
+		{
+			MyTCB.retryCount = 0;
+			MyTCB.retryInterval = MyTCB.dwRTO;
+		}	
+
+		// Time this segment if nothing else is being timed and it carries 
+		// new data or our initial SYN.  Sequence space at or before 
+		// dwRTTSeq may have been retransmitted and must not be sampled.
+		if(!MyTCB.flags.bRTTTiming)
+		{
+			if(((vTCPFlags & SYN) && !MyTCB.flags.bSYNSent) || (len && ((LONG)(MyTCB.MySEQ - MyTCB.dwRTTSeq) >= (LONG)0)))
+			{
+				MyTCB.dwRTTSeq = MyTCB.MySEQ + len;
+				if(vTCPFlags & SYN)
+					MyTCB.dwRTTSeq++;
+				MyTCB.dwRTTStartTime = TickGet();
+				MyTCB.flags.bRTTTiming = 1;
+			}
+		}
+
+		MyTCBStub.eventTime = TickGet() + MyTCB.retryInterval;
+		MyTCBStub.Flags.bTimerEnabled = 1;
+	}
+	else if(vSendFlags & SENDTCP_KEEP_ALIVE)
+	{
+		// Increment Keep Alive TX counter to handle disconnection if not response is returned
+		MyTCBStub.Flags.vUnackedKeepalives++;
+		
+		// Generate a dummy byte
+		MyTCB.MySEQ -= 1;
+		len = 1;
+	}
+	else if(MyTCBStub.Flags.bTimerEnabled) 
+	{
+		// If we have data to transmit, but the remote RX window is zero, 
+		// so we aren't transmitting any right now then make sure to not 
+		// extend the retry counter or timer.  This will stall our TX 
+		// with a periodic ACK sent to the remote node.
+		if(!(vSendFlags & SENDTCP_RESET_TIMERS))
+		{
+			// Roll back retry counters since we can't send anything, 
+			// but only if we incremented it in the first place
+			if(MyTCB.retryCount)
+			{
+				MyTCB.retryCount--;
+				MyTCB.retryInterval >>= 1;
+			}
+		}
+	
+		MyTCBStub.eventTime = TickGet() + MyTCB.retryInterval;
+	}
+	
+
+	header.SourcePort			= MyTCB.localPort.Val;
+	header.DestPort				= MyTCB.remotePort.Val;
+	header.SeqNumber			= MyTCB.MySEQ;
+	header.AckNumber			= MyTCB.RemoteSEQ;
+	header.Flags.bits.Reserved2	= 0;
+	header.DataOffset.Reserved3	= 0;
+	header.Flags.byte			= vTCPFlags;
+	header.UrgentPointer        = 0;
+
+	// Update our send sequence number and ensure retransmissions 
+	// of SYNs and FINs use the right sequence number
+	MyTCB.MySEQ += (DWORD)len;
+	if(vTCPFlags & SYN)
+	{
+		// SEG.ACK needs to be zero for the first SYN packet for compatibility 
+		// with certain paranoid TCP/IP stacks, even though the ACK flag isn't 
+		// set (indicating that the AckNumber field is unused).
+		if(!(vTCPFlags & ACK))
+			header.AckNumber = 0x00000000;
+
+		if(MyTCB.flags.bSYNSent)
+			header.SeqNumber--;
+		else
+		{
+			MyTCB.MySEQ++;
+			MyTCB.flags.bSYNSent = 1;
+		}
+	}
+	if(vTCPFlags & FIN)
+	{
+        MyTCB.flags.bFINSent = 1;   // do not advance the seq no for FIN!
+	}
+	else if(MyTCB.flags.bFINSent && !MyTCBStub.Flags.bTXFIN)
+	{
+		// Our FIN has been ACKed, so the remote node has counted its
+		// sequence number.  The final ACK must come after it or the remote
+		// node drops it and stays in TCP_LAST_ACK.
+		header.SeqNumber++;
+	}
+
+	// Calculate the amount of free space in the RX buffer area of this socket
+	if(MyTCBStub.rxHead >= MyTCBStub.rxTail)
+		wWindow = (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart) - (MyTCBStub.rxHead - MyTCBStub.rxTail);
+	else
+		wWindow = MyTCBStub.rxTail - MyTCBStub.rxHead - 1;
+
+	// Calculate the amount of free space in the MAC RX buffer area and adjust 
+	// window if needed.  A MAC that reports 0xFFFF never runs low, and mustn't 
+	// cap a scaled window at 64KB.
+	wVal.Val = MACGetFreeRxSize();
+	if(wVal.Val != 0xFFFFu)
+	{
+		if(wVal.Val < 64)
+			wVal.Val = 0;
+		else
+			wVal.Val -= 64;
+
+		// Force the remote node to throttle back if we are running low on general RX buffer space
+		if(wWindow > wVal.Val)
+			wWindow = wVal.Val;
+	}
+
+	// The window in a SYN is never scaled (RFC 7323)
+	if(!(vTCPFlags & SYN))
+		wWindow >>= MyTCB.vLocalWindowShift;
+	#if defined(TCP_LARGE_FIFOS)
+	if(wWindow > 0xFFFFu)
+		wWindow = 0xFFFFu;
+	#endif
+	header.Window = (WORD)wWindow;
+
+	SwapTCPHeader(&header);
+
+
+	len += sizeof(header) + vOptionsLen;
+	header.DataOffset.Val   = (sizeof(header) + vOptionsLen) >> 2;
+
+	// Calculate IP pseudoheader checksum.
+	pseudoHeader.SourceAddress	= AppConfig.MyIPAddr;
+	pseudoHeader.DestAddress    = MyTCB.remote.niRemoteMACIP.IPAddr;
+	pseudoHeader.Zero           = 0x0;
+	pseudoHeader.Protocol       = IP_PROT_TCP;
+	pseudoHeader.Length			= len;
+	SwapPseudoHeader(pseudoHeader);
+	header.Checksum = ~CalcIPChecksum((BYTE*)&pseudoHeader, sizeof(pseudoHeader));
+
+	// Write IP header
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
+	IPPutHeader(&MyTCB.remote.niRemoteMACIP, IP_PROT_TCP, len);
+	MACPutArray((BYTE*)&header, sizeof(header));
+	if(vOptionsLen)
+		MACPutArray(vOptions, vOptionsLen);
+
+	// Update the TCP checksum
+	MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
+	wVal.Val = CalcIPBufferChecksum(len);
+#if defined(DEBUG_GENERATE_TX_LOSS)
+	// Damage TCP checksums on TX packets randomly
+	if(LFSRRand() > DEBUG_GENERATE_TX_LOSS)
+	{
+		wVal.Val++;
+	}
+#endif
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER) + 16);
+	MACPutArray((BYTE*)&wVal, sizeof(WORD));
+
+	// Physically start the packet transmission over the network
+	MACFlush();
+
+	TCPStatsCount(dwSegmentsOut);
+	if(vSendFlags & SENDTCP_FAST_RETRANSMIT)
+		TCPStatsCount(dwRetransmits);
+	#if defined(STACK_USE_TCP_STATS)
+	TCPStatsSyncState();
+	#endif
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPUpdateRTT(DWORD dwAckNumber)
+
+  Summary:
+	Completes a round trip time sample and recomputes the retransmission 
+	timeout.
+
+  Description:
+	If a segment is being timed and dwAckNumber acknowledges it, the elapsed 
+	time is fed into the RFC 6298 estimator.  SRTT is kept scaled by 8 and 
+	RTTVAR scaled by 4 so that the 1/8 and 1/4 gains reduce to shifts.  The 
+	new timeout is SRTT + 4*RTTVAR, clamped to TCP_MIN_RTO and TCP_MAX_RTO.
+
+  Precondition:
+	TCB is synched.
+
+  Parameters:
+	dwAckNumber - Acknowledgement number of the segment just received.
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPUpdateRTT(DWORD dwAckNumber)
+{
+	DWORD dwRTT;
+	LONG lDelta;
+
+	if(!MyTCB.flags.bRTTTiming)
+		return;
+	if((LONG)(dwAckNumber - MyTCB.dwRTTSeq) < (LONG)0)
+		return;
+
+	MyTCB.flags.bRTTTiming = 0;
+	dwRTT = TickGet() - MyTCB.dwRTTStartTime;
+
+	if(MyTCB.dwSRTT == 0u)
+	{
+		// First measurement: SRTT = R, RTTVAR = R/2
+		MyTCB.dwSRTT = (dwRTT << 3) | 1;	// | 1 keeps a 0 tick sample distinguishable from "no sample yet"
+		MyTCB.dwRTTVAR = dwRTT << 1;
+	}
+	else
+	{
+		// SRTT += (R - SRTT)/8
+		lDelta = (LONG)dwRTT - (LONG)(MyTCB.dwSRTT >> 3);
+		MyTCB.dwSRTT += lDelta;
+		if(MyTCB.dwSRTT == 0u)
+			MyTCB.dwSRTT = 1;
+
+		// RTTVAR += (|R - SRTT| - RTTVAR)/4
+		if(lDelta < 0)
+			lDelta = -lDelta;
+		lDelta -= (LONG)(MyTCB.dwRTTVAR >> 2);
+		MyTCB.dwRTTVAR += lDelta;
+	}
+
+	// RTO = SRTT + 4*RTTVAR
+	MyTCB.dwRTO = (MyTCB.dwSRTT >> 3) + MyTCB.dwRTTVAR;
+	if(MyTCB.dwRTO < TCP_MIN_RTO)
+		MyTCB.dwRTO = TCP_MIN_RTO;
+	else if(MyTCB.dwRTO > TCP_MAX_RTO)
+		MyTCB.dwRTO = TCP_MAX_RTO;
+
+	// A fresh estimate replaces any backed off timeout for the next 
+	// retransmission of whatever is still outstanding
+	if(MyTCB.retryCount == 0u)
+		MyTCB.retryInterval = MyTCB.dwRTO;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPCancelRTTSample(void)
+
+  Summary:
+	Abandons the current round trip time sample before a retransmission.
+
+  Description:
+	Implements Karn's algorithm.  Once sequence space is retransmitted, an 
+	ACK covering it could belong to either copy, so the sample in progress 
+	is dropped.  dwRTTSeq is moved to the highest sequence number sent so 
+	far so that SendTCP() will not start timing again until new data goes 
+	out.
+
+  Precondition:
+	TCB is synched and MySEQ has not yet been rolled back for the 
+	retransmission.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPCancelRTTSample(void)
+{
+	MyTCB.flags.bRTTTiming = 0;
+	if((LONG)(MyTCB.MySEQ - MyTCB.dwRTTSeq) > (LONG)0)
+		MyTCB.dwRTTSeq = MyTCB.MySEQ;
+}
+
+/*****************************************************************************
+  Function:
+	static TCP_FIFO_SIZE TCPGetBytesInFlight(void)
+
+  Summary:
+	Determines how many transmitted bytes are still unacknowledged.
+
+  Description:
+	Returns the number of bytes between the TX tail pointer and the TX 
+	unacked tail pointer, accounting for FIFO wrap.  After a timeout 
+	rolls txUnackedTail back, this only counts what has been resent.
+
+  Precondition:
+	TCB is synched.
+
+  Parameters:
+	None
+
+  Returns:
+	Number of bytes in flight.
+  ***************************************************************************/
+static TCP_FIFO_SIZE TCPGetBytesInFlight(void)
+{
+	TCP_FIFO_SIZE w;
+
+	w = MyTCBStub.txUnackedTail - MyTCBStub.txTail;
+	if(MyTCBStub.txUnackedTail < MyTCBStub.txTail)
+		w += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+
+	return w;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPResetCongestionWindow(void)
+
+  Summary:
+	Puts the congestion control state back to slow start.
+
+  Description:
+	Sets the congestion window to the RFC 5681 initial window, which 
+	depends on the remote MSS, and leaves slow start unbounded until the 
+	first loss.  Called when a socket is reset and again once the MSS 
+	option of the remote node is known.  With TCP_NO_CONGESTION_CONTROL 
+	the window is opened all the way and stays there.
+
+  Precondition:
+	TCB is synched.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPResetCongestionWindow(void)
+{
+	// IW = min(4*MSS, max(2*MSS, 4380 bytes))
+	if(MyTCB.wRemoteMSS > 2190u)
+		MyTCB.wCwnd = MyTCB.wRemoteMSS<<1;
+	else if(MyTCB.wRemoteMSS > 1095u)
+		MyTCB.wCwnd = 4380u;
+	else
+		MyTCB.wCwnd = MyTCB.wRemoteMSS<<2;
 
-			case TCP_CLOSING:
-				if(MyTCB.retryCount < TCP_MAX_RETRIES)
-				{
-					// Send another ACK+FIN (the FIN is retransmitted 
-					// automatically since it hasn't been acknowledged by 
-					// the remote node yet)
-					vFlags = ACK;
-					bRetransmit = TRUE;
-				}
-				else
-				{
-					// Close on our own, we can't seem to communicate 
-					// with the remote node anymore
-					vFlags = RST | ACK;
-					bCloseSocket = TRUE;
-				}
-				break;
-	
-//			case TCP_TIME_WAIT:
-//				// Wait around for a while (2MSL) and then goto closed state
-//				bCloseSocket = TRUE;
-//				break;
-//			
+	#if defined(TCP_NO_CONGESTION_CONTROL)
+		MyTCB.wCwnd = TCP_FIFO_SIZE_MAX;
+	#endif
 
-			case TCP_LAST_ACK:
-				// Send some more FINs or close anyway
-				if(MyTCB.retryCount < TCP_MAX_RETRIES)
-				{
-					vFlags = FIN | ACK;
-					bRetransmit = TRUE;
-				}
-				else
-				{
-					vFlags = RST | ACK;
-					bCloseSocket = TRUE;
-				}
-				break;
-			
-			default:
-				break;
-		}
+	MyTCB.wSsthresh = TCP_FIFO_SIZE_MAX;
+	MyTCB.dwRecover = MyTCB.MySEQ;
+	MyTCB.vDupACKs = 0;
+	MyTCB.flags.bFastRecovery = 0;
+}
 
-		if(vFlags)
-		{
-			// Transmit all unacknowledged data over again
-			if(bRetransmit)
-			{
-				// Set the appropriate retry time
-				MyTCB.retryCount++;
-				MyTCB.retryInterval <<= 1;
-		
-				// Calculate how many bytes we have to roll back and retransmit
-				w = MyTCB.txUnackedTail - MyTCBStub.txTail;
-				if(MyTCB.txUnackedTail < MyTCBStub.txTail)
-					w += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
-				
-				// Perform roll back of local SEQuence counter, remote window 
-				// adjustment, and cause all unacknowledged data to be 
-				// retransmitted by moving the unacked tail pointer.
-				MyTCB.MySEQ -= w;
-				MyTCB.remoteWindow += w;
-				MyTCB.txUnackedTail = MyTCBStub.txTail;		
-				SendTCP(vFlags, 0);
-			}
-			else
-				SendTCP(vFlags, SENDTCP_RESET_TIMERS);
+/*****************************************************************************
+  Function:
+	static void TCPCongestionAck(TCP_FIFO_SIZE wAcked, DWORD dwAckNumber)
+
+  Summary:
+	Updates the congestion window for an ACK of new data.
+
+  Description:
+	Outside of fast recovery, the window grows by up to one MSS per ACK in 
+	slow start and by about one MSS per round trip in congestion avoidance 
+	(RFC 5681).  During fast recovery, an ACK that covers the recovery 
+	point ends it and deflates the window to ssthresh.  A partial ACK means 
+	another segment from the same window was lost, so that segment is 
+	resent right away instead of waiting for the retransmission timer 
+	(NewReno, RFC 6582).
+
+  Precondition:
+	TCB is synched and the acknowledged bytes have been removed from the 
+	TX FIFO.
+
+  Parameters:
+	wAcked - Number of bytes newly acknowledged
+	dwAckNumber - Acknowledgement number of the segment just received
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPCongestionAck(TCP_FIFO_SIZE wAcked, DWORD dwAckNumber)
+{
+	TCP_FIFO_SIZE wGrowth;
 
+	MyTCB.vDupACKs = 0;
+
+	if(MyTCB.flags.bFastRecovery)
+	{
+		if((LONG)(dwAckNumber - MyTCB.dwRecover) >= (LONG)0)
+		{
+			// Full ACK: everything that was outstanding when the loss was 
+			// detected has arrived
+			MyTCB.wCwnd = MyTCB.wSsthresh;
+			MyTCB.flags.bFastRecovery = 0;
+			wGrowth = 0;
 		}
-		
-		if(bCloseSocket)
-			CloseSocket();
-	}
-	
-	
-	#if TCP_SYN_QUEUE_MAX_ENTRIES
-		// Process SYN Queue entry timeouts
-		for(w = 0; w < TCP_SYN_QUEUE_MAX_ENTRIES; w++)
+		else
 		{
-			// Abort search if there are no more valid records
-			if(SYNQueue[w].wDestPort == 0u)
-				break;
-			
-			// See if this SYN has timed out
-			if((WORD)TickGetDiv256() - SYNQueue[w].wTimestamp > (WORD)(TCP_SYN_QUEUE_TIMEOUT/256ull))
-			{
-				// Delete this SYN from the SYNQueue and compact the SYNQueue[] array
-				TCPRAMCopy((PTR_BASE)&SYNQueue[w], TCP_PIC_RAM, (PTR_BASE)&SYNQueue[w+1], TCP_PIC_RAM, (TCP_SYN_QUEUE_MAX_ENTRIES-1u-w)*sizeof(TCP_SYN_QUEUE));
-				SYNQueue[TCP_SYN_QUEUE_MAX_ENTRIES-1].wDestPort = 0u;
-	
-				// Since we deleted an entry, we need to roll back one 
-				// index so next loop will process the correct record
-				w--;	
-			}
+			// Partial ACK: the first unacknowledged segment is the next 
+			// hole.  With SACK it may already have been resent from the 
+			// scoreboard, otherwise always resend it.
+			if(!MyTCB.flags.bSACKPermitted)
+				MyTCB.wSACKHighRxt = 0;
+			TCPRetransmitNextHole();
+			MyTCB.wCwnd = (MyTCB.wCwnd > wAcked) ? MyTCB.wCwnd - wAcked : 0;
+			wGrowth = MyTCB.wRemoteMSS;
 		}
-	#endif
-}
+	}
+	else if(MyTCB.wCwnd < MyTCB.wSsthresh)
+	{
+		// Slow start
+		wGrowth = (wAcked < MyTCB.wRemoteMSS) ? wAcked : MyTCB.wRemoteMSS;
+	}
+	else
+	{
+		// Congestion avoidance
+		wGrowth = ((DWORD)MyTCB.wRemoteMSS * MyTCB.wRemoteMSS) / MyTCB.wCwnd + 1;
+	}
 
+	// Saturate rather than wrap, which a 32 bit TCP_FIFO_SIZE otherwise 
+	// would once the window reaches TCP_FIFO_SIZE_MAX
+	MyTCB.wCwnd = (MyTCB.wCwnd <= TCP_FIFO_SIZE_MAX - wGrowth) ? MyTCB.wCwnd + wGrowth : TCP_FIFO_SIZE_MAX;
+	TCPScheduleNewData();
+}
 
 /*****************************************************************************
   Function:
-	BOOL TCPProcess(NODE_INFO* remote, IP_ADDR* localIP, WORD len)
+	static void TCPCongestionDupAck(DWORD dwAckNumber)
 
   Summary:
-  	Handles incoming TCP segments.
+	Counts a duplicate ACK and starts fast retransmit when needed.
 
   Description:
-	This function handles incoming TCP segments.  When a segment arrives, it
-	is compared to open sockets using a hash of the remote port and IP.  
-	On a match, the data is passed to HandleTCPSeg for further processing.
+	On the TCP_DUP_ACK_THRESHOLD'th duplicate, the missing segment is 
+	resent immediately, ssthresh is set to half the data in flight, and 
+	fast recovery begins with the window inflated by the segments known 
+	to have left the network.  Each further duplicate inflates the window 
+	by one more MSS so new data can keep flowing.  A new recovery is only 
+	started once the previous recovery point has been passed, so a single 
+	loss event halves the window only once.  With 
+	TCP_NO_CONGESTION_CONTROL duplicates are only counted.
 
   Precondition:
-	TCP is initialized and a TCP segment is ready in the MAC buffer.
+	TCB is synched.
 
   Parameters:
-	remote - Remote NODE_INFO structure
-	localIP - This stack's IP address (for header checking)
-	len - Total length of the waiting TCP segment
+	dwAckNumber - Acknowledgement number of the duplicate ACK
 
-  Return Values:
-	TRUE - the segment was properly handled.
-	FALSE - otherwise
+  Returns:
+	None
   ***************************************************************************/
-BOOL TCPProcess(NODE_INFO* remote, IP_ADDR* localIP, WORD len)
+static void TCPCongestionDupAck(DWORD dwAckNumber)
 {
-	TCP_HEADER      TCPHeader;
-	PSEUDO_HEADER   pseudoHeader;
-	WORD_VAL        checksum1;
-	WORD_VAL        checksum2;
-	BYTE            optionsSize;
-
-	// Calculate IP pseudoheader checksum.
-	pseudoHeader.SourceAddress      = remote->IPAddr;
-	pseudoHeader.DestAddress        = *localIP;
-	pseudoHeader.Zero               = 0x0;
-	pseudoHeader.Protocol           = IP_PROT_TCP;
-	pseudoHeader.Length          	= len;
+	TCP_FIFO_SIZE w;
 
-	SwapPseudoHeader(pseudoHeader);
+	if(MyTCB.vDupACKs != 0xFFu)
+		MyTCB.vDupACKs++;
 
-	checksum1.Val = ~CalcIPChecksum((BYTE*)&pseudoHeader,
-		sizeof(pseudoHeader));
+	#if defined(TCP_NO_CONGESTION_CONTROL)
+		return;
+	#endif
 
-	// Now calculate TCP packet checksum in NIC RAM - should match
-	// pesudo header checksum
-	checksum2.Val = CalcIPBufferChecksum(len);
+	if(MyTCB.flags.bFastRecovery)
+	{
+		if(MyTCB.wCwnd <= TCP_FIFO_SIZE_MAX - MyTCB.wRemoteMSS)
+			MyTCB.wCwnd += MyTCB.wRemoteMSS;
 
-	// Compare checksums.
-	if(checksum1.Val != checksum2.Val)
+		// Another segment left the network, so with SACK the next hole 
+		// can be repaired now rather than one per round trip
+		if(MyTCB.flags.bSACKPermitted)
+			TCPRetransmitNextHole();
+	}
+	else if(MyTCB.vDupACKs == TCP_DUP_ACK_THRESHOLD)
 	{
-		MACDiscardRx();
-		return TRUE;
+		if((LONG)(dwAckNumber - MyTCB.dwRecover) > (LONG)0)
+		{
+			// ssthresh = max(FlightSize/2, 2*MSS)
+			w = TCPGetBytesInFlight()>>1;
+			if(w < ((TCP_FIFO_SIZE)MyTCB.wRemoteMSS<<1))
+				w = MyTCB.wRemoteMSS<<1;
+			MyTCB.wSsthresh = w;
+			MyTCB.dwRecover = MyTCB.MySEQ;
+
+			MyTCB.wSACKHighRxt = 0;
+			TCPRetransmitNextHole();
+
+			// cwnd = ssthresh + 3*MSS
+			w = MyTCB.wRemoteMSS * TCP_DUP_ACK_THRESHOLD;
+			MyTCB.wCwnd = (MyTCB.wSsthresh <= TCP_FIFO_SIZE_MAX - w) ? MyTCB.wSsthresh + w : TCP_FIFO_SIZE_MAX;
+			MyTCB.flags.bFastRecovery = 1;
+		}
 	}
 
-#if defined(DEBUG_GENERATE_RX_LOSS)
-	// Throw RX packets away randomly
-	if(LFSRRand() > DEBUG_GENERATE_RX_LOSS)
+	TCPScheduleNewData();
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPCongestionTimeout(void)
+
+  Summary:
+	Collapses the congestion window after a retransmission timeout.
+
+  Description:
+	Sets ssthresh to half the data in flight (only on the first timeout 
+	of a series, so repeated backoffs don't keep shrinking it) and 
+	restarts slow start from one segment.  Any fast recovery in progress 
+	is abandoned.  With TCP_NO_CONGESTION_CONTROL the window is left 
+	open and only the SACK scoreboard is forgotten.
+
+  Precondition:
+	TCB is synched, retryCount has been incremented for this timeout, and 
+	the TX pointers have not yet been rolled back.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPCongestionTimeout(void)
+{
+	TCP_FIFO_SIZE w;
+
+	// The remote node is allowed to discard data it SACKed (RFC 2018), and 
+	// everything is about to be resent anyway
+	MyTCB.vSACKedRangeCount = 0;
+	MyTCB.wSACKHighRxt = 0;
+
+	#if defined(TCP_NO_CONGESTION_CONTROL)
+		return;
+	#endif
+
+	if(MyTCB.retryCount <= 1u)
 	{
-		MACDiscardRx();
-		return TRUE;
+		w = TCPGetBytesInFlight()>>1;
+		if(w < ((TCP_FIFO_SIZE)MyTCB.wRemoteMSS<<1))
+			w = MyTCB.wRemoteMSS<<1;
+		MyTCB.wSsthresh = w;
 	}
-#endif
 
-	// Retrieve TCP header.
-	IPSetRxBuffer(0);
-	MACGetArray((BYTE*)&TCPHeader, sizeof(TCPHeader));
-	SwapTCPHeader(&TCPHeader);
+	MyTCB.wCwnd = MyTCB.wRemoteMSS;
+	MyTCB.vDupACKs = 0;
+	MyTCB.flags.bFastRecovery = 0;
+	if((LONG)(MyTCB.MySEQ - MyTCB.dwRecover) > (LONG)0)
+		MyTCB.dwRecover = MyTCB.MySEQ;
+}
 
+/*****************************************************************************
+  Function:
+	static BOOL TCPRetransmitNextHole(void)
 
-	// Skip over options to retrieve data bytes
-	optionsSize = (BYTE)((TCPHeader.DataOffset.Val << 2)-
-		sizeof(TCPHeader));
-	len = len - optionsSize - sizeof(TCPHeader);
+  Summary:
+	Resends the next segment the remote node is known to be missing.
 
-	// Find matching socket.
-	if(FindMatchingSocket(&TCPHeader, remote))
+  Description:
+	Starting at wSACKHighRxt (the first byte not yet resent during this 
+	recovery), SACKed data is skipped and one segment is resent from the 
+	hole that follows.  Without SACK information the only known hole is 
+	the first unacknowledged segment.  A hole beyond the highest SACKed 
+	range isn't known to be lost, so nothing is sent for it.
+	
+	The TX unacked tail pointer is temporarily moved to the hole, as a 
+	timeout retransmission would, and restored afterwards so that the 
+	rest of the data in flight isn't sent a second time.
+
+  Precondition:
+	TCB is synched and the scoreboard is up to date for this ACK.
+
+  Parameters:
+	None
+
+  Returns:
+	TRUE if a segment was retransmitted, FALSE if there was no known hole.
+  ***************************************************************************/
+static BOOL TCPRetransmitNextHole(void)
+{
+	DWORD dwSavedSEQ;
+	PTR_BASE wSavedUnackedTail;
+	DWORD dwSavedWindow;
+	TCP_FIFO_SIZE wInFlight;
+	TCP_FIFO_SIZE wStart;
+	TCP_FIFO_SIZE wEnd;
+	BYTE i;
+
+	wInFlight = TCPGetBytesInFlight();
+
+	// Find the hole: skip anything already resent or SACKed, and stop at 
+	// the next SACKed range
+	wStart = MyTCB.wSACKHighRxt;
+	wEnd = (wStart == 0u) ? wInFlight : 0;
+	for(i = 0; i < MyTCB.vSACKedRangeCount; i++)
 	{
-		#if defined(STACK_USE_SSL)
-		PTR_BASE prevRxHead;
-		// For SSL connections, show HandleTCPSeg() the full data buffer
-		prevRxHead = MyTCBStub.rxHead;
-		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
-			MyTCBStub.rxHead = MyTCBStub.sslRxHead;
-		#endif
-		
-		HandleTCPSeg(&TCPHeader, len);
-		
-		#if defined(STACK_USE_SSL)
-		if(MyTCBStub.sslStubID != SSL_INVALID_ID)
+		if(MyTCB.SACKedRanges[i].wEnd <= wStart)
+			continue;
+		if(MyTCB.SACKedRanges[i].wStart <= wStart)
 		{
-			// Restore the buffer state
-			MyTCBStub.sslRxHead = MyTCBStub.rxHead;
-			MyTCBStub.rxHead = prevRxHead;
+			wStart = MyTCB.SACKedRanges[i].wEnd;
+			continue;
+		}
+		wEnd = MyTCB.SACKedRanges[i].wStart;
+		break;
+	}
+	if(wEnd > wInFlight)
+		wEnd = wInFlight;
+	if(wStart >= wEnd)
+		return FALSE;
 
-			// Process the new SSL data, using the currently loaded stub
-			TCPSSLHandleIncoming(hCurrentTCP);
+	// This data has been sent before (Karn's algorithm)
+	TCPCancelRTTSample();
+
+	dwSavedSEQ = MyTCB.MySEQ;
+	wSavedUnackedTail = MyTCBStub.txUnackedTail;
+	dwSavedWindow = MyTCB.remoteWindow;
+
+	MyTCB.MySEQ -= wInFlight - wStart;
+	MyTCB.remoteWindow += wInFlight - wStart;
+	MyTCBStub.txUnackedTail = MyTCBStub.txTail + wStart;
+	if(MyTCBStub.txUnackedTail >= MyTCBStub.bufferRxStart)
+		MyTCBStub.txUnackedTail -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+	wFastRetransmitLen = wEnd - wStart;
+	SendTCP(ACK, SENDTCP_FAST_RETRANSMIT);
+	MyTCB.wSACKHighRxt = wStart + (TCP_FIFO_SIZE)(MyTCB.MySEQ - (dwSavedSEQ - (wInFlight - wStart)));
+
+	MyTCB.MySEQ = dwSavedSEQ;
+	MyTCBStub.txUnackedTail = wSavedUnackedTail;
+	MyTCB.remoteWindow = dwSavedWindow;
+	MyTCBStub.Flags.bTXASAPWithoutTimerReset = 0;
+
+	return TRUE;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPScheduleNewData(void)
+
+  Summary:
+	Arranges for unsent data to go out if the congestion window allows.
+
+  Description:
+	SendTCP() stops at the congestion window, so data left in the TX FIFO 
+	would otherwise wait for the next flush or auto-transmit timeout.  
+	When an ACK opens the window, TCPTick() is asked to transmit as soon 
+	as possible without resetting the retransmission timer.
+
+  Precondition:
+	TCB is synched.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPScheduleNewData(void)
+{
+	if(MyTCBStub.txHead == MyTCBStub.txUnackedTail)
+		return;
+
+	if(MyTCB.wCwnd > TCPGetBytesInFlight())
+		MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
+}
+
+/*****************************************************************************
+  Function:
+	static TCP_FIFO_SIZE TCPRangeAdvance(TCP_SEQ_RANGE* vRanges, BYTE* vCount, TCP_FIFO_SIZE wLen)
+
+  Summary:
+	Moves the base of a range list forward.
+
+  Description:
+	Used both for out-of-order RX data (based at the RX head pointer) and 
+	for the SACK scoreboard (based at the TX tail pointer).  Ranges that 
+	the first wLen bytes cover are dropped.  If those bytes reach the first 
+	range, that range joins them.  The remaining ranges are rebased so 
+	their offsets stay relative to the new base.
+
+  Precondition:
+	vRanges is sorted, disjoint and non-adjacent.
+
+  Parameters:
+	vRanges - Range list to update
+	vCount - Number of valid entries in vRanges, updated on return
+	wLen - Number of bytes the base is moving forward
+
+  Returns:
+	Number of additional bytes, beyond wLen, that the base must move 
+	because a range now touches it.
+  ***************************************************************************/
+static TCP_FIFO_SIZE TCPRangeAdvance(TCP_SEQ_RANGE* vRanges, BYTE* vCount, TCP_FIFO_SIZE wLen)
+{
+	BYTE i, j;
+	TCP_FIFO_SIZE wJoined;
+
+	wJoined = 0;
+	for(i = 0; i < *vCount; i++)
+	{
+		if(vRanges[i].wStart > wLen)
+			break;
+
+		// This range touches or is covered by the bytes before the new base
+		if(vRanges[i].wEnd > wLen)
+		{
+			wJoined += vRanges[i].wEnd - wLen;
+			wLen = vRanges[i].wEnd;
 		}
-		#endif
 	}
-//	else
-//	{
-//		// NOTE: RFC 793 specifies that if the socket is closed and a segment 
-//		// arrives, we should send back a RST if the RST bit in the incoming 
-//		// packet is not set.  Instead, we will just silently ignore such a 
-//		// packet since this is what firewalls do on purpose to enhance 
-//		// security.
-//		//if(!TCPHeader.Flags.bits.flagRST)
-//		//	SendTCP(RST, SENDTCP_RESET_TIMERS);
-//	}
 
-	// Finished with this packet, discard it and free the Ethernet RAM for new packets
-	MACDiscardRx();
+	// Rebase and compact whatever is still ahead of a hole
+	for(j = 0; i < *vCount; i++, j++)
+	{
+		vRanges[j].wStart = vRanges[i].wStart - wLen;
+		vRanges[j].wEnd = vRanges[i].wEnd - wLen;
+	}
+	*vCount = j;
 
-	return TRUE;
+	return wJoined;
 }
 
-
 /*****************************************************************************
   Function:
-	static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
+	static void TCPRangeInsert(TCP_SEQ_RANGE* vRanges, BYTE* vCount, 
+							   BYTE vMaxCount, TCP_FIFO_SIZE wStart, 
+							   TCP_FIFO_SIZE wEnd)
 
   Summary:
-	Transmits a TPC segment.
+	Adds a range to a sorted range list.
 
   Description:
-	This function assembles and transmits a TCP segment, including any 
-	pending data.  It also supports retransmissions, keep-alives, and 
-	other packet types.
+	Keeps vRanges sorted, disjoint and non-adjacent, merging the new range 
+	with every existing range it overlaps or touches.  If all vMaxCount 
+	entries are in use and the new range can't be merged, the range 
+	farthest from the base is forgotten, since it matters last.  For RX 
+	data, forgotten data is simply retransmitted by the remote node later.  
+	For the SACK scoreboard, a forgotten range may be resent needlessly.
 
   Precondition:
-	TCP is initialized.
+	vRanges is sorted, disjoint and non-adjacent, and wStart > 0.
 
   Parameters:
-	vTCPFlags - Additional TCP flags to include
-	vSendFlags - Any combinations of SENDTCP_* constants to modify the
-				 transmit behavior or contents.
+	vRanges - Range list to update
+	vCount - Number of valid entries in vRanges, updated on return
+	vMaxCount - Capacity of vRanges
+	wStart - Offset of the first byte, relative to the base
+	wEnd - Offset one past the last byte
 
   Returns:
 	None
   ***************************************************************************/
-static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
+static void TCPRangeInsert(TCP_SEQ_RANGE* vRanges, BYTE* vCount, BYTE vMaxCount, TCP_FIFO_SIZE wStart, TCP_FIFO_SIZE wEnd)
 {
-	WORD_VAL        wVal;
-	TCP_HEADER      header;
-	TCP_OPTIONS     options;
-	PSEUDO_HEADER   pseudoHeader;
-	WORD 			len;
-	
-	SyncTCB();
+	BYTE i, j, k;
 
-	// FINs must be handled specially
-	if(vTCPFlags & FIN)
+	// Skip ranges that end before the new one starts (and don't touch it)
+	for(i = 0; i < *vCount; i++)
 	{
-		MyTCBStub.Flags.bTXFIN = 1;
-		vTCPFlags &= ~FIN;
+		if(vRanges[i].wEnd >= wStart)
+			break;
 	}
 
-	// Status will now be synched, disable automatic future 
-	// status transmissions
-	MyTCBStub.Flags.bTimer2Enabled = 0;
-	MyTCBStub.Flags.bDelayedACKTimerEnabled = 0;
-	MyTCBStub.Flags.bOneSegmentReceived = 0;
-	MyTCBStub.Flags.bTXASAP = 0;
-	MyTCBStub.Flags.bTXASAPWithoutTimerReset = 0;
-	MyTCBStub.Flags.bHalfFullFlush = 0;
-
-	//  Make sure that we can write to the MAC transmit area
-	while(!IPIsTxReady());
+	// Absorb every range that overlaps or touches the new one
+	for(j = i; j < *vCount; j++)
+	{
+		if(vRanges[j].wStart > wEnd)
+			break;
+		if(vRanges[j].wStart < wStart)
+			wStart = vRanges[j].wStart;
+		if(vRanges[j].wEnd > wEnd)
+			wEnd = vRanges[j].wEnd;
+	}
 
-	// Put all socket application data in the TX space
-	if(vTCPFlags & (SYN | RST))
+	if(j != i)
 	{
-		// Don't put any data in SYN and RST messages
-		len = 0;
+		// Ranges i through j-1 collapse into entry i
+		vRanges[i].wStart = wStart;
+		vRanges[i].wEnd = wEnd;
+		for(k = i+1; j < *vCount; j++, k++)
+			vRanges[k] = vRanges[j];
+		*vCount = k;
+		return;
 	}
-	else
+
+	// A new disjoint range goes in at position i.  Make room if needed by 
+	// forgetting the farthest range, unless the new one is the farthest.
+	if(*vCount >= vMaxCount)
 	{
-		// Begin copying any application data over to the TX space
-		if(MyTCBStub.txHead == MyTCB.txUnackedTail)
-		{
-			// All caught up on data TX, no real data for this packet
-			len = 0;
-		}
-		else if(MyTCBStub.txHead > MyTCB.txUnackedTail)
-		{
-			len = MyTCBStub.txHead - MyTCB.txUnackedTail;
+		if(i >= vMaxCount)
+			return;
+		(*vCount)--;
+	}
+	for(k = *vCount; k > i; k--)
+		vRanges[k] = vRanges[k-1];
+	vRanges[i].wStart = wStart;
+	vRanges[i].wEnd = wEnd;
+	(*vCount)++;
+}
 
-			if(len > MyTCB.remoteWindow)
-				len = MyTCB.remoteWindow;
+/*****************************************************************************
+  Function:
+	static BYTE TCPFormatOptions(BYTE vTCPFlags, BYTE* vOptions)
 
-			if(len > MyTCB.wRemoteMSS)
-			{
-				len = MyTCB.wRemoteMSS;
-				MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
-			}
+  Summary:
+	Builds the TCP options for an outgoing segment.
 
-			// Copy application data into the raw TX buffer
-			TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), TCP_ETH_RAM, MyTCB.txUnackedTail, MyTCBStub.vMemoryMedium, len);
-			MyTCB.txUnackedTail += len;
-		}
-		else
-		{
-			pseudoHeader.Length = MyTCBStub.bufferRxStart - MyTCB.txUnackedTail;
-			len = pseudoHeader.Length + MyTCBStub.txHead - MyTCBStub.bufferTxStart;
+  Description:
+	SYN segments carry our Maximum Segment Size and, when we're opening the 
+	connection or the remote node offered them, SACK-permitted and our 
+	window scale shift count.  Other 
+	segments carry a SACK option describing the out-of-order data held in 
+	the RX FIFO, if SACK was negotiated and any exists.  The block holding 
+	the most recently received segment goes first, as RFC 2018 requires.
 
-			if(len > MyTCB.remoteWindow)
-				len = MyTCB.remoteWindow;
+  Precondition:
+	TCB is synched.
 
-			if(len > MyTCB.wRemoteMSS)
-			{
-				len = MyTCB.wRemoteMSS;
-				MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
-			}
+  Parameters:
+	vTCPFlags - TCP flags of the segment being built
+	vOptions - Buffer of at least TCP_MAX_OPTIONS_LEN bytes
 
-			if(pseudoHeader.Length > len)
-				pseudoHeader.Length = len;
+  Returns:
+	Number of option bytes written, always a multiple of 4.
+  ***************************************************************************/
+static BYTE TCPFormatOptions(BYTE vTCPFlags, BYTE* vOptions)
+{
+	BYTE i, j;
+	BYTE vLen;
+	BYTE vRecent;
+	TCP_FIFO_SIZE wRecent;
+	DWORD_VAL dwVal;
 
-			// Copy application data into the raw TX buffer
-			TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), TCP_ETH_RAM, MyTCB.txUnackedTail, MyTCBStub.vMemoryMedium, pseudoHeader.Length);
-			pseudoHeader.Length = len - pseudoHeader.Length;
-	
-			// Copy any left over chunks of application data over
-			if(pseudoHeader.Length)
-			{
-				TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+(MyTCBStub.bufferRxStart-MyTCB.txUnackedTail), TCP_ETH_RAM, MyTCBStub.bufferTxStart, MyTCBStub.vMemoryMedium, pseudoHeader.Length);
-			}
+	if(vTCPFlags & SYN)
+	{
+		vOptions[0] = TCP_OPTIONS_MAX_SEG_SIZE;
+		vOptions[1] = 4;
+		vOptions[2] = (BYTE)((TCP_MAX_SEG_SIZE_RX)>>8);
+		vOptions[3] = (BYTE)(TCP_MAX_SEG_SIZE_RX);
+		vLen = 4;
 
-			MyTCB.txUnackedTail += len;
-			if(MyTCB.txUnackedTail >= MyTCBStub.bufferRxStart)
-				MyTCB.txUnackedTail -= MyTCBStub.bufferRxStart-MyTCBStub.bufferTxStart;
+		if(!(vTCPFlags & ACK) || MyTCB.flags.bSACKPermitted)
+		{
+			vOptions[vLen++] = TCP_OPTIONS_NO_OP;
+			vOptions[vLen++] = TCP_OPTIONS_NO_OP;
+			vOptions[vLen++] = TCP_OPTIONS_SACK_PERMITTED;
+			vOptions[vLen++] = 2;
 		}
 
-		// If we are to transmit a FIN, make sure we can put one in this packet
-		if(MyTCBStub.Flags.bTXFIN)
+		if(!(vTCPFlags & ACK) || MyTCB.flags.bWindowScale)
 		{
-			if((len != MyTCB.remoteWindow) && (len != MyTCB.wRemoteMSS))
-				vTCPFlags |= FIN;
+			vOptions[vLen++] = TCP_OPTIONS_NO_OP;
+			vOptions[vLen++] = TCP_OPTIONS_WINDOW_SCALE;
+			vOptions[vLen++] = 3;
+			vOptions[vLen++] = MyTCB.vLocalWindowShift;
 		}
+		return vLen;
 	}
 
-	// Ensure that all packets with data of some kind are 
-	// retransmitted by TCPTick() until acknowledged
-	// Pure ACK packets with no data are not ACKed back in TCP
-	if(len || (vTCPFlags & (SYN | FIN)))
-	{
-		// Transmitting data, update remote window variable to reflect smaller 
-		// window.
-		MyTCB.remoteWindow -= len;
-
-		// Push (PSH) all data for enhanced responsiveness on 
-		// the remote end, especially with GUIs
-		if(len)
-			vTCPFlags |= PSH;
-
-		if(vSendFlags & SENDTCP_RESET_TIMERS)
-		{
-			MyTCB.retryCount = 0;
-			MyTCB.retryInterval = TCP_START_TIMEOUT_VAL;
-		}	
+	if((vTCPFlags & RST) || !MyTCB.flags.bSACKPermitted || (MyTCB.vOOORangeCount == 0u))
+		return 0;
 
-		MyTCBStub.eventTime = TickGet() + MyTCB.retryInterval;
-		MyTCBStub.Flags.bTimerEnabled = 1;
-	}
-	else if(vSendFlags & SENDTCP_KEEP_ALIVE)
+	// Find the range holding the most recently received segment
+	vRecent = 0xFF;
+	wRecent = (TCP_FIFO_SIZE)(MyTCB.dwSACKRecentSeq - MyTCB.RemoteSEQ);
+	for(i = 0; i < MyTCB.vOOORangeCount; i++)
 	{
-		// Increment Keep Alive TX counter to handle disconnection if not response is returned
-		MyTCBStub.Flags.vUnackedKeepalives++;
-		
-		// Generate a dummy byte
-		MyTCB.MySEQ -= 1;
-		len = 1;
+		if((wRecent >= MyTCB.OOORanges[i].wStart) && (wRecent < MyTCB.OOORanges[i].wEnd))
+			vRecent = i;
 	}
-	else if(MyTCBStub.Flags.bTimerEnabled) 
+
+	vOptions[0] = TCP_OPTIONS_NO_OP;
+	vOptions[1] = TCP_OPTIONS_NO_OP;
+	vOptions[2] = TCP_OPTIONS_SACK;
+	vLen = 4;
+	for(j = 0; j <= MyTCB.vOOORangeCount; j++)
 	{
-		// If we have data to transmit, but the remote RX window is zero, 
-		// so we aren't transmitting any right now then make sure to not 
-		// extend the retry counter or timer.  This will stall our TX 
-		// with a periodic ACK sent to the remote node.
-		if(!(vSendFlags & SENDTCP_RESET_TIMERS))
+		// Pass 0 emits the most recent range, the rest follow in order
+		if(j == 0u)
 		{
-			// Roll back retry counters since we can't send anything, 
-			// but only if we incremented it in the first place
-			if(MyTCB.retryCount)
-			{
-				MyTCB.retryCount--;
-				MyTCB.retryInterval >>= 1;
-			}
+			if(vRecent == 0xFFu)
+				continue;
+			i = vRecent;
 		}
-	
-		MyTCBStub.eventTime = TickGet() + MyTCB.retryInterval;
-	}
-	
-
-	header.SourcePort			= MyTCB.localPort.Val;
-	header.DestPort				= MyTCB.remotePort.Val;
-	header.SeqNumber			= MyTCB.MySEQ;
-	header.AckNumber			= MyTCB.RemoteSEQ;
-	header.Flags.bits.Reserved2	= 0;
-	header.DataOffset.Reserved3	= 0;
-	header.Flags.byte			= vTCPFlags;
-	header.UrgentPointer        = 0;
-
-	// Update our send sequence number and ensure retransmissions 
-	// of SYNs and FINs use the right sequence number
-	MyTCB.MySEQ += (DWORD)len;
-	if(vTCPFlags & SYN)
-	{
-		// SEG.ACK needs to be zero for the first SYN packet for compatibility 
-		// with certain paranoid TCP/IP stacks, even though the ACK flag isn't 
-		// set (indicating that the AckNumber field is unused).
-		if(!(vTCPFlags & ACK))
-			header.AckNumber = 0x00000000;
-
-		if(MyTCB.flags.bSYNSent)
-			header.SeqNumber--;
 		else
 		{
-			MyTCB.MySEQ++;
-			MyTCB.flags.bSYNSent = 1;
+			i = j - 1;
+			if(i == vRecent)
+				continue;
 		}
+
+		if(vLen + 8u > TCP_MAX_OPTIONS_LEN)
+			break;
+
+		dwVal.Val = MyTCB.RemoteSEQ + MyTCB.OOORanges[i].wStart;
+		vOptions[vLen++] = dwVal.v[3];
+		vOptions[vLen++] = dwVal.v[2];
+		vOptions[vLen++] = dwVal.v[1];
+		vOptions[vLen++] = dwVal.v[0];
+		dwVal.Val = MyTCB.RemoteSEQ + MyTCB.OOORanges[i].wEnd;
+		vOptions[vLen++] = dwVal.v[3];
+		vOptions[vLen++] = dwVal.v[2];
+		vOptions[vLen++] = dwVal.v[1];
+		vOptions[vLen++] = dwVal.v[0];
 	}
-	if(vTCPFlags & FIN)
+	vOptions[3] = vLen - 2;
+
+	return vLen;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPSACKUpdate(TCP_FIFO_SIZE wAcked)
+
+  Summary:
+	Updates the SACK scoreboard from the segment just received.
+
+  Description:
+	The scoreboard lists TX data the remote node has reported receiving 
+	beyond SND.UNA, as offsets from the TX tail pointer.  Newly 
+	acknowledged bytes rebase it, then each SACK block parsed by 
+	GetTCPOptions() is merged in.  Blocks at or below SND.UNA (D-SACK) 
+	or beyond the data in the TX FIFO are ignored.
+
+  Precondition:
+	TCB is synched, GetTCPOptions() has been called for this segment, and 
+	the acknowledged bytes have been removed from the TX FIFO.
+
+  Parameters:
+	wAcked - Number of bytes newly acknowledged by this segment
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPSACKUpdate(TCP_FIFO_SIZE wAcked)
+{
+	DWORD dwUna;
+	TCP_FIFO_SIZE wQueued;
+	BYTE i;
+
+	if(!MyTCB.flags.bSACKPermitted)
+		return;
+
+	if(wAcked)
 	{
-        MyTCB.flags.bFINSent = 1;   // do not advance the seq no for FIN!
+		TCPRangeAdvance(MyTCB.SACKedRanges, &MyTCB.vSACKedRangeCount, wAcked);
+		MyTCB.wSACKHighRxt = (MyTCB.wSACKHighRxt > wAcked) ? MyTCB.wSACKHighRxt - wAcked : 0;
 	}
 
-	// Calculate the amount of free space in the RX buffer area of this socket
-	if(MyTCBStub.rxHead >= MyTCBStub.rxTail)
-		header.Window = (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart) - (MyTCBStub.rxHead - MyTCBStub.rxTail);
-	else
-		header.Window = MyTCBStub.rxTail - MyTCBStub.rxHead - 1;
+	// Sequence number of the TX tail pointer and how much is queued after it
+	dwUna = MyTCB.MySEQ - TCPGetBytesInFlight();
+	wQueued = MyTCBStub.txHead - MyTCBStub.txTail;
+	if(MyTCBStub.txHead < MyTCBStub.txTail)
+		wQueued += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
 
-	// Calculate the amount of free space in the MAC RX buffer area and adjust window if needed
-	wVal.Val = MACGetFreeRxSize();
-	if(wVal.Val < 64)
-    {
-		wVal.Val = 0;
-    }
-    else
-    {
-		wVal.Val -= 64;
-    }
-	// Force the remote node to throttle back if we are running low on general RX buffer space
-	if(header.Window > wVal.Val)
-		header.Window = wVal.Val;
+	for(i = 0; i < vRXSACKBlocks; i++)
+	{
+		if((LONG)(dwRXSACKLeft[i] - dwUna) <= (LONG)0)
+			continue;
+		if((LONG)(dwRXSACKRight[i] - dwRXSACKLeft[i]) <= (LONG)0)
+			continue;
+		if((LONG)(dwRXSACKRight[i] - dwUna) > (LONG)wQueued)
+			continue;
 
-	SwapTCPHeader(&header);
+		TCPRangeInsert(MyTCB.SACKedRanges, &MyTCB.vSACKedRangeCount, TCP_MAX_SACK_RANGES, (TCP_FIFO_SIZE)(dwRXSACKLeft[i] - dwUna), (TCP_FIFO_SIZE)(dwRXSACKRight[i] - dwUna));
+	}
+}
 
+// Removes one hash table entry
+static void TCPHashRemove(WORD wKey, TCP_SOCKET hTCP)
+{
+	WORD i, j, k;
 
-	len += sizeof(header);
-	header.DataOffset.Val   = sizeof(header) >> 2;
+	// Find the entry
+	for(i = TCPHashSlot(wKey); TCPHashTable[i].hTCP != INVALID_SOCKET; i = (i+1) & (TCP_HASH_TABLE_SIZE-1))
+	{
+		if(TCPHashTable[i].hTCP == hTCP && TCPHashTable[i].wKey == wKey)
+			break;
+	}
+	if(TCPHashTable[i].hTCP == INVALID_SOCKET)
+		return;
 
-	// Insert the MSS (Maximum Segment Size) TCP option if this is SYN packet
-	if(vTCPFlags & SYN)
+	// Shift following entries back into the hole so that no probe sequence 
+	// gets cut short.  An entry can fill the hole only if its home slot is 
+	// not cyclically between the hole and where the entry is now.
+	j = i;
+	while(1)
 	{
-		len += sizeof(options);
-		options.Kind = TCP_OPTIONS_MAX_SEG_SIZE;
-		options.Length = 0x04;
+		j = (j+1) & (TCP_HASH_TABLE_SIZE-1);
+		if(TCPHashTable[j].hTCP == INVALID_SOCKET)
+			break;
+		k = TCPHashSlot(TCPHashTable[j].wKey);
+		if((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+			continue;
+		TCPHashTable[i] = TCPHashTable[j];
+		i = j;
+	}
+	TCPHashTable[i].hTCP = INVALID_SOCKET;
+}
 
-		// Load MSS and swap to big endian
-		options.MaxSegSize.Val = (((TCP_MAX_SEG_SIZE_RX)&0x00FF)<<8) | (((TCP_MAX_SEG_SIZE_RX)&0xFF00)>>8);
+// Adds one hash table entry and remembers its key so it can be removed later
+static void TCPHashInsert(WORD wKey, TCP_SOCKET hTCP)
+{
+	WORD i;
 
-		header.DataOffset.Val   += sizeof(options) >> 2;
-	}
+	for(i = TCPHashSlot(wKey); TCPHashTable[i].hTCP != INVALID_SOCKET; i = (i+1) & (TCP_HASH_TABLE_SIZE-1));
+	TCPHashTable[i].wKey = wKey;
+	TCPHashTable[i].hTCP = hTCP;
+	TCPHashKeys[hTCP][TCPHashKeyCount[hTCP]++] = wKey;
+}
 
-	// Calculate IP pseudoheader checksum.
-	pseudoHeader.SourceAddress	= AppConfig.MyIPAddr;
-	pseudoHeader.DestAddress    = MyTCB.remote.niRemoteMACIP.IPAddr;
-	pseudoHeader.Zero           = 0x0;
-	pseudoHeader.Protocol       = IP_PROT_TCP;
-	pseudoHeader.Length			= len;
-	SwapPseudoHeader(pseudoHeader);
-	header.Checksum = ~CalcIPChecksum((BYTE*)&pseudoHeader, sizeof(pseudoHeader));
+/*****************************************************************************
+  Function:
+	static void TCPHashSync(void)
 
-	// Write IP header
-	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
-	IPPutHeader(&MyTCB.remote.niRemoteMACIP, IP_PROT_TCP, len);
-	MACPutArray((BYTE*)&header, sizeof(header));
-	if(vTCPFlags & SYN)
-		MACPutArray((BYTE*)&options, sizeof(options));
+  Summary:
+	Updates the socket hash table for the current socket.
 
-	// Update the TCP checksum
-	MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
-	wVal.Val = CalcIPBufferChecksum(len);
-#if defined(DEBUG_GENERATE_TX_LOSS)
-	// Damage TCP checksums on TX packets randomly
-	if(LFSRRand() > DEBUG_GENERATE_TX_LOSS)
+  Description:
+	Removes every hash table entry belonging to the socket in hCurrentTCP 
+	and re-inserts it under its current remoteHash (and SSL listening port,
+	for SSL servers).  Sockets in the TCP_CLOSED state are not inserted.  
+	This must be called any time smState moves to or from TCP_CLOSED or 
+	remoteHash changes, or else FindMatchingSocket() will not find the 
+	socket.
+	
+  Precondition:
+	The TCPStub corresponding to the socket to be updated is synced.
+
+  Parameters:
+	None
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPHashSync(void)
+{
+	// Remove the old entries
+	while(TCPHashKeyCount[hCurrentTCP])
 	{
-		wVal.Val++;
+		TCPHashKeyCount[hCurrentTCP]--;
+		TCPHashRemove(TCPHashKeys[hCurrentTCP][TCPHashKeyCount[hCurrentTCP]], hCurrentTCP);
 	}
-#endif
-	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER) + 16);
-	MACPutArray((BYTE*)&wVal, sizeof(WORD));
 
-	// Physically start the packet transmission over the network
-	MACFlush();
+	if(MyTCBStub.smState == TCP_CLOSED)
+		return;
+
+	// Insert the new ones
+	TCPHashInsert(MyTCBStub.remoteHash.Val, hCurrentTCP);
+	#if defined(STACK_USE_SSL_SERVER)
+	if(MyTCBStub.smState == TCP_LISTEN && MyTCBStub.sslTxHead != 0u && (WORD)MyTCBStub.sslTxHead != MyTCBStub.remoteHash.Val)
+		TCPHashInsert((WORD)MyTCBStub.sslTxHead, hCurrentTCP);
+	#endif
 }
 
 /*****************************************************************************
@@ -3212,6 +5570,7 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 	TCP_SOCKET hTCP;
 	TCP_SOCKET partialMatch;
 	WORD hash;
+	WORD i;
 
 	// Prevent connections on invalid port 0
 	if(h->DestPort == 0u)
@@ -3220,44 +5579,52 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 	partialMatch = INVALID_SOCKET;
 	hash = (remote->IPAddr.w[1]+remote->IPAddr.w[0] + h->SourcePort) ^ h->DestPort;
 
-	// Loop through all sockets looking for a socket that is expecting this 
-	// packet or can handle it.
-	for(hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++ )
+	// Look up sockets that are expecting this packet.  Only the sockets whose 
+	// hash matches are visited, and the full TCB is loaded only for those.  
+	// The table never fills up, so there is always an empty slot to stop at.
+	for(i = TCPHashSlot(hash); TCPHashTable[i].hTCP != INVALID_SOCKET; i = (i+1) & (TCP_HASH_TABLE_SIZE-1))
 	{
-		SyncTCBStub(hTCP);
-
-		if(MyTCBStub.smState == TCP_CLOSED)
-		{
-			continue;
-		}
-		else if(MyTCBStub.smState == TCP_LISTEN)
-		{// For listening ports, check if this is the correct port
-			if(MyTCBStub.remoteHash.Val == h->DestPort)
-				partialMatch = hTCP;
-			
-			#if defined(STACK_USE_SSL_SERVER)
-			// Check the SSL port as well for SSL Servers
-			// 0 is defined as an invalid port number
-			if(MyTCBStub.sslTxHead == h->DestPort)
-				partialMatch = hTCP;
-			#endif
-			
+		if(TCPHashTable[i].wKey != hash)
 			continue;
-		}
-		else if(MyTCBStub.remoteHash.Val != hash)
-		{// Ignore if the hash doesn't match
+
+		SyncTCBStub(TCPHashTable[i].hTCP);
+		if(MyTCBStub.smState == TCP_CLOSED || MyTCBStub.smState == TCP_LISTEN || MyTCBStub.remoteHash.Val != hash)
 			continue;
-		}
 
-		SyncTCB();
+		SyncTCBForRead();
 		if(	h->DestPort == MyTCB.localPort.Val &&
 			h->SourcePort == MyTCB.remotePort.Val &&
 			remote->IPAddr.Val == MyTCB.remote.niRemoteMACIP.IPAddr.Val)
 		{
+			// HandleTCPSeg() will update this TCB
+			SyncTCB();
 			return TRUE;
 		}
 	}
 
+	// Look up listening sockets that can handle this packet.  These are 
+	// keyed on their local port (and SSL port, for SSL servers).
+	for(i = TCPHashSlot(h->DestPort); TCPHashTable[i].hTCP != INVALID_SOCKET; i = (i+1) & (TCP_HASH_TABLE_SIZE-1))
+	{
+		if(TCPHashTable[i].wKey != h->DestPort)
+			continue;
+
+		hTCP = TCPHashTable[i].hTCP;
+		SyncTCBStub(hTCP);
+		if(MyTCBStub.smState != TCP_LISTEN)
+			continue;
+
+		if(MyTCBStub.remoteHash.Val == h->DestPort)
+			partialMatch = hTCP;
+			
+		#if defined(STACK_USE_SSL_SERVER)
+		// Check the SSL port as well for SSL Servers
+		// 0 is defined as an invalid port number
+		if(MyTCBStub.sslTxHead == h->DestPort)
+			partialMatch = hTCP;
+		#endif
+	}
+
 
 	// If there is a partial match, then a listening socket is currently 
 	// available.  Set up the extended TCB with the info needed 
@@ -3285,11 +5652,12 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 		if(partialMatch != INVALID_SOCKET)
 		{
 			MyTCBStub.remoteHash.Val = hash;
+			TCPHashSync();
 		
 			memcpy((void*)&MyTCB.remote, (void*)remote, sizeof(NODE_INFO));
 			MyTCB.remotePort.Val = h->SourcePort;
 			MyTCB.localPort.Val = h->DestPort;
-			MyTCB.txUnackedTail	= MyTCBStub.bufferTxStart;
+			MyTCBStub.txUnackedTail	= MyTCBStub.bufferTxStart;
 		
 			// All done, and we have a match
 			return TRUE;
@@ -3300,39 +5668,33 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 	// SSL requests, perhaps no SSL sessions were available.  However,
 	// there may be a server socket which is currently busy but 
 	// could handle this packet, so we should check.
-	#if TCP_SYN_QUEUE_MAX_ENTRIES
+	#if TCP_SYN_QUEUE_MAX_ENTRIES || defined(TCP_SYN_COOKIES)
 	{
-		WORD wQueueInsertPos;
+		#if TCP_SYN_QUEUE_MAX_ENTRIES
+		WORD k, wIndex;
+		#endif
 		
 		// See if this is a SYN packet
 		if(!h->Flags.bits.flagSYN)
 			return FALSE;
 
-		// See if there is space in our SYN queue
-		if(SYNQueue[TCP_SYN_QUEUE_MAX_ENTRIES-1].wDestPort)
-			return FALSE;
-		
-		// See if we have this SYN already in our SYN queue.
-		// If not already in the queue, find out where we 
-		// should insert this SYN to the queue
-		for(wQueueInsertPos = 0; wQueueInsertPos < TCP_SYN_QUEUE_MAX_ENTRIES; wQueueInsertPos++)
+		#if TCP_SYN_QUEUE_MAX_ENTRIES
+		// See if we have this SYN already in our SYN queue.  A retransmitted 
+		// SYN keeps its original place in line and its timestamp.
+		for(wIndex = 0; SYNQueueCount && (wIndex < TCP_SYN_QUEUE_MAX_ENTRIES); wIndex++)
 		{
-			// Exit loop if we found a free record
-			if(SYNQueue[wQueueInsertPos].wDestPort == 0u)
-				break;
-
 			// Check if this SYN packet is already in the SYN queue
-			if(SYNQueue[wQueueInsertPos].wDestPort != h->DestPort)
+			if(SYNQueue[wIndex].wDestPort != h->DestPort)
 				continue;
-			if(SYNQueue[wQueueInsertPos].wSourcePort != h->SourcePort)
+			if(SYNQueue[wIndex].wSourcePort != h->SourcePort)
 				continue;
-			if(SYNQueue[wQueueInsertPos].niSourceAddress.IPAddr.Val != remote->IPAddr.Val)
+			if(SYNQueue[wIndex].niSourceAddress.IPAddr.Val != remote->IPAddr.Val)
 				continue;
 
-			// SYN matches SYN queue entry.  Update timestamp and do nothing.
-			SYNQueue[wQueueInsertPos].wTimestamp = TickGetDiv256();
+			// SYN matches SYN queue entry.  Do nothing.
 			return FALSE;
 		}
+		#endif
 		
 		// Check to see if we have any server sockets which 
 		// are currently connected, but could handle this SYN 
@@ -3343,7 +5705,7 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 			if(!MyTCBStub.Flags.bServer)
 				continue;
 
-			SyncTCB();
+			SyncTCBForRead();
 			#if defined(STACK_USE_SSL_SERVER)
 			if((MyTCB.localPort.Val != h->DestPort) && (MyTCB.localSSLPort.Val != h->DestPort))
 			#else
@@ -3351,12 +5713,34 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 			#endif
 				continue;
 
-			// Generate the SYN queue entry
-			memcpy((void*)&SYNQueue[wQueueInsertPos].niSourceAddress, (void*)remote, sizeof(NODE_INFO));
-			SYNQueue[wQueueInsertPos].wSourcePort = h->SourcePort;
-			SYNQueue[wQueueInsertPos].dwSourceSEQ = h->SeqNumber;
-			SYNQueue[wQueueInsertPos].wDestPort = h->DestPort;
-			SYNQueue[wQueueInsertPos].wTimestamp = TickGetDiv256();
+			#if TCP_SYN_QUEUE_MAX_ENTRIES
+			// Generate the SYN queue entry in the first free slot at or 
+			// after the tail of the ring, reusing slots that were freed 
+			// out of order
+			if(SYNQueueCount < TCP_SYN_QUEUE_MAX_ENTRIES)
+			{
+				for(k = 0; SYNQueue[SYNQueueIndex(k)].wDestPort != 0u; k++);
+				wIndex = SYNQueueIndex(k);
+				SYNQueueTail = (wIndex + 1) % TCP_SYN_QUEUE_MAX_ENTRIES;
+				SYNQueueCount++;
+				memcpy((void*)&SYNQueue[wIndex].niSourceAddress, (void*)remote, sizeof(NODE_INFO));
+				SYNQueue[wIndex].wSourcePort = h->SourcePort;
+				SYNQueue[wIndex].dwSourceSEQ = h->SeqNumber;
+				SYNQueue[wIndex].wDestPort = h->DestPort;
+				SYNQueue[wIndex].wTimestamp = TickGetDiv256();
+				SYNQueue[wIndex].wRemoteMSS = GetTCPOptions();
+				SYNQueue[wIndex].vRemoteWindowShift = vRXWindowShift;
+				SYNQueue[wIndex].Flags.bSACKPermitted = bRXSACKPermitted;
+				SYNQueue[wIndex].Flags.bWindowScale = bRXWindowScale;
+				return FALSE;
+			}
+			#endif
+
+			// No room to remember this SYN, so answer it without keeping 
+			// any state at all
+			#if defined(TCP_SYN_COOKIES)
+			TCPSendSYNCookie(h, remote);
+			#endif
 
 			return FALSE;
 		}
@@ -3367,6 +5751,222 @@ static BOOL FindMatchingSocket(TCP_HEADER* h, NODE_INFO* remote)
 
 }
 
+#if defined(TCP_SYN_COOKIES)
+/*****************************************************************************
+  Function:
+	static DWORD TCPSYNCookie(DWORD dwRemoteIP, WORD wRemotePort, 
+		WORD wLocalPort, DWORD dwRemoteISN, BYTE vTime, BYTE vMSSIndex, 
+		BYTE vOptions)
+
+  Summary:
+	Computes a SYN cookie.
+
+  Description:
+	The cookie is used as our initial sequence number.  Bits 31-27 hold 
+	the time counter, bits 26-25 the index of the MSS in wSYNCookieMSS[], 
+	bits 24-20 the TCP_SYN_COOKIE_* options, and bits 19-0 a keyed hash of 
+	the connection's addresses, the remote node's initial sequence number, 
+	and everything else in the cookie.  The hash is a fast integer mix 
+	keyed with dwSYNCookieSecret rather than a cryptographic MAC; it only 
+	has to make blind guessing of a valid cookie impractical.
+
+  Precondition:
+	None
+
+  Parameters:
+	dwRemoteIP - Remote IP address
+	wRemotePort - Remote TCP port
+	wLocalPort - Local TCP port
+	dwRemoteISN - Sequence number of the remote node's SYN
+	vTime - Value of TCPSYNCookieTime() when the cookie is issued
+	vMSSIndex - Index into wSYNCookieMSS[]
+	vOptions - TCP_SYN_COOKIE_SACK and TCP_SYN_COOKIE_WS_MASK bits
+
+  Returns:
+	The cookie.
+  ***************************************************************************/
+static DWORD TCPSYNCookie(DWORD dwRemoteIP, WORD wRemotePort, WORD wLocalPort, DWORD dwRemoteISN, BYTE vTime, BYTE vMSSIndex, BYTE vOptions)
+{
+	DWORD dwInput[4];
+	DWORD dwHash;
+	BYTE i;
+
+	dwInput[0] = dwRemoteIP;
+	dwInput[1] = ((DWORD)wRemotePort<<16) | wLocalPort;
+	dwInput[2] = dwRemoteISN;
+	dwInput[3] = ((DWORD)vTime<<16) | ((DWORD)vMSSIndex<<8) | vOptions;
+
+	dwHash = dwSYNCookieSecret;
+	for(i = 0; i < 4u; i++)
+	{
+		dwHash ^= dwInput[i];
+		dwHash *= 0x9E3779B1ul;
+		dwHash ^= dwHash >> 15;
+		dwHash *= 0x85EBCA6Bul;
+		dwHash ^= dwHash >> 13;
+	}
+
+	return ((DWORD)vTime<<27) | ((DWORD)vMSSIndex<<25) | ((DWORD)vOptions<<20) | (dwHash & 0x000FFFFFul);
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPSendSYNCookie(TCP_HEADER* h, NODE_INFO* remote)
+
+  Summary:
+	Answers a SYN with a SYN+ACK whose sequence number is a SYN cookie.
+
+  Description:
+	Used when a SYN arrives for a busy server port and the SYN queue is 
+	full.  No socket is involved, so the segment is built directly from 
+	the incoming header and advertises a window of one TCP_MAX_SEG_SIZE_RX 
+	segment.  The MSS sent to us by the remote node is rounded down to one 
+	wSYNCookieMSS[] entry and encoded in the cookie, along with its SACK 
+	and window scale options, which are echoed back so both sides agree 
+	on them.  Which socket will take the connection isn't known yet, so 
+	our own window scale shift is 0.
+
+  Precondition:
+	The SYN is being processed via TCPProcess() and its header has been 
+	swapped to host byte order.
+
+  Parameters:
+	h - Header of the incoming SYN
+	remote - Remote node info
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPSendSYNCookie(TCP_HEADER* h, NODE_INFO* remote)
+{
+	TCP_HEADER		header;
+	PSEUDO_HEADER	pseudoHeader;
+	BYTE			vOptions[12];
+	BYTE			vLen;
+	BYTE			vCookieOptions;
+	WORD_VAL		wVal;
+	WORD			wMSS;
+	BYTE			i;
+
+	// Encode the largest supported MSS the remote node can take, and the 
+	// SACK and window scale options it offered
+	wMSS = GetTCPOptions();
+	for(i = sizeof(wSYNCookieMSS)/sizeof(wSYNCookieMSS[0]) - 1; i && (wSYNCookieMSS[i] > wMSS); i--);
+	vCookieOptions = 0;
+	if(bRXSACKPermitted)
+		vCookieOptions |= TCP_SYN_COOKIE_SACK;
+	if(bRXWindowScale)
+		vCookieOptions |= vRXWindowShift + 1u;
+
+	//  Make sure that we can write to the MAC transmit area
+	while(!IPIsTxReady());
+
+	header.SourcePort			= h->DestPort;
+	header.DestPort				= h->SourcePort;
+	header.SeqNumber			= TCPSYNCookie(remote->IPAddr.Val, h->SourcePort, h->DestPort, h->SeqNumber, TCPSYNCookieTime(), i, vCookieOptions);
+	header.AckNumber			= h->SeqNumber + 1;
+	header.Flags.bits.Reserved2	= 0;
+	header.DataOffset.Reserved3	= 0;
+	header.Flags.byte			= SYN | ACK;
+	header.Window				= TCP_MAX_SEG_SIZE_RX;
+	header.UrgentPointer		= 0;
+	SwapTCPHeader(&header);
+
+	// Same option layout as SendTCP()
+	vOptions[0] = TCP_OPTIONS_MAX_SEG_SIZE;
+	vOptions[1] = 4;
+	vOptions[2] = (BYTE)((TCP_MAX_SEG_SIZE_RX)>>8);
+	vOptions[3] = (BYTE)(TCP_MAX_SEG_SIZE_RX);
+	vLen = 4;
+	if(vCookieOptions & TCP_SYN_COOKIE_SACK)
+	{
+		vOptions[vLen++] = TCP_OPTIONS_NO_OP;
+		vOptions[vLen++] = TCP_OPTIONS_NO_OP;
+		vOptions[vLen++] = TCP_OPTIONS_SACK_PERMITTED;
+		vOptions[vLen++] = 2;
+	}
+	if(vCookieOptions & TCP_SYN_COOKIE_WS_MASK)
+	{
+		vOptions[vLen++] = TCP_OPTIONS_NO_OP;
+		vOptions[vLen++] = TCP_OPTIONS_WINDOW_SCALE;
+		vOptions[vLen++] = 3;
+		vOptions[vLen++] = 0;
+	}
+	header.DataOffset.Val		= (sizeof(header) + vLen) >> 2;
+
+	// Calculate IP pseudoheader checksum.
+	pseudoHeader.SourceAddress	= AppConfig.MyIPAddr;
+	pseudoHeader.DestAddress    = remote->IPAddr;
+	pseudoHeader.Zero           = 0x0;
+	pseudoHeader.Protocol       = IP_PROT_TCP;
+	pseudoHeader.Length			= sizeof(header) + vLen;
+	SwapPseudoHeader(pseudoHeader);
+	header.Checksum = ~CalcIPChecksum((BYTE*)&pseudoHeader, sizeof(pseudoHeader));
+
+	// Write IP and TCP headers
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
+	IPPutHeader(remote, IP_PROT_TCP, sizeof(header) + vLen);
+	MACPutArray((BYTE*)&header, sizeof(header));
+	MACPutArray(vOptions, vLen);
+
+	// Update the TCP checksum
+	MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
+	wVal.Val = CalcIPBufferChecksum(sizeof(header) + vLen);
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER) + 16);
+	MACPutArray((BYTE*)&wVal, sizeof(WORD));
+
+	MACFlush();
+
+	#if defined(STACK_USE_TCP_STATS)
+	TCPStackStats.dwSegmentsOut++;
+	#endif
+}
+
+/*****************************************************************************
+  Function:
+	static WORD TCPCheckSYNCookie(DWORD dwCookie, DWORD dwRemoteISN, 
+		BYTE* vOptions)
+
+  Summary:
+	Validates a SYN cookie returned in the ACK of a handshake.
+
+  Description:
+	Recomputes the cookie from the addresses in MyTCB and the fields 
+	encoded in the cookie itself.  Cookies issued during the current or 
+	the previous 64 second period are accepted.
+
+  Precondition:
+	TCB is synced and its remote address and ports describe the segment 
+	being processed, as set up by FindMatchingSocket().
+
+  Parameters:
+	dwCookie - The segment's acknowledgement number minus one
+	dwRemoteISN - The segment's sequence number minus one
+	vOptions - Receives the TCP_SYN_COOKIE_* options encoded in the cookie
+
+  Returns:
+	The MSS encoded in the cookie, or 0 if the cookie isn't valid.
+  ***************************************************************************/
+static WORD TCPCheckSYNCookie(DWORD dwCookie, DWORD dwRemoteISN, BYTE* vOptions)
+{
+	BYTE vTime;
+	BYTE vMSSIndex;
+
+	vTime = (BYTE)(dwCookie>>27);
+	vMSSIndex = (BYTE)(dwCookie>>25) & 0x03u;
+	*vOptions = (BYTE)(dwCookie>>20) & 0x1Fu;
+
+	if((BYTE)((TCPSYNCookieTime() - vTime) & 0x1Fu) > 1u)
+		return 0;
+	if((*vOptions & TCP_SYN_COOKIE_WS_MASK) > TCP_MAX_WINDOW_SHIFT + 1u)
+		return 0;
+	if(TCPSYNCookie(MyTCB.remote.niRemoteMACIP.IPAddr.Val, MyTCB.remotePort.Val, MyTCB.localPort.Val, dwRemoteISN, vTime, vMSSIndex, *vOptions) != dwCookie)
+		return 0;
+
+	return wSYNCookieMSS[vMSSIndex];
+}
+#endif
+
 
 
 /*****************************************************************************
@@ -3426,6 +6026,11 @@ static void CloseSocket(void)
 {
 	SyncTCB();
 
+	// Queued TCPPutIov() buffers will never be sent now
+	#if TCP_MAX_IOVS
+	TCPIovReleaseAll();
+	#endif
+
 	MyTCBStub.remoteHash.Val = MyTCB.localPort.Val;
 	MyTCBStub.txHead = MyTCBStub.bufferTxStart;
 	MyTCBStub.txTail = MyTCBStub.bufferTxStart;
@@ -3467,31 +6072,55 @@ static void CloseSocket(void)
 
 	MyTCB.flags.bFINSent = 0;
 	MyTCB.flags.bSYNSent = 0;
-	MyTCB.flags.bRXNoneACKed1 = 0;
-	MyTCB.flags.bRXNoneACKed2 = 0;
-	MyTCB.txUnackedTail = MyTCBStub.bufferTxStart;
+	MyTCBStub.txUnackedTail = MyTCBStub.bufferTxStart;
 	((DWORD_VAL*)(&MyTCB.MySEQ))->w[0] = LFSRRand();
 	((DWORD_VAL*)(&MyTCB.MySEQ))->w[1] = LFSRRand();
-	MyTCB.sHoleSize = -1;
+	MyTCB.vOOORangeCount = 0;
+	MyTCB.vSACKedRangeCount = 0;
+	MyTCB.wSACKHighRxt = 0;
+	MyTCB.flags.bSACKPermitted = 0;
+	MyTCB.flags.bWindowScale = 0;
+	MyTCB.vRemoteWindowShift = 0;
 	MyTCB.remoteWindow = 1;
+
+	// Use the smallest window scale shift that can describe the whole 
+	// socket buffer, however TCPAdjustFIFOSize() later splits it
+	MyTCB.vLocalWindowShift = 0;
+	while((((DWORD)(MyTCBStub.bufferEnd - MyTCBStub.bufferTxStart)) >> MyTCB.vLocalWindowShift > 0xFFFFu) && (MyTCB.vLocalWindowShift < TCP_MAX_WINDOW_SHIFT))
+		MyTCB.vLocalWindowShift++;
+	MyTCB.dwRTO = TCP_START_TIMEOUT_VAL;
+	MyTCB.dwSRTT = 0;
+	MyTCB.dwRTTVAR = 0;
+	MyTCB.dwRTTSeq = MyTCB.MySEQ;
+	MyTCB.dwPushSeq = MyTCB.MySEQ;
+	MyTCB.flags.bRTTTiming = 0;
+	TCPResetCongestionWindow();
+
+	#if defined(STACK_USE_TCP_STATS)
+	TCPStatsSyncState();
+	#endif
+	TCPHashSync();
 }
 
 
 /*****************************************************************************
   Function:
-	static WORD GetMaxSegSizeOption(void)
+	static WORD GetTCPOptions(void)
 
   Summary:
-	Obtains the Maximum Segment Size (MSS) TCP Option out of the TCP header 
-	for the current socket.
+	Parses the TCP Options out of the TCP header for the current socket.
 
   Description:
-	Parses the current TCP packet header and extracts the Maximum Segment Size 
-	option.  
+	Walks the options of the current TCP packet header.  The Maximum 
+	Segment Size option is returned.  Whether SACK-permitted was present 
+	is left in bRXSACKPermitted, a window scale option is left in 
+	bRXWindowScale and vRXWindowShift, and up to TCP_MAX_SACK_BLOCKS_RX blocks 
+	of a SACK option are left in dwRXSACKLeft[]/dwRXSACKRight[] with 
+	vRXSACKBlocks holding the count.  Unknown options are skipped.
 
   Precondition:
 	Must be called while a TCP packet is present and being processed via 
-	HandleTCPSeg() and only if the the TCP SYN flag is set.
+	HandleTCPSeg().
 
   Parameters:
 	None
@@ -3504,11 +6133,19 @@ static void CloseSocket(void)
   Remarks:
 	The internal MAC Read Pointer is moved but not restored.
   ***************************************************************************/
-static WORD GetMaxSegSizeOption(void)
+static WORD GetTCPOptions(void)
 {
 	BYTE vOptionsBytes;
 	BYTE vOption;
+	BYTE vLength;
 	WORD wMSS;
+	DWORD dwEdge;
+
+	wMSS = 536;
+	bRXSACKPermitted = FALSE;
+	bRXWindowScale = FALSE;
+	vRXWindowShift = 0;
+	vRXSACKBlocks = 0;
 
 	// Find out how many options bytes are in this packet.
 	IPSetRxBuffer(2+2+4+4);	// Seek to data offset field, skipping Source port (2), Destination port (2), Sequence number (4), and Acknowledgement number (4)
@@ -3518,59 +6155,117 @@ static WORD GetMaxSegSizeOption(void)
 	// Return minimum Maximum Segment Size value of 536 bytes if none are 
 	// present
 	if(vOptionsBytes == 0u)
-		return 536;
+		return wMSS;
 		
 	// Seek to beginning of options
-	MACGetArray(NULL, 7);
+	MACSkipArray(7);
 
-	// Search for the Maximum Segment Size option	
-	while(vOptionsBytes--)
+	while(vOptionsBytes)
 	{
 		vOption = MACGet();
+		vOptionsBytes--;
 		
-		if(vOption == 0u)	// End of Options list
+		if(vOption == TCP_OPTIONS_END_OF_LIST)
 			break;
 		
-		if(vOption == 1u)	// NOP option
+		if(vOption == TCP_OPTIONS_NO_OP)
 			continue;
+
+		// All other options have a length byte that includes the kind and 
+		// length bytes themselves
+		if(vOptionsBytes == 0u)
+			break;
+		vLength = MACGet();
+		vOptionsBytes--;
+		if((vLength < 2u) || (vLength - 2u > vOptionsBytes))
+			break;
+		vLength -= 2;
+		vOptionsBytes -= vLength;
 			
-		if(vOption == 2u)	// Maximum Segment Size option
+		if((vOption == TCP_OPTIONS_MAX_SEG_SIZE) && (vLength == 2u))
 		{
-			if(vOptionsBytes < 3u)
-				break;
-
-			wMSS = 0;
-				
-			// Get option length
-			vOption = MACGet();
-			if(vOption == 4u)
-			{// Retrieve MSS and swap value to little endian
-				((BYTE*)&wMSS)[1] = MACGet();
-				((BYTE*)&wMSS)[0] = MACGet();
-			}
+			// Retrieve MSS and swap value to little endian
+			((BYTE*)&wMSS)[1] = MACGet();
+			((BYTE*)&wMSS)[0] = MACGet();
+			vLength = 0;
 			
 			if(wMSS < 536u)
-				break;
-			if(wMSS > TCP_MAX_SEG_SIZE_TX)
-				return TCP_MAX_SEG_SIZE_TX;
-			else 
-				return wMSS;
+				wMSS = 536;
+			else if(wMSS > TCP_MAX_SEG_SIZE_TX)
+				wMSS = TCP_MAX_SEG_SIZE_TX;
 		}
-		else
-		{ // Assume this is a multi byte option and throw it way
-			if(vOptionsBytes < 2u)
-				break;
-			vOption = MACGet();
-			if(vOptionsBytes < vOption)
-				break;
-			MACGetArray(NULL, vOption);
-			vOptionsBytes -= vOption;
+		else if((vOption == TCP_OPTIONS_WINDOW_SCALE) && (vLength == 1u))
+		{
+			bRXWindowScale = TRUE;
+			vRXWindowShift = MACGet();
+			vLength = 0;
+			if(vRXWindowShift > TCP_MAX_WINDOW_SHIFT)
+				vRXWindowShift = TCP_MAX_WINDOW_SHIFT;
 		}
-		
+		else if(vOption == TCP_OPTIONS_SACK_PERMITTED)
+		{
+			bRXSACKPermitted = TRUE;
+		}
+		else if(vOption == TCP_OPTIONS_SACK)
+		{
+			while((vLength >= 8u) && (vRXSACKBlocks < TCP_MAX_SACK_BLOCKS_RX))
+			{
+				MACGetArray((BYTE*)&dwEdge, 4);
+				dwRXSACKLeft[vRXSACKBlocks] = swapl(dwEdge);
+				MACGetArray((BYTE*)&dwEdge, 4);
+				dwRXSACKRight[vRXSACKBlocks] = swapl(dwEdge);
+				vRXSACKBlocks++;
+				vLength -= 8;
+			}
+		}
+
+		// Throw away whatever is left of this option
+		MACSkipArray(vLength);
 	}
 	
-	// Did not find MSS option, return worst case default
-	return 536;
+	return wMSS;
+}
+
+/*****************************************************************************
+  Function:
+	static void TCPCopySegmentData(PTR_BASE ptrDest, WORD wOffset, 
+									TCP_FIFO_SIZE wLength)
+
+  Summary:
+	Copies received segment data into the current socket's RX FIFO.
+
+  Description:
+	Copies wLength bytes of the segment being processed to ptrDest in the 
+	current socket's memory medium.  When the segment was staged in 
+	MACRxStage[] while its checksum was verified, sockets in TCP_PIC_RAM or 
+	TCP_SPI_RAM are filled from that copy instead of reading the MAC again.  
+	Sockets in TCP_ETH_RAM still copy straight from the MAC buffer since 
+	that copy never leaves the MAC.
+
+  Precondition:
+	TCP is initialized and the current TCP stub is already synced.
+
+  Parameters:
+	ptrDest - Address in the socket's memory medium to write to
+	wOffset - Offset of the first byte to copy from the start of the TCP 
+		header
+	wLength - Number of bytes to copy
+
+  Returns:
+	None
+  ***************************************************************************/
+static void TCPCopySegmentData(PTR_BASE ptrDest, WORD wOffset, TCP_FIFO_SIZE wLength)
+{
+	#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	if(bRXStaged && (MyTCBStub.vMemoryMedium != TCP_ETH_RAM))
+	{
+		TCPRAMCopy(ptrDest, MyTCBStub.vMemoryMedium, (PTR_BASE)&MACRxStage[wOffset], TCP_PIC_RAM, wLength);
+		return;
+	}
+	#endif
+
+	IPSetRxBuffer(wOffset);
+	TCPRAMCopy(ptrDest, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, wLength);
 }
 
 /*****************************************************************************
@@ -3602,14 +6297,19 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 	DWORD dwTemp;
 	PTR_BASE wTemp;
 	LONG lMissingBytes;
-	WORD wMissingBytes;
-	WORD wFreeSpace;
+	TCP_FIFO_SIZE wMissingBytes;
+	TCP_FIFO_SIZE wFreeSpace;
 	BYTE localHeaderFlags;
 	DWORD localAckNumber;
 	DWORD localSeqNumber;
 	WORD wSegmentLength;
+	WORD wOffset;
 	BOOL bSegmentAcceptable;
-	WORD wNewWindow;
+	DWORD dwNewWindow;
+	#if defined(TCP_SYN_COOKIES)
+	WORD wMSS;
+	BYTE vCookieOptions;
+	#endif
 
 
 	// Cache a few variables in local RAM.  
@@ -3640,9 +6340,41 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 				return;
 			}
 
-			// Second: check ACK flag, which would be invalid
+			// Second: check ACK flag, which would be invalid unless it 
+			// completes a handshake that was answered with a SYN cookie
 			if(localHeaderFlags & ACK)
 			{
+				#if defined(TCP_SYN_COOKIES)
+				if(!(localHeaderFlags & SYN))
+				{
+					wMSS = TCPCheckSYNCookie(localAckNumber - 1, localSeqNumber - 1, &vCookieOptions);
+					if(wMSS)
+					{
+						// Rebuild the state our SYN+ACK would have created.  The 
+						// cookie SYN+ACK echoed the SACK and window scale options 
+						// encoded in the cookie, with a window scale shift of 0 
+						// for our side.
+						MyTCB.RemoteSEQ = localSeqNumber;
+						MyTCB.MySEQ = localAckNumber;
+						MyTCB.dwRTTSeq = localAckNumber;
+						MyTCB.dwPushSeq = localAckNumber;
+						MyTCB.flags.bSYNSent = 1;
+						MyTCB.wRemoteMSS = wMSS;
+						MyTCB.flags.bSACKPermitted = (vCookieOptions & TCP_SYN_COOKIE_SACK) ? 1 : 0;
+						MyTCB.flags.bWindowScale = (vCookieOptions & TCP_SYN_COOKIE_WS_MASK) ? 1 : 0;
+						MyTCB.vRemoteWindowShift = MyTCB.flags.bWindowScale ? (vCookieOptions & TCP_SYN_COOKIE_WS_MASK) - 1u : 0;
+						MyTCB.vLocalWindowShift = 0;
+						MyTCB.remoteWindow = (DWORD)h->Window << MyTCB.vRemoteWindowShift;
+						TCPResetCongestionWindow();
+						MyTCBStub.smState = TCP_SYN_RECEIVED;
+						
+						// Continue below, where the ACK moves us to 
+						// TCP_ESTABLISHED and any data is accepted
+						break;
+					}
+				}
+				#endif
+
 				// Use a believable sequence number and reset the remote node
 				MyTCB.MySEQ = localAckNumber;
 				SendTCP(RST, 0);
@@ -3656,8 +6388,17 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 				// We now have a sequence number for the remote node
 				MyTCB.RemoteSEQ = localSeqNumber + 1;
 
-				// Get MSS option
-				MyTCB.wRemoteMSS = GetMaxSegSizeOption();
+				// Get MSS, SACK-permitted and window scale options and size 
+				// the initial congestion window from the MSS
+				MyTCB.wRemoteMSS = GetTCPOptions();
+				MyTCB.flags.bSACKPermitted = bRXSACKPermitted;
+				TCPResetCongestionWindow();
+
+				// Windows are only scaled if both sides sent the option
+				MyTCB.flags.bWindowScale = bRXWindowScale;
+				MyTCB.vRemoteWindowShift = vRXWindowShift;
+				if(!bRXWindowScale)
+					MyTCB.vLocalWindowShift = 0;
 
 				// Set Initial Send Sequence (ISS) number
 				// Nothing to do on this step... ISS already set in CloseSocket()
@@ -3697,6 +6438,9 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 					MyTCB.MySEQ = localSeqNumber;	// Restore original SEQ number
 					return;
 				}
+
+				// Our SYN made it, measure how long it took
+				TCPUpdateRTT(localAckNumber);
 			}
 
 			// Third: check the security and precedence
@@ -3709,8 +6453,17 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 				MyTCB.RemoteSEQ = localSeqNumber + 1;
 				MyTCB.remoteWindow = h->Window;
 
-				// Get MSS option
-				MyTCB.wRemoteMSS = GetMaxSegSizeOption();
+				// Get MSS, SACK-permitted and window scale options and size 
+				// the initial congestion window from the MSS
+				MyTCB.wRemoteMSS = GetTCPOptions();
+				MyTCB.flags.bSACKPermitted = bRXSACKPermitted;
+				TCPResetCongestionWindow();
+
+				// Windows are only scaled if both sides sent the option
+				MyTCB.flags.bWindowScale = bRXWindowScale;
+				MyTCB.vRemoteWindowShift = vRXWindowShift;
+				if(!bRXWindowScale)
+					MyTCB.vLocalWindowShift = 0;
 
 				if(localHeaderFlags & ACK)
 				{
@@ -3753,7 +6506,7 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 
 	// Calculate the number of bytes ahead of our head pointer this segment skips
 	lMissingBytes = localSeqNumber - MyTCB.RemoteSEQ;
-	wMissingBytes = (WORD)lMissingBytes;
+	wMissingBytes = (TCP_FIFO_SIZE)lMissingBytes;
 	
 	// Run TCP acceptability tests to verify that this packet has a valid sequence number
 	bSegmentAcceptable = FALSE;
@@ -3768,11 +6521,11 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 			else
 			{
 				// RCV.NXT =< SEG.SEQ+SEG.LEN-1 < RCV.NXT+RCV.WND
-				if((lMissingBytes + (LONG)wSegmentLength > (LONG)0) && (lMissingBytes <= (LONG)(SHORT)(wFreeSpace - wSegmentLength)))
+				if((lMissingBytes + (LONG)wSegmentLength > (LONG)0) && (lMissingBytes <= (LONG)wFreeSpace - (LONG)wSegmentLength))
 					bSegmentAcceptable = TRUE;
 			}
 			
-			if((lMissingBytes < (LONG)wFreeSpace) && ((SHORT)wMissingBytes + (SHORT)wSegmentLength > (SHORT)0))
+			if((lMissingBytes < (LONG)wFreeSpace) && (lMissingBytes + (LONG)wSegmentLength > (LONG)0))
 				bSegmentAcceptable = TRUE;
 		}
 		// Segments with data are not acceptable if we have no free space
@@ -3849,8 +6602,8 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 		case TCP_CLOSE_WAIT:
 		case TCP_CLOSING:
 			// Calculate what the highest possible SEQ number in our TX FIFO is
-			wTemp = MyTCBStub.txHead - MyTCB.txUnackedTail;
-			if((SHORT)wTemp < (SHORT)0)
+			wTemp = MyTCBStub.txHead - MyTCBStub.txUnackedTail;
+			if(MyTCBStub.txHead < MyTCBStub.txUnackedTail)
 				wTemp += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
 			dwTemp = MyTCB.MySEQ + (DWORD)wTemp;
 
@@ -3869,65 +6622,85 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
                 }
             }
 
+			// Pick up any SACK blocks the remote node reported
+			if(MyTCB.flags.bSACKPermitted && (h->DataOffset.Val > 5u))
+				GetTCPOptions();
+			else
+				vRXSACKBlocks = 0;
+
+			// Complete the round trip time sample if the timed segment has 
+			// now been acknowledged
+			TCPUpdateRTT(localAckNumber);
+
 			// Throw away all ACKnowledged TX data:
 			// Calculate what the last acknowledged sequence number was (ignoring any FINs we sent)
-			dwTemp = MyTCB.MySEQ - (LONG)(SHORT)(MyTCB.txUnackedTail - MyTCBStub.txTail);
-			if(MyTCB.txUnackedTail < MyTCBStub.txTail)
-				dwTemp -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+			dwTemp = MyTCB.MySEQ - TCPGetBytesInFlight();
 	
 			// Calcluate how many bytes were ACKed with this packet
 			dwTemp = localAckNumber - dwTemp;
 			if(((LONG)(dwTemp) > (LONG)0) && (dwTemp <= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart))
 			{
-				MyTCB.flags.bRXNoneACKed1 = 0;
-				MyTCB.flags.bRXNoneACKed2 = 0;
 				MyTCBStub.Flags.bHalfFullFlush = FALSE;
+
+				// New data was acknowledged, so restart the retransmission 
+				// timer from the current RTO (RFC 6298 section 5.3)
+				MyTCB.retryCount = 0;
+				MyTCB.retryInterval = MyTCB.dwRTO;
+				if(MyTCBStub.Flags.bTimerEnabled)
+					MyTCBStub.eventTime = TickGet() + MyTCB.retryInterval;
 	
+				// Let go of TCPPutIov() buffers that are now fully ACKed
+				#if TCP_MAX_IOVS
+				TCPIovAck((TCP_FIFO_SIZE)dwTemp);
+				#endif
+
 				// Bytes ACKed, free up the TX FIFO space
 				wTemp = MyTCBStub.txTail;
 				MyTCBStub.txTail += dwTemp;
-				if(MyTCB.txUnackedTail >= wTemp)
+				if(MyTCBStub.txUnackedTail >= wTemp)
 				{
-					if(MyTCB.txUnackedTail < MyTCBStub.txTail)
+					if(MyTCBStub.txUnackedTail < MyTCBStub.txTail)
 					{
-						MyTCB.MySEQ += MyTCBStub.txTail - MyTCB.txUnackedTail;
-						MyTCB.txUnackedTail = MyTCBStub.txTail;
+						MyTCB.MySEQ += MyTCBStub.txTail - MyTCBStub.txUnackedTail;
+						MyTCBStub.txUnackedTail = MyTCBStub.txTail;
 					}
 				}
 				else
 				{
-					wTemp = MyTCB.txUnackedTail + (MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart);
+					wTemp = MyTCBStub.txUnackedTail + (MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart);
 					if(wTemp < MyTCBStub.txTail)
 					{
 						MyTCB.MySEQ += MyTCBStub.txTail - wTemp;
-						MyTCB.txUnackedTail = MyTCBStub.txTail;
+						MyTCBStub.txUnackedTail = MyTCBStub.txTail;
 					}
 				}
 				if(MyTCBStub.txTail >= MyTCBStub.bufferRxStart)
 					MyTCBStub.txTail -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
-				if(MyTCB.txUnackedTail >= MyTCBStub.bufferRxStart)
-					MyTCB.txUnackedTail -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+				if(MyTCBStub.txUnackedTail >= MyTCBStub.bufferRxStart)
+					MyTCBStub.txUnackedTail -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+
+				// Reserve the freed space for queued TCPPutIov() buffers so 
+				// TCPCongestionAck() sees them as new data to send
+				#if TCP_MAX_IOVS
+				TCPIovMap();
+				#endif
+
+				// Update the SACK scoreboard, then grow the congestion 
+				// window or continue/finish fast recovery
+				TCPSACKUpdate((TCP_FIFO_SIZE)dwTemp);
+				TCPCongestionAck((TCP_FIFO_SIZE)dwTemp, localAckNumber);
 			}
 			else
 			{
-				// See if we have outstanding TX data that is waiting for an ACK
-				if(MyTCBStub.txTail != MyTCB.txUnackedTail)
+				TCPSACKUpdate(0);
+
+				// A pure ACK that doesn't move SND.UNA while we have 
+				// outstanding TX data is a duplicate ACK, meaning a later 
+				// segment arrived at the remote node ahead of a lost one
+				if((dwTemp == 0u) && (wSegmentLength == 0u) && (MyTCBStub.txTail != MyTCBStub.txUnackedTail))
 				{
-					if(MyTCB.flags.bRXNoneACKed1)
-					{
-						if(MyTCB.flags.bRXNoneACKed2)
-						{
-							// Set up to perform a fast retransmission
-							// Roll back unacknowledged TX tail pointer to cause retransmit to occur
-							MyTCB.MySEQ -= (LONG)(SHORT)(MyTCB.txUnackedTail - MyTCBStub.txTail);
-							if(MyTCB.txUnackedTail < MyTCBStub.txTail)
-								MyTCB.MySEQ -= (LONG)(SHORT)(MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart);
-							MyTCB.txUnackedTail = MyTCBStub.txTail;
-							MyTCBStub.Flags.bTXASAPWithoutTimerReset = 1;
-						}
-						MyTCB.flags.bRXNoneACKed2 = 1;
-					}
-					MyTCB.flags.bRXNoneACKed1 = 1;
+					TCPStatsCount(dwDupACKs);
+					TCPCongestionDupAck(localAckNumber);
 				}
 			}
 
@@ -3954,17 +6727,25 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 				}
 			}
 
-			// The window size advirtised in this packet is adjusted to account 
-			// for any bytes that we have transmitted but haven't been ACKed yet 
-			// by this segment.
-			wNewWindow = h->Window - ((WORD)(MyTCB.MySEQ - localAckNumber));
+			// The window size advirtised in this packet is scaled up by the 
+			// shift count the remote node sent in its SYN, then adjusted to 
+			// account for any bytes that we have transmitted but haven't been 
+			// ACKed yet by this segment.
+			dwNewWindow = (DWORD)h->Window << MyTCB.vRemoteWindowShift;
+			#if defined(STACK_USE_TCP_STATS)
+			TCPStatsWindow(dwNewWindow);
+			#endif
+			if(dwNewWindow > MyTCB.MySEQ - localAckNumber)
+				dwNewWindow -= MyTCB.MySEQ - localAckNumber;
+			else
+				dwNewWindow = 0;
 
 			// Update the local stored copy of the RemoteWindow.
 			// If previously we had a zero window, and now we don't, then 
 			// immediately send whatever was pending.
-			if((MyTCB.remoteWindow == 0u) && wNewWindow)
+			if((MyTCB.remoteWindow == 0u) && dwNewWindow)
 				MyTCBStub.Flags.bTXASAP = 1;
-			MyTCB.remoteWindow = wNewWindow;
+			MyTCB.remoteWindow = dwNewWindow;
 
 			// A couple of states must do all of the TCP_ESTABLISHED stuff, but also a little more
 			if(MyTCBStub.smState == TCP_FIN_WAIT_1)
@@ -4059,10 +6840,10 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 	if(len)
 	{
 		// See if there are bytes we must skip
-		if((SHORT)wMissingBytes <= 0)
+		if(lMissingBytes <= 0)
 		{
-			// Position packet read pointer to start of useful data area.
-			IPSetRxBuffer((h->DataOffset.Val << 2) - wMissingBytes);
+			// Offset of the useful data area in the packet
+			wOffset = (h->DataOffset.Val << 2) - wMissingBytes;
 			len += wMissingBytes;		
 	
 			// Truncate packets that would overflow our TCP RX FIFO
@@ -4077,92 +6858,67 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 			if(MyTCBStub.rxHead + len > MyTCBStub.bufferEnd)
 			{
 				wTemp = MyTCBStub.bufferEnd - MyTCBStub.rxHead + 1;
-				TCPRAMCopy(MyTCBStub.rxHead, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, wTemp);
-				TCPRAMCopy(MyTCBStub.bufferRxStart, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, len - wTemp);
+				TCPCopySegmentData(MyTCBStub.rxHead, wOffset, wTemp);
+				TCPCopySegmentData(MyTCBStub.bufferRxStart, wOffset + wTemp, len - wTemp);
 				MyTCBStub.rxHead = MyTCBStub.bufferRxStart + (len - wTemp);
 			}
 			else
 			{
-				TCPRAMCopy(MyTCBStub.rxHead, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, len);
+				TCPCopySegmentData(MyTCBStub.rxHead, wOffset, len);
 				MyTCBStub.rxHead += len;
 			}
 		
-			// See if we have a hole and other data waiting already in the RX FIFO
-			if(MyTCB.sHoleSize != -1)
+			// See if we have holes and other data waiting already in the RX FIFO
+			if(MyTCB.vOOORangeCount)
 			{
-				MyTCB.sHoleSize -= len;
-				wTemp = MyTCB.wFutureDataSize + MyTCB.sHoleSize;
-		
-				// See if we just closed up a hole, and if so, advance head pointer
-				if((SHORT)wTemp < (SHORT)0)
-				{
-					MyTCB.sHoleSize = -1;
-				}
-				else if(MyTCB.sHoleSize <= 0)
+				// If we just closed up the first hole, advance head pointer 
+				// over the future data that is now in order
+				wTemp = TCPRangeAdvance(MyTCB.OOORanges, &MyTCB.vOOORangeCount, len);
+				if(wTemp)
 				{
 					MyTCB.RemoteSEQ += wTemp;
 					MyTCBStub.rxHead += wTemp;
 					if(MyTCBStub.rxHead > MyTCBStub.bufferEnd)
 						MyTCBStub.rxHead -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;							
-					MyTCB.sHoleSize = -1;
 				}
 			}
 		} // This packet is out of order or we lost a packet, see if we can generate a hole to accomodate it
-		else if((SHORT)wMissingBytes > 0)
+		else if(lMissingBytes > 0)
 		{
 			// Truncate packets that would overflow our TCP RX FIFO
 			if(len + wMissingBytes > wFreeSpace)
 				len = wFreeSpace - wMissingBytes;
 		
-			// Position packet read pointer to start of useful data area.
-			IPSetRxBuffer(h->DataOffset.Val << 2);
+			// Offset of the useful data area in the packet
+			wOffset = h->DataOffset.Val << 2;
 	
 			// See if we need a two part copy (spans bufferEnd->bufferRxStart)
 			if(MyTCBStub.rxHead + wMissingBytes + len > MyTCBStub.bufferEnd)
 			{
 				// Calculate number of data bytes to copy before wraparound
-				wTemp = MyTCBStub.bufferEnd - MyTCBStub.rxHead + 1 - wMissingBytes;
-				if((SHORT)wTemp >= 0)
+				if(MyTCBStub.rxHead + wMissingBytes <= MyTCBStub.bufferEnd + 1)
 				{
-					TCPRAMCopy(MyTCBStub.rxHead + wMissingBytes, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, wTemp);
-					TCPRAMCopy(MyTCBStub.bufferRxStart, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, len - wTemp);
+					wTemp = MyTCBStub.bufferEnd - MyTCBStub.rxHead + 1 - wMissingBytes;
+					TCPCopySegmentData(MyTCBStub.rxHead + wMissingBytes, wOffset, wTemp);
+					TCPCopySegmentData(MyTCBStub.bufferRxStart, wOffset + wTemp, len - wTemp);
 				}
 				else
 				{
-					TCPRAMCopy(MyTCBStub.rxHead + wMissingBytes - (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1), MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, len);
+					TCPCopySegmentData(MyTCBStub.rxHead + wMissingBytes - (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1), wOffset, len);
 				}
 			}
 			else
 			{
-				TCPRAMCopy(MyTCBStub.rxHead + wMissingBytes, MyTCBStub.vMemoryMedium, (PTR_BASE)-1, TCP_ETH_RAM, len);
+				TCPCopySegmentData(MyTCBStub.rxHead + wMissingBytes, wOffset, len);
 			}
 		
-			// Record the hole is here
-			if(MyTCB.sHoleSize == -1)
-			{
-				MyTCB.sHoleSize = wMissingBytes;
-				MyTCB.wFutureDataSize = len;
-			}
-			else
+			// Record where this future data is, merging it with any 
+			// ranges it overlaps or touches.  Remember it as the most 
+			// recent arrival for the SACK option.
+			if(len)
 			{
-				// We already have a hole, see if we can shrink the hole 
-				// or extend the future data size
-				if(wMissingBytes < (WORD)MyTCB.sHoleSize)
-				{
-					if((wMissingBytes + len > (WORD)MyTCB.sHoleSize + MyTCB.wFutureDataSize) || (wMissingBytes + len < (WORD)MyTCB.sHoleSize))
-						MyTCB.wFutureDataSize = len;
-					else
-						MyTCB.wFutureDataSize = (WORD)MyTCB.sHoleSize + MyTCB.wFutureDataSize - wMissingBytes;
-					MyTCB.sHoleSize = wMissingBytes;
-				}
-				else if(wMissingBytes + len > (WORD)MyTCB.sHoleSize + MyTCB.wFutureDataSize)
-				{
-					// Make sure that there isn't a second hole between 
-					// our future data and this TCP segment's future data
-					if(wMissingBytes <= (WORD)MyTCB.sHoleSize + MyTCB.wFutureDataSize)
-						MyTCB.wFutureDataSize += wMissingBytes + len - (WORD)MyTCB.sHoleSize - MyTCB.wFutureDataSize;
-				}
-				
+				TCPRangeInsert(MyTCB.OOORanges, &MyTCB.vOOORangeCount, TCP_MAX_OOO_RANGES, wMissingBytes, wMissingBytes + len);
+				MyTCB.dwSACKRecentSeq = MyTCB.RemoteSEQ + wMissingBytes;
 			}
 		}
 	}
@@ -4187,7 +6943,7 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 		if(MyTCBStub.smState != TCP_ESTABLISHED)
 			MyTCBStub.rxTail = MyTCBStub.rxHead;
 
-		if(MyTCBStub.Flags.bOneSegmentReceived)
+		if(MyTCBStub.Flags.bOneSegmentReceived || MyTCBStub.Options.bQuickACK)
 		{
 			SendTCP(ACK, SENDTCP_RESET_TIMERS);
 			SyncTCB();
@@ -4298,8 +7054,8 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 
 /*****************************************************************************
   Function:
-	BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, 
-							WORD wMinTXSize, BYTE vFlags)
+	BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, TCP_FIFO_SIZE wMinRXSize, 
+							TCP_FIFO_SIZE wMinTXSize, BYTE vFlags)
 
   Summary:
 	Adjusts the relative sizes of the RX and TX buffers.
@@ -4320,7 +7076,9 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 	remaining space equally.
 	
 	Received data can be preserved as long as the buffer is expanding and 
-	has not wrapped.
+	has not wrapped.  Transmit data (both unsent and unacknowledged) can be 
+	preserved as long as it has not wrapped and still fits within the new 
+	TX FIFO.
 
   Precondition:
 	TCP is initialized.
@@ -4330,8 +7088,8 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 	wMinRXSize	- Minimum number of byte for the RX FIFO
 	wMinTXSize 	- Minimum number of bytes for the RX FIFO
 	vFlags		- Any combination of TCP_ADJUST_GIVE_REST_TO_RX, 
-				  TCP_ADJUST_GIVE_REST_TO_TX, TCP_ADJUST_PRESERVE_RX.
-				  TCP_ADJUST_PRESERVE_TX is not currently supported.
+				  TCP_ADJUST_GIVE_REST_TO_TX, TCP_ADJUST_PRESERVE_RX, 
+				  TCP_ADJUST_PRESERVE_TX.
 
   Return Values:
 	TRUE - The FIFOs were adjusted successfully
@@ -4339,17 +7097,17 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 			therefore the socket was left unchanged.
 
   Side Effects:
-	Any unacknowledged or untransmitted data in the TX FIFO is always
-	deleted.
+	Unless TCP_ADJUST_PRESERVE_TX is specified, any unacknowledged or 
+	untransmitted data in the TX FIFO is deleted.
 
   Remarks:
 	At least one byte must always be allocated to the RX buffer so that
 	a FIN can be received.  The function automatically corrects for this.
   ***************************************************************************/
-BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE vFlags)
+BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, TCP_FIFO_SIZE wMinRXSize, TCP_FIFO_SIZE wMinTXSize, BYTE vFlags)
 {
 	PTR_BASE ptrTemp, ptrHead;
-	WORD wTXAllocation;
+	TCP_FIFO_SIZE wTXAllocation;
 	
 	if(hTCP >= TCP_SOCKET_COUNT)
     {
@@ -4406,6 +7164,18 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 	// Calculate new bufferRxStart pointer
 	ptrTemp = MyTCBStub.bufferTxStart + wTXAllocation + 1;
 
+	// Determine if resizing will lose any TX data.  Data can only stay where 
+	// it is if it hasn't wrapped and ends before the new RX FIFO begins.
+	if((vFlags & TCP_ADJUST_PRESERVE_TX) && (MyTCBStub.txHead != MyTCBStub.txTail))
+	{
+		#if defined(STACK_USE_SSL)
+		if(TCPIsSSL(hTCP))
+			return FALSE;
+		#endif
+		if(MyTCBStub.txHead < MyTCBStub.txTail || MyTCBStub.txHead >= ptrTemp)
+			return FALSE;
+	}
+
 	// Find the head pointer to use
 	ptrHead = MyTCBStub.rxHead;
 	#if defined(STACK_USE_SSL)
@@ -4414,9 +7184,9 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 	#endif
 	
 	// If there's out-of-order data pending, adjust the head pointer to compensate
-	if(MyTCB.sHoleSize != -1)
+	if(MyTCB.vOOORangeCount)
 	{
-		ptrHead += MyTCB.sHoleSize + MyTCB.wFutureDataSize;
+		ptrHead += TCPGetOOODataEnd();
 		if(ptrHead > MyTCBStub.bufferEnd)
 			ptrHead -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;
 	}
@@ -4432,6 +7202,7 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 			{
 				MyTCBStub.rxTail = ptrTemp;
 				MyTCBStub.rxHead = ptrTemp;
+				MyTCB.vOOORangeCount = 0;
 
 				#if defined(STACK_USE_SSL)
 				MyTCBStub.sslRxHead = ptrTemp;
@@ -4449,6 +7220,7 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 			{
 				MyTCBStub.rxTail = ptrTemp;
 				MyTCBStub.rxHead = ptrTemp;
+				MyTCB.vOOORangeCount = 0;
 				
 				#if defined(STACK_USE_SSL)
 				MyTCBStub.sslRxHead = ptrTemp;
@@ -4487,15 +7259,26 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 	// Move the RX buffer pointer - it's the one that divides the two
 	MyTCBStub.bufferRxStart = ptrTemp;
 
-	// Empty the TX buffer
-	MyTCB.txUnackedTail = MyTCBStub.bufferTxStart;
-	MyTCBStub.txTail = MyTCBStub.bufferTxStart;
-	MyTCBStub.txHead = MyTCBStub.bufferTxStart;
-	
-	#if defined(STACK_USE_SSL)
-	if(TCPIsSSL(hTCP))
-		MyTCBStub.sslTxHead = MyTCBStub.txHead + 5;
-	#endif
+	// Empty the TX buffer, unless its data was checked above and is being 
+	// kept in place
+	if(!(vFlags & TCP_ADJUST_PRESERVE_TX) || (MyTCBStub.txHead == MyTCBStub.txTail))
+	{
+		// Buffers with space reserved lose it here.  With nothing in the FIFO, 
+		// the rest just get their space reserved at the new position.
+		#if TCP_MAX_IOVS
+		if(!(vFlags & TCP_ADJUST_PRESERVE_TX))
+			TCPIovReleaseAll();
+		#endif
+
+		MyTCBStub.txUnackedTail = MyTCBStub.bufferTxStart;
+		MyTCBStub.txTail = MyTCBStub.bufferTxStart;
+		MyTCBStub.txHead = MyTCBStub.bufferTxStart;
+		
+		#if defined(STACK_USE_SSL)
+		if(TCPIsSSL(hTCP))
+			MyTCBStub.sslTxHead = MyTCBStub.txHead + 5;
+		#endif
+	}
 	
 	// Send a window update to notify remote node of change
 	if(MyTCBStub.smState == TCP_ESTABLISHED)
@@ -4508,7 +7291,7 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 /*****************************************************************************
   Function:
 	static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, 
-							BYTE vSourceType, WORD wLength)
+							BYTE vSourceType, TCP_FIFO_SIZE wLength)
 
   Summary:
 	Copies data to/from various memory mediums.
@@ -4536,11 +7319,14 @@ BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE v
 	address (closer to 0x0000) than the source pointer.  However, if they do 
 	overlap there must be at least 4 bytes of non-overlap to ensure correct 
 	results due to hardware DMA requirements.
+	
+	Copies of 64KB or more (TCP_LARGE_FIFOS) are only supported between 
+	TCP_PIC_RAM locations.
   ***************************************************************************/
-static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYTE vSourceType, WORD wLength)
+static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYTE vSourceType, TCP_FIFO_SIZE wLength)
 {
 	#if defined(SPIRAM_CS_TRIS)
-	BYTE vBuffer[16];
+	DWORD vBuffer[TCP_COPY_CHUNK_SIZE/4];
 	WORD w;
 	#endif
 		
@@ -4592,8 +7378,8 @@ static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYT
 							w = wLength;
 						
 						// Read and write a chunk	
-						MACGetArray(vBuffer, w);
-						SPIRAMPutArray(ptrDest, vBuffer, w);
+						MACGetArray((BYTE*)vBuffer, w);
+						SPIRAMPutArray(ptrDest, (BYTE*)vBuffer, w);
 						ptrDest += w;
 						wLength -= w;
 					}
@@ -4620,9 +7406,9 @@ static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYT
 							w = wLength;
 						
 						// Read and write a chunk	
-						SPIRAMGetArray(ptrSource, vBuffer, w);
+						SPIRAMGetArray(ptrSource, (BYTE*)vBuffer, w);
 						ptrSource += w;
-						MACPutArray(vBuffer, w);
+						MACPutArray((BYTE*)vBuffer, w);
 						wLength -= w;
 					}
 					break;
@@ -4635,8 +7421,8 @@ static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYT
 						if(w > wLength)
 							w = wLength;
 							
-						SPIRAMGetArray(ptrSource, vBuffer, w);
-						SPIRAMPutArray(ptrDest, vBuffer, w);
+						SPIRAMGetArray(ptrSource, (BYTE*)vBuffer, w);
+						SPIRAMPutArray(ptrDest, (BYTE*)vBuffer, w);
 						ptrSource += w;
 						ptrDest += w;
 						wLength -= w;
@@ -4683,7 +7469,7 @@ static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYT
 #if defined(__18CXX)
 static void TCPRAMCopyROM(PTR_BASE wDest, BYTE wDestType, ROM BYTE* wSource, WORD wLength)
 {
-	BYTE vBuffer[16];
+	BYTE vBuffer[TCP_COPY_CHUNK_SIZE];
 	WORD w;
 	
 	switch(wDestType)
@@ -4964,6 +7750,7 @@ BOOL TCPAddSSLListener(TCP_SOCKET hTCP, WORD port)
 	
 	MyTCB.localSSLPort.Val = port;
 	MyTCBStub.sslTxHead = port;
+	TCPHashSync();
 
 	return TRUE;
 }
@@ -5503,13 +8290,13 @@ void TCPSSLHandleIncoming(TCP_SOCKET hTCP)
 				SyncTCB();
 
 				// Calculate how big the SSL hole is
-				if(MyTCB.sHoleSize == -1)
+				if(MyTCB.vOOORangeCount == 0u)
 				{// Just need to move pending SSL data
 					wToMove = TCPIsGetReady(hTCP);
 				}
 				else
 				{// A TCP hole exists, so move all data
-					wToMove = TCPIsGetReady(hTCP) + MyTCB.sHoleSize + MyTCB.wFutureDataSize;
+					wToMove = TCPIsGetReady(hTCP) + TCPGetOOODataEnd();
 				}
 				
 				// Start with the destination as the startRxTail and source as current rxTail
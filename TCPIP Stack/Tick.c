@@ -57,14 +57,26 @@
 
 #include "includes/TCPIP.h"
 
+#if defined(COMPILER_GCC_HOST)
+	#include <time.h>
+#endif
+
 // Internal counter to store Ticks.  This variable is incremented in an ISR and 
 // therefore must be marked volatile to prevent the compiler optimizer from 
 // reordering code to use this value in the main context while interrupts are 
 // disabled.
+#if !defined(COMPILER_GCC_HOST)
 static volatile DWORD dwInternalTicks = 0;
+#else
+// Virtual time set with TickSetHostTime(), used instead of CLOCK_MONOTONIC 
+// once bHostTimeIsVirtual is set.  Kept per thread with STACK_MULTI_INSTANCE, 
+// since each thread simulates its own network.
+static STACK_THREAD_LOCAL QWORD qwHostTimeNs;
+static STACK_THREAD_LOCAL BOOL bHostTimeIsVirtual = FALSE;
+#endif
 
 // 6-byte value to store Ticks.  Allows for use over longer periods of time.
-static BYTE vTickReading[6];
+static STACK_THREAD_LOCAL BYTE vTickReading[6];
 
 static void GetTickCopy(void);
 
@@ -93,6 +105,10 @@ static void GetTickCopy(void);
   ***************************************************************************/
 void TickInit(void)
 {
+#if defined(COMPILER_GCC_HOST)
+	// The host reads CLOCK_MONOTONIC in GetTickCopy(), so there is no timer 
+	// to set up
+#else
     // Use Timer 1 for 16-bit and 32-bit processors
     // 1:256 prescale
 //    T5CONbits.TCKPS = 3;
@@ -113,6 +129,7 @@ void TickInit(void)
 
     // Activate timer3 interrupt
     ConfigIntTimer5(T5_INT_ON | T5_INT_PRIOR_2);
+#endif
 }
 
 /*****************************************************************************
@@ -137,6 +154,24 @@ void TickInit(void)
   ***************************************************************************/
 static void GetTickCopy(void)
 {
+#if defined(COMPILER_GCC_HOST)
+	struct timespec ts;
+	QWORD qwTicks;
+
+	// Scale the monotonic (or virtual) clock to the same TICKS_PER_SECOND 
+	// the board's Timer5 counts at and keep the low 48 bits, little endian
+	if(bHostTimeIsVirtual)
+	{
+		ts.tv_sec = (time_t)(qwHostTimeNs/1000000000ull);
+		ts.tv_nsec = (long)(qwHostTimeNs%1000000000ull);
+	}
+	else
+	{
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	}
+	qwTicks = (QWORD)ts.tv_sec*TICKS_PER_SECOND + ((QWORD)ts.tv_nsec*TICKS_PER_SECOND)/1000000000ull;
+	memcpy((void*)vTickReading, (void*)&qwTicks, sizeof(vTickReading));
+#else
 	// Perform an Interrupt safe and synchronized read of the 48-bit 
 	// tick value
 
@@ -175,6 +210,7 @@ static void GetTickCopy(void)
 		vTickReading[5] = ((BYTE*)&dwTempTicks)[3];
 	} while(IFS0bits.T5IF);
 	IEC0SET = _IEC0_T5IE_MASK;		// Enable interrupt
+#endif
 }
 
 
@@ -315,6 +351,38 @@ DWORD TickConvertToMilliseconds(DWORD dwTickValue)
 	return (dwTickValue+(TICKS_PER_SECOND/2000ul))/((DWORD)(TICKS_PER_SECOND/1000ul));
 }
 
+#if defined(COMPILER_GCC_HOST)
+/*****************************************************************************
+  Function:
+	void TickSetHostTime(QWORD qwNanoseconds)
+
+  Summary:
+	Switches a host build to virtual time.
+
+  Description:
+	From the first call on, the Tick module counts from qwNanoseconds 
+	instead of the host's monotonic clock.  A simulator advances time by 
+	calling this again with later values, so timeouts in TCP and the other 
+	modules behave the same way on every run no matter how fast the host 
+	is.  With STACK_MULTI_INSTANCE, this only sets the time seen by the 
+	calling thread.
+
+  Precondition:
+	None
+
+  Parameters:
+	qwNanoseconds - current virtual time; should never go backwards
+
+  Returns:
+  	None
+  ***************************************************************************/
+void TickSetHostTime(QWORD qwNanoseconds)
+{
+	qwHostTimeNs = qwNanoseconds;
+	bHostTimeIsVirtual = TRUE;
+}
+
+#else
 /*****************************************************************************
   Function:
 	void _ISR _T5Interrupt(void)
@@ -342,3 +410,4 @@ extern void __attribute((interrupt(ipl2), vector(_TIMER_5_VECTOR), nomips16)) vT
 	// Reset interrupt flag
 	IFS0CLR = _IFS0_T5IF_MASK;
 }
+#endif
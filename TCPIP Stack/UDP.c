@@ -106,27 +106,21 @@
 	UDP Global Variables
   ***************************************************************************/
 
-// Stores an array of information pertaining to each UDP socket
-UDP_SOCKET_INFO		UDPSocketInfo[MAX_UDP_SOCKETS];
-
-// Indicates which UDP socket is currently active
-UDP_SOCKET			activeUDPSocket;
-
-WORD UDPTxCount;	// Number of bytes written to this UDP segment
-WORD UDPRxCount;	// Number of bytes read from this UDP segment
-static UDP_SOCKET	LastPutSocket = INVALID_UDP_SOCKET;	// Indicates the last socket to which data was written
-static WORD wPutOffset;		// Offset from beginning of payload where data is to be written.
-static WORD wGetOffset;		// Offset from beginning of payload from where data is to be read.
-
-// Stores various flags for the UDP module
-static struct
-{
-	unsigned char bFirstRead : 1;		// No data has been read from this segment yet
-	unsigned char bWasDiscarded : 1;	// The data in this segment has been discarded
-} Flags;
-
-// Indicates which socket has currently received data for this loop
-static UDP_SOCKET SocketWithRxData = INVALID_UDP_SOCKET;
+// Power-on value of a UDP_CONTEXT.  Members that aren't named start at 0.
+#define UDP_CONTEXT_INIT	{.LastPutSocket = INVALID_UDP_SOCKET, .SocketWithRxData = INVALID_UDP_SOCKET}
+
+// State of the module, see UDP.h
+UDP_CONTEXT STACK_INSTANCE_ARRAY(UDPContext) = STACK_INSTANCE_INIT(UDP_CONTEXT_INIT);
+#define LastPutSocket		(STACK_INSTANCE(UDPContext).LastPutSocket)
+#define SocketWithRxData	(STACK_INSTANCE(UDPContext).SocketWithRxData)
+#define wPutOffset			(STACK_INSTANCE(UDPContext).wPutOffset)
+#define wGetOffset			(STACK_INSTANCE(UDPContext).wGetOffset)
+#define Flags				(STACK_INSTANCE(UDPContext).Flags)
+
+// Next local port for sockets opened without one.  Not cleared by a reset, 
+// so ports aren't reused right after one.
+static WORD STACK_INSTANCE_ARRAY(UDPNextPort) __attribute__((persistent));
+#define NextPort			STACK_INSTANCE(UDPNextPort)
 
 /****************************************************************************
   Section:
@@ -173,6 +167,8 @@ void UDPInit(void)
 		UDPClose(s);
     }
 	Flags.bWasDiscarded = 1;
+	LastPutSocket = INVALID_UDP_SOCKET;
+	SocketWithRxData = INVALID_UDP_SOCKET;
 }
 
 
@@ -243,9 +239,8 @@ UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, UDP_PORT localPort,
 	UDP_SOCKET s;
 	UDP_SOCKET_INFO *p;
 
-	// Local temp port numbers.
-	static WORD NextPort __attribute__((persistent));
-
+	// Host builds must be able to pass pointers in remoteHost
+	CheckDWORDPointer("UDPOpenEx()");
 
 	p = UDPSocketInfo;
 	for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
@@ -685,7 +680,10 @@ void UDPSetTxBuffer(WORD wOffset)
   ***************************************************************************/
 void UDPSetRxBuffer(WORD wOffset)
 {
-	IPSetRxBuffer(wOffset+sizeof(UDP_HEADER));
+	#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	if(!Flags.bStaged)
+	#endif
+		IPSetRxBuffer(wOffset+sizeof(UDP_HEADER));
 	wGetOffset = wOffset;
 }
 
@@ -1095,7 +1093,12 @@ BOOL UDPGet(BYTE *v)
     if((wGetOffset >= UDPRxCount) || (SocketWithRxData != activeUDPSocket))
         return FALSE;
 
-    *v = MACGet();
+    #if defined(STACK_USE_RX_CHECKSUM_COPY)
+    if(Flags.bStaged)
+        *v = MACRxStage[sizeof(UDP_HEADER) + wGetOffset];
+    else
+    #endif
+        *v = MACGet();
     wGetOffset++;
 
     return TRUE;
@@ -1142,7 +1145,15 @@ WORD UDPGetArray(BYTE *cData, WORD wDataLen)
 	if(wBytesAvailable < wDataLen)
 		wDataLen = wBytesAvailable;
 
-	wDataLen = MACGetArray(cData, wDataLen);
+	#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	if(Flags.bStaged)
+	{
+		if(cData)
+			memcpy((void*)cData, (void*)&MACRxStage[sizeof(UDP_HEADER) + wGetOffset], wDataLen);
+	}
+	else
+	#endif
+		wDataLen = MACGetArray(cData, wDataLen);
     wGetOffset += wDataLen;
 
     return wDataLen;
@@ -1224,6 +1235,7 @@ BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len)
     DWORD_VAL		checksums;
 
 	UDPRxCount = 0;
+	Flags.bStaged = 0;
 
     // Retrieve UDP header.
     MACGetArray((BYTE*)&h, sizeof(h));
@@ -1250,7 +1262,16 @@ BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len)
 	
 	    // Now calculate UDP packet checksum in NIC RAM -- should match pseudoHeader
 	    IPSetRxBuffer(0);
-	    checksums.w[1] = CalcIPBufferChecksum(len);
+		#if defined(STACK_USE_RX_CHECKSUM_COPY)
+		// Keep the copy so UDPGet() and UDPGetArray() needn't read it again
+		if(len <= sizeof(MACRxStage))
+		{
+			checksums.w[1] = MACGetArrayChecksum(MACRxStage, len);
+			Flags.bStaged = 1;
+		}
+		else
+		#endif
+		    checksums.w[1] = CalcIPBufferChecksum(len);
 	
 	    if(checksums.w[0] != checksums.w[1])
 	    {
@@ -1270,6 +1291,11 @@ BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR *localIP, WORD len)
     else
     {
 		SocketWithRxData = s;
+		#if defined(STACK_USE_RX_CHECKSUM_COPY)
+		// Never let a bad length field read past the staged bytes
+		if(Flags.bStaged && (h.Length > len - sizeof(UDP_HEADER)))
+			h.Length = len - sizeof(UDP_HEADER);
+		#endif
         UDPRxCount = h.Length;
         Flags.bFirstRead = 1;
 		Flags.bWasDiscarded = 0;
@@ -185,6 +185,11 @@ static BOOL   g_txBufferFlushed;
 static BOOL   g_mgmtRxInProgress = FALSE;
 static BOOL   g_mgmtAppWaiting = FALSE;
 static UINT16 g_sizeofScratchMemory = 0;
+
+#if defined(STACK_USE_RX_CHECKSUM_COPY)
+/* PIC RAM copy of the received TCP segment or UDP datagram, see MACGetArrayChecksum() */
+BYTE MACRxStage[MAC_RX_STAGE_SIZE];
+#endif
 BOOL g_rxIndexSetBeyondBuffer;        // debug -- remove after test
 
 
@@ -1575,37 +1580,61 @@ BYTE MACGet()
  *                  ERDPT is incremented after each byte, following the same
  *                  rules as MACGet().
  *
- * Note:            None
+ * Note:            If val is NULL the bytes are skipped with MACSkipArray()
+ *                  instead of being read.
  *****************************************************************************/
 WORD MACGetArray(BYTE *val, WORD len)
 {
-    WORD i = 0;
-    UINT8 byte;
+    if ( val == NULL )
+    {
+        MACSkipArray(len);
+        return len;
+    }
 
     if ( g_encPtrRAWId[ENC_RD_PTR_ID] == RAW_INVALID_ID )
     {
         SyncENCPtrRAWState(ENC_RD_PTR_ID);
     }
 
-    if ( val )
-    {
-        RawGetByte(g_encPtrRAWId[ENC_RD_PTR_ID], val, len);
-    }
-    else
-    {
-        // Read the data
-        while(i<len)
-        {
-            RawGetByte(g_encPtrRAWId[ENC_RD_PTR_ID], &byte, 1);
-            i++;
-        }
-    }
+    RawGetByte(g_encPtrRAWId[ENC_RD_PTR_ID], val, len);
     g_encIndex[ENC_RD_PTR_ID] += len;
 
     return len;
 }//end MACGetArray
 
 
+/******************************************************************************
+ * Function:        void MACSkipArray(WORD len)
+ *
+ * PreCondition:    SPI bus must be initialized (done in MACInit()).
+ *                  ERDPT must point to the place to skip from.
+ *
+ * Input:           len:  Number of bytes to skip over in the data buffer.
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Advances ERDPT past len bytes without reading them.  The
+ *                  RAW read index is moved with a single RawSetIndex()
+ *                  instead of clocking every skipped byte across SPI, so
+ *                  skipping costs the same no matter how many bytes are
+ *                  skipped.
+ *
+ * Note:            None
+ *****************************************************************************/
+void MACSkipArray(WORD len)
+{
+    if ( len == 0u )
+    {
+        return;
+    }
+
+    g_encIndex[ENC_RD_PTR_ID] += len;
+    SyncENCPtrRAWState(ENC_RD_PTR_ID);
+}//end MACSkipArray
+
+
 /******************************************************************************
  * Function:        void MACPut(BYTE val)
  *
@@ -1781,6 +1810,53 @@ WORD CalcIPBufferChecksum(WORD len)
 }
 
 
+/*****************************************************************************
+  Function:
+    WORD MACGetArrayChecksum(BYTE *val, WORD len)
+
+  Summary:
+    Reads an array from the MAC buffer and calculates its IP checksum.
+
+  Description:
+    This function performs a MACGetArray() into val and returns the same 
+    checksum CalcIPBufferChecksum() would have calculated over those bytes.  
+    The data crosses the SPI bus once, so callers that need both the data 
+    and the checksum should use this instead of calling 
+    CalcIPBufferChecksum() and then reading the data again.
+
+  Precondition:
+    The MAC read pointer is set to the start of the data to read.
+
+  Parameters:
+    val - buffer to receive the data; need not be WORD aligned
+    len - number of bytes to read and checksum
+
+  Returns:
+    The calculated checksum.
+  ***************************************************************************/
+WORD MACGetArrayChecksum(BYTE *val, WORD len)
+{
+    DWORD_VAL Checksum;
+    WORD i;
+
+    MACGetArray(val, len);
+
+    // Sum the data as little endian WORDs, zero padding a last odd byte.  
+    // Bytes are combined by hand since val may not be WORD aligned.
+    Checksum.Val = 0;
+    for(i = 1; i < len; i += 2)
+        Checksum.Val += (WORD)val[i-1] | ((WORD)val[i] << 8);
+    if(len & 0x1u)
+        Checksum.Val += val[len-1];
+
+    // Do two end-around carries (one's complement arrithmatic)
+    Checksum.Val = (DWORD)Checksum.w[0] + (DWORD)Checksum.w[1];
+    Checksum.w[0] += Checksum.w[1];
+
+    return ~Checksum.w[0];
+}
+
+
 
 /******************************************************************************
  * Function:        void MACPowerDown(void)
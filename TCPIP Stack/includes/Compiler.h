@@ -115,6 +115,13 @@
     #define COMPILER_MPLAB_C32
 	#include <p32xxxx.h>
 	#include <plib.h>
+#elif defined(__linux__) && defined(__GNUC__)	// GCC on a Linux PC
+	// Host build of the stack, with a MAC that works on capture files or a 
+	// TAP device instead of hardware.  TCPOpen() and UDPOpenEx() carry 
+	// pointers in DWORDs, so 64-bit hosts must link with -no-pie (keeping 
+	// static data below 4GB) and only pass static strings and NODE_INFOs.  
+	// Both stop the program (CheckDWORDPointer()) if -no-pie was left out.
+    #define COMPILER_GCC_HOST
 #else
 	#error Unknown processor or compiler.  See Compiler.h
 #endif
@@ -137,6 +144,9 @@
 #elif defined(COMPILER_HITECH_PICC18)
 	#define PTR_BASE		unsigned short
 	#define ROM_PTR_BASE	unsigned long
+#elif defined(COMPILER_GCC_HOST)
+	#define PTR_BASE		unsigned long	// Pointer sized on both ILP32 and LP64
+	#define ROM_PTR_BASE	unsigned long
 #endif
 
 
@@ -211,6 +221,28 @@
 			#define Nop()				asm("nop")
 		#endif
 	#endif
+
+	// Linux host specific defines
+	#if defined(COMPILER_GCC_HOST)
+		#define persistent
+		#define far
+		#define FAR
+		#define Nop()
+		#define ClrWdt()
+		#define Reset()				abort()
+
+		// TCPOpen() and UDPOpenEx() take pointers in a DWORD.  This stops 
+		// the program when the string literal s, and so the rest of the 
+		// static data, is above 4GB, as it is when a 64-bit build isn't 
+		// linked with -no-pie.  Otherwise the pointers would be silently 
+		// cut short.
+		#define CheckDWORDPointer(s)	do { if(((PTR_BASE)(s) >> 16) >> 16) { fprintf(stderr, "%s: static data is above 4GB and pointers to it don't fit in a DWORD; link with -no-pie\n", (s)); abort(); } } while(0)
+	#endif
+#endif
+
+// Pointers always fit in a DWORD on the PICs
+#if !defined(CheckDWORDPointer)
+	#define CheckDWORDPointer(s)
 #endif
 
 
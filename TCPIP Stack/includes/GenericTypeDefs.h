@@ -73,7 +73,11 @@ typedef enum _BIT { CLEAR = 0, SET } BIT;
 typedef signed int          INT;
 typedef signed char         INT8;
 typedef signed short int    INT16;
+#if defined(__LP64__)
+typedef signed int          INT32;      /* long is 64 bits on LP64 hosts */
+#else
 typedef signed long int     INT32;
+#endif
 
 /* MPLAB C Compiler for PIC18 does not support 64-bit integers */
 #if !defined(__18CXX)
@@ -88,7 +92,11 @@ typedef unsigned short int  UINT16;
 #if defined(__18CXX)
 typedef unsigned short long UINT24;
 #endif
+#if defined(__LP64__)
+typedef unsigned int        UINT32;     /* long is 64 bits on LP64 hosts */
+#else
 typedef unsigned long int   UINT32;     /* other name for 32-bit integer */
+#endif
 /* MPLAB C Compiler for PIC18 does not support 64-bit integers */
 #if !defined(__18CXX)
 __EXTENSION typedef unsigned long long  UINT64;
@@ -341,13 +349,21 @@ typedef unsigned char           UCHAR8;
 
 typedef unsigned char           BYTE;                           /* 8-bit unsigned  */
 typedef unsigned short int      WORD;                           /* 16-bit unsigned */
+#if defined(__LP64__)
+typedef unsigned int            DWORD;                          /* 32-bit unsigned */
+#else
 typedef unsigned long           DWORD;                          /* 32-bit unsigned */
+#endif
 /* MPLAB C Compiler for PIC18 does not support 64-bit integers */
 __EXTENSION
 typedef unsigned long long      QWORD;                          /* 64-bit unsigned */
 typedef signed char             CHAR;                           /* 8-bit signed    */
 typedef signed short int        SHORT;                          /* 16-bit signed   */
+#if defined(__LP64__)
+typedef signed int              LONG;                           /* 32-bit signed   */
+#else
 typedef signed long             LONG;                           /* 32-bit signed   */
+#endif
 /* MPLAB C Compiler for PIC18 does not support 64-bit integers */
 __EXTENSION
 typedef signed long long        LONGLONG;                       /* 64-bit signed   */
@@ -69,6 +69,11 @@
 #define GetPeripheralClock()	(GetSystemClock()/2)	// Normally GetSystemClock()/4 for PIC18, GetSystemClock()/2 for PIC24/dsPIC, and GetSystemClock()/1 for PIC32.  Divisor may be different if using a PIC32 since it's configurable.
 
 
+// A host build (COMPILER_GCC_HOST) keeps the clock values above so tick 
+// based timeouts match the board, but has no I/O pins.  Its MAC is 
+// HostMAC.c.
+#if !defined(COMPILER_GCC_HOST)
+
 // +++++++++++++++++++ Hardware I/O pin mappings +++++++++++++++++++++++++++++++
 
 // ======================== For Cerebot MX4ck ==================================
@@ -229,5 +234,6 @@
 
 	#define WF_MAX_SPI_FREQ		(10000000ul)	// Hz
 
+#endif	// #if !defined(COMPILER_GCC_HOST)
 
 #endif // #ifndef HARDWARE_PROFILE_H
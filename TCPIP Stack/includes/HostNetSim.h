@@ -0,0 +1,80 @@
+/*********************************************************************
+ *
+ *	Simulated Network for the Linux Host Build of the Stack
+ *
+ *********************************************************************
+ * FileName:        HostNetSim.h
+ * Dependencies:    GenericTypeDefs.h, StackTsk.h
+ * Processor:       Linux PC (COMPILER_GCC_HOST)
+ * Compiler:        GCC
+ *
+ * A switch with up to NETSIM_MAX_PORTS ports, each with its own
+ * simulated link, that runs entirely in virtual time.  See HostNetSim.c.
+ * With STACK_MULTI_INSTANCE, each thread has its own network and clock.
+ ********************************************************************/
+#ifndef __HOSTNETSIM_H
+#define __HOSTNETSIM_H
+
+// Most stations (stack instances or test peers) on one simulated network, 
+// at most 255
+#if !defined(NETSIM_MAX_PORTS)
+	#if defined(STACK_MULTI_INSTANCE)
+		#define NETSIM_MAX_PORTS	(64u)
+	#else
+		#define NETSIM_MAX_PORTS	(4u)
+	#endif
+#endif
+
+// Most frames that can be in flight across all links at once
+#if !defined(NETSIM_MAX_FRAMES)
+	#if defined(STACK_MULTI_INSTANCE)
+		#define NETSIM_MAX_FRAMES	(512u)
+	#else
+		#define NETSIM_MAX_FRAMES	(1024u)
+	#endif
+#endif
+
+// Returned by HostNetSimAddPort() when all ports are in use
+#define NETSIM_INVALID_PORT		(0xFFu)
+
+// Returned by HostNetSimGetNextEvent() when nothing is in flight
+#define NETSIM_NO_EVENT			(0xFFFFFFFFFFFFFFFFull)
+
+// Impairments of the link from the switch to one port.  They apply to
+// every frame delivered to that port, so the two directions between a
+// pair of stations can be configured separately.  All zero is a perfect,
+// infinitely fast link.
+typedef struct
+{
+	DWORD dwDelayUs;			// Fixed one-way delay, in microseconds
+	DWORD dwJitterUs;			// Random extra delay, 0 to dwJitterUs
+	DWORD dwLossPPM;			// Frames lost per million
+	DWORD dwDuplicatePPM;		// Frames delivered twice per million
+	DWORD dwReorderPPM;			// Frames held back per million...
+	DWORD dwReorderDelayUs;		// ...by this much, so later frames overtake them
+	DWORD dwBandwidthBps;		// Link rate in bits/second, 0 for unlimited
+	WORD wQueueFrames;			// Frames waiting for the link before tail drop, 0 for no limit
+} NETSIM_LINK_CONFIG;
+
+// What happened to frames on their way to one port
+typedef struct
+{
+	DWORD dwSent;				// Frames this port sent into the switch
+	DWORD dwDelivered;			// Frames this port received
+	DWORD dwLost;				// Frames to this port dropped by dwLossPPM
+	DWORD dwDuplicated;			// Extra copies made by dwDuplicatePPM
+	DWORD dwReordered;			// Frames held back by dwReorderPPM
+	DWORD dwQueueDrops;			// Frames dropped by wQueueFrames or lack of NETSIM_MAX_FRAMES
+} NETSIM_PORT_STATS;
+
+void HostNetSimInit(QWORD qwSeed);
+BYTE HostNetSimAddPort(MAC_ADDR *MAC, NETSIM_LINK_CONFIG *Config);
+void HostNetSimSetLink(BYTE vPort, NETSIM_LINK_CONFIG *Config);
+void HostNetSimSend(BYTE vPort, BYTE *vFrame, WORD wLen);
+WORD HostNetSimReceive(BYTE vPort, BYTE *vFrame, WORD wMaxLen);
+void HostNetSimAdvance(QWORD qwNanoseconds);
+QWORD HostNetSimGetTime(void);
+QWORD HostNetSimGetNextEvent(void);
+void HostNetSimGetStats(BYTE vPort, NETSIM_PORT_STATS *Stats);
+
+#endif
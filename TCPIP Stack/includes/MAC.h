@@ -86,6 +86,8 @@
 	#define PHYREG WORD
 #elif defined(__PIC32MX__) && defined(_ETH)
 	// extra includes for PIC32MX with embedded ETH Controller
+#elif defined(COMPILER_GCC_HOST)
+	// HostMAC.c emulates the MAC buffer RAM in a PC's memory
 #else
 	#error No Ethernet/WiFi controller defined in HardwareProfile.h.  Defines for an ENC28J60, ENC424J600/624J600, or WiFi MRF24WB10 must be present.
 #endif
@@ -150,6 +152,18 @@ typedef struct  __attribute__((aligned(2), packed))
 	#define BASE_SSLB_ADDR	(MACGetSslBaseAddr())
 	#define RXSIZE			(EMAC_RX_BUFF_SIZE)
 	#define RAMSIZE			(2*RXSIZE)	// not used but silences the compiler
+#elif defined(COMPILER_GCC_HOST)
+	// Laid out like the ENC28J60 buffer, but big enough to hold the 
+	// TCP_ETH_RAM sockets configured for the MRF24WB
+	#define RAMSIZE			(24*1024ul)
+	#define TXSTART 		(RAMSIZE - 1518ul - TCP_ETH_RAM_SIZE - RESERVED_HTTP_MEMORY - RESERVED_SSL_MEMORY)
+	#define RXSTART			(0ul)
+	#define	RXSTOP			(TXSTART-1ul)
+	#define RXSIZE			(RXSTOP-RXSTART+1ul)
+	#define BASE_TX_ADDR	(TXSTART)
+	#define BASE_TCB_ADDR	(BASE_TX_ADDR + 1518ul)
+	#define BASE_HTTPB_ADDR (BASE_TCB_ADDR + TCP_ETH_RAM_SIZE)
+	#define BASE_SSLB_ADDR	(BASE_HTTPB_ADDR + RESERVED_HTTP_MEMORY)
 #else	// ENC28J60 or PIC18F97J60 family internal Ethernet controller
 	#define RAMSIZE			(8*1024ul)
 	#define TXSTART 		(RAMSIZE - (1ul+1518ul+7ul) - TCP_ETH_RAM_SIZE - RESERVED_HTTP_MEMORY - RESERVED_SSL_MEMORY)
@@ -168,6 +182,18 @@ typedef struct  __attribute__((aligned(2), packed))
 
 WORD	MACCalcRxChecksum(WORD offset, WORD len);
 WORD 	CalcIPBufferChecksum(WORD len);
+WORD	MACGetArrayChecksum(BYTE *val, WORD len);
+
+#if defined(STACK_USE_RX_CHECKSUM_COPY)
+	#define MAC_RX_STAGE_SIZE	(1480u)		// Largest TCP segment or UDP datagram in a 1500 byte IP packet
+	#if defined(STACK_MULTI_INSTANCE)
+		// One staging buffer per stack instance (see StackTsk.h)
+		extern BYTE MACRxStages[STACK_MAX_INSTANCES][MAC_RX_STAGE_SIZE];
+		#define MACRxStage	(MACRxStages[wStackInstance])
+	#else
+		extern BYTE MACRxStage[MAC_RX_STAGE_SIZE];
+	#endif
+#endif
 
 void	MACPowerDown(void);
 void	MACEDPowerDown(void);
@@ -294,6 +320,7 @@ PTR_BASE MACSetWritePtr(PTR_BASE address);
 PTR_BASE MACSetReadPtr(PTR_BASE address);
 BYTE MACGet(void);
 WORD MACGetArray(BYTE *val, WORD len);
+void MACSkipArray(WORD len);
 void MACDiscardRx(void);
 WORD MACGetFreeRxSize(void);
 void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len);
@@ -320,5 +347,16 @@ void MACFlush(void);
 	PTR_BASE MACGetSslBaseAddr(void);
 #endif
 
+// Linux host MAC (HostMAC.c) frame sources and sinks
+#if defined(COMPILER_GCC_HOST)
+	BOOL HostMACOpenTap(const char *szInterface);
+	BOOL HostMACOpenFd(int fd);
+	BOOL HostMACOpenNetSim(BYTE vPort);
+	BOOL HostMACOpenPcap(const char *szRxFile, const char *szTxFile);
+	void HostMACClose(void);
+	void HostMACRewind(void);
+	DWORD HostMACGetTxCount(void);
+#endif
+
 	
 #endif
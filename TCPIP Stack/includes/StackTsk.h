@@ -72,6 +72,61 @@
 #error Invalid MAX_HTTP_CONNECTIONS value specified.
 #endif
 
+// Several stack instances in one process.  Each module keeps all of its 
+// state in a context structure, and refers to it through macros built from 
+// the ones below.  Normally there is one static copy of every context, so 
+// STACK_INSTANCE(x) is just x and the generated code is the same as with 
+// plain static variables.  A host build with STACK_MULTI_INSTANCE defined 
+// (see TCPIPConfig.h) has STACK_MAX_INSTANCES copies instead, and every 
+// stack function works on the copy StackSetInstance() last selected in the 
+// calling thread.  Threads can run different instances at the same time, 
+// but each instance must only be used by one thread at a time.
+#if defined(STACK_MULTI_INSTANCE)
+	#if !defined(COMPILER_GCC_HOST)
+		#error STACK_MULTI_INSTANCE is only supported by the host build (COMPILER_GCC_HOST)
+	#endif
+	#if NETWORK_INTERFACES > 1
+		#error STACK_MULTI_INSTANCE requires NETWORK_INTERFACES == 1
+	#endif
+	// Modules whose state has not been moved into a context yet
+	#if defined(STACK_USE_HTTP2_SERVER) || defined(STACK_USE_SSL) || \
+		defined(STACK_USE_FTP_SERVER) || defined(STACK_USE_SMTP_CLIENT) || \
+		defined(STACK_USE_SNMP_SERVER) || defined(STACK_USE_TFTP_CLIENT) || \
+		defined(STACK_USE_TELNET_SERVER) || defined(STACK_USE_DHCP_SERVER) || \
+		defined(STACK_USE_DNS_SERVER) || defined(STACK_USE_REBOOT_SERVER) || \
+		defined(STACK_USE_UDP_PERFORMANCE_TEST) || defined(STACK_USE_TCP_PERFORMANCE_TEST) || \
+		defined(STACK_USE_DYNAMICDNS_CLIENT) || defined(STACK_USE_BERKELEY_API) || \
+		defined(STACK_USE_ZEROCONF_LINK_LOCAL) || defined(STACK_USE_ZEROCONF_MDNS_SD) || \
+		defined(STACK_USE_RANDOM) || defined(STACK_USE_UART2TCP_BRIDGE)
+		#error A module enabled in TCPIPConfig.h does not support STACK_MULTI_INSTANCE
+	#endif
+
+	// Most stack instances one process can run
+	#if !defined(STACK_MAX_INSTANCES)
+		#define STACK_MAX_INSTANCES			(256u)
+	#endif
+
+	// Declares the copies of a context:  static X_CONTEXT STACK_INSTANCE_ARRAY(XContext);
+	#define STACK_INSTANCE_ARRAY(name)		name[STACK_MAX_INSTANCES]
+	// The current instance's copy of a context
+	#define STACK_INSTANCE(name)			name[wStackInstance]
+	// Initializer giving every copy the power-on value init, which must be 
+	// a single token (a #define) since it usually contains commas
+	#define STACK_INSTANCE_INIT(init)		{[0 ... STACK_MAX_INSTANCES-1] = init}
+	// Scratch space used only within one call, which needs one copy per 
+	// thread rather than per instance
+	#define STACK_THREAD_LOCAL				__thread
+
+	extern __thread WORD wStackInstance;
+	#define StackSetInstance(w)				(wStackInstance = (w))
+	#define StackGetInstance()				(wStackInstance)
+#else
+	#define STACK_INSTANCE_ARRAY(name)		name
+	#define STACK_INSTANCE(name)			name
+	#define STACK_INSTANCE_INIT(init)		init
+	#define STACK_THREAD_LOCAL
+#endif
+
 // Structure to contain a MAC address
 typedef struct __attribute__((__packed__))
 {
@@ -135,7 +190,37 @@ typedef struct __attribute__((__packed__)) appConfigStruct
 
 } APP_CONFIG;
 
-#ifndef THIS_IS_STACK_APPLICATION
+// Stack FSM states.
+typedef enum
+{
+    SM_STACK_IDLE,
+    SM_STACK_MAC,
+    SM_STACK_IP,
+    SM_STACK_ARP,
+    SM_STACK_TCP,
+    SM_STACK_UDP
+} SM_STACK;
+
+// State of StackTsk.c, and with STACK_MULTI_INSTANCE, the AppConfig of 
+// each instance
+typedef struct
+{
+	SM_STACK smStack;
+	BOOL once;					// LFSRSeedRand() has been called
+	BOOL bLastLinkState;		// MACIsLinked() at the last StackTask() call
+	NODE_INFO remoteNode;		// Sender of the frame being processed
+	#if defined(STACK_MULTI_INSTANCE)
+	APP_CONFIG AppConfig;
+	#endif
+} STACK_CONTEXT;
+extern STACK_CONTEXT STACK_INSTANCE_ARRAY(StackContext);
+
+// Sender of the frame StackTask() is processing
+#define StackRemoteNode		(STACK_INSTANCE(StackContext).remoteNode)
+
+#if defined(STACK_MULTI_INSTANCE)
+	#define AppConfig		(STACK_INSTANCE(StackContext).AppConfig)
+#elif !defined(THIS_IS_STACK_APPLICATION)
     extern APP_CONFIG AppConfig;
 #endif
 
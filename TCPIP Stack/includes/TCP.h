@@ -63,6 +63,20 @@ typedef BYTE TCP_SOCKET;
 #define INVALID_SOCKET      (0xFE)	// The socket is invalid or could not be opened
 #define UNKNOWN_SOCKET      (0xFF)	// The socket is not known
 
+// Byte counts and offsets within a socket's TX and RX FIFOs.  These are 
+// 16 bits unless TCP_LARGE_FIFOS is defined in TCPIPConfig.h, which allows 
+// FIFOs and windows of 64KB and larger.
+#if defined(TCP_LARGE_FIFOS)
+	#if !defined(__PIC32MX__) && !defined(COMPILER_GCC_HOST)
+		#error TCP_LARGE_FIFOS requires 32 bit RAM pointers (PIC32 or the host build)
+	#endif
+	typedef DWORD TCP_FIFO_SIZE;
+	#define TCP_FIFO_SIZE_MAX	(0xFFFFFFFFul)
+#else
+	typedef WORD TCP_FIFO_SIZE;
+	#define TCP_FIFO_SIZE_MAX	(0xFFFFu)
+#endif
+
 /****************************************************************************
   Section:
 	State Machine Variables
@@ -105,7 +119,7 @@ typedef enum
   ***************************************************************************/
 
 // TCP Control Block (TCB) stub data storage.  Stubs are stored in local PIC RAM for speed.
-// Current size is 34 bytes (PIC18), 36 bytes (PIC24/dsPIC), or 56 (PIC32)
+// Current size is 39 bytes (PIC18), 42 bytes (PIC24/dsPIC), or 64 (PIC32)
 typedef struct
 {
 	PTR_BASE bufferTxStart;		// First byte of TX buffer
@@ -115,6 +129,7 @@ typedef struct
 	PTR_BASE txTail;			// Tail pointer for TX
 	PTR_BASE rxHead;			// Head pointer for RX
 	PTR_BASE rxTail;			// Tail pointer for RX
+	PTR_BASE txUnackedTail;		// TX tail pointer for data that is not yet acked.  Kept here so TCPFlush() and friends need no SyncTCB()
     DWORD eventTime;			// Packet retransmissions, state changes
 	WORD eventTime2;			// Window updates, automatic transmission
 	union
@@ -139,6 +154,14 @@ typedef struct
 		unsigned char bSSLHandshaking : 1;			// Socket is in an SSL handshake
 		unsigned char filler : 2;					// Future expansion
     } Flags;
+	WORD wAutoFlushTime;	// Auto-transmit timeout for unflushed data, in TickGetDiv256() units (TCP_OPT_AUTOFLUSH_MS)
+	struct
+	{
+		unsigned char bNoDelay : 1;		// Transmit after every TCPPut*() call (TCP_OPT_NODELAY)
+		unsigned char bQuickACK : 1;	// Acknowledge every received segment immediately (TCP_OPT_QUICKACK)
+		unsigned char bCork : 1;		// Hold TX data until a full segment is available (TCP_OPT_CORK)
+		unsigned char filler : 5;		// Future expansion
+	} Options;					// Transmit/acknowledgement policy set by TCPSetOption(); kept across server reconnects
 	WORD_VAL remoteHash;	// Consists of remoteIP, remotePort, localPort for connected sockets.  It is a localPort number only for listening server sockets.
 
     #if defined(STACK_USE_SSL)
@@ -153,39 +176,79 @@ typedef struct
 	
 } TCB_STUB;
 
+// Number of separate out-of-order data ranges each socket can hold in its 
+// RX FIFO while waiting for the holes in front of them to be filled
+#if !defined(TCP_MAX_OOO_RANGES)
+	#define TCP_MAX_OOO_RANGES	(4u)
+#endif
+
+// Number of separate SACKed ranges of TX data each socket remembers so that 
+// only the holes between them are retransmitted
+#if !defined(TCP_MAX_SACK_RANGES)
+	#define TCP_MAX_SACK_RANGES	(4u)
+#endif
+
+// A range of sequence space, in bytes relative to a base.  Used for out-of-order 
+// data held in the RX FIFO (based at RemoteSEQ, the RX head pointer) and for 
+// TX data SACKed by the remote node (based at SND.UNA, the TX tail pointer).  
+// wEnd is exclusive.
+typedef struct
+{
+	TCP_FIFO_SIZE wStart;		// First byte of the range
+	TCP_FIFO_SIZE wEnd;			// One past the last byte of the range
+} TCP_SEQ_RANGE;
+
 // Remainder of TCP Control Block data.
 // The rest of the TCB is stored in Ethernet buffer RAM or elsewhere as defined by vMemoryMedium.
-// Current size is 41 (PIC18), 42 (PIC24/dsPIC), or 48 bytes (PIC32)
+// Current size is 112 (PIC18), 114 (PIC24/dsPIC), or 116 bytes (PIC32) with 4 out-of-order and 4 SACK ranges.
+// TCP_LARGE_FIFOS adds about 40 bytes.
 typedef struct
 {
 	DWORD		retryInterval;			// How long to wait before retrying transmission
+	DWORD		dwRTO;					// Retransmission timeout computed from the round trip time estimate
+	DWORD		dwSRTT;					// Smoothed round trip time in ticks, scaled by 8 (0 until the first sample is taken)
+	DWORD		dwRTTVAR;				// Round trip time variation in ticks, scaled by 4
+	DWORD		dwRTTStartTime;			// Tick at which the segment being timed was transmitted
+	DWORD		dwRTTSeq;				// Sequence number that must be ACKed to complete the round trip time sample
+	DWORD		dwRecover;				// Highest sequence number sent when the last loss recovery started (NewReno)
+	DWORD		dwPushSeq;				// End of the data a corked socket may send in a segment shorter than the MSS: pushed by TCPFlush() or sent before
+	TCP_FIFO_SIZE	wCwnd;				// Congestion window: most unacknowledged bytes allowed in flight
+	TCP_FIFO_SIZE	wSsthresh;			// Slow start threshold
 	DWORD		MySEQ;					// Local sequence number
 	DWORD		RemoteSEQ;				// Remote sequence number
-	PTR_BASE	txUnackedTail;			// TX tail pointer for data that is not yet acked
     WORD_VAL	remotePort;				// Remote port number
     WORD_VAL	localPort;				// Local port number
-	WORD		remoteWindow;			// Remote window size
-	WORD		wFutureDataSize;		// How much out-of-order data has been received
+	DWORD		remoteWindow;			// Remote window size, after window scaling
 	union
 	{
 		NODE_INFO	niRemoteMACIP;		// 10 bytes for MAC and IP address
 		DWORD		dwRemoteHost;		// RAM or ROM pointer to a hostname string (ex: "www.microchip.com")
 	} remote;
-	SHORT		sHoleSize;				// Size of the hole, or -1 for none exists.  (0 indicates hole has just been filled)
+	TCP_SEQ_RANGE	OOORanges[TCP_MAX_OOO_RANGES];	// Out-of-order data received, sorted, disjoint and non-adjacent
+	TCP_SEQ_RANGE	SACKedRanges[TCP_MAX_SACK_RANGES];	// SACK scoreboard: TX data the remote node reported receiving
+	DWORD		dwSACKRecentSeq;		// Start of the most recently received out-of-order segment
+	TCP_FIFO_SIZE	wSACKHighRxt;		// Offset from SND.UNA of the first byte not yet resent in this recovery
     struct
     {
         unsigned char bFINSent : 1;		// A FIN has been sent
 		unsigned char bSYNSent : 1;		// A SYN has been sent
 		unsigned char bRemoteHostIsROM : 1;	// Remote host is stored in ROM
-		unsigned char bRXNoneACKed1 : 1;	// A duplicate ACK was likely received
-		unsigned char bRXNoneACKed2 : 1;	// A second duplicate ACK was likely received
-		unsigned char filler : 3;		// future use
+		unsigned char bFastRecovery : 1;	// Fast recovery is in progress after a fast retransmit
+		unsigned char bRTTTiming : 1;	// A segment is being timed for a round trip time sample
+		unsigned char bSACKPermitted : 1;	// Both sides agreed to use selective acknowledgements
+		unsigned char bWindowScale : 1;	// Both sides sent the window scale option
+		unsigned char filler : 1;		// future use
     } flags;
 	WORD		wRemoteMSS;				// Maximum Segment Size option advirtised by the remote node during initial handshaking
     #if defined(STACK_USE_SSL)
     WORD_VAL	localSSLPort;			// Local SSL port number (for listening sockets)
     #endif
 	BYTE		retryCount;				// Counter for transmission retries
+	BYTE		vDupACKs;				// Number of consecutive duplicate ACKs received
+	BYTE		vOOORangeCount;			// Number of valid entries in OOORanges[]
+	BYTE		vSACKedRangeCount;		// Number of valid entries in SACKedRanges[]
+	BYTE		vLocalWindowShift;		// Window scale shift count applied to windows we advertise
+	BYTE		vRemoteWindowShift;		// Window scale shift count applied to windows the remote node advertises
 	BYTE		vSocketPurpose;			// Purpose of socket (as defined in TCPIPConfig.h)
 } TCB;
 
@@ -207,16 +270,16 @@ BOOL TCPWasReset(TCP_SOCKET hTCP);
 BOOL TCPIsConnected(TCP_SOCKET hTCP);
 void TCPDisconnect(TCP_SOCKET hTCP);
 void TCPClose(TCP_SOCKET hTCP);
-WORD TCPIsPutReady(TCP_SOCKET hTCP);
+TCP_FIFO_SIZE TCPIsPutReady(TCP_SOCKET hTCP);
 BOOL TCPPut(TCP_SOCKET hTCP, BYTE byte);
-WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* Data, WORD Len);
+TCP_FIFO_SIZE TCPPutArray(TCP_SOCKET hTCP, BYTE* Data, TCP_FIFO_SIZE Len);
 BYTE* TCPPutString(TCP_SOCKET hTCP, BYTE* Data);
-WORD TCPIsGetReady(TCP_SOCKET hTCP);
-WORD TCPGetRxFIFOFree(TCP_SOCKET hTCP);
+TCP_FIFO_SIZE TCPIsGetReady(TCP_SOCKET hTCP);
+TCP_FIFO_SIZE TCPGetRxFIFOFree(TCP_SOCKET hTCP);
 BOOL TCPGet(TCP_SOCKET hTCP, BYTE* byte);
-WORD TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, WORD count);
-BYTE TCPPeek(TCP_SOCKET hTCP, WORD wStart);
-WORD TCPPeekArray(TCP_SOCKET hTCP, BYTE *vBuffer, WORD wLen, WORD wStart);
+TCP_FIFO_SIZE TCPGetArray(TCP_SOCKET hTCP, BYTE* buffer, TCP_FIFO_SIZE count);
+BYTE TCPPeek(TCP_SOCKET hTCP, TCP_FIFO_SIZE wStart);
+TCP_FIFO_SIZE TCPPeekArray(TCP_SOCKET hTCP, BYTE *vBuffer, TCP_FIFO_SIZE wLen, TCP_FIFO_SIZE wStart);
 WORD TCPFindEx(TCP_SOCKET hTCP, BYTE cFind, WORD wStart, WORD wSearchLen, BOOL bTextCompare);
 WORD TCPFindArrayEx(TCP_SOCKET hTCP, BYTE* cFindArray, WORD wLen, WORD wStart, WORD wSearchLen, BOOL bTextCompare);
 void TCPDiscard(TCP_SOCKET hTCP);
@@ -276,7 +339,8 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vS
 	#define TCPPutROMString(a,b)			TCPPutString(a,(BYTE*)b)
 #endif
 
-WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP);
+TCP_FIFO_SIZE TCPGetTxFIFOFull(TCP_SOCKET hTCP);
+DWORD TCPGetRTT(TCP_SOCKET hTCP);
 // Alias to TCPIsGetReady provided for API completeness
 #define TCPGetRxFIFOFull(a)					TCPIsGetReady(a)
 // Alias to TCPIsPutReady provided for API completeness
@@ -286,7 +350,67 @@ WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP);
 #define TCP_ADJUST_GIVE_REST_TO_TX	0x02u	// Resize flag: extra bytes go to TX
 #define TCP_ADJUST_PRESERVE_RX		0x04u	// Resize flag: attempt to preserve RX buffer
 #define TCP_ADJUST_PRESERVE_TX		0x08u	// Resize flag: attempt to preserve TX buffer
-BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize, BYTE vFlags);
+BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, TCP_FIFO_SIZE wMinRXSize, TCP_FIFO_SIZE wMinTXSize, BYTE vFlags);
+
+#define TCP_OPT_NODELAY			0x01u	// Socket option: nonzero transmits every TCPPut*() write immediately
+#define TCP_OPT_QUICKACK		0x02u	// Socket option: nonzero disables delayed acknowledgements
+#define TCP_OPT_CORK			0x03u	// Socket option: nonzero holds TX data until a full segment is queued
+#define TCP_OPT_AUTOFLUSH_MS	0x04u	// Socket option: milliseconds before unflushed TX data is sent automatically
+BOOL TCPSetOption(TCP_SOCKET hTCP, BYTE vOption, WORD wValue);
+WORD TCPGetOption(TCP_SOCKET hTCP, BYTE vOption);
+
+// Called once a buffer passed to TCPPutIov() is no longer needed
+typedef void (*TCP_IOV_RELEASE)(TCP_SOCKET hTCP, void* pContext);
+
+// One buffer to transmit by reference with TCPPutIov()
+typedef struct
+{
+	ROM BYTE* pData;			// Data to send.  Must stay valid and unchanged until fRelease is called.
+	DWORD dwLen;				// Number of bytes at pData
+	TCP_IOV_RELEASE fRelease;	// Called when pData is no longer needed, or NULL
+	void* pContext;				// Passed to fRelease
+} TCP_IOV;
+BYTE TCPPutIov(TCP_SOCKET hTCP, TCP_IOV* vIov, BYTE vCount);
+
+// Counters for one socket, returned by TCPGetStats().  Counters start from 
+// zero when the socket is opened; the window, RTT and FIFO fields are the 
+// current values.  The types are always declared, so code that reads the 
+// statistics builds with or without STACK_USE_TCP_STATS.
+typedef struct
+{
+	DWORD dwSegmentsIn;			// Segments received for this socket
+	DWORD dwSegmentsOut;		// Segments transmitted, including retransmissions
+	DWORD dwRetransmits;		// Retransmission timeouts plus fast retransmitted segments
+	DWORD dwDupACKs;			// Duplicate ACKs received
+	DWORD dwZeroWindows;		// Times the remote node advertised a zero window after a nonzero one
+	DWORD dwTXFIFOFull;			// TCPPut*() calls that filled the TX FIFO
+	DWORD dwRemoteWindow;		// Window last advertised by the remote node, after scaling
+	DWORD dwMinRemoteWindow;	// Smallest advertised window, or 0xFFFFFFFF before the first ACK
+	DWORD dwMaxRemoteWindow;	// Largest advertised window
+	DWORD dwSRTT;				// Smoothed round trip time in ticks, or 0 before the first sample
+	DWORD dwRTO;				// Retransmission timeout in ticks
+	TCP_FIFO_SIZE wTXUsed;		// Bytes in the TX FIFO, sent or not
+	TCP_FIFO_SIZE wRXUsed;		// Bytes waiting to be read from the RX FIFO
+	DWORD dwStateTicks[TCP_CLOSED_BUT_RESERVED+1];	// Ticks spent in each TCP_STATE
+} TCP_SOCKET_STATS;
+
+// Totals for all sockets since TCPInit(), returned by TCPGetStats()
+typedef struct
+{
+	DWORD dwSegmentsIn;			// Segments that passed the checksum
+	DWORD dwSegmentsOut;		// Segments transmitted, including resets and SYN cookies
+	DWORD dwRetransmits;		// Retransmission timeouts plus fast retransmitted segments
+	DWORD dwDupACKs;			// Duplicate ACKs received
+	DWORD dwZeroWindows;		// Zero windows advertised after a nonzero one
+	DWORD dwChecksumErrors;		// Segments dropped for a bad checksum
+	DWORD dwNoSocket;			// Segments not handed to a socket (no match, or a SYN that was queued or answered with a cookie)
+} TCP_STACK_STATS;
+
+#if defined(STACK_USE_TCP_STATS)
+BOOL TCPGetStats(TCP_SOCKET hTCP, TCP_SOCKET_STATS* pStats, TCP_STACK_STATS* pTotals);
+#else
+	#define TCPGetStats(a,b,c)		(FALSE)
+#endif
 
 #if defined(STACK_USE_SSL)
 BOOL TCPStartSSLClient(TCP_SOCKET hTCP, BYTE* host);
@@ -55,7 +55,7 @@
 #include <stdlib.h>
 #include "GenericTypeDefs.h"
 #include "Compiler.h"
-#include "../includes/HardWareProfile.h"
+#include "HardwareProfile.h"
 
 // RESERVED FEATURE -- do not change from current value of 1u as this is not 
 // fully implemented yet.
@@ -430,4 +430,8 @@
 #if defined(WF_CS_TRIS)
     #include "WFMac.h"
 #endif
+
+#if defined(COMPILER_GCC_HOST)
+	#include "HostNetSim.h"
+#endif
 #endif
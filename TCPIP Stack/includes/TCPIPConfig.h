@@ -231,10 +231,38 @@
  *   amount and medium of storage can be allocated on a per-socket
  *   basis using the example below as a guide.
  */
+	// Uncomment to allow TX and RX FIFOs of 64KB and larger (PIC32 or the 
+	// host build, for sockets stored in TCP_PIC_RAM).  FIFO sizes, offsets, 
+	// and windows become 32 bits and the TCP window scale option lets the 
+	// remote node fill all of a large RX FIFO in one round trip.
+	//#define TCP_LARGE_FIFOS
+
+	// Host builds (COMPILER_GCC_HOST) of one board get an extra server 
+	// socket in PIC RAM with TX and RX FIFOs of this many bytes each, so 
+	// bulk transfers can be benchmarked (my_C_TCPIP_netsim_bench_host.c).  
+	// Set it with -DTCP_HOST_BULK_FIFO_SIZE=<bytes>; more than 65535 needs 
+	// -DTCP_LARGE_FIFOS too.  Board builds and STACK_MULTI_INSTANCE builds, 
+	// whose PIC RAM isn't per instance, never have it.
+	#if defined(COMPILER_GCC_HOST) && !defined(STACK_MULTI_INSTANCE)
+		#if !defined(TCP_HOST_BULK_FIFO_SIZE)
+			#if defined(TCP_LARGE_FIFOS)
+				#define TCP_HOST_BULK_FIFO_SIZE		(256ul*1024ul)
+			#else
+				#define TCP_HOST_BULK_FIFO_SIZE		(32ul*1024ul)
+			#endif
+		#endif
+	#else
+		#undef TCP_HOST_BULK_FIFO_SIZE
+	#endif
+
 	// Allocate how much total RAM (in bytes) you want to allocate
 	// for use by your TCP TCBs, RX FIFOs, and TX FIFOs.
 	#define TCP_ETH_RAM_SIZE					(8192ul)
+	#if defined(TCP_HOST_BULK_FIFO_SIZE)
+	#define TCP_PIC_RAM_SIZE					(2ul*TCP_HOST_BULK_FIFO_SIZE + 1024ul)
+	#else
 	#define TCP_PIC_RAM_SIZE					(0ul)
+	#endif
 	#define TCP_SPI_RAM_SIZE					(0ul)
 	#define TCP_SPI_RAM_BASE_ADDRESS			(0x00)
 
@@ -252,6 +280,7 @@
 		#define TCP_PURPOSE_DEFAULT 9
 		#define TCP_PURPOSE_BERKELEY_SERVER 10
 		#define TCP_PURPOSE_BERKELEY_CLIENT 11
+		#define TCP_PURPOSE_HOST_BULK_SERVER 12
 	#define END_OF_TCP_SOCKET_TYPES
 
 	#if defined(__TCP_C)
@@ -272,8 +301,13 @@
 		{
 			BYTE vSocketPurpose;
 			BYTE vMemoryMedium;
+			#if defined(TCP_LARGE_FIFOS)
+			DWORD wTXBufferSize;
+			DWORD wRXBufferSize;
+			#else
 			WORD wTXBufferSize;
 			WORD wRXBufferSize;
+			#endif
 		} TCPSocketInitializer[] = 
 		{
 			//{TCP_PURPOSE_GENERIC_TCP_CLIENT, TCP_ETH_RAM, 125, 100},
@@ -293,6 +327,9 @@
 			//{TCP_PURPOSE_BERKELEY_SERVER, TCP_ETH_RAM, 25, 20},
 			//{TCP_PURPOSE_BERKELEY_SERVER, TCP_ETH_RAM, 25, 20},
 			//{TCP_PURPOSE_BERKELEY_CLIENT, TCP_ETH_RAM, 125, 100},
+			#if defined(TCP_HOST_BULK_FIFO_SIZE)
+			{TCP_PURPOSE_HOST_BULK_SERVER, TCP_PIC_RAM, TCP_HOST_BULK_FIFO_SIZE, TCP_HOST_BULK_FIFO_SIZE},
+			#endif
 		};
 		#define END_OF_TCP_CONFIGURATION
 	#endif
@@ -304,6 +341,46 @@
 #define MAX_UDP_SOCKETS     (8u)
 #define UDP_USE_TX_CHECKSUM		// This slows UDP TX performance by nearly 50%, except when using the ENCX24J600 or PIC32MX6XX/7XX, which have a super fast DMA and incurs virtually no speed pentalty.
 
+/* Receive Checksum Configuration
+ *   Uncomment to verify TCP and UDP receive checksums while the segment is 
+ *   copied into a PIC RAM staging buffer (MAC_RX_STAGE_SIZE bytes), instead 
+ *   of summing it in the MAC buffer and reading it again afterwards.  UDP 
+ *   reads and copies into TCP_PIC_RAM or TCP_SPI_RAM sockets are then served 
+ *   from the staging buffer, so each received byte is read from the MAC only 
+ *   once.  Nothing is handed to a socket until the checksum has passed.
+ */
+#define STACK_USE_RX_CHECKSUM_COPY
+
+/* TCP Statistics Configuration
+ *   Uncomment to keep per-socket and stack-wide TCP counters (segments, 
+ *   retransmissions, duplicate ACKs, zero windows, remote window range and 
+ *   time spent in each TCP state) that can be read with TCPGetStats().  
+ *   Costs about 120 bytes of PIC RAM per TCP socket.  When commented out, 
+ *   TCPGetStats() compiles to FALSE, but the statistics types are still 
+ *   declared so callers build unchanged.
+ */
+//#define STACK_USE_TCP_STATS
+
+/* TCP Congestion Control Configuration
+ *   Uncomment, or define on the compiler command line, to turn off the
+ *   congestion window and fast retransmit/fast recovery.  TCP then sends
+ *   as much as the remote window allows and leaves every loss to the
+ *   retransmission timer.  This is only meant for measuring what they are
+ *   worth, e.g. with the bulk scenarios of my_C_TCPIP_netsim_bench_host.c.
+ */
+//#define TCP_NO_CONGESTION_CONTROL
+
+/* Multiple Stack Instances Configuration (host build only)
+ *   Uncomment, or define on the compiler command line, to run up to 
+ *   STACK_MAX_INSTANCES (default 256) independent copies of the stack in 
+ *   one Linux process, such as a fleet of simulated boards.  Every module 
+ *   then keeps one copy of its state per instance, including AppConfig, 
+ *   and each thread picks the instance it works on with StackSetInstance().  
+ *   See StackTsk.h.  Only some modules support it, and it can't be used in 
+ *   the board build, which always has exactly one instance.
+ */
+//#define STACK_MULTI_INSTANCE
+
 
 /* Berkeley API Sockets Configuration
  *   Note that each Berkeley socket internally uses one TCP or UDP socket
@@ -83,5 +83,8 @@ DWORD TickGetDiv256(void);
 DWORD TickGetDiv64K(void);
 DWORD TickConvertToMilliseconds(DWORD dwTickValue);
 void TickUpdate(void);
+#if defined(COMPILER_GCC_HOST)
+	void TickSetHostTime(QWORD qwNanoseconds);
+#endif
 
 #endif
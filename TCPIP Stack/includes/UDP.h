@@ -99,12 +99,36 @@ typedef struct
   Section:
 	External Global Variables
   ***************************************************************************/
+
+// All UDP module state, one copy per stack instance (see StackTsk.h).  
+// Only the members #defined below are meant for use outside UDP.c.
+typedef struct
+{
+	UDP_SOCKET LastPutSocket;			// Indicates the last socket to which data was written
+	UDP_SOCKET SocketWithRxData;		// Indicates which socket has currently received data for this loop
+	UDP_SOCKET_INFO UDPSocketInfo[MAX_UDP_SOCKETS];	// Information pertaining to each UDP socket
+	UDP_SOCKET activeUDPSocket;			// Indicates which UDP socket is currently active
+	WORD UDPTxCount;					// Number of bytes written to this UDP segment
+	WORD UDPRxCount;					// Number of bytes read from this UDP segment
+	WORD wPutOffset;					// Offset from beginning of payload where data is to be written.
+	WORD wGetOffset;					// Offset from beginning of payload from where data is to be read.
+
+	// Stores various flags for the UDP module
+	struct
+	{
+		unsigned char bFirstRead : 1;		// No data has been read from this segment yet
+		unsigned char bWasDiscarded : 1;	// The data in this segment has been discarded
+		unsigned char bStaged : 1;			// The segment was copied to MACRxStage[] while checking its checksum
+	} Flags;
+} UDP_CONTEXT;
+
 #if !defined(__UDP_C)
-    extern UDP_SOCKET activeUDPSocket;
-    extern UDP_SOCKET_INFO  UDPSocketInfo[MAX_UDP_SOCKETS];
-	extern WORD UDPTxCount;
-	extern WORD UDPRxCount;
+	extern UDP_CONTEXT STACK_INSTANCE_ARRAY(UDPContext);
 #endif
+#define activeUDPSocket		(STACK_INSTANCE(UDPContext).activeUDPSocket)
+#define UDPSocketInfo		(STACK_INSTANCE(UDPContext).UDPSocketInfo)
+#define UDPTxCount			(STACK_INSTANCE(UDPContext).UDPTxCount)
+#define UDPRxCount			(STACK_INSTANCE(UDPContext).UDPRxCount)
 
 // Stores the header of a UDP packet
 typedef struct
@@ -0,0 +1,204 @@
+// This benchmarks TCPRAMCopy() in "TCPIP Stack/TCP.c", which moves every
+// byte between the application, the socket FIFOs and the MAC, for each pair
+// of memory mediums the host build has (TCP_PIC_RAM and TCP_ETH_RAM) and a
+// range of copy sizes, and checks that every copy it times is right.
+//    gcc -O2 -no-pie -o copy_bench my_C_TCPIP_copy_bench_host.c "TCPIP Stack/"{IP,UDP,ARP,ICMP,DNS,DHCP,AutoIP,Helpers,Tick,HostMAC,HostNetSim}.c
+//    ./copy_bench [-m min_ms]
+// Note: TCP.c is #included here rather than linked, since TCPRAMCopy() is
+// static.  The TCP_ETH_RAM copies use the socket area of "TCPIP Stack/
+// HostMAC.c"'s MAC buffer RAM, so no sockets are opened.
+// Note: HostMAC.c copies within the MAC RAM with memmove(), and
+// MACMemCopyAsync() finishes before it returns, as it does on the MRF24WB.
+// So TCP_ETH_RAM to TCP_ETH_RAM shows the cost of the call, not of a copy
+// that could overlap anything else.
+// Note: There's no TCP_SPI_RAM on the host, so its bounce buffer
+// (TCP_COPY_CHUNK_SIZE) isn't measured here.
+// Note: Each row is timed for at least min_ms.  The run fails if any copy
+// is wrong.
+
+// for the code under test
+#include "TCPIP Stack/TCP.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// the longest copy, half of the MAC RAM the TCP_ETH_RAM copies use
+#define MAX_COPY_BYTES 4096u
+
+// copies timed between reads of the clock
+#define COPIES_PER_READ 1000u
+
+#if TCP_ETH_RAM_SIZE < 2 * MAX_COPY_BYTES
+#error my_C_TCPIP_copy_bench_host.c needs TCP_ETH_RAM_SIZE of at least 2 * MAX_COPY_BYTES
+#endif
+
+// one memory medium copies can be made to and from
+typedef struct medium
+{
+   const char *name_ptr;
+   BYTE type;
+   PTR_BASE source;
+   PTR_BASE destination;
+} MEDIUM;
+
+APP_CONFIG AppConfig;
+
+static BYTE g_pic_source[MAX_COPY_BYTES];
+static BYTE g_pic_destination[MAX_COPY_BYTES];
+static BYTE g_check[MAX_COPY_BYTES];
+
+static unsigned long long get_time_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return ((unsigned long long)now.tv_sec * 1000000000ull) + (unsigned long long)now.tv_nsec;
+}
+
+static void app_config_init(void)
+{
+   memset((void *)&AppConfig, 0, sizeof(AppConfig));
+   AppConfig.MyMACAddr.v[0] = MY_DEFAULT_MAC_BYTE1;
+   AppConfig.MyMACAddr.v[1] = MY_DEFAULT_MAC_BYTE2;
+   AppConfig.MyMACAddr.v[2] = MY_DEFAULT_MAC_BYTE3;
+   AppConfig.MyMACAddr.v[3] = MY_DEFAULT_MAC_BYTE4;
+   AppConfig.MyMACAddr.v[4] = MY_DEFAULT_MAC_BYTE5;
+   AppConfig.MyMACAddr.v[5] = MY_DEFAULT_MAC_BYTE6;
+}
+
+// fills length bytes at address with a pattern that depends on seed
+static void medium_fill(const MEDIUM *medium_ptr, PTR_BASE address, WORD length, BYTE seed)
+{
+   WORD i;
+
+   for (i = 0; i < length; i++)
+   {
+      g_check[i] = (BYTE)((i * 7u) + seed);
+   }
+   TCPRAMCopy(address, medium_ptr->type, (PTR_BASE)g_check, TCP_PIC_RAM, length);
+}
+
+// returns 1 if the length bytes at address hold the pattern for seed
+static int medium_check(const MEDIUM *medium_ptr, PTR_BASE address, WORD length, BYTE seed)
+{
+   WORD i;
+
+   memset(g_check, 0, length);
+   TCPRAMCopy((PTR_BASE)g_check, TCP_PIC_RAM, address, medium_ptr->type, length);
+   for (i = 0; i < length; i++)
+   {
+      if (g_check[i] != (BYTE)((i * 7u) + seed))
+      {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+// checks and times one cell of the matrix and prints its row; returns 0 if
+// the copy was wrong
+static int bench_row(const MEDIUM *from_ptr, const MEDIUM *to_ptr, WORD length, unsigned long long min_ns)
+{
+   unsigned long long start_ns;
+   unsigned long long elapsed_ns;
+   unsigned long copies = 0;
+   BYTE seed = (BYTE)(length + from_ptr->type * 16u + to_ptr->type);
+
+   medium_fill(to_ptr, to_ptr->destination, length, (BYTE)~seed);
+   medium_fill(from_ptr, from_ptr->source, length, seed);
+   TCPRAMCopy(to_ptr->destination, to_ptr->type, from_ptr->source, from_ptr->type, length);
+   if (!medium_check(to_ptr, to_ptr->destination, length, seed))
+   {
+      printf("%-8s %-8s %6u  wrong\n", from_ptr->name_ptr, to_ptr->name_ptr, length);
+      return 0;
+   }
+
+   // Note: The clock is only read every COPIES_PER_READ copies, since
+   // reading it costs about as much as a short copy.
+   start_ns = get_time_ns();
+   do
+   {
+      unsigned int i;
+
+      for (i = 0; i < COPIES_PER_READ; i++)
+      {
+         TCPRAMCopy(to_ptr->destination, to_ptr->type, from_ptr->source, from_ptr->type, length);
+      }
+      copies += COPIES_PER_READ;
+      elapsed_ns = get_time_ns() - start_ns;
+   } while (elapsed_ns < min_ns);
+
+   printf("%-8s %-8s %6u %10.1f %10.1f\n", from_ptr->name_ptr, to_ptr->name_ptr, length,
+      (double)elapsed_ns / copies, (double)length * copies * 1000.0 / elapsed_ns);
+   return 1;
+}
+
+static void print_usage(const char *program_name_ptr)
+{
+   fprintf(stderr, "usage: %s [-m min_ms]\n", program_name_ptr);
+}
+
+int main(int argc, char *argv[])
+{
+   static const WORD lengths[] = {16, 64, 256, 1460, MAX_COPY_BYTES};
+   MEDIUM media[2];
+   unsigned long long min_ns = 50000000ull;
+   NETSIM_LINK_CONFIG link;
+   int all_good = 1;
+   unsigned int from;
+   unsigned int to;
+   unsigned int l;
+   int option;
+
+   while ((option = getopt(argc, argv, "m:")) != -1)
+   {
+      switch (option)
+      {
+      case 'm':
+         min_ns = strtoull(optarg, NULL, 0) * 1000000ull;
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+
+   media[0].name_ptr = "pic";
+   media[0].type = TCP_PIC_RAM;
+   media[0].source = (PTR_BASE)g_pic_source;
+   media[0].destination = (PTR_BASE)g_pic_destination;
+   media[1].name_ptr = "eth";
+   media[1].type = TCP_ETH_RAM;
+   media[1].source = TCP_ETH_RAM_BASE_ADDRESS;
+   media[1].destination = TCP_ETH_RAM_BASE_ADDRESS + MAX_COPY_BYTES;
+
+   // Note: Nothing is ever sent; the simulated network is only there so
+   // MACInit() doesn't go looking for a TAP interface.
+   app_config_init();
+   memset((void *)&link, 0, sizeof(link));
+   HostNetSimInit(1);
+   HostMACOpenNetSim(HostNetSimAddPort(&AppConfig.MyMACAddr, &link));
+   MACInit();
+
+   printf("%-8s %-8s %6s %10s %10s\n", "from", "to", "bytes", "ns/copy", "MB/s");
+   for (from = 0; from < sizeof(media) / sizeof(media[0]); from++)
+   {
+      for (to = 0; to < sizeof(media) / sizeof(media[0]); to++)
+      {
+         for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+         {
+            if (!bench_row(&media[from], &media[to], lengths[l], min_ns))
+            {
+               all_good = 0;
+            }
+         }
+      }
+   }
+
+   HostMACClose();
+   return all_good ? 0 : 1;
+}
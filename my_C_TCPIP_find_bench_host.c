@@ -0,0 +1,378 @@
+// This checks and benchmarks the RX FIFO search in "TCPIP Stack/TCP.c"
+// (TCPFindArrayEx() and TCPFindEx()), built as an ordinary Linux process.
+// First it compares thousands of random searches with a brute force search
+// of the same bytes, then it times searches that don't find anything, for
+// a range of pattern lengths and search windows.
+//    gcc -O2 -no-pie [-DTCP_LARGE_FIFOS] -o find_bench my_C_TCPIP_find_bench_host.c "TCPIP Stack/"{IP,UDP,ARP,ICMP,DNS,DHCP,AutoIP,Helpers,Tick,HostMAC,HostNetSim}.c
+//    ./find_bench [-s seed] [-c checks] [-m min_ms] [-i]
+// Note: TCP.c is #included here rather than linked, so this can put any
+// bytes it likes in the RX FIFO of the host build's bulk socket
+// (TCP_HOST_BULK_FIFO_SIZE in TCPIPConfig.h) and move its head and tail
+// pointers anywhere, which is how the checks get data that wraps around
+// the end of the FIFO at every possible place.
+// Note: The checks mostly use a four letter alphabet in mixed case, and
+// patterns copied from the data with one byte changed, so most alignments
+// match for a while before they fail.  Patterns run from 1 byte to well
+// past TCP_FIND_BUFFER_SIZE, which takes the long pattern path.
+// Note: Each benchmark row is timed for at least min_ms.  The "text" data is
+// random lower case letters and the pattern ends in a byte that isn't one,
+// so every alignment fails at its last byte.  The "repeat" data is all 'a'
+// and the pattern is 'b' followed by 'a's, so every alignment matches all
+// the way back to its first byte, the worst case for long patterns.  -i
+// times case-insensitive searches instead.
+// Note: The run fails if any search disagrees with the brute force one.
+
+// for the code under test and its private socket state
+#include "TCPIP Stack/TCP.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// the longest pattern the checks try
+#define MAX_CHECK_PATTERN 600
+
+// the most bytes the checks put in the FIFO, most of the time
+#define SHORT_CHECK_DATA 2048
+
+// the longest pattern the benchmark tries
+#define MAX_BENCH_PATTERN 1024
+
+// the bytes most checks are made of
+static const BYTE g_check_alphabet[] = "abAB";
+
+APP_CONFIG AppConfig;
+
+// what the RX FIFO holds, in order from its tail
+static BYTE g_data[TCP_HOST_BULK_FIFO_SIZE];
+static TCP_FIFO_SIZE g_data_length = 0;
+
+static BYTE g_pattern[MAX_BENCH_PATTERN];
+
+// state of the xorshift generator, so a seed always gives the same checks
+static unsigned long long g_random = 1;
+
+static unsigned long long get_time_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return ((unsigned long long)now.tv_sec * 1000000000ull) + (unsigned long long)now.tv_nsec;
+}
+
+static unsigned long random_below(unsigned long limit)
+{
+   g_random ^= g_random << 13;
+   g_random ^= g_random >> 7;
+   g_random ^= g_random << 17;
+   return (unsigned long)(g_random % limit);
+}
+
+static void app_config_init(void)
+{
+   memset((void *)&AppConfig, 0, sizeof(AppConfig));
+   AppConfig.MyIPAddr.Val = MY_DEFAULT_IP_ADDR_BYTE1 | MY_DEFAULT_IP_ADDR_BYTE2 << 8ul | MY_DEFAULT_IP_ADDR_BYTE3 << 16ul | MY_DEFAULT_IP_ADDR_BYTE4 << 24ul;
+   AppConfig.MyMask.Val = MY_DEFAULT_MASK_BYTE1 | MY_DEFAULT_MASK_BYTE2 << 8ul | MY_DEFAULT_MASK_BYTE3 << 16ul | MY_DEFAULT_MASK_BYTE4 << 24ul;
+   AppConfig.MyMACAddr.v[0] = MY_DEFAULT_MAC_BYTE1;
+   AppConfig.MyMACAddr.v[1] = MY_DEFAULT_MAC_BYTE2;
+   AppConfig.MyMACAddr.v[2] = MY_DEFAULT_MAC_BYTE3;
+   AppConfig.MyMACAddr.v[3] = MY_DEFAULT_MAC_BYTE4;
+   AppConfig.MyMACAddr.v[4] = MY_DEFAULT_MAC_BYTE5;
+   AppConfig.MyMACAddr.v[5] = MY_DEFAULT_MAC_BYTE6;
+   AppConfig.Flags.bIsDHCPEnabled = 0;
+}
+
+// the number of bytes the socket's RX FIFO can hold
+static TCP_FIFO_SIZE fifo_capacity(TCP_SOCKET socket)
+{
+   SyncTCBStub(socket);
+   return (TCP_FIFO_SIZE)(MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart);
+}
+
+// puts g_data in the socket's RX FIFO, starting tail_offset bytes from the
+// start of the FIFO and wrapping around its end if it gets there
+static void fifo_load(TCP_SOCKET socket, TCP_FIFO_SIZE tail_offset)
+{
+   TCP_FIFO_SIZE size;
+   TCP_FIFO_SIZE i;
+
+   SyncTCBStub(socket);
+   size = (TCP_FIFO_SIZE)(MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1);
+   for (i = 0; i < g_data_length; i++)
+   {
+      *(BYTE *)(MyTCBStub.bufferRxStart + ((tail_offset + i) % size)) = g_data[i];
+   }
+   MyTCBStub.rxTail = MyTCBStub.bufferRxStart + tail_offset;
+   MyTCBStub.rxHead = MyTCBStub.bufferRxStart + ((tail_offset + g_data_length) % size);
+}
+
+static BYTE fold_upper(BYTE c)
+{
+   return ((c >= 'a') && (c <= 'z')) ? (BYTE)(c + 'A' - 'a') : c;
+}
+
+// what TCPFindArrayEx() should return for g_data, the brute force way
+static WORD reference_find(WORD length, WORD start, WORD search_length, BOOL text_compare)
+{
+   unsigned long range;
+   unsigned long position;
+   WORD i;
+
+   if (g_data_length < (unsigned long)start + length)
+   {
+      return 0xFFFFu;
+   }
+   range = g_data_length - start;
+   if (search_length && (range > search_length))
+   {
+      range = search_length;
+   }
+   // Note: Positions are WORDs, so TCP.c never searches past 0xFFFF.
+   if (range > 0xFFFFul - start)
+   {
+      range = 0xFFFFul - start;
+   }
+
+   for (position = start; position + length <= start + range; position++)
+   {
+      for (i = 0; i < length; i++)
+      {
+         BYTE data = g_data[position + i];
+         BYTE pattern = g_pattern[i];
+
+         if (text_compare ? (fold_upper(data) != fold_upper(pattern)) : (data != pattern))
+         {
+            break;
+         }
+      }
+      if (i == length)
+      {
+         return (WORD)position;
+      }
+   }
+   return 0xFFFFu;
+}
+
+// runs checks random searches against reference_find(); returns the number
+// that disagreed
+static unsigned long run_checks(TCP_SOCKET socket, unsigned long checks)
+{
+   TCP_FIFO_SIZE capacity = fifo_capacity(socket);
+   unsigned long failures = 0;
+   unsigned long found = 0;
+   unsigned long n;
+
+   for (n = 0; n < checks; n++)
+   {
+      BOOL text_compare = (BOOL)random_below(2);
+      WORD length;
+      WORD start;
+      WORD search_length;
+      WORD expected;
+      WORD result;
+      TCP_FIFO_SIZE i;
+
+      // the data, with most tails close enough to the end to wrap
+      g_data_length = (random_below(4) == 0) ? random_below(capacity + 1) : random_below(SHORT_CHECK_DATA + 1);
+      for (i = 0; i < g_data_length; i++)
+      {
+         g_data[i] = (random_below(8) == 0) ? (BYTE)random_below(256) : g_check_alphabet[random_below(4)];
+      }
+      fifo_load(socket, (random_below(2) == 0) ?
+         (capacity + 1 - (TCP_FIFO_SIZE)random_below(g_data_length + 1)) % (capacity + 1) :
+         (TCP_FIFO_SIZE)random_below(capacity + 1));
+
+      // a pattern from the data, usually with one byte changed, or from
+      // nowhere
+      length = (random_below(2) == 0) ? (WORD)(1 + random_below(8)) : (WORD)(1 + random_below(MAX_CHECK_PATTERN));
+      if ((g_data_length >= length) && (random_below(4) != 0))
+      {
+         memcpy(g_pattern, &g_data[random_below(g_data_length - length + 1)], length);
+         if (random_below(2) == 0)
+         {
+            g_pattern[random_below((length < 4) ? length : 4)] ^= 0x01;
+         }
+      }
+      else
+      {
+         for (i = 0; i < length; i++)
+         {
+            g_pattern[i] = g_check_alphabet[random_below(4)];
+         }
+      }
+
+      start = (g_data_length && (random_below(2) == 0)) ? (WORD)random_below((g_data_length < 0xFFFFu) ? g_data_length : 0xFFFFu) : 0;
+      search_length = (random_below(2) == 0) ? (WORD)random_below(g_data_length + 1) : 0;
+
+      expected = reference_find(length, start, search_length, text_compare);
+      if (length == 1)
+      {
+         result = TCPFindEx(socket, g_pattern[0], start, search_length, text_compare);
+      }
+      else
+      {
+         result = TCPFindArrayEx(socket, g_pattern, length, start, search_length, text_compare);
+      }
+      if (result != 0xFFFFu)
+      {
+         found++;
+      }
+      if (result != expected)
+      {
+         if (failures < 10)
+         {
+            fprintf(stderr, "check %lu: %lu bytes, pattern %u, start %u, search %u, %s: got %u, expected %u\n",
+               n, (unsigned long)g_data_length, length, start, search_length,
+               text_compare ? "text" : "binary", result, expected);
+         }
+         failures++;
+      }
+   }
+
+   printf("%lu checks, %lu found, %lu wrong\n", checks, found, failures);
+   return failures;
+}
+
+// times one kind of search and prints its row
+static void bench_row(TCP_SOCKET socket, const char *data_name_ptr, WORD length, WORD window,
+   BOOL text_compare, unsigned long long min_ns)
+{
+   unsigned long long start_ns;
+   unsigned long long elapsed_ns;
+   unsigned long searches = 0;
+   int found = 0;
+
+   start_ns = get_time_ns();
+   do
+   {
+      if (TCPFindArrayEx(socket, g_pattern, length, 0, window, text_compare) != 0xFFFFu)
+      {
+         found = 1;
+      }
+      searches++;
+      elapsed_ns = get_time_ns() - start_ns;
+   } while (elapsed_ns < min_ns);
+
+   printf("%-8s %8u %8u %12.0f %10.1f%s\n", data_name_ptr, length, window,
+      (double)elapsed_ns / searches, (double)window * searches * 1000.0 / elapsed_ns,
+      found ? "  (found)" : "");
+}
+
+static void run_bench(TCP_SOCKET socket, BOOL text_compare, unsigned long long min_ns)
+{
+   static const WORD lengths[] = {1, 4, 16, 64, 128, 256, 1024};
+   static const WORD windows[] = {512, 4096, 32767};
+   TCP_FIFO_SIZE capacity = fifo_capacity(socket);
+   unsigned int data_kind;
+   unsigned int l;
+   unsigned int w;
+   TCP_FIFO_SIZE i;
+
+   printf("%-8s %8s %8s %12s %10s\n", "data", "pattern", "window", "ns/search", "MB/s");
+   for (data_kind = 0; data_kind < 2; data_kind++)
+   {
+      g_data_length = (capacity < 32767u) ? capacity : 32767u;
+      for (i = 0; i < g_data_length; i++)
+      {
+         g_data[i] = data_kind ? 'a' : (BYTE)('a' + random_below(26));
+      }
+      // Note: Tail in the middle, so the window wraps.
+      fifo_load(socket, (capacity + 1) / 2);
+
+      for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+      {
+         memset(g_pattern, 'a', lengths[l]);
+         if (data_kind)
+         {
+            g_pattern[0] = 'b';
+         }
+         else
+         {
+            for (i = 0; i < lengths[l]; i++)
+            {
+               g_pattern[i] = (BYTE)('a' + random_below(26));
+            }
+            g_pattern[lengths[l] - 1] = '#';
+         }
+
+         for (w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+         {
+            if ((windows[w] <= g_data_length) && (lengths[l] <= windows[w]))
+            {
+               bench_row(socket, data_kind ? "repeat" : "text", lengths[l], windows[w], text_compare, min_ns);
+            }
+         }
+      }
+   }
+}
+
+static void print_usage(const char *program_name_ptr)
+{
+   fprintf(stderr, "usage: %s [-s seed] [-c checks] [-m min_ms] [-i]\n", program_name_ptr);
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long long seed = 1;
+   unsigned long checks = 20000;
+   unsigned long long min_ns = 50000000ull;
+   BOOL text_compare = FALSE;
+   NETSIM_LINK_CONFIG link;
+   TCP_SOCKET socket;
+   int option;
+
+   while ((option = getopt(argc, argv, "s:c:m:i")) != -1)
+   {
+      switch (option)
+      {
+      case 's':
+         seed = strtoull(optarg, NULL, 0);
+         break;
+      case 'c':
+         checks = strtoul(optarg, NULL, 0);
+         break;
+      case 'm':
+         min_ns = strtoull(optarg, NULL, 0) * 1000000ull;
+         break;
+      case 'i':
+         text_compare = TRUE;
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+   g_random = seed ? seed : 1;
+
+   // Note: Nothing is ever sent; the simulated network is only there so
+   // MACInit() doesn't go looking for a TAP interface.
+   app_config_init();
+   memset((void *)&link, 0, sizeof(link));
+   HostNetSimInit(seed);
+   HostMACOpenNetSim(HostNetSimAddPort(&AppConfig.MyMACAddr, &link));
+   TickInit();
+   MACInit();
+   ARPInit();
+   UDPInit();
+   TCPInit();
+   socket = TCPOpen(0, TCP_OPEN_SERVER, 9760, TCP_PURPOSE_HOST_BULK_SERVER);
+   if (socket == INVALID_SOCKET)
+   {
+      fprintf(stderr, "no bulk socket; build for one board, without -DSTACK_MULTI_INSTANCE\n");
+      return 2;
+   }
+
+   printf("seed %llu, RX FIFO %lu bytes, TCP_FIND_BUFFER_SIZE %u\n", seed,
+      (unsigned long)fifo_capacity(socket), (unsigned int)TCP_FIND_BUFFER_SIZE);
+   if (run_checks(socket, checks))
+   {
+      return 1;
+   }
+   run_bench(socket, text_compare, min_ns);
+
+   HostMACClose();
+   return 0;
+}
@@ -0,0 +1,517 @@
+// This runs a fleet of simulated boards, each a complete copy of the
+// Microchip TCPIP stack, in one Linux process.  The stack is built with
+// STACK_MULTI_INSTANCE, so each board's state is one slot of the per-module
+// context arrays, picked with StackSetInstance().  The boards are split into
+// shards of up to shard_boards, and each shard is its own simulated network
+// ("TCPIP Stack/HostNetSim.c") run by one of threads worker threads.
+//    gcc -O2 -no-pie -pthread -DSTACK_MULTI_INSTANCE -o fleet my_C_TCPIP_fleet_host.c "TCPIP Stack/"{StackTsk,Announce,NBNS,SNTP,DNS,DHCP,AutoIP,Helpers,Delay,Tick,IP,TCP,UDP,ARP,ICMP,HostMAC,HostNetSim}.c
+//    ./fleet [-b boards] [-j threads] [-p shard_boards] [-s seed] [-t seconds]
+//       [-u step_us] [-n request_bytes] [-r requests_per_connection] [-l loss_ppm]
+// Note: Boards come in pairs.  The even board of a pair runs an echo server,
+// and the odd one connects to it, sends requests of request_bytes, checks
+// every byte of each echo and reconnects after requests_per_connection of
+// them.  Both boards also run everything StackApplications() runs.
+// Note: A shard runs from start to finish on one thread, in virtual time, so
+// the totals depend only on the seed and the options other than threads.
+// Running with -j 1 and then -j 8 must print the same numbers, just faster.
+// Note: The run fails if any echoed byte is wrong or no request completes.
+
+// for linking with the stack's declarations
+#include "TCPIP Stack/includes/TCPIP.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if !defined(STACK_MULTI_INSTANCE)
+#error my_C_TCPIP_fleet_host.c needs the stack built with -DSTACK_MULTI_INSTANCE
+#endif
+
+
+// TCP port every server board listens on
+#define ECHO_PORT 9760
+
+// the largest request, so one fits in a socket's 200 byte FIFOs
+#define MAX_REQUEST_BYTES 200
+
+// virtual time a client waits for a connection or an echo before giving up
+#define CLIENT_TIMEOUT_NS 10000000000ull
+
+// the most worker threads
+#define MAX_THREADS 64
+
+// what a client board is doing
+typedef enum
+{
+   CLIENT_OPEN = 0,
+   CLIENT_CONNECTING,
+   CLIENT_SENDING,
+   CLIENT_RECEIVING
+} CLIENT_STATE;
+
+// one board's application state
+// Note: The stack keeps its own state per instance; this is only what the
+// application on the board would keep in its globals.
+typedef struct board
+{
+   TCP_SOCKET socket;
+   CLIENT_STATE state;           // clients only
+   int connected;                // servers only: had a connection last step
+   IP_ADDR server_IP;
+   unsigned long request;        // requests sent so far, picks the pattern
+   unsigned long on_connection;  // requests done on this connection
+   unsigned int sent;            // bytes of the current request sent
+   unsigned int received;        // bytes of the current request echoed
+   unsigned long long started_ns;
+   unsigned long completed;
+   unsigned long connections;
+   unsigned long timeouts;
+   unsigned long resets;
+   unsigned long bad_bytes;
+   unsigned long long latency_total_ns;
+   unsigned long long latency_max_ns;
+} BOARD;
+
+// what happened on one shard's network
+typedef struct shard
+{
+   unsigned long lost;
+   unsigned long queue_drops;
+   unsigned long frames;
+} SHARD;
+
+static BOARD g_boards[STACK_MAX_INSTANCES];
+static SHARD g_shards[STACK_MAX_INSTANCES];
+
+static unsigned int g_board_count = 64;
+static unsigned int g_shard_boards = 16;
+static unsigned int g_shard_count;
+static unsigned long long g_seed = 1;
+static unsigned long long g_run_ns = 10000000000ull;
+static unsigned long long g_step_ns = 500000;
+static unsigned int g_request_bytes = 64;
+static unsigned long g_requests_per_connection = 8;
+static unsigned long g_loss_ppm;
+
+// next shard for a worker thread to take
+static unsigned int g_next_shard;
+
+// the byte at offset in a board's request, different for every request
+static BYTE request_byte(unsigned int board, unsigned long request, unsigned int offset)
+{
+   return (BYTE)(board * 7u + request * 13u + offset);
+}
+
+// sets up the AppConfig of the current instance as board
+static void board_config(unsigned int board)
+{
+   memset((void *)&AppConfig, 0, sizeof(AppConfig));
+   AppConfig.MyIPAddr.v[0] = 10;
+   AppConfig.MyIPAddr.v[1] = 0;
+   AppConfig.MyIPAddr.v[2] = (BYTE)((board + 1) >> 8);
+   AppConfig.MyIPAddr.v[3] = (BYTE)(board + 1);
+   AppConfig.MyMask.Val = 0x0000FFFFul;
+   AppConfig.DefaultIPAddr.Val = AppConfig.MyIPAddr.Val;
+   AppConfig.DefaultMask.Val = AppConfig.MyMask.Val;
+   AppConfig.MyMACAddr.v[0] = 0x02;
+   AppConfig.MyMACAddr.v[4] = (BYTE)((board + 1) >> 8);
+   AppConfig.MyMACAddr.v[5] = (BYTE)(board + 1);
+   sprintf((char *)AppConfig.NetBIOSName, "BOARD%03u", board);
+   FormatNetBIOSName(AppConfig.NetBIOSName);
+   AppConfig.Flags.bIsDHCPEnabled = 0;
+   AppConfig.Flags.bInConfigMode = 0;
+}
+
+// the application on a server board: echo whatever arrives, as space allows
+static void server_task(BOARD *board_ptr)
+{
+   BYTE buffer[MAX_REQUEST_BYTES];
+   WORD count;
+   WORD space;
+
+   // Note: When the client closes its end, close ours straight away rather
+   // than leave it to TCP.c's CLOSE_WAIT timeout.  A reset connection is
+   // already listening again.
+   if (!TCPIsConnected(board_ptr->socket))
+   {
+      if (board_ptr->connected && !TCPWasReset(board_ptr->socket))
+      {
+         TCPDisconnect(board_ptr->socket);
+      }
+      board_ptr->connected = 0;
+      return;
+   }
+   if (!board_ptr->connected)
+   {
+      TCPWasReset(board_ptr->socket);
+      board_ptr->connected = 1;
+   }
+
+   count = TCPIsGetReady(board_ptr->socket);
+   space = TCPIsPutReady(board_ptr->socket);
+   if (count > space)
+   {
+      count = space;
+   }
+   if (count > sizeof(buffer))
+   {
+      count = sizeof(buffer);
+   }
+   if (count)
+   {
+      TCPGetArray(board_ptr->socket, buffer, count);
+      TCPPutArray(board_ptr->socket, buffer, count);
+      TCPFlush(board_ptr->socket);
+   }
+}
+
+// the application on a client board
+static void client_task(unsigned int board, BOARD *board_ptr, unsigned long long now_ns)
+{
+   BYTE buffer[MAX_REQUEST_BYTES];
+   WORD count;
+   WORD i;
+
+   if ((board_ptr->state != CLIENT_OPEN) && (now_ns - board_ptr->started_ns > CLIENT_TIMEOUT_NS))
+   {
+      // Note: Disconnecting twice resets the connection and frees the socket
+      // at once.
+      board_ptr->timeouts++;
+      TCPDisconnect(board_ptr->socket);
+      TCPDisconnect(board_ptr->socket);
+      board_ptr->state = CLIENT_OPEN;
+   }
+   if ((board_ptr->state == CLIENT_SENDING) || (board_ptr->state == CLIENT_RECEIVING))
+   {
+      if (TCPWasReset(board_ptr->socket) || !TCPIsConnected(board_ptr->socket))
+      {
+         board_ptr->resets++;
+         TCPDisconnect(board_ptr->socket);
+         TCPDisconnect(board_ptr->socket);
+         board_ptr->state = CLIENT_OPEN;
+      }
+   }
+
+   switch (board_ptr->state)
+   {
+   case CLIENT_OPEN:
+      // Note: The socket stays in use until the last connection has closed,
+      // so this is tried again every step until it works.
+      board_ptr->socket = TCPOpen(board_ptr->server_IP.Val, TCP_OPEN_IP_ADDRESS, ECHO_PORT, TCP_PURPOSE_GENERIC_TCP_SERVER);
+      if (board_ptr->socket != INVALID_SOCKET)
+      {
+         board_ptr->state = CLIENT_CONNECTING;
+         board_ptr->started_ns = now_ns;
+      }
+      break;
+
+   case CLIENT_CONNECTING:
+      if (TCPIsConnected(board_ptr->socket))
+      {
+         TCPWasReset(board_ptr->socket);
+         board_ptr->connections++;
+         board_ptr->on_connection = 0;
+         board_ptr->sent = 0;
+         board_ptr->received = 0;
+         board_ptr->started_ns = now_ns;
+         board_ptr->state = CLIENT_SENDING;
+      }
+      break;
+
+   case CLIENT_SENDING:
+      count = TCPIsPutReady(board_ptr->socket);
+      if (count > g_request_bytes - board_ptr->sent)
+      {
+         count = g_request_bytes - board_ptr->sent;
+      }
+      for (i = 0; i < count; i++)
+      {
+         buffer[i] = request_byte(board, board_ptr->request, board_ptr->sent + i);
+      }
+      if (count)
+      {
+         TCPPutArray(board_ptr->socket, buffer, count);
+         TCPFlush(board_ptr->socket);
+         board_ptr->sent += count;
+      }
+      if (board_ptr->sent == g_request_bytes)
+      {
+         board_ptr->state = CLIENT_RECEIVING;
+      }
+      // the echo can start arriving before the whole request is sent
+      // fall through
+
+   case CLIENT_RECEIVING:
+      count = TCPIsGetReady(board_ptr->socket);
+      if (count > board_ptr->sent - board_ptr->received)
+      {
+         count = board_ptr->sent - board_ptr->received;
+      }
+      if (count == 0)
+      {
+         break;
+      }
+      TCPGetArray(board_ptr->socket, buffer, count);
+      for (i = 0; i < count; i++)
+      {
+         if (buffer[i] != request_byte(board, board_ptr->request, board_ptr->received + i))
+         {
+            board_ptr->bad_bytes++;
+         }
+      }
+      board_ptr->received += count;
+      if (board_ptr->received < g_request_bytes)
+      {
+         break;
+      }
+
+      board_ptr->completed++;
+      board_ptr->latency_total_ns += now_ns - board_ptr->started_ns;
+      if (now_ns - board_ptr->started_ns > board_ptr->latency_max_ns)
+      {
+         board_ptr->latency_max_ns = now_ns - board_ptr->started_ns;
+      }
+      board_ptr->request++;
+      board_ptr->sent = 0;
+      board_ptr->received = 0;
+      board_ptr->started_ns = now_ns;
+      board_ptr->state = CLIENT_SENDING;
+      if (++board_ptr->on_connection == g_requests_per_connection)
+      {
+         TCPDisconnect(board_ptr->socket);
+         board_ptr->state = CLIENT_OPEN;
+      }
+      break;
+   }
+}
+
+// runs every board of one shard for the whole run
+static void run_shard(unsigned int shard)
+{
+   unsigned int first = shard * g_shard_boards;
+   unsigned int last = first + g_shard_boards;
+   NETSIM_LINK_CONFIG link;
+   NETSIM_PORT_STATS stats;
+   BYTE ports[NETSIM_MAX_PORTS];
+   unsigned int board;
+
+   if (last > g_board_count)
+   {
+      last = g_board_count;
+   }
+
+   // a lan, as in the netsim benchmark, with optional loss
+   memset(&link, 0, sizeof(link));
+   link.dwDelayUs = 250;
+   link.dwJitterUs = 50;
+   link.dwBandwidthBps = 10000000;
+   link.dwLossPPM = (DWORD)g_loss_ppm;
+
+   HostNetSimInit(g_seed * 1000003ull + shard);
+   for (board = first; board < last; board++)
+   {
+      BOARD *board_ptr = &g_boards[board];
+
+      StackSetInstance(board);
+      board_config(board);
+      ports[board - first] = HostNetSimAddPort(&AppConfig.MyMACAddr, &link);
+
+      // Note: The port must be open before StackInit(), or MACInit() opens
+      // the TAP interface.  Seeding first gives each board its own ISNs.
+      HostMACOpenNetSim(ports[board - first]);
+      LFSRSeedRand((DWORD)(g_seed * 2654435761u + board));
+      StackInit();
+      AutoIPDisable(0);
+
+      memset(board_ptr, 0, sizeof(*board_ptr));
+      if (board & 1)
+      {
+         // the address board_config() gives the board before it
+         board_ptr->server_IP.Val = AppConfig.MyIPAddr.Val;
+         board_ptr->server_IP.v[2] = (BYTE)(board >> 8);
+         board_ptr->server_IP.v[3] = (BYTE)board;
+         board_ptr->state = CLIENT_OPEN;
+      }
+      else
+      {
+         board_ptr->socket = TCPOpen(0, TCP_OPEN_SERVER, ECHO_PORT, TCP_PURPOSE_GENERIC_TCP_SERVER);
+      }
+   }
+
+   while (HostNetSimGetTime() < g_run_ns)
+   {
+      for (board = first; board < last; board++)
+      {
+         StackSetInstance(board);
+         StackTask();
+         StackApplications();
+         if (board & 1)
+         {
+            client_task(board, &g_boards[board], HostNetSimGetTime());
+         }
+         else if (g_boards[board].socket != INVALID_SOCKET)
+         {
+            server_task(&g_boards[board]);
+         }
+      }
+      HostNetSimAdvance(g_step_ns);
+   }
+
+   for (board = first; board < last; board++)
+   {
+      StackSetInstance(board);
+      HostMACClose();
+      HostNetSimGetStats(ports[board - first], &stats);
+      g_shards[shard].lost += stats.dwLost;
+      g_shards[shard].queue_drops += stats.dwQueueDrops;
+      g_shards[shard].frames += stats.dwDelivered;
+   }
+}
+
+static void *worker(void *unused_ptr)
+{
+   unsigned int shard;
+
+   (void)unused_ptr;
+   while ((shard = __sync_fetch_and_add(&g_next_shard, 1)) < g_shard_count)
+   {
+      run_shard(shard);
+   }
+   return NULL;
+}
+
+static void print_usage(const char *program_name_ptr)
+{
+   fprintf(stderr, "usage: %s [-b boards] [-j threads] [-p shard_boards] [-s seed] [-t seconds] [-u step_us]\n"
+      "   [-n request_bytes] [-r requests_per_connection] [-l loss_ppm]\n", program_name_ptr);
+}
+
+int main(int argc, char *argv[])
+{
+   pthread_t threads[MAX_THREADS];
+   unsigned int thread_count = 4;
+   struct timespec start;
+   struct timespec end;
+   double wall_s;
+   unsigned long completed = 0;
+   unsigned long connections = 0;
+   unsigned long timeouts = 0;
+   unsigned long resets = 0;
+   unsigned long bad_bytes = 0;
+   unsigned long long latency_total_ns = 0;
+   unsigned long long latency_max_ns = 0;
+   unsigned long lost = 0;
+   unsigned long queue_drops = 0;
+   unsigned long frames = 0;
+   unsigned int i;
+   int option;
+
+   while ((option = getopt(argc, argv, "b:j:p:s:t:u:n:r:l:")) != -1)
+   {
+      switch (option)
+      {
+      case 'b':
+         g_board_count = strtoul(optarg, NULL, 0);
+         break;
+      case 'j':
+         thread_count = strtoul(optarg, NULL, 0);
+         break;
+      case 'p':
+         g_shard_boards = strtoul(optarg, NULL, 0);
+         break;
+      case 's':
+         g_seed = strtoull(optarg, NULL, 0);
+         break;
+      case 't':
+         g_run_ns = strtoull(optarg, NULL, 0) * 1000000000ull;
+         break;
+      case 'u':
+         g_step_ns = strtoull(optarg, NULL, 0) * 1000ull;
+         break;
+      case 'n':
+         g_request_bytes = strtoul(optarg, NULL, 0);
+         break;
+      case 'r':
+         g_requests_per_connection = strtoul(optarg, NULL, 0);
+         break;
+      case 'l':
+         g_loss_ppm = strtoul(optarg, NULL, 0);
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+   // Note: Shards hold whole pairs, so a client is always on its server's
+   // network.
+   if ((g_board_count == 0) || (g_board_count > STACK_MAX_INSTANCES) ||
+      (thread_count == 0) || (thread_count > MAX_THREADS) ||
+      (g_shard_boards < 2) || (g_shard_boards & 1) || (g_shard_boards > NETSIM_MAX_PORTS) ||
+      (g_step_ns == 0) || (g_run_ns == 0) || (g_request_bytes == 0) || (g_request_bytes > MAX_REQUEST_BYTES) ||
+      (g_requests_per_connection == 0) || (g_loss_ppm > 1000000))
+   {
+      fprintf(stderr, "boards must be 1 to %u, threads 1 to %u, shard boards even and 2 to %u, "
+         "request bytes 1 to %u, and seconds, step and requests per connection more than 0\n",
+         STACK_MAX_INSTANCES, MAX_THREADS, NETSIM_MAX_PORTS, MAX_REQUEST_BYTES);
+      return 2;
+   }
+   g_shard_count = (g_board_count + g_shard_boards - 1) / g_shard_boards;
+   if (thread_count > g_shard_count)
+   {
+      thread_count = g_shard_count;
+   }
+
+   printf("seed %llu, %u boards in %u shards on %u threads, %llu s in steps of %llu us, "
+      "%u byte requests, %lu per connection, loss %lu ppm\n",
+      g_seed, g_board_count, g_shard_count, thread_count, g_run_ns / 1000000000ull, g_step_ns / 1000ull,
+      g_request_bytes, g_requests_per_connection, g_loss_ppm);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < thread_count; i++)
+   {
+      if (pthread_create(&threads[i], NULL, worker, NULL))
+      {
+         fprintf(stderr, "can't start thread %u\n", i);
+         return 2;
+      }
+   }
+   for (i = 0; i < thread_count; i++)
+   {
+      pthread_join(threads[i], NULL);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   wall_s = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+   for (i = 0; i < g_board_count; i++)
+   {
+      completed += g_boards[i].completed;
+      connections += g_boards[i].connections;
+      timeouts += g_boards[i].timeouts;
+      resets += g_boards[i].resets;
+      bad_bytes += g_boards[i].bad_bytes;
+      latency_total_ns += g_boards[i].latency_total_ns;
+      if (g_boards[i].latency_max_ns > latency_max_ns)
+      {
+         latency_max_ns = g_boards[i].latency_max_ns;
+      }
+   }
+   for (i = 0; i < g_shard_count; i++)
+   {
+      lost += g_shards[i].lost;
+      queue_drops += g_shards[i].queue_drops;
+      frames += g_shards[i].frames;
+   }
+
+   printf("requests %lu, connections %lu, timeouts %lu, resets %lu, bad bytes %lu\n",
+      completed, connections, timeouts, resets, bad_bytes);
+   printf("latency avg %.3f ms, max %.3f ms\n",
+      completed ? (double)latency_total_ns / (double)completed / 1e6 : 0.0, (double)latency_max_ns / 1e6);
+   printf("frames delivered %lu, lost %lu, queue drops %lu\n", frames, lost, queue_drops);
+   printf("wall %.3f s, %.1f board-seconds per second\n",
+      wall_s, (double)g_board_count * ((double)g_run_ns / 1e9) / wall_s);
+
+   return (bad_bytes || (completed == 0)) ? 1 : 0;
+}
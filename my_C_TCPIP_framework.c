@@ -2,6 +2,12 @@
 // declarations
 #include "my_C_TCPIP_framework.h"
 
+// Note: This file is the Microchip TCPIP stack backend of the framework.  The
+// callbacks, framing, statistics, and FIFO profiles are shared with the POSIX
+// backend in my_C_TCPIP_framework_common.c, and this file only sets up the
+// stack and answers that file's questions about the sockets.
+#include "my_C_TCPIP_framework_backend.h"
+
 
 // Include all headers for any enabled TCPIP Stack functions
 // Note: Do not try including anything else. The Microchip TCPIP stack is a
@@ -11,6 +17,14 @@
 // organized, is TCPIP.h.
 #include "TCPIP Stack/includes/TCPIP.h"
 
+// Note: This file keeps one board's worth of state in its own globals, so it
+// can't drive several stack instances at once.  A multi-instance host build
+// runs its boards with its own application code instead (see
+// my_C_TCPIP_fleet_host.c).
+#if defined(STACK_MULTI_INSTANCE)
+#error my_C_TCPIP_framework.c drives a single board; build it without STACK_MULTI_INSTANCE
+#endif
+
 
 // use these sockets to communicate over the network
 // Note: I am making them global because I want to split up the "send" and
@@ -22,15 +36,9 @@
 // multi-socket program.  I don't know what you might do with it since this
 // microcontroller is not built for heavy network communication, but it's here
 // if you want it.
-// Note: For each socket, two pieces of information will be tracked:
-// - A socket handle
-// - The port used in that socket (this is just book keeping; I don't use it)
-// Note: For simplicity, each socket handle will correspond to one, and only
-// one, port.  Port numbers are easier for the user to track because they are
-// just integers.
-#define MAX_SOCKETS 5
+// Note: The port used by each socket is kept in
+// my_C_TCPIP_framework_common.c, at the same index as the socket handle.
 static TCP_SOCKET	g_socket_handles[MAX_SOCKETS];
-static unsigned int g_socket_port_numbers[MAX_SOCKETS];
 
 
 
@@ -61,6 +69,10 @@ tPassphraseReady g_WpsPassphrase;
 //static UINT8 ConnectionProfileID;
 
 
+// Note: WF_CS_TRIS is only undefined in a Linux host build, where the stack
+// talks through a TAP device (see "TCPIP Stack/HostMAC.c") instead of the
+// MRF24WB, so there is no Wi-Fi network to join.
+#if defined(WF_CS_TRIS)
 /*****************************************************************************
 * FUNCTION: my_WF_connect
 *
@@ -132,6 +144,7 @@ static void my_WF_connect(void)
    // a network that matches the TCPIP connection profile.
    WF_CMConnect(ConnectionProfileID);
 }
+#endif   /* defined(WF_CS_TRIS) */
 
 
 /*********************************************************************
@@ -183,6 +196,7 @@ static int my_init_app_config(const char *wifi_SSID, const char *wifi_pass_phras
       this_ret_val = -2;
    }
 
+#if defined(WF_CS_TRIS)
    if (0 == this_ret_val)
    {
       // inputs are ok, but now check if they are too big for their destination
@@ -198,6 +212,7 @@ static int my_init_app_config(const char *wifi_SSID, const char *wifi_pass_phras
          this_ret_val = -4;
       }
    }
+#endif   /* defined(WF_CS_TRIS) */
 
    if (0 == this_ret_val)
    {
@@ -253,7 +268,9 @@ static int my_init_app_config(const char *wifi_SSID, const char *wifi_pass_phras
       // Note: The formatting is some string mangling to restrict the specified
       // host name to the NetBIOS standard of exactly 16 characters, with 15
       // being characters and the last being a null terminator.
-      memcpy(AppConfig.NetBIOSName, (ROM void*)MY_DEFAULT_HOST_NAME, 16);
+      // Note: The name is usually shorter than 16 bytes, so it is copied as a
+      // string instead of as 16 bytes, which would read past the end of it.
+      strncpy((char*)AppConfig.NetBIOSName, (ROM char*)MY_DEFAULT_HOST_NAME, sizeof(AppConfig.NetBIOSName) - 1);
       FormatNetBIOSName(AppConfig.NetBIOSName);
 
 
@@ -265,6 +282,7 @@ static int my_init_app_config(const char *wifi_SSID, const char *wifi_pass_phras
       // since it is so widely defined, I am going to simply go without the
       // check here.
 
+#if defined(WF_CS_TRIS)
       // load the SSID name into the wifi
       memcpy(AppConfig.MySSID, (ROM void*)wifi_SSID, strlen(wifi_SSID));
       AppConfig.SsidLength = strlen(wifi_SSID);
@@ -281,6 +299,7 @@ static int my_init_app_config(const char *wifi_SSID, const char *wifi_pass_phras
       AppConfig.SecurityMode = WF_SECURITY_WPA_AUTO_WITH_PASS_PHRASE;
       memcpy(AppConfig.SecurityKey, (ROM void*)wifi_pass_phrase, strlen(wifi_pass_phrase));
       AppConfig.SecurityKeyLength = strlen(wifi_pass_phrase);
+#endif   /* defined(WF_CS_TRIS) */
    }
 
    return this_ret_val;
@@ -290,21 +309,9 @@ static int my_init_app_config(const char *wifi_SSID, const char *wifi_pass_phras
 
 
 
-
-
-
-
-
-
-
 void TCPIP_and_wifi_stack_init(const char *wifi_SSID, const char *wifi_password)
 {
-   int count = 0;
-
-   for (count = 0; count < MAX_SOCKETS; count += 1)
-   {
-      g_socket_port_numbers[count] = 0;
-   }
+   framework_init_sockets();
 
    // ??what does this do? apparently it works without it?
 //#if defined(WF_CS_TRIS)
@@ -329,11 +336,15 @@ void TCPIP_and_wifi_stack_init(const char *wifi_SSID, const char *wifi_password)
 #endif   /* defined(DERIVE_KEY_FROM_PASSPHRASE_IN_HOST) */
 
    // keep the wifi connection alive
+#if defined(WF_CS_TRIS)
    my_WF_connect();
+#endif
 }
 
 void TCPIP_keep_stack_alive(void)
 {
+   int count = 0;
+
    // perform normal stack tasks including checking for incoming
    // packets and calling appropriate handlers
    StackTask();
@@ -343,10 +354,25 @@ void TCPIP_keep_stack_alive(void)
    // some kind of check for the RF module version.  This code is build
    // specifically for the Microchip MRF24WB RF module, for which all of these
    // checks were always true.  I deleted the checks to clean up code.
+   // Note: WF_CS_TRIS is back for the Linux host build; see my_WF_connect.
+#if defined(WF_CS_TRIS)
    WiFiTask();
+#endif
 
    // this tasks invokes each of the core stack application tasks
    StackApplications();
+
+   // now that the stack has had a chance to process incoming packets, look
+   // for anything that changed on our sockets
+   for (count = 0; count < MAX_SOCKETS; count += 1)
+   {
+      if (0 != framework_port_number(count))
+      {
+         framework_service_socket(count);
+      }
+   }
+
+   framework_dump_stats();
 }
 
 void TCPIP_get_IP_address(unsigned char *ip_first, unsigned char *ip_second, unsigned char *ip_third, unsigned char *ip_fourth)
@@ -364,53 +390,6 @@ void TCPIP_get_IP_address(unsigned char *ip_first, unsigned char *ip_second, uns
    *ip_first = AppConfig.MyIPAddr.byte.LB;     // lowest byte, first number
 }
 
-static int get_next_available_socket_index(void)
-{
-   int count = 0;
-   int this_ret_val = 0;
-
-   // check for an unused port, then use the socket of that port
-   for (count = 0; count < MAX_SOCKETS; count += 1)
-   {
-      if (0 == g_socket_port_numbers[count])
-      {
-         this_ret_val = count;
-         break;
-      }
-   }
-
-   if (MAX_SOCKETS == count)
-   {
-      // no ports available
-      this_ret_val = -1;
-   }
-
-   return this_ret_val;
-}
-
-static int find_index_of_port_number(unsigned int port_num)
-{
-   int this_ret_val = 0;
-   int count = 0;
-
-   for (count = 0; count < MAX_SOCKETS; count += 1)
-   {
-      if (port_num == g_socket_port_numbers[count])
-      {
-         // found it
-         this_ret_val = count;
-         break;
-      }
-   }
-
-   if (MAX_SOCKETS == count)
-   {
-      // didn't find it
-      this_ret_val = -1;
-   }
-
-   return this_ret_val;
-}
 
 int TCPIP_open_socket(unsigned int port_num)
 {
@@ -418,7 +397,7 @@ int TCPIP_open_socket(unsigned int port_num)
    int socket_index;
 
    // first check if this port is already in use
-   socket_index = find_index_of_port_number(port_num);
+   socket_index = framework_find_index_of_port_number(port_num);
    if (socket_index >= 0)
    {
       // already in use; abort
@@ -428,7 +407,7 @@ int TCPIP_open_socket(unsigned int port_num)
    if (0 == this_ret_val)
    {
       // port number was not in use, so now get the next available socket index
-      socket_index = get_next_available_socket_index();
+      socket_index = framework_get_next_available_socket_index();
       if (socket_index < 0)
       {
          // no index available
@@ -448,7 +427,11 @@ int TCPIP_open_socket(unsigned int port_num)
       else
       {
          // socket opened ok, so do some book keeping
-         g_socket_port_numbers[socket_index] = port_num;
+         // Note: A fresh socket gets whatever split TCPSocketInitializer
+         // says, which is an even split for our sockets.  If it was changed
+         // by whoever had this socket before us, the common code puts it
+         // back.
+         framework_open_port(socket_index, port_num);
       }
    }
 
@@ -461,7 +444,7 @@ int TCPIP_close_socket(unsigned int port_num)
    int socket_index = 0;
 
    // find the index of the port in use
-   socket_index = find_index_of_port_number(port_num);
+   socket_index = framework_find_index_of_port_number(port_num);
    if (socket_index < 0)
    {
       // couldn't find this port number, so we must not be using it
@@ -475,216 +458,151 @@ int TCPIP_close_socket(unsigned int port_num)
       // destroy server sockets.  TCPDisconnect(...) only destroys socket
       // clients.
       TCPClose(g_socket_handles[socket_index]);
-      g_socket_port_numbers[socket_index] = 0;
+      framework_close_port(socket_index);
    }
 
    return this_ret_val;
 }
 
-int TCPIP_is_there_a_connection_on_port(unsigned int port_num)
-{
-   int this_ret_val = 0;
-   int socket_index = 0;
 
-   socket_index = find_index_of_port_number(port_num);
-   if (socket_index < 0)
-   {
-      // couldn't find this port number, so we must not be using it
-      this_ret_val = -1;
-   }
-
-   if (0 == this_ret_val)
-   {
-      if (TCPIsConnected(g_socket_handles[socket_index]))
-      {
-         this_ret_val = 1;
-      }
-      else
-      {
-         // leave it at 0
-      }
-   }
 
-   return this_ret_val;
+unsigned long backend_get_ticks(void)
+{
+   return TickGet();
 }
 
-int TCPIP_bytes_in_TX_FIFO(unsigned int port_num)
+unsigned long backend_ticks_since(unsigned long then_ticks)
 {
-   int this_ret_val = 0;
-   int socket_index = 0;
+   // Note: Unsigned subtraction in the tick counter's own size takes care of
+   // the counter wrapping.
+   return (DWORD)(TickGet() - (DWORD)then_ticks);
+}
 
-   socket_index = find_index_of_port_number(port_num);
-   if (socket_index < 0)
-   {
-      // couldn't find this port number, so we must not be using it
-      this_ret_val = -1;
-   }
+unsigned long backend_ticks_per_second(void)
+{
+   return TICK_SECOND;
+}
 
-   if (0 == this_ret_val)
-   {
-      // check the space in the TX buffer
-      // Note: The function "TCP is put ready" only uses the socket handle to
-      // perform some kind of synchronization before checking the number of
-      // bytes available in the TX FIFO.  The number of bytes available is
-      // actually independent of the socket in use, despite what the argument
-      // to the function suggests.  I think that the socket handle argument is
-      // only there to ensure that a socket-port combo is active.
-      this_ret_val = TCPIsPutReady(g_socket_handles[socket_index]);
-   }
+int backend_is_connected(int socket_index)
+{
+   return TCPIsConnected(g_socket_handles[socket_index]) ? 1 : 0;
+}
 
-   return this_ret_val;
+int backend_was_reset(int socket_index)
+{
+   return TCPWasReset(g_socket_handles[socket_index]) ? 1 : 0;
 }
 
-int TCPIP_bytes_in_RX_FIFO(unsigned int port_num)
+unsigned long backend_bytes_in_TX(int socket_index)
 {
-   int this_ret_val = 0;
-   int socket_index = 0;
+   return TCPGetTxFIFOFull(g_socket_handles[socket_index]);
+}
 
-   socket_index = find_index_of_port_number(port_num);
-   if (socket_index < 0)
-   {
-      // couldn't find this port number, so we must not be using it
-      this_ret_val = -1;
-   }
+unsigned long backend_space_in_TX(int socket_index)
+{
+   // Note: The function "TCP is put ready" only uses the socket handle to
+   // perform some kind of synchronization before checking the number of
+   // bytes available in the TX FIFO.  It returns 0 unless the socket is
+   // connected.
+   return TCPIsPutReady(g_socket_handles[socket_index]);
+}
 
-   if (0 == this_ret_val)
-   {
-      // check the space in the TX buffer
-      // Note: See note in "TCPIP bytes in TX FIFO".
-      this_ret_val = TCPIsGetReady(g_socket_handles[socket_index]);
-   }
+unsigned long backend_bytes_in_RX(int socket_index)
+{
+   return TCPIsGetReady(g_socket_handles[socket_index]);
+}
 
-   return this_ret_val;
+unsigned long backend_space_in_RX(int socket_index)
+{
+   return TCPGetRxFIFOFree(g_socket_handles[socket_index]);
 }
 
-int TCPIP_basic_send(unsigned int port_num, unsigned char *byte_buffer, unsigned int bytes_to_send)
+unsigned long backend_put(int socket_index, const unsigned char *byte_buffer, unsigned long bytes_to_put)
 {
-   int this_ret_val = 0;
-   int socket_index = 0;
-   WORD space_in_tx_buffer = 0;
-   WORD bytes_sent;
+   // Note: The documentation for TCPPutArray(...) says that, if the number of
+   // bytes sent is less than the number that was requested, then the TX
+   // buffer became full or the socket was not connected.
+   return TCPPutArray(g_socket_handles[socket_index], (BYTE*)byte_buffer, (TCP_FIFO_SIZE)bytes_to_put);
+}
 
-   if (0 == byte_buffer)
-   {
-      // bad pointer
-      this_ret_val = -1;
-   }
+unsigned long backend_get(int socket_index, unsigned char *byte_buffer, unsigned long bytes_to_get)
+{
+   // Note: TCPGetArray(...) with a null buffer just moves the FIFO's read
+   // pointer.
+   return TCPGetArray(g_socket_handles[socket_index], byte_buffer, (TCP_FIFO_SIZE)bytes_to_get);
+}
 
-   if (0 == this_ret_val)
-   {
-      socket_index = find_index_of_port_number(port_num);
-      if (socket_index < 0)
-      {
-         // couldn't find this port number, so we must not be using it
-         this_ret_val = -2;
-      }
-   }
+unsigned long backend_peek(int socket_index, unsigned char *byte_buffer, unsigned long bytes_to_peek, unsigned long offset)
+{
+   return TCPPeekArray(g_socket_handles[socket_index], byte_buffer, (TCP_FIFO_SIZE)bytes_to_peek, (TCP_FIFO_SIZE)offset);
+}
 
-   if (0 == this_ret_val)
-   {
-      if (!TCPIsConnected(g_socket_handles[socket_index]))
-      {
-         // there are no sockets communicating with this one, so do nothing
-         this_ret_val = -3;
-      }
-   }
+long backend_find(int socket_index, const unsigned char *pattern, unsigned int pattern_length, unsigned long offset)
+{
+   WORD found_offset = 0xFFFFu;
 
-   if (0 == this_ret_val)
+   // Note: TCPFindArrayEx(...) only takes a WORD offset and returns 0xFFFF
+   // if the pattern wasn't found, so a search that starts past that can't
+   // find anything.
+   if (offset < 0xFFFFu)
    {
-      space_in_tx_buffer = TCPIsPutReady(g_socket_handles[socket_index]);
-      if (bytes_to_send > space_in_tx_buffer)
-      {
-         // too much data to send at once, so do nothing
-         // Note: If you're feeling clever, modify this function so that it
-         // sends the data in multiple chunks.
-         this_ret_val = -4;
-      }
+      found_offset = TCPFindArrayEx(g_socket_handles[socket_index],
+         (BYTE*)pattern,
+         (WORD)pattern_length,
+         (WORD)offset,
+         0,
+         FALSE);
    }
 
-   if (0 == this_ret_val)
-   {
-      bytes_sent = TCPPutArray(g_socket_handles[socket_index], byte_buffer, bytes_to_send);
-      if (bytes_sent < bytes_to_send)
-      {
-         // some kind of problem; bad
-         // Note: The documentation for TCPPutArray(...) says that, if the
-         // number of bytes sent is less than the number that was requested,
-         // then the TX buffer became full or the socket was not connected.
-         // Hopefully, with the checks in this function, those should be caught
-         // before reaching the call to TCPPutArray(...).
-         this_ret_val = -5;
-      }
-      else
-      {
-         // all went well
-         this_ret_val = bytes_sent;
-      }
-   }
+   return (0xFFFFu == found_offset) ? -1 : (long)found_offset;
+}
 
-   return this_ret_val;
+void backend_FIFOs_changed(int socket_index)
+{
+   // Note: StackTask() moves the bytes between the FIFOs and the network, so
+   // there is nothing to do until the next "keep stack alive".
+   (void)socket_index;
 }
 
-int TCPIP_basic_receive(unsigned int port_num, unsigned char *byte_buffer, unsigned int max_buffer_size)
+unsigned long backend_FIFO_memory_size(int socket_index)
 {
-   int this_ret_val = 0;
-   int socket_index = 0;
-   WORD bytes_in_rx_buffer = 0;
-   WORD bytes_read;
+   TCP_SOCKET handle = g_socket_handles[socket_index];
 
-   if (0 == byte_buffer)
-   {
-      // bad pointer
-      this_ret_val = -1;
-   }
+   return (unsigned long)TCPIsPutReady(handle) + TCPGetTxFIFOFull(handle) +
+      TCPIsGetReady(handle) + TCPGetRxFIFOFree(handle);
+}
 
-   if (0 == this_ret_val)
-   {
-      socket_index = find_index_of_port_number(port_num);
-      if (socket_index < 0)
-      {
-         // couldn't find this port number, so we must not be using it
-         this_ret_val = -2;
-      }
-   }
+int backend_set_FIFO_split(int socket_index, TCPIP_FIFO_PROFILE layout, unsigned long new_TX_size, unsigned long total_FIFO_size)
+{
+   TCP_SOCKET handle = g_socket_handles[socket_index];
+   BOOL adjusted = FALSE;
 
-   if (0 == this_ret_val)
+   // Note: With TCP_ADJUST_PRESERVE_TX and TCP_ADJUST_PRESERVE_RX, the stack
+   // refuses to adjust anything rather than lose data (TX data that has
+   // wrapped around the end of its FIFO, for instance).
+   switch (layout)
    {
-      if (!TCPIsConnected(g_socket_handles[socket_index]))
-      {
-         // there are no sockets communicating with this one, so do nothing
-         this_ret_val = -3;
-      }
+   case TCPIP_FIFO_PROFILE_TX_HEAVY:
+      adjusted = TCPAdjustFIFOSize(handle, (TCP_FIFO_SIZE)(total_FIFO_size - new_TX_size), 0,
+         TCP_ADJUST_GIVE_REST_TO_TX | TCP_ADJUST_PRESERVE_RX | TCP_ADJUST_PRESERVE_TX);
+      break;
+   case TCPIP_FIFO_PROFILE_RX_HEAVY:
+      adjusted = TCPAdjustFIFOSize(handle, 0, (TCP_FIFO_SIZE)new_TX_size,
+         TCP_ADJUST_GIVE_REST_TO_RX | TCP_ADJUST_PRESERVE_RX | TCP_ADJUST_PRESERVE_TX);
+      break;
+   default:
+      adjusted = TCPAdjustFIFOSize(handle, 0, 0,
+         TCP_ADJUST_GIVE_REST_TO_TX | TCP_ADJUST_GIVE_REST_TO_RX | TCP_ADJUST_PRESERVE_RX | TCP_ADJUST_PRESERVE_TX);
+      break;
    }
 
-   if (0 == this_ret_val)
-   {
-      bytes_in_rx_buffer = TCPIsGetReady(g_socket_handles[socket_index]);
-      if (bytes_in_rx_buffer >= max_buffer_size)
-      {
-         // too much data to receive at once, so do nothing
-         // Note: If you're feeling clever, modify this function so that it
-         // receives the data in multiple chunks.
-         this_ret_val = -4;
-      }
-   }
+   return adjusted ? 1 : 0;
+}
 
-   if (0 == this_ret_val)
-   {
-      bytes_read = TCPGetArray(g_socket_handles[socket_index], byte_buffer, max_buffer_size);
-      if (bytes_read >= max_buffer_size)
-      {
-         // this should have been caught in the "number bytes in RX buffer"
-         // check prior to reading the buffer, so there was some kind of
-         // problem
-         this_ret_val = -5;
-      }
-      else
-      {
-         // all went well
-         this_ret_val = bytes_read;
-      }
-   }
+int backend_get_RTT_ms(int socket_index, unsigned long *RTT_ms_ptr)
+{
+   // Note: The stack keeps the round trip time in ticks.
+   *RTT_ms_ptr = (unsigned long)(((QWORD)TCPGetRTT(g_socket_handles[socket_index]) * 1000ull) / TICK_SECOND);
 
-   return this_ret_val;
+   return 0;
 }
-
@@ -27,6 +27,92 @@ extern "C" {
    int TCPIP_basic_send(unsigned int port_num, unsigned char *byte_buffer, unsigned int bytes_to_send);
    int TCPIP_basic_receive(unsigned int port_num, unsigned char *byte_buffer, unsigned int max_buffer_size);
 
+   // event callbacks
+   // Note: These are checked once per call to TCPIP_keep_stack_alive(), so
+   // the application does not have to poll every socket on every loop.  The
+   // callbacks take no arguments so that they can be handed straight to the
+   // function queue (see my_function_queue.h).  Register a different set of
+   // functions for each port if you need to tell the ports apart.
+   // Note: Any callback may be 0 if you don't care about that event.
+   int TCPIP_register_callbacks(unsigned int port_num,
+      void (*on_connect)(void),
+      void (*on_data)(void),
+      void (*on_writable)(void),
+      void (*on_close)(void));
+   int TCPIP_set_callback_thresholds(unsigned int port_num, unsigned int RX_bytes_threshold, unsigned int TX_space_threshold);
+   void TCPIP_use_function_queue_for_callbacks(int use_queue);
+
+   // message framing
+   // Note: Once a port has a framing type, complete frames are found directly
+   // in the socket's RX FIFO, so there is no need to receive into a scratch
+   // buffer and scan it again.  Only the payload is copied out; headers and
+   // delimiters are thrown away in the FIFO.
+   // Note: All multi-byte length and type fields are big endian (network byte
+   // order), and each may be 1, 2, or 4 bytes wide.  The length field counts
+   // only the payload, not the header.
+   // Note: Delimiters may be up to 8 bytes long (ex: "\r\n").
+   typedef enum
+   {
+      TCPIP_FRAMING_NONE = 0,
+      TCPIP_FRAMING_DELIMITER,
+      TCPIP_FRAMING_LENGTH_PREFIX,
+      TCPIP_FRAMING_TLV
+   } TCPIP_FRAMING_TYPE;
+
+   int TCPIP_set_delimiter_framing(unsigned int port_num, const unsigned char *delimiter, unsigned int delimiter_length);
+   int TCPIP_set_length_prefix_framing(unsigned int port_num, unsigned int length_bytes);
+   int TCPIP_set_TLV_framing(unsigned int port_num, unsigned int type_bytes, unsigned int length_bytes);
+   int TCPIP_peek_frame(unsigned int port_num, unsigned int *payload_length_ptr, unsigned long *frame_type_ptr);
+   int TCPIP_receive_frame(unsigned int port_num, unsigned char *byte_buffer, unsigned int max_buffer_size);
+
+   // traffic statistics
+   // Note: These are kept for each port so that the FIFO sizes in
+   // TCPSocketInitializer (TCPIPConfig.h) can be picked from real traffic
+   // instead of guessed.  If the high water mark of a FIFO never gets near its
+   // size, the FIFO is too big, and if sends are being rejected, the TX FIFO
+   // is too small.
+   // Note: Durations are in seconds.
+   typedef struct
+   {
+      unsigned long bytes_sent;
+      unsigned long bytes_received;
+      unsigned long sends_rejected;          // not enough space in TX FIFO
+      unsigned long receives_rejected;       // user's buffer was too small
+      unsigned long connection_count;
+      unsigned long current_connection_seconds;
+      unsigned long total_connected_seconds;
+      unsigned long smoothed_RTT_ms;         // 0 until the current connection has been measured
+      unsigned long TX_FIFO_size;
+      unsigned long RX_FIFO_size;
+      unsigned long TX_FIFO_high_water_mark; // most bytes ever waiting to go out
+      unsigned long RX_FIFO_high_water_mark; // most bytes ever waiting to be read
+   } TCPIP_PORT_STATS;
+
+   int TCPIP_get_port_stats(unsigned int port_num, TCPIP_PORT_STATS *stats_ptr);
+   int TCPIP_reset_port_stats(unsigned int port_num);
+   void TCPIP_set_stats_dump(void (*dump_function)(unsigned int port_num, const TCPIP_PORT_STATS *stats_ptr), unsigned int period_seconds);
+
+   // FIFO profiles
+   // Note: Each socket has one chunk of memory that is split between its TX
+   // and RX FIFOs.  Out of the box, the split is whatever TCPSocketInitializer
+   // (TCPIPConfig.h) says.  A port that mostly streams data out can get a
+   // bigger TX FIFO (and therefore bigger packets) by taking memory from the
+   // RX FIFO, and vice versa, without using any more RAM.
+   // Note: "Adaptive" watches how full each FIFO gets and moves memory toward
+   // the busy one on its own.
+   // Note: The split can only be changed when the data waiting in each FIFO
+   // fits in its new size, so a new profile may take a little while to kick
+   // in on a busy port.
+   typedef enum
+   {
+      TCPIP_FIFO_PROFILE_BALANCED = 0,
+      TCPIP_FIFO_PROFILE_TX_HEAVY,
+      TCPIP_FIFO_PROFILE_RX_HEAVY,
+      TCPIP_FIFO_PROFILE_ADAPTIVE
+   } TCPIP_FIFO_PROFILE;
+
+   int TCPIP_set_FIFO_profile(unsigned int port_num, TCPIP_FIFO_PROFILE profile);
+
 
 
 #ifdef	__cplusplus
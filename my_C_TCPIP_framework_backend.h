@@ -0,0 +1,93 @@
+/*
+ * File:   my_C_TCPIP_framework_backend.h
+ *
+ * The split between my_C_TCPIP_framework_common.c and the code that actually
+ * moves bytes for it.
+ */
+
+#ifndef MY_TCPIP_FRAMEWORK_BACKEND_H
+#define	MY_TCPIP_FRAMEWORK_BACKEND_H
+
+// Note: Everything in my_C_TCPIP_framework.h that doesn't depend on where the
+// bytes come from (callbacks, framing, statistics, FIFO profiles, argument
+// checking) lives in my_C_TCPIP_framework_common.c.  A backend supplies the
+// rest: stack setup, opening and closing ports, and the socket I/O below.
+// There are two backends:
+// - my_C_TCPIP_framework.c runs on the Microchip TCPIP stack (the board, or
+//   the Linux host build of the stack).
+// - my_C_TCPIP_framework_host.c runs on POSIX sockets and doesn't touch the
+//   stack at all.
+// Note: Build the common file and exactly one backend, for example:
+//    gcc -o my_app my_app.c my_C_TCPIP_framework_common.c my_C_TCPIP_framework_host.c my_function_queue.c
+// Note: This header is only for the framework's own files.  Applications
+// include my_C_TCPIP_framework.h.
+
+#include "my_C_TCPIP_framework.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+   // the number of ports that can be open at once
+   // Note: The common file and the backend must be built with the same
+   // value.
+#ifndef MAX_SOCKETS
+#define MAX_SOCKETS 5
+#endif
+
+   // provided by my_C_TCPIP_framework_common.c for the backend
+   // Note: A socket index is 0 to MAX_SOCKETS - 1, and a port number of 0
+   // means that the socket is unused.
+   void framework_init_sockets(void);
+   int framework_find_index_of_port_number(unsigned int port_num);
+   int framework_get_next_available_socket_index(void);
+   unsigned int framework_port_number(int socket_index);
+   void framework_open_port(int socket_index, unsigned int port_num);
+   void framework_close_port(int socket_index);
+   void framework_service_socket(int socket_index);
+   void framework_dump_stats(void);
+
+   // provided by the backend for my_C_TCPIP_framework_common.c
+   // Note: Ticks are whatever the backend counts time in.  Only differences
+   // are ever used, and "ticks since" takes care of the counter wrapping.
+   unsigned long backend_get_ticks(void);
+   unsigned long backend_ticks_since(unsigned long then_ticks);
+   unsigned long backend_ticks_per_second(void);
+
+   // Note: These behave like their counterparts in TCP.c: "was reset" clears
+   // the flag when it is read, and the free TX space is 0 unless someone is
+   // connected.
+   int backend_is_connected(int socket_index);
+   int backend_was_reset(int socket_index);
+   unsigned long backend_bytes_in_TX(int socket_index);
+   unsigned long backend_space_in_TX(int socket_index);
+   unsigned long backend_bytes_in_RX(int socket_index);
+   unsigned long backend_space_in_RX(int socket_index);
+
+   // Note: "Get" with a null buffer throws the bytes away.  "Find" returns
+   // the offset of the first match at or after "offset", or -1.
+   unsigned long backend_put(int socket_index, const unsigned char *byte_buffer, unsigned long bytes_to_put);
+   unsigned long backend_get(int socket_index, unsigned char *byte_buffer, unsigned long bytes_to_get);
+   unsigned long backend_peek(int socket_index, unsigned char *byte_buffer, unsigned long bytes_to_peek, unsigned long offset);
+   long backend_find(int socket_index, const unsigned char *pattern, unsigned int pattern_length, unsigned long offset);
+
+   // called after the common code has put data into or taken data out of a
+   // socket's FIFOs, in case the backend has to move bytes to or from the
+   // network itself
+   void backend_FIFOs_changed(int socket_index);
+
+   // Note: The total is the size of the one chunk of memory that both FIFOs
+   // are carved out of.  Changing the split must keep any data that is
+   // waiting in either FIFO, or refuse (return 0) and be tried again later.
+   unsigned long backend_FIFO_memory_size(int socket_index);
+   int backend_set_FIFO_split(int socket_index, TCPIP_FIFO_PROFILE layout, unsigned long new_TX_size, unsigned long total_FIFO_size);
+
+   // returns 0 and fills in the smoothed round trip time of the current
+   // connection, or returns -1 if it isn't known
+   int backend_get_RTT_ms(int socket_index, unsigned long *RTT_ms_ptr);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* MY_TCPIP_FRAMEWORK_BACKEND_H */
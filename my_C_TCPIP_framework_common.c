@@ -0,0 +1,1214 @@
+// for linking the definitions of the functions defined in this file with their
+// declarations
+#include "my_C_TCPIP_framework.h"
+#include "my_C_TCPIP_framework_backend.h"
+
+// for optionally deferring event callbacks until the main loop gets around to
+// them
+#include "my_function_queue.h"
+
+#include <string.h>
+
+
+// Note: This file is the part of the framework that is the same no matter
+// what carries the bytes.  It never talks to a socket itself; everything goes
+// through the backend_* functions (see my_C_TCPIP_framework_backend.h), which
+// are implemented by my_C_TCPIP_framework.c on the Microchip TCPIP stack and by
+// my_C_TCPIP_framework_host.c on POSIX sockets.
+// Note: Byte counts are unsigned long so that they hold any FIFO size the
+// backend has, including TCP_LARGE_FIFOS on the stack.
+
+// the port used by each socket
+// Note: For simplicity, each socket corresponds to one, and only one, port.
+// Port numbers are easier for the user to track because they are just
+// integers.  A port number of 0 means that the socket is unused.
+static unsigned int g_socket_port_numbers[MAX_SOCKETS];
+
+// event callback book keeping for each socket
+// Note: The "previous" values are what the socket looked like the last time
+// that "keep stack alive" ran.  Events are edges, so we need to remember the
+// last state to tell when something changed.
+// Note: The RX threshold is the number of bytes that must be waiting in the RX
+// FIFO before "on data" is called, and the TX threshold is the amount of free
+// space that must open up in the TX FIFO before "on writable" is called.
+typedef struct socket_events
+{
+   void (*on_connect)(void);
+   void (*on_data)(void);
+   void (*on_writable)(void);
+   void (*on_close)(void);
+   unsigned int RX_bytes_threshold;
+   unsigned int TX_space_threshold;
+   int prev_is_connected;
+   unsigned long prev_bytes_in_RX;
+   unsigned long prev_space_in_TX;
+} SOCKET_EVENTS;
+static SOCKET_EVENTS g_socket_events[MAX_SOCKETS];
+
+// if non-zero, callbacks are put on the function queue instead of being
+// called from inside "keep stack alive"
+static int g_use_function_queue_for_callbacks = 0;
+
+// framing book keeping for each socket
+// Note: The delimiter search start is how far into the RX FIFO we have
+// already looked for a delimiter without finding one.  There's no point in
+// searching those bytes again when more data arrives, so the next search
+// picks up where the last one left off (minus a partial delimiter's worth of
+// bytes, in case the delimiter was split across two packets).
+#define MAX_DELIMITER_BYTES 8
+typedef struct socket_framing
+{
+   TCPIP_FRAMING_TYPE framing_type;
+   unsigned char delimiter[MAX_DELIMITER_BYTES];
+   unsigned int delimiter_length;
+   unsigned int type_bytes;
+   unsigned int length_bytes;
+   unsigned long delimiter_search_start;
+} SOCKET_FRAMING;
+static SOCKET_FRAMING g_socket_framing[MAX_SOCKETS];
+
+// traffic statistics for each socket
+// Note: Connection time is added up a little at a time on every pass of "keep
+// stack alive" instead of being measured from the start of the connection.
+// The tick counter wraps every few hours on the board, so a long connection
+// would otherwise come out wrong.  Leftover ticks that don't make up a whole
+// second are carried over to the next pass.
+static TCPIP_PORT_STATS g_socket_stats[MAX_SOCKETS];
+static unsigned long g_socket_last_stats_tick[MAX_SOCKETS];
+static unsigned long g_socket_connected_ticks[MAX_SOCKETS];
+
+// optional periodic dump of the statistics
+static void (*g_stats_dump_function)(unsigned int port_num, const TCPIP_PORT_STATS *stats_ptr) = 0;
+static unsigned long g_stats_dump_period_ticks = 0;
+static unsigned long g_last_stats_dump_tick = 0;
+
+// FIFO profile book keeping for each socket
+// Note: The layout is the TX/RX split that the socket actually has right now
+// (balanced, TX heavy, or RX heavy), and the wanted layout is the one that it
+// should have.  They differ until the backend gets a chance to move the
+// memory around.
+// Note: In the heavy layouts, the small side gets a quarter of the memory.
+// Note: The adaptive profile keeps a score that goes up when the TX FIFO has
+// been busy and the RX FIFO idle, and down for the reverse.  The layout only
+// changes when the score reaches one end or the other, and only goes back to
+// balanced when the score drifts back to 0, so that a short burst in one
+// direction doesn't make the memory bounce back and forth.
+#define FIFO_PROFILE_SMALL_SIDE_DIVISOR 4
+#define FIFO_PROFILE_SAMPLES_PER_SECOND 10
+#define FIFO_PROFILE_SAMPLES_TO_SWITCH 8
+typedef struct socket_FIFO_profile
+{
+   TCPIP_FIFO_PROFILE profile;
+   TCPIP_FIFO_PROFILE layout;
+   TCPIP_FIFO_PROFILE wanted_layout;
+   int adaptive_score;
+   unsigned long interval_TX_peak;
+   unsigned long interval_RX_peak;
+   unsigned long last_sample_tick;
+} SOCKET_FIFO_PROFILE;
+static SOCKET_FIFO_PROFILE g_socket_FIFO_profiles[MAX_SOCKETS];
+
+
+
+static void update_FIFO_stats(int socket_index)
+{
+   TCPIP_PORT_STATS *stats_ptr = &g_socket_stats[socket_index];
+   unsigned long bytes_in_TX = 0;
+   unsigned long bytes_in_RX = 0;
+
+   // Note: The FIFO sizes can change if the backend adjusts them, so look
+   // them up every time.
+   bytes_in_TX = backend_bytes_in_TX(socket_index);
+   bytes_in_RX = backend_bytes_in_RX(socket_index);
+   stats_ptr->TX_FIFO_size = bytes_in_TX + backend_space_in_TX(socket_index);
+   stats_ptr->RX_FIFO_size = bytes_in_RX + backend_space_in_RX(socket_index);
+
+   if (bytes_in_TX > stats_ptr->TX_FIFO_high_water_mark)
+   {
+      stats_ptr->TX_FIFO_high_water_mark = bytes_in_TX;
+   }
+   if (bytes_in_RX > stats_ptr->RX_FIFO_high_water_mark)
+   {
+      stats_ptr->RX_FIFO_high_water_mark = bytes_in_RX;
+   }
+
+   // the adaptive FIFO profile looks at the peaks since its last sample
+   if (bytes_in_TX > g_socket_FIFO_profiles[socket_index].interval_TX_peak)
+   {
+      g_socket_FIFO_profiles[socket_index].interval_TX_peak = bytes_in_TX;
+   }
+   if (bytes_in_RX > g_socket_FIFO_profiles[socket_index].interval_RX_peak)
+   {
+      g_socket_FIFO_profiles[socket_index].interval_RX_peak = bytes_in_RX;
+   }
+}
+
+static void sample_adaptive_FIFO_profile(int socket_index)
+{
+   SOCKET_FIFO_PROFILE *profile_ptr = &g_socket_FIFO_profiles[socket_index];
+   TCPIP_PORT_STATS *stats_ptr = &g_socket_stats[socket_index];
+   int TX_busy = 0;
+   int RX_busy = 0;
+   int TX_idle = 0;
+   int RX_idle = 0;
+
+   if (backend_ticks_since(profile_ptr->last_sample_tick) < backend_ticks_per_second() / FIFO_PROFILE_SAMPLES_PER_SECOND)
+   {
+      // not yet
+      return;
+   }
+   profile_ptr->last_sample_tick = backend_get_ticks();
+
+   // "busy" is at least 3/4 full at some point, and "idle" is never more
+   // than 1/4 full
+   TX_busy = (4 * profile_ptr->interval_TX_peak) >= (3 * stats_ptr->TX_FIFO_size);
+   RX_busy = (4 * profile_ptr->interval_RX_peak) >= (3 * stats_ptr->RX_FIFO_size);
+   TX_idle = (4 * profile_ptr->interval_TX_peak) < stats_ptr->TX_FIFO_size;
+   RX_idle = (4 * profile_ptr->interval_RX_peak) < stats_ptr->RX_FIFO_size;
+   profile_ptr->interval_TX_peak = 0;
+   profile_ptr->interval_RX_peak = 0;
+
+   if (TX_busy && RX_idle)
+   {
+      if (profile_ptr->adaptive_score < FIFO_PROFILE_SAMPLES_TO_SWITCH)
+      {
+         profile_ptr->adaptive_score += 1;
+      }
+   }
+   else if (RX_busy && TX_idle)
+   {
+      if (profile_ptr->adaptive_score > -FIFO_PROFILE_SAMPLES_TO_SWITCH)
+      {
+         profile_ptr->adaptive_score -= 1;
+      }
+   }
+   else if (profile_ptr->adaptive_score > 0)
+   {
+      profile_ptr->adaptive_score -= 1;
+   }
+   else if (profile_ptr->adaptive_score < 0)
+   {
+      profile_ptr->adaptive_score += 1;
+   }
+
+   if (FIFO_PROFILE_SAMPLES_TO_SWITCH == profile_ptr->adaptive_score)
+   {
+      profile_ptr->wanted_layout = TCPIP_FIFO_PROFILE_TX_HEAVY;
+   }
+   else if (-FIFO_PROFILE_SAMPLES_TO_SWITCH == profile_ptr->adaptive_score)
+   {
+      profile_ptr->wanted_layout = TCPIP_FIFO_PROFILE_RX_HEAVY;
+   }
+   else if (0 == profile_ptr->adaptive_score)
+   {
+      profile_ptr->wanted_layout = TCPIP_FIFO_PROFILE_BALANCED;
+   }
+}
+
+static void apply_FIFO_layout(int socket_index)
+{
+   SOCKET_FIFO_PROFILE *profile_ptr = &g_socket_FIFO_profiles[socket_index];
+   unsigned long total_FIFO_size = 0;
+   unsigned long small_side_size = 0;
+   unsigned long new_TX_size = 0;
+
+   if (profile_ptr->wanted_layout == profile_ptr->layout)
+   {
+      // nothing to do
+      return;
+   }
+
+   total_FIFO_size = backend_FIFO_memory_size(socket_index);
+   small_side_size = total_FIFO_size / FIFO_PROFILE_SMALL_SIDE_DIVISOR;
+
+   switch (profile_ptr->wanted_layout)
+   {
+   case TCPIP_FIFO_PROFILE_TX_HEAVY:
+      new_TX_size = total_FIFO_size - small_side_size;
+      break;
+   case TCPIP_FIFO_PROFILE_RX_HEAVY:
+      new_TX_size = small_side_size;
+      break;
+   default:
+      new_TX_size = total_FIFO_size / 2;
+      break;
+   }
+
+   if ((backend_bytes_in_TX(socket_index) > new_TX_size) ||
+      (backend_bytes_in_RX(socket_index) > total_FIFO_size - new_TX_size))
+   {
+      // the waiting data wouldn't fit; try again later
+      return;
+   }
+
+   // Note: The backend may still refuse rather than lose data (TX data that
+   // has wrapped around the end of its FIFO on the board, for instance), and
+   // we'll try again on the next pass.
+   if (backend_set_FIFO_split(socket_index, profile_ptr->wanted_layout, new_TX_size, total_FIFO_size))
+   {
+      profile_ptr->layout = profile_ptr->wanted_layout;
+      profile_ptr->interval_TX_peak = 0;
+      profile_ptr->interval_RX_peak = 0;
+
+      // the amount of free TX space just changed, so re-arm "on writable"
+      g_socket_events[socket_index].prev_space_in_TX = 0;
+   }
+}
+
+static void update_connection_time(int socket_index, int is_connected)
+{
+   unsigned long ticks_per_second = backend_ticks_per_second();
+   unsigned long whole_seconds = 0;
+   unsigned long RTT_ms = 0;
+
+   if (is_connected)
+   {
+      g_socket_connected_ticks[socket_index] += backend_ticks_since(g_socket_last_stats_tick[socket_index]);
+      whole_seconds = g_socket_connected_ticks[socket_index] / ticks_per_second;
+      g_socket_connected_ticks[socket_index] -= whole_seconds * ticks_per_second;
+      g_socket_stats[socket_index].current_connection_seconds += whole_seconds;
+      g_socket_stats[socket_index].total_connected_seconds += whole_seconds;
+
+      if (0 == backend_get_RTT_ms(socket_index, &RTT_ms))
+      {
+         g_socket_stats[socket_index].smoothed_RTT_ms = RTT_ms;
+      }
+   }
+
+   g_socket_last_stats_tick[socket_index] = backend_get_ticks();
+}
+
+static void dispatch_callback(void (*callback)(void))
+{
+   if (0 == callback)
+   {
+      // nothing registered for this event
+      return;
+   }
+
+   if (g_use_function_queue_for_callbacks)
+   {
+      if (add_function_to_queue(callback) < 0)
+      {
+         // the queue is full, so call it now rather than lose the event
+         callback();
+      }
+   }
+   else
+   {
+      callback();
+   }
+}
+
+static void check_socket_events(int socket_index)
+{
+   SOCKET_EVENTS *events_ptr = &g_socket_events[socket_index];
+   int was_reset = 0;
+   int is_connected = 0;
+   unsigned long bytes_in_RX = 0;
+   unsigned long space_in_TX = 0;
+
+   // Note: "Was reset" clears the socket's reset flag when it is read, so it
+   // must only be called here.  A reset and a brand new connection can both
+   // happen between two passes, so treat a reset as a close even if the socket
+   // looks connected again.
+   was_reset = backend_was_reset(socket_index) ? 1 : 0;
+   is_connected = backend_is_connected(socket_index) ? 1 : 0;
+
+   // count up connection time before the "connected" state changes
+   update_connection_time(socket_index, events_ptr->prev_is_connected);
+
+   if (events_ptr->prev_is_connected && (was_reset || !is_connected))
+   {
+      dispatch_callback(events_ptr->on_close);
+      events_ptr->prev_is_connected = 0;
+      events_ptr->prev_bytes_in_RX = 0;
+      events_ptr->prev_space_in_TX = 0;
+
+      // whatever was in the RX FIFO is gone, so start searching from scratch
+      g_socket_framing[socket_index].delimiter_search_start = 0;
+   }
+
+   if (is_connected && !events_ptr->prev_is_connected)
+   {
+      g_socket_stats[socket_index].connection_count += 1;
+      g_socket_stats[socket_index].current_connection_seconds = 0;
+      g_socket_stats[socket_index].smoothed_RTT_ms = 0;
+      g_socket_connected_ticks[socket_index] = 0;
+      dispatch_callback(events_ptr->on_connect);
+   }
+   events_ptr->prev_is_connected = is_connected;
+
+   if (is_connected)
+   {
+      // data event: enough bytes are waiting and some of them are new since
+      // the last pass
+      bytes_in_RX = backend_bytes_in_RX(socket_index);
+      if ((bytes_in_RX >= events_ptr->RX_bytes_threshold) &&
+         (bytes_in_RX > events_ptr->prev_bytes_in_RX))
+      {
+         dispatch_callback(events_ptr->on_data);
+      }
+      events_ptr->prev_bytes_in_RX = bytes_in_RX;
+
+      // writable event: the free space in the TX FIFO just climbed to the
+      // threshold
+      space_in_TX = backend_space_in_TX(socket_index);
+      if ((space_in_TX >= events_ptr->TX_space_threshold) &&
+         (events_ptr->prev_space_in_TX < events_ptr->TX_space_threshold))
+      {
+         dispatch_callback(events_ptr->on_writable);
+      }
+      events_ptr->prev_space_in_TX = space_in_TX;
+
+      update_FIFO_stats(socket_index);
+   }
+}
+
+
+
+void framework_init_sockets(void)
+{
+   int count = 0;
+
+   for (count = 0; count < MAX_SOCKETS; count += 1)
+   {
+      g_socket_port_numbers[count] = 0;
+      memset((void*)&g_socket_events[count], 0x00, sizeof(SOCKET_EVENTS));
+      memset((void*)&g_socket_framing[count], 0x00, sizeof(SOCKET_FRAMING));
+      memset((void*)&g_socket_stats[count], 0x00, sizeof(TCPIP_PORT_STATS));
+      memset((void*)&g_socket_FIFO_profiles[count], 0x00, sizeof(SOCKET_FIFO_PROFILE));
+   }
+}
+
+int framework_find_index_of_port_number(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int count = 0;
+
+   for (count = 0; count < MAX_SOCKETS; count += 1)
+   {
+      if (port_num == g_socket_port_numbers[count])
+      {
+         // found it
+         this_ret_val = count;
+         break;
+      }
+   }
+
+   if (MAX_SOCKETS == count)
+   {
+      // didn't find it
+      this_ret_val = -1;
+   }
+
+   return this_ret_val;
+}
+
+int framework_get_next_available_socket_index(void)
+{
+   // an unused socket has a port number of 0
+   return framework_find_index_of_port_number(0);
+}
+
+unsigned int framework_port_number(int socket_index)
+{
+   return g_socket_port_numbers[socket_index];
+}
+
+void framework_open_port(int socket_index, unsigned int port_num)
+{
+   // Note: Default to calling "on data" for any data and "on writable"
+   // whenever any space opens up.
+   g_socket_port_numbers[socket_index] = port_num;
+   memset((void*)&g_socket_events[socket_index], 0x00, sizeof(SOCKET_EVENTS));
+   memset((void*)&g_socket_framing[socket_index], 0x00, sizeof(SOCKET_FRAMING));
+   memset((void*)&g_socket_stats[socket_index], 0x00, sizeof(TCPIP_PORT_STATS));
+   g_socket_last_stats_tick[socket_index] = backend_get_ticks();
+   g_socket_connected_ticks[socket_index] = 0;
+   g_socket_events[socket_index].RX_bytes_threshold = 1;
+   g_socket_events[socket_index].TX_space_threshold = 1;
+
+   // Note: A fresh socket should have an even split, but whoever had it
+   // before us may have changed it, so put it back.
+   // Note: "Adaptive" is never an actual layout, so it is used here to mean
+   // "don't know".
+   memset((void*)&g_socket_FIFO_profiles[socket_index], 0x00, sizeof(SOCKET_FIFO_PROFILE));
+   g_socket_FIFO_profiles[socket_index].layout = TCPIP_FIFO_PROFILE_ADAPTIVE;
+   g_socket_FIFO_profiles[socket_index].wanted_layout = TCPIP_FIFO_PROFILE_BALANCED;
+}
+
+void framework_close_port(int socket_index)
+{
+   g_socket_port_numbers[socket_index] = 0;
+
+   // the user asked for this, so don't bother them with an "on close"
+   memset((void*)&g_socket_events[socket_index], 0x00, sizeof(SOCKET_EVENTS));
+   memset((void*)&g_socket_framing[socket_index], 0x00, sizeof(SOCKET_FRAMING));
+}
+
+void framework_service_socket(int socket_index)
+{
+   check_socket_events(socket_index);
+
+   if (TCPIP_FIFO_PROFILE_ADAPTIVE == g_socket_FIFO_profiles[socket_index].profile)
+   {
+      sample_adaptive_FIFO_profile(socket_index);
+   }
+   apply_FIFO_layout(socket_index);
+}
+
+void framework_dump_stats(void)
+{
+   int count = 0;
+
+   // hand the statistics to the user every so often, if they asked for it
+   if ((0 != g_stats_dump_function) &&
+      (backend_ticks_since(g_last_stats_dump_tick) >= g_stats_dump_period_ticks))
+   {
+      g_last_stats_dump_tick = backend_get_ticks();
+      for (count = 0; count < MAX_SOCKETS; count += 1)
+      {
+         if (0 != g_socket_port_numbers[count])
+         {
+            g_stats_dump_function(g_socket_port_numbers[count], &g_socket_stats[count]);
+         }
+      }
+   }
+}
+
+
+
+int TCPIP_is_there_a_connection_on_port(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      this_ret_val = backend_is_connected(socket_index) ? 1 : 0;
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_bytes_in_TX_FIFO(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      // Note: Like TCPIsPutReady(...), this is the free space in the TX FIFO,
+      // and there is none unless someone is connected.
+      this_ret_val = (int)backend_space_in_TX(socket_index);
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_bytes_in_RX_FIFO(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      this_ret_val = (int)backend_bytes_in_RX(socket_index);
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_basic_send(unsigned int port_num, unsigned char *byte_buffer, unsigned int bytes_to_send)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   unsigned long bytes_sent = 0;
+
+   if (0 == byte_buffer)
+   {
+      // bad pointer
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      if (!backend_is_connected(socket_index))
+      {
+         // there are no sockets communicating with this one, so do nothing
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      if (bytes_to_send > backend_space_in_TX(socket_index))
+      {
+         // too much data to send at once, so do nothing
+         // Note: If you're feeling clever, modify this function so that it
+         // sends the data in multiple chunks.
+         g_socket_stats[socket_index].sends_rejected += 1;
+         this_ret_val = -4;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      bytes_sent = backend_put(socket_index, byte_buffer, bytes_to_send);
+      if (bytes_sent < bytes_to_send)
+      {
+         // some kind of problem; bad
+         // Note: The checks above should make this impossible; the TX FIFO
+         // would have had to fill up or the connection close in between.
+         this_ret_val = -5;
+      }
+      else
+      {
+         // all went well
+         this_ret_val = (int)bytes_sent;
+      }
+
+      // Note: Check the high water mark now, while the data is still sitting
+      // in the TX FIFO.  It may be gone by the next "keep stack alive".
+      g_socket_stats[socket_index].bytes_sent += bytes_sent;
+      update_FIFO_stats(socket_index);
+      backend_FIFOs_changed(socket_index);
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_basic_receive(unsigned int port_num, unsigned char *byte_buffer, unsigned int max_buffer_size)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   unsigned long bytes_read = 0;
+
+   if (0 == byte_buffer)
+   {
+      // bad pointer
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      if (!backend_is_connected(socket_index))
+      {
+         // there are no sockets communicating with this one, so do nothing
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      // Note: The buffer must be strictly bigger than what is waiting.
+      if (backend_bytes_in_RX(socket_index) >= max_buffer_size)
+      {
+         // too much data to receive at once, so do nothing
+         // Note: If you're feeling clever, modify this function so that it
+         // receives the data in multiple chunks.
+         g_socket_stats[socket_index].receives_rejected += 1;
+         this_ret_val = -4;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      // Note: Check the high water mark before emptying the RX FIFO.
+      update_FIFO_stats(socket_index);
+      bytes_read = backend_get(socket_index, byte_buffer, max_buffer_size);
+      g_socket_stats[socket_index].bytes_received += bytes_read;
+
+      // Note: The bytes that the delimiter search already looked at are
+      // gone, so a framed receive has to start searching from the front.
+      g_socket_framing[socket_index].delimiter_search_start = 0;
+      if (bytes_read >= max_buffer_size)
+      {
+         // this should have been caught in the "number bytes in RX buffer"
+         // check prior to reading the buffer, so there was some kind of
+         // problem
+         this_ret_val = -5;
+      }
+      else
+      {
+         // all went well
+         this_ret_val = (int)bytes_read;
+      }
+
+      // there's room now, so the backend can take in more
+      backend_FIFOs_changed(socket_index);
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_register_callbacks(unsigned int port_num,
+   void (*on_connect)(void),
+   void (*on_data)(void),
+   void (*on_writable)(void),
+   void (*on_close)(void))
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      g_socket_events[socket_index].on_connect = on_connect;
+      g_socket_events[socket_index].on_data = on_data;
+      g_socket_events[socket_index].on_writable = on_writable;
+      g_socket_events[socket_index].on_close = on_close;
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_set_callback_thresholds(unsigned int port_num, unsigned int RX_bytes_threshold, unsigned int TX_space_threshold)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      // Note: A threshold of 0 would make the "greater than or equal" checks
+      // always true, so bump it up to 1.
+      g_socket_events[socket_index].RX_bytes_threshold = (0 == RX_bytes_threshold) ? 1 : RX_bytes_threshold;
+      g_socket_events[socket_index].TX_space_threshold = (0 == TX_space_threshold) ? 1 : TX_space_threshold;
+
+      // re-arm the "writable" edge against the new threshold
+      g_socket_events[socket_index].prev_space_in_TX = 0;
+   }
+
+   return this_ret_val;
+}
+
+void TCPIP_use_function_queue_for_callbacks(int use_queue)
+{
+   g_use_function_queue_for_callbacks = use_queue;
+}
+
+static int is_valid_field_size(unsigned int field_bytes)
+{
+   return (1 == field_bytes) || (2 == field_bytes) || (4 == field_bytes);
+}
+
+int TCPIP_set_delimiter_framing(unsigned int port_num, const unsigned char *delimiter, unsigned int delimiter_length)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   SOCKET_FRAMING *framing_ptr = 0;
+
+   if (0 == delimiter)
+   {
+      // bad pointer
+      this_ret_val = -1;
+   }
+   else if ((0 == delimiter_length) || (delimiter_length > MAX_DELIMITER_BYTES))
+   {
+      // can't search for nothing, and we can only remember so much
+      this_ret_val = -2;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      framing_ptr = &g_socket_framing[socket_index];
+      memset((void*)framing_ptr, 0x00, sizeof(SOCKET_FRAMING));
+      framing_ptr->framing_type = TCPIP_FRAMING_DELIMITER;
+      memcpy((void*)framing_ptr->delimiter, (const void*)delimiter, delimiter_length);
+      framing_ptr->delimiter_length = delimiter_length;
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_set_length_prefix_framing(unsigned int port_num, unsigned int length_bytes)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   SOCKET_FRAMING *framing_ptr = 0;
+
+   if (!is_valid_field_size(length_bytes))
+   {
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      framing_ptr = &g_socket_framing[socket_index];
+      memset((void*)framing_ptr, 0x00, sizeof(SOCKET_FRAMING));
+      framing_ptr->framing_type = TCPIP_FRAMING_LENGTH_PREFIX;
+      framing_ptr->length_bytes = length_bytes;
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_set_TLV_framing(unsigned int port_num, unsigned int type_bytes, unsigned int length_bytes)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   SOCKET_FRAMING *framing_ptr = 0;
+
+   if (!is_valid_field_size(type_bytes) || !is_valid_field_size(length_bytes))
+   {
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      framing_ptr = &g_socket_framing[socket_index];
+      memset((void*)framing_ptr, 0x00, sizeof(SOCKET_FRAMING));
+      framing_ptr->framing_type = TCPIP_FRAMING_TLV;
+      framing_ptr->type_bytes = type_bytes;
+      framing_ptr->length_bytes = length_bytes;
+   }
+
+   return this_ret_val;
+}
+
+static unsigned long peek_big_endian_field(int socket_index, unsigned long offset, unsigned int field_bytes)
+{
+   unsigned char field[4];
+   unsigned long value = 0;
+   unsigned int count = 0;
+
+   // Note: The caller must have already checked that the bytes are there.
+   backend_peek(socket_index, field, field_bytes, offset);
+   for (count = 0; count < field_bytes; count += 1)
+   {
+      value = (value << 8) | field[count];
+   }
+
+   return value;
+}
+
+// Looks for a complete frame at the front of the socket's RX FIFO without
+// removing anything.
+// Returns 1 if a frame is ready, 0 if not (yet), and -1 if the frame can never
+// be completed because it can't fit in the RX FIFO.  On success, the header
+// size, payload size, and trailer (delimiter) size are filled in.
+static int find_frame(int socket_index, unsigned long *header_bytes_ptr, unsigned long *payload_bytes_ptr, unsigned long *trailer_bytes_ptr, unsigned long *frame_type_ptr)
+{
+   int this_ret_val = 0;
+   SOCKET_FRAMING *framing_ptr = &g_socket_framing[socket_index];
+   unsigned long bytes_in_rx_buffer = 0;
+   unsigned long rx_buffer_capacity = 0;
+   unsigned long header_bytes = 0;
+   long delimiter_offset = 0;
+   unsigned long payload_bytes = 0;
+
+   bytes_in_rx_buffer = backend_bytes_in_RX(socket_index);
+   rx_buffer_capacity = bytes_in_rx_buffer + backend_space_in_RX(socket_index);
+   *frame_type_ptr = 0;
+
+   if (TCPIP_FRAMING_DELIMITER == framing_ptr->framing_type)
+   {
+      // Note: The search offset only holds while the RX FIFO keeps the bytes
+      // it was computed against.  If it got emptied some other way (a reset,
+      // for instance), start over from the front.
+      if (framing_ptr->delimiter_search_start > bytes_in_rx_buffer)
+      {
+         framing_ptr->delimiter_search_start = 0;
+      }
+
+      delimiter_offset = -1;
+      if (bytes_in_rx_buffer > framing_ptr->delimiter_search_start)
+      {
+         delimiter_offset = backend_find(socket_index,
+            framing_ptr->delimiter,
+            framing_ptr->delimiter_length,
+            framing_ptr->delimiter_search_start);
+      }
+
+      if (delimiter_offset < 0)
+      {
+         if (bytes_in_rx_buffer >= rx_buffer_capacity)
+         {
+            // the FIFO is full and there's still no delimiter, so this frame
+            // will never finish
+            this_ret_val = -1;
+         }
+         else if (bytes_in_rx_buffer >= framing_ptr->delimiter_length)
+         {
+            // don't search these bytes again, but back up enough to catch a
+            // delimiter that is only partially here
+            framing_ptr->delimiter_search_start = bytes_in_rx_buffer - (framing_ptr->delimiter_length - 1);
+         }
+      }
+      else
+      {
+         *header_bytes_ptr = 0;
+         *payload_bytes_ptr = (unsigned long)delimiter_offset;
+         *trailer_bytes_ptr = framing_ptr->delimiter_length;
+         this_ret_val = 1;
+      }
+   }
+   else if ((TCPIP_FRAMING_LENGTH_PREFIX == framing_ptr->framing_type) ||
+      (TCPIP_FRAMING_TLV == framing_ptr->framing_type))
+   {
+      // TLV is just a length prefix with a type in front of it
+      header_bytes = framing_ptr->type_bytes + framing_ptr->length_bytes;
+      if (header_bytes > rx_buffer_capacity)
+      {
+         // not even the header fits in the FIFO, so this frame will never
+         // finish
+         // Note: This has to be checked first, or the capacity left for the
+         // payload below would wrap around to a huge number.
+         this_ret_val = -1;
+      }
+      else if (bytes_in_rx_buffer >= header_bytes)
+      {
+         if (framing_ptr->type_bytes > 0)
+         {
+            *frame_type_ptr = peek_big_endian_field(socket_index, 0, framing_ptr->type_bytes);
+         }
+         payload_bytes = peek_big_endian_field(socket_index, framing_ptr->type_bytes, framing_ptr->length_bytes);
+
+         if (payload_bytes > rx_buffer_capacity - header_bytes)
+         {
+            // the sender says that the frame is bigger than the FIFO can ever
+            // hold, so it will never finish
+            this_ret_val = -1;
+         }
+         else if (bytes_in_rx_buffer >= header_bytes + payload_bytes)
+         {
+            *header_bytes_ptr = header_bytes;
+            *payload_bytes_ptr = payload_bytes;
+            *trailer_bytes_ptr = 0;
+            this_ret_val = 1;
+         }
+      }
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_peek_frame(unsigned int port_num, unsigned int *payload_length_ptr, unsigned long *frame_type_ptr)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   unsigned long header_bytes = 0;
+   unsigned long payload_bytes = 0;
+   unsigned long trailer_bytes = 0;
+   unsigned long frame_type = 0;
+
+   if (0 == payload_length_ptr)
+   {
+      // bad pointer
+      // Note: The frame type pointer is optional.
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+      else if (TCPIP_FRAMING_NONE == g_socket_framing[socket_index].framing_type)
+      {
+         // nobody told us how to find frames on this port
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      this_ret_val = find_frame(socket_index, &header_bytes, &payload_bytes, &trailer_bytes, &frame_type);
+      if (this_ret_val < 0)
+      {
+         // framing error; the only way out is to close the connection
+         this_ret_val = -4;
+      }
+      else if (1 == this_ret_val)
+      {
+         *payload_length_ptr = (unsigned int)payload_bytes;
+         if (0 != frame_type_ptr)
+         {
+            *frame_type_ptr = frame_type;
+         }
+      }
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_receive_frame(unsigned int port_num, unsigned char *byte_buffer, unsigned int max_buffer_size)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   unsigned long header_bytes = 0;
+   unsigned long payload_bytes = 0;
+   unsigned long trailer_bytes = 0;
+   unsigned long frame_type = 0;
+
+   if (0 == byte_buffer)
+   {
+      // bad pointer
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+      else if (TCPIP_FRAMING_NONE == g_socket_framing[socket_index].framing_type)
+      {
+         // nobody told us how to find frames on this port
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      switch (find_frame(socket_index, &header_bytes, &payload_bytes, &trailer_bytes, &frame_type))
+      {
+      case 1:
+         // got one
+         break;
+      case 0:
+         // no complete frame yet
+         this_ret_val = -4;
+         break;
+      default:
+         // framing error; the only way out is to close the connection
+         this_ret_val = -5;
+         break;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      if (payload_bytes > max_buffer_size)
+      {
+         // the frame won't fit, so leave it in the FIFO
+         // Note: Use TCPIP_peek_frame(...) to find out how big it is.
+         g_socket_stats[socket_index].receives_rejected += 1;
+         this_ret_val = -6;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      update_FIFO_stats(socket_index);
+
+      // throw away the header in the FIFO, copy out the payload, then throw
+      // away the delimiter (if any)
+      // Note: "Get" with a null buffer just moves the FIFO's read pointer, so
+      // nothing gets copied except the payload.
+      if (header_bytes > 0)
+      {
+         backend_get(socket_index, 0, header_bytes);
+      }
+      if (payload_bytes > 0)
+      {
+         backend_get(socket_index, byte_buffer, payload_bytes);
+      }
+      if (trailer_bytes > 0)
+      {
+         backend_get(socket_index, 0, trailer_bytes);
+      }
+
+      // the next frame starts at the front of the FIFO, so search from there
+      g_socket_framing[socket_index].delimiter_search_start = 0;
+
+      // Note: Count everything that left the FIFO, not just the payload.
+      g_socket_stats[socket_index].bytes_received += header_bytes + payload_bytes + trailer_bytes;
+
+      this_ret_val = (int)payload_bytes;
+      backend_FIFOs_changed(socket_index);
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_get_port_stats(unsigned int port_num, TCPIP_PORT_STATS *stats_ptr)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   if (0 == stats_ptr)
+   {
+      // bad pointer
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      memcpy((void*)stats_ptr, (const void*)&g_socket_stats[socket_index], sizeof(TCPIP_PORT_STATS));
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_reset_port_stats(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   unsigned long current_connection_seconds = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      // Note: The current connection is still going, so keep its duration.
+      current_connection_seconds = g_socket_stats[socket_index].current_connection_seconds;
+      memset((void*)&g_socket_stats[socket_index], 0x00, sizeof(TCPIP_PORT_STATS));
+      g_socket_stats[socket_index].current_connection_seconds = current_connection_seconds;
+   }
+
+   return this_ret_val;
+}
+
+void TCPIP_set_stats_dump(void (*dump_function)(unsigned int port_num, const TCPIP_PORT_STATS *stats_ptr), unsigned int period_seconds)
+{
+   // Note: A null function turns the dump off.
+   g_stats_dump_function = dump_function;
+   g_stats_dump_period_ticks = (unsigned long)period_seconds * backend_ticks_per_second();
+   g_last_stats_dump_tick = backend_get_ticks();
+}
+
+int TCPIP_set_FIFO_profile(unsigned int port_num, TCPIP_FIFO_PROFILE profile)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   SOCKET_FIFO_PROFILE *profile_ptr = 0;
+
+   if (profile > TCPIP_FIFO_PROFILE_ADAPTIVE)
+   {
+      // not a profile
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_find_index_of_port_number(port_num);
+      if (socket_index < 0)
+      {
+         // couldn't find this port number, so we must not be using it
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      profile_ptr = &g_socket_FIFO_profiles[socket_index];
+      profile_ptr->profile = profile;
+      profile_ptr->adaptive_score = 0;
+      profile_ptr->last_sample_tick = backend_get_ticks();
+
+      // Note: Adaptive starts out balanced and moves from there.
+      profile_ptr->wanted_layout = (TCPIP_FIFO_PROFILE_ADAPTIVE == profile) ? TCPIP_FIFO_PROFILE_BALANCED : profile;
+
+      // try it now; if it doesn't work, "keep stack alive" will keep trying
+      apply_FIFO_layout(socket_index);
+   }
+
+   return this_ret_val;
+}
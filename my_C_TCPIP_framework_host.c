@@ -0,0 +1,835 @@
+// This is an alternative to my_C_TCPIP_framework.c for running the same
+// application code as an ordinary Linux process.  It is the POSIX backend of
+// the framework: the callbacks, framing, statistics, and FIFO profiles are
+// shared with the board in my_C_TCPIP_framework_common.c, and this file moves
+// the bytes with non-blocking POSIX sockets and epoll, so application logic
+// can be load tested on a PC without a board.
+// Note: Build either this file or my_C_TCPIP_framework.c, never both, and
+// always my_C_TCPIP_framework_common.c.  This file doesn't touch the
+// Microchip TCPIP stack at all, so none of the "TCPIP Stack" folder needs to
+// be built with it.
+//    gcc -o my_app my_app.c my_C_TCPIP_framework_common.c my_C_TCPIP_framework_host.c my_function_queue.c
+// Note: The behavior of the board is copied as closely as is reasonable:
+// - Each port is a server socket that talks to one client at a time.  Other
+//   clients wait in the listen backlog (the board keeps them in its SYN queue).
+// - Each port has a small TX and RX FIFO of the same sizes as on the board,
+//   so "is put ready" and "is get ready" give the same kind of answers, and
+//   application code that chokes on small FIFOs will choke here too.
+// - A connection stops counting as "connected" as soon as the other side
+//   closes it, and then gets cleaned up after a short close-wait time.
+// Note: If you want to serve hundreds of clients, open hundreds of ports and
+// compile with -DMAX_SOCKETS=<however many>.  The FIFO sizes can be changed
+// the same way.
+
+// accept4(...) is a Linux extension
+// Note: This must come before any system header is included.
+#define _GNU_SOURCE
+
+// for linking the definitions of the functions defined in this file with their
+// declarations
+#include "my_C_TCPIP_framework.h"
+#include "my_C_TCPIP_framework_backend.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// FIFO sizes for each socket
+// Note: These match the TX and RX sizes for TCP_PURPOSE_GENERIC_TCP_SERVER in
+// TCPSocketInitializer (TCPIPConfig.h).
+#ifndef TCPIP_HOST_TX_FIFO_SIZE
+#define TCPIP_HOST_TX_FIFO_SIZE 200
+#endif
+#ifndef TCPIP_HOST_RX_FIFO_SIZE
+#define TCPIP_HOST_RX_FIFO_SIZE 200
+#endif
+
+// how long, in milliseconds, a connection that the other side has closed is
+// kept around so that the user can read whatever is left in the RX FIFO
+// Note: Same as TCP_CLOSE_WAIT_TIMEOUT in TCP.c.
+#ifndef TCPIP_HOST_CLOSE_WAIT_MS
+#define TCPIP_HOST_CLOSE_WAIT_MS 200
+#endif
+
+// the number of clients that can be waiting on a busy port
+// Note: Same as TCP_SYN_QUEUE_MAX_ENTRIES in TCP.c.
+#ifndef TCPIP_HOST_LISTEN_BACKLOG
+#define TCPIP_HOST_LISTEN_BACKLOG 3
+#endif
+
+// the most epoll events that are handled on one pass of "keep stack alive"
+#ifndef TCPIP_HOST_MAX_EVENTS_PER_PASS
+#define TCPIP_HOST_MAX_EVENTS_PER_PASS 64
+#endif
+
+// the kernel's socket buffers are this many times the size of our FIFOs
+// Note: FIFO profiles change the kernel's send and receive buffer sizes along
+// with our own FIFO sizes, so that the kernel leans the same way we do.
+#ifndef TCPIP_HOST_KERNEL_BUFFER_SCALE
+#define TCPIP_HOST_KERNEL_BUFFER_SCALE 16
+#endif
+
+
+// a circular buffer that plays the part of a socket's TX or RX FIFO
+typedef struct fifo
+{
+   unsigned char *data_ptr;
+   unsigned int size;
+   unsigned int head;      // index of the oldest byte
+   unsigned int count;     // number of bytes in the FIFO
+} FIFO;
+
+// everything the host needs to know about one port
+// Note: The TX and RX FIFOs are carved out of one chunk of memory, the same
+// way that the board carves them out of one chunk of TCB memory.
+typedef struct host_socket
+{
+   int listen_fd;
+   int connection_fd;
+   int peer_closed;
+   int was_reset;
+   unsigned long long peer_closed_time_ms;
+   unsigned int epoll_events;
+   unsigned int TX_FIFO_size;    // the rest of the memory goes to RX
+   unsigned char fifo_memory[TCPIP_HOST_TX_FIFO_SIZE + TCPIP_HOST_RX_FIFO_SIZE];
+   FIFO TX_fifo;
+   FIFO RX_fifo;
+} HOST_SOCKET;
+
+// Note: The port used by each socket is kept in
+// my_C_TCPIP_framework_common.c, at the same index as the socket here.
+static HOST_SOCKET g_sockets[MAX_SOCKETS];
+
+// every listening and connected socket is watched by this
+static int g_epoll_fd = -1;
+
+// Note: Epoll hands back a 32bit value with each event.  The socket index is
+// stored in it, with the lowest bit set for listening sockets.
+#define EPOLL_DATA_LISTENER 1u
+#define EPOLL_DATA_FOR(index, is_listener) (((unsigned int)(index) << 1) | (is_listener))
+
+
+
+static unsigned long long get_time_ms(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return ((unsigned long long)now.tv_sec * 1000ull) + ((unsigned long long)now.tv_nsec / 1000000ull);
+}
+
+static void fifo_init(FIFO *fifo_ptr, unsigned char *data_ptr, unsigned int size)
+{
+   fifo_ptr->data_ptr = data_ptr;
+   fifo_ptr->size = size;
+   fifo_ptr->head = 0;
+   fifo_ptr->count = 0;
+}
+
+static unsigned int fifo_free(const FIFO *fifo_ptr)
+{
+   return fifo_ptr->size - fifo_ptr->count;
+}
+
+static unsigned int fifo_put(FIFO *fifo_ptr, const unsigned char *byte_buffer, unsigned int bytes_to_put)
+{
+   unsigned int count = 0;
+   unsigned int tail = 0;
+
+   if (bytes_to_put > fifo_free(fifo_ptr))
+   {
+      bytes_to_put = fifo_free(fifo_ptr);
+   }
+
+   tail = (fifo_ptr->head + fifo_ptr->count) % fifo_ptr->size;
+   for (count = 0; count < bytes_to_put; count += 1)
+   {
+      fifo_ptr->data_ptr[tail] = byte_buffer[count];
+      tail = (tail + 1) % fifo_ptr->size;
+   }
+   fifo_ptr->count += bytes_to_put;
+
+   return bytes_to_put;
+}
+
+// copies bytes out of the FIFO, starting "offset" bytes in, without removing
+// them
+static unsigned int fifo_peek(const FIFO *fifo_ptr, unsigned char *byte_buffer, unsigned int bytes_to_peek, unsigned int offset)
+{
+   unsigned int count = 0;
+   unsigned int index = 0;
+
+   if (offset >= fifo_ptr->count)
+   {
+      return 0;
+   }
+   if (bytes_to_peek > fifo_ptr->count - offset)
+   {
+      bytes_to_peek = fifo_ptr->count - offset;
+   }
+
+   index = (fifo_ptr->head + offset) % fifo_ptr->size;
+   for (count = 0; count < bytes_to_peek; count += 1)
+   {
+      byte_buffer[count] = fifo_ptr->data_ptr[index];
+      index = (index + 1) % fifo_ptr->size;
+   }
+
+   return bytes_to_peek;
+}
+
+// removes bytes from the front of the FIFO, copying them out if the buffer
+// isn't null
+static unsigned int fifo_get(FIFO *fifo_ptr, unsigned char *byte_buffer, unsigned int bytes_to_get)
+{
+   if (bytes_to_get > fifo_ptr->count)
+   {
+      bytes_to_get = fifo_ptr->count;
+   }
+
+   if (0 != byte_buffer)
+   {
+      fifo_peek(fifo_ptr, byte_buffer, bytes_to_get, 0);
+   }
+   fifo_ptr->head = (fifo_ptr->head + bytes_to_get) % fifo_ptr->size;
+   fifo_ptr->count -= bytes_to_get;
+   if (0 == fifo_ptr->count)
+   {
+      // keep the data in one piece for as long as possible
+      fifo_ptr->head = 0;
+   }
+
+   return bytes_to_get;
+}
+
+// returns the offset of the first byte of the first match at or after
+// "offset", or -1 if there isn't one
+// Note: Same idea as TCPFindArrayEx(...) in TCP.c.
+static int fifo_find(const FIFO *fifo_ptr, const unsigned char *pattern, unsigned int pattern_length, unsigned int offset)
+{
+   unsigned int start = 0;
+   unsigned int count = 0;
+
+   for (start = offset; start + pattern_length <= fifo_ptr->count; start += 1)
+   {
+      for (count = 0; count < pattern_length; count += 1)
+      {
+         if (fifo_ptr->data_ptr[(fifo_ptr->head + start + count) % fifo_ptr->size] != pattern[count])
+         {
+            break;
+         }
+      }
+
+      if (pattern_length == count)
+      {
+         return (int)start;
+      }
+   }
+
+   return -1;
+}
+
+// how many bytes can be read or written in one piece, starting at the head or
+// the tail of the FIFO
+static unsigned int fifo_contiguous_used(const FIFO *fifo_ptr)
+{
+   unsigned int bytes_until_wrap = fifo_ptr->size - fifo_ptr->head;
+
+   return (fifo_ptr->count < bytes_until_wrap) ? fifo_ptr->count : bytes_until_wrap;
+}
+
+static unsigned int fifo_contiguous_free(const FIFO *fifo_ptr)
+{
+   unsigned int tail = (fifo_ptr->head + fifo_ptr->count) % fifo_ptr->size;
+   unsigned int bytes_until_wrap = fifo_ptr->size - tail;
+
+   return (fifo_free(fifo_ptr) < bytes_until_wrap) ? fifo_free(fifo_ptr) : bytes_until_wrap;
+}
+
+static void reset_fifos(int socket_index)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+
+   fifo_init(&socket_ptr->TX_fifo, socket_ptr->fifo_memory, socket_ptr->TX_FIFO_size);
+   fifo_init(&socket_ptr->RX_fifo, socket_ptr->fifo_memory + socket_ptr->TX_FIFO_size, sizeof(socket_ptr->fifo_memory) - socket_ptr->TX_FIFO_size);
+}
+
+static void set_kernel_buffer_sizes(int socket_index, int fd)
+{
+   int buffer_size = 0;
+
+   buffer_size = (int)(g_sockets[socket_index].TX_FIFO_size * TCPIP_HOST_KERNEL_BUFFER_SCALE);
+   setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+   buffer_size = (int)((sizeof(g_sockets[socket_index].fifo_memory) - g_sockets[socket_index].TX_FIFO_size) * TCPIP_HOST_KERNEL_BUFFER_SCALE);
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+}
+
+static int is_connected(int socket_index)
+{
+   return (g_sockets[socket_index].connection_fd >= 0) && !g_sockets[socket_index].peer_closed;
+}
+
+// only ask epoll about things that we can actually do something about, or
+// else a full RX FIFO or an empty TX FIFO will wake it up on every pass
+static void update_epoll_interest(int socket_index)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+   struct epoll_event event;
+   unsigned int wanted_events = 0;
+
+   if (socket_ptr->connection_fd < 0)
+   {
+      return;
+   }
+
+   if (!socket_ptr->peer_closed && (fifo_free(&socket_ptr->RX_fifo) > 0))
+   {
+      wanted_events |= EPOLLIN;
+   }
+   if (socket_ptr->TX_fifo.count > 0)
+   {
+      wanted_events |= EPOLLOUT;
+   }
+
+   if (wanted_events != socket_ptr->epoll_events)
+   {
+      memset((void*)&event, 0x00, sizeof(event));
+      event.events = wanted_events;
+      event.data.u32 = EPOLL_DATA_FOR(socket_index, 0);
+      epoll_ctl(g_epoll_fd, EPOLL_CTL_MOD, socket_ptr->connection_fd, &event);
+      socket_ptr->epoll_events = wanted_events;
+   }
+}
+
+// turns listening on or off
+// Note: While a client is connected, other clients are left waiting in the
+// listen backlog.  Epoll would otherwise tell us about them on every pass.
+static void set_listening(int socket_index, int listen_for_clients)
+{
+   struct epoll_event event;
+
+   memset((void*)&event, 0x00, sizeof(event));
+   event.events = listen_for_clients ? EPOLLIN : 0;
+   event.data.u32 = EPOLL_DATA_FOR(socket_index, EPOLL_DATA_LISTENER);
+   epoll_ctl(g_epoll_fd, EPOLL_CTL_MOD, g_sockets[socket_index].listen_fd, &event);
+}
+
+static void drop_connection(int socket_index)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+
+   if (socket_ptr->connection_fd >= 0)
+   {
+      // Note: Closing the file descriptor also takes it out of epoll.
+      close(socket_ptr->connection_fd);
+      socket_ptr->connection_fd = -1;
+
+      // Note: The board's stack flags a reset every time a connection is
+      // closed, for any reason, so do the same.
+      socket_ptr->was_reset = 1;
+   }
+
+   socket_ptr->peer_closed = 0;
+   socket_ptr->epoll_events = 0;
+   reset_fifos(socket_index);
+
+   // start waiting for the next client
+   set_listening(socket_index, 1);
+}
+
+static void accept_connection(int socket_index)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+   struct epoll_event event;
+   int new_fd = 0;
+   int flag = 1;
+
+   if (socket_ptr->connection_fd >= 0)
+   {
+      // already talking to someone
+      return;
+   }
+
+   new_fd = accept4(socket_ptr->listen_fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+   if (new_fd < 0)
+   {
+      // the client gave up before we got to it, or something else went wrong;
+      // either way, try again next time
+      return;
+   }
+
+   // Note: The framework already collects small writes in the TX FIFO, so
+   // don't let the kernel delay them again.
+   setsockopt(new_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+   set_kernel_buffer_sizes(socket_index, new_fd);
+
+   socket_ptr->connection_fd = new_fd;
+   socket_ptr->peer_closed = 0;
+   reset_fifos(socket_index);
+
+   memset((void*)&event, 0x00, sizeof(event));
+   event.events = EPOLLIN;
+   event.data.u32 = EPOLL_DATA_FOR(socket_index, 0);
+   if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, new_fd, &event) < 0)
+   {
+      close(new_fd);
+      socket_ptr->connection_fd = -1;
+      return;
+   }
+   socket_ptr->epoll_events = EPOLLIN;
+
+   // one client at a time
+   set_listening(socket_index, 0);
+}
+
+// moves as much as possible from the TX FIFO to the kernel
+static void flush_TX(int socket_index)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+   ssize_t bytes_sent = 0;
+
+   while ((socket_ptr->connection_fd >= 0) && (socket_ptr->TX_fifo.count > 0))
+   {
+      bytes_sent = send(socket_ptr->connection_fd,
+         socket_ptr->TX_fifo.data_ptr + socket_ptr->TX_fifo.head,
+         fifo_contiguous_used(&socket_ptr->TX_fifo),
+         MSG_NOSIGNAL);
+      if (bytes_sent > 0)
+      {
+         fifo_get(&socket_ptr->TX_fifo, 0, (unsigned int)bytes_sent);
+      }
+      else if ((bytes_sent < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+      {
+         // the kernel is full; epoll will tell us when there's room
+         break;
+      }
+      else if ((bytes_sent < 0) && (EINTR == errno))
+      {
+         // try again
+      }
+      else
+      {
+         // the connection is broken
+         drop_connection(socket_index);
+      }
+   }
+}
+
+// moves as much as possible from the kernel to the RX FIFO
+static void fill_RX(int socket_index)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+   FIFO *fifo_ptr = &socket_ptr->RX_fifo;
+   ssize_t bytes_read = 0;
+
+   while ((socket_ptr->connection_fd >= 0) && !socket_ptr->peer_closed && (fifo_free(fifo_ptr) > 0))
+   {
+      bytes_read = recv(socket_ptr->connection_fd,
+         fifo_ptr->data_ptr + ((fifo_ptr->head + fifo_ptr->count) % fifo_ptr->size),
+         fifo_contiguous_free(fifo_ptr),
+         0);
+      if (bytes_read > 0)
+      {
+         fifo_ptr->count += (unsigned int)bytes_read;
+      }
+      else if (0 == bytes_read)
+      {
+         // the other side closed the connection
+         socket_ptr->peer_closed = 1;
+         socket_ptr->peer_closed_time_ms = get_time_ms();
+      }
+      else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+      {
+         // nothing more for now
+         break;
+      }
+      else if (EINTR == errno)
+      {
+         // try again
+      }
+      else
+      {
+         // the connection is broken
+         drop_connection(socket_index);
+      }
+   }
+}
+
+unsigned long backend_get_ticks(void)
+{
+   // Note: Ticks are milliseconds here.
+   return (unsigned long)get_time_ms();
+}
+
+unsigned long backend_ticks_since(unsigned long then_ticks)
+{
+   return (unsigned long)get_time_ms() - then_ticks;
+}
+
+unsigned long backend_ticks_per_second(void)
+{
+   return 1000;
+}
+
+int backend_is_connected(int socket_index)
+{
+   return is_connected(socket_index);
+}
+
+int backend_was_reset(int socket_index)
+{
+   int was_reset = g_sockets[socket_index].was_reset;
+
+   // Note: Like TCPWasReset(...), reading the flag clears it.
+   g_sockets[socket_index].was_reset = 0;
+   return was_reset;
+}
+
+unsigned long backend_bytes_in_TX(int socket_index)
+{
+   return g_sockets[socket_index].TX_fifo.count;
+}
+
+unsigned long backend_space_in_TX(int socket_index)
+{
+   // Note: Like TCPIsPutReady(...), there is no space unless someone is
+   // connected.
+   return is_connected(socket_index) ? fifo_free(&g_sockets[socket_index].TX_fifo) : 0;
+}
+
+unsigned long backend_bytes_in_RX(int socket_index)
+{
+   return g_sockets[socket_index].RX_fifo.count;
+}
+
+unsigned long backend_space_in_RX(int socket_index)
+{
+   return fifo_free(&g_sockets[socket_index].RX_fifo);
+}
+
+unsigned long backend_put(int socket_index, const unsigned char *byte_buffer, unsigned long bytes_to_put)
+{
+   return fifo_put(&g_sockets[socket_index].TX_fifo, byte_buffer, (unsigned int)bytes_to_put);
+}
+
+unsigned long backend_get(int socket_index, unsigned char *byte_buffer, unsigned long bytes_to_get)
+{
+   return fifo_get(&g_sockets[socket_index].RX_fifo, byte_buffer, (unsigned int)bytes_to_get);
+}
+
+unsigned long backend_peek(int socket_index, unsigned char *byte_buffer, unsigned long bytes_to_peek, unsigned long offset)
+{
+   return fifo_peek(&g_sockets[socket_index].RX_fifo, byte_buffer, (unsigned int)bytes_to_peek, (unsigned int)offset);
+}
+
+long backend_find(int socket_index, const unsigned char *pattern, unsigned int pattern_length, unsigned long offset)
+{
+   return fifo_find(&g_sockets[socket_index].RX_fifo, pattern, pattern_length, (unsigned int)offset);
+}
+
+void backend_FIFOs_changed(int socket_index)
+{
+   // Note: The board holds onto small amounts of data for a little while in
+   // case more is coming.  The kernel is much better at that than we are, so
+   // hand it over right away, and pull in anything the kernel is holding now
+   // that there may be room for it.
+   flush_TX(socket_index);
+   fill_RX(socket_index);
+   update_epoll_interest(socket_index);
+}
+
+unsigned long backend_FIFO_memory_size(int socket_index)
+{
+   return sizeof(g_sockets[socket_index].fifo_memory);
+}
+
+// moves the line between the TX and RX FIFOs
+// Note: Like the board, data waiting in either FIFO is kept, as long as it
+// fits in the new FIFO.  Otherwise this refuses and gets tried again later.
+int backend_set_FIFO_split(int socket_index, TCPIP_FIFO_PROFILE layout, unsigned long new_TX_size, unsigned long total_FIFO_size)
+{
+   HOST_SOCKET *socket_ptr = &g_sockets[socket_index];
+   unsigned char TX_data[TCPIP_HOST_TX_FIFO_SIZE + TCPIP_HOST_RX_FIFO_SIZE];
+   unsigned char RX_data[TCPIP_HOST_TX_FIFO_SIZE + TCPIP_HOST_RX_FIFO_SIZE];
+   unsigned int TX_bytes = 0;
+   unsigned int RX_bytes = 0;
+
+   // Note: On the board, "balanced" means the split that TCPSocketInitializer
+   // gives a fresh socket, and the FIFO sizes here copy it, so use it even if
+   // it isn't an even split.
+   if (TCPIP_FIFO_PROFILE_BALANCED == layout)
+   {
+      new_TX_size = TCPIP_HOST_TX_FIFO_SIZE;
+   }
+
+   if ((socket_ptr->TX_fifo.count > new_TX_size) ||
+      (socket_ptr->RX_fifo.count > total_FIFO_size - new_TX_size))
+   {
+      // data is in the way
+      return 0;
+   }
+
+   TX_bytes = fifo_get(&socket_ptr->TX_fifo, TX_data, socket_ptr->TX_fifo.count);
+   RX_bytes = fifo_get(&socket_ptr->RX_fifo, RX_data, socket_ptr->RX_fifo.count);
+   socket_ptr->TX_FIFO_size = (unsigned int)new_TX_size;
+   reset_fifos(socket_index);
+   fifo_put(&socket_ptr->TX_fifo, TX_data, TX_bytes);
+   fifo_put(&socket_ptr->RX_fifo, RX_data, RX_bytes);
+
+   if (socket_ptr->connection_fd >= 0)
+   {
+      set_kernel_buffer_sizes(socket_index, socket_ptr->connection_fd);
+   }
+
+   return 1;
+}
+
+int backend_get_RTT_ms(int socket_index, unsigned long *RTT_ms_ptr)
+{
+   struct tcp_info info;
+   socklen_t info_size = sizeof(info);
+
+   // Note: The kernel does the RTT estimation on this side, so just report
+   // its smoothed value (microseconds).
+   if ((g_sockets[socket_index].connection_fd >= 0) &&
+      (0 == getsockopt(g_sockets[socket_index].connection_fd, IPPROTO_TCP, TCP_INFO, &info, &info_size)))
+   {
+      *RTT_ms_ptr = info.tcpi_rtt / 1000;
+      return 0;
+   }
+
+   return -1;
+}
+
+
+
+void TCPIP_and_wifi_stack_init(const char *wifi_SSID, const char *wifi_password)
+{
+   int count = 0;
+
+   // Note: There is no wifi here; the PC is already on the network.
+   (void)wifi_SSID;
+   (void)wifi_password;
+
+   framework_init_sockets();
+   for (count = 0; count < MAX_SOCKETS; count += 1)
+   {
+      g_sockets[count].listen_fd = -1;
+      g_sockets[count].connection_fd = -1;
+   }
+
+   if (g_epoll_fd < 0)
+   {
+      g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   }
+}
+
+void TCPIP_keep_stack_alive(void)
+{
+   struct epoll_event events[TCPIP_HOST_MAX_EVENTS_PER_PASS];
+   int event_count = 0;
+   int count = 0;
+   int socket_index = 0;
+   unsigned long long now = 0;
+
+   // see what happened on the network since the last pass
+   // Note: Don't wait.  On the board, this function returns right away, and
+   // application code is written expecting that.
+   event_count = epoll_wait(g_epoll_fd, events, TCPIP_HOST_MAX_EVENTS_PER_PASS, 0);
+   for (count = 0; count < event_count; count += 1)
+   {
+      socket_index = (int)(events[count].data.u32 >> 1);
+      if (0 == framework_port_number(socket_index))
+      {
+         // closed earlier in this pass
+         continue;
+      }
+
+      if (events[count].data.u32 & EPOLL_DATA_LISTENER)
+      {
+         accept_connection(socket_index);
+      }
+      else
+      {
+         if (events[count].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+         {
+            fill_RX(socket_index);
+         }
+         if (events[count].events & EPOLLOUT)
+         {
+            flush_TX(socket_index);
+         }
+      }
+   }
+
+   // finish off connections that the other side closed, then look for
+   // anything that changed on our sockets
+   now = get_time_ms();
+   for (count = 0; count < MAX_SOCKETS; count += 1)
+   {
+      if (0 == framework_port_number(count))
+      {
+         continue;
+      }
+
+      if (g_sockets[count].peer_closed &&
+         ((0 == g_sockets[count].RX_fifo.count) || (now - g_sockets[count].peer_closed_time_ms >= TCPIP_HOST_CLOSE_WAIT_MS)))
+      {
+         flush_TX(count);
+         drop_connection(count);
+      }
+
+      framework_service_socket(count);
+      update_epoll_interest(count);
+   }
+
+   framework_dump_stats();
+}
+
+void TCPIP_get_IP_address(unsigned char *ip_first, unsigned char *ip_second, unsigned char *ip_third, unsigned char *ip_fourth)
+{
+   struct ifaddrs *interface_list_ptr = 0;
+   struct ifaddrs *interface_ptr = 0;
+   unsigned long address = INADDR_LOOPBACK;
+
+   // use the first IPv4 address that isn't loopback, or loopback if there
+   // isn't one
+   if (0 == getifaddrs(&interface_list_ptr))
+   {
+      for (interface_ptr = interface_list_ptr; 0 != interface_ptr; interface_ptr = interface_ptr->ifa_next)
+      {
+         if ((0 != interface_ptr->ifa_addr) && (AF_INET == interface_ptr->ifa_addr->sa_family))
+         {
+            if (INADDR_LOOPBACK != ntohl(((struct sockaddr_in*)interface_ptr->ifa_addr)->sin_addr.s_addr))
+            {
+               address = ntohl(((struct sockaddr_in*)interface_ptr->ifa_addr)->sin_addr.s_addr);
+               break;
+            }
+         }
+      }
+      freeifaddrs(interface_list_ptr);
+   }
+
+   *ip_first = (unsigned char)(address >> 24);
+   *ip_second = (unsigned char)(address >> 16);
+   *ip_third = (unsigned char)(address >> 8);
+   *ip_fourth = (unsigned char)address;
+}
+
+
+int TCPIP_open_socket(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+   int listen_fd = -1;
+   int flag = 1;
+   struct sockaddr_in address;
+   struct epoll_event event;
+
+   if ((0 == port_num) || (port_num > 0xFFFF))
+   {
+      // Note: The board would accept these, then fail to find them later.
+      this_ret_val = -3;
+   }
+   else if (framework_find_index_of_port_number(port_num) >= 0)
+   {
+      // already in use; abort
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      socket_index = framework_get_next_available_socket_index();
+      if (socket_index < 0)
+      {
+         // no index available
+         this_ret_val = -2;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (listen_fd < 0)
+      {
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+      memset((void*)&address, 0x00, sizeof(address));
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_ANY);
+      address.sin_port = htons((unsigned short)port_num);
+
+      memset((void*)&event, 0x00, sizeof(event));
+      event.events = EPOLLIN;
+      event.data.u32 = EPOLL_DATA_FOR(socket_index, EPOLL_DATA_LISTENER);
+
+      if ((bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0) ||
+         (listen(listen_fd, TCPIP_HOST_LISTEN_BACKLOG) < 0) ||
+         (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0))
+      {
+         close(listen_fd);
+         this_ret_val = -3;
+      }
+   }
+
+   if (0 == this_ret_val)
+   {
+      // socket opened ok, so do some book keeping
+      g_sockets[socket_index].listen_fd = listen_fd;
+      g_sockets[socket_index].connection_fd = -1;
+      g_sockets[socket_index].peer_closed = 0;
+      g_sockets[socket_index].was_reset = 0;
+      g_sockets[socket_index].epoll_events = 0;
+      g_sockets[socket_index].TX_FIFO_size = TCPIP_HOST_TX_FIFO_SIZE;
+      reset_fifos(socket_index);
+      framework_open_port(socket_index, port_num);
+   }
+
+   return this_ret_val;
+}
+
+int TCPIP_close_socket(unsigned int port_num)
+{
+   int this_ret_val = 0;
+   int socket_index = 0;
+
+   socket_index = framework_find_index_of_port_number(port_num);
+   if (socket_index < 0)
+   {
+      // couldn't find this port number, so we must not be using it
+      this_ret_val = -1;
+   }
+
+   if (0 == this_ret_val)
+   {
+      if (g_sockets[socket_index].connection_fd >= 0)
+      {
+         // try to get out whatever the user already sent
+         flush_TX(socket_index);
+      }
+      if (g_sockets[socket_index].connection_fd >= 0)
+      {
+         close(g_sockets[socket_index].connection_fd);
+         g_sockets[socket_index].connection_fd = -1;
+      }
+      close(g_sockets[socket_index].listen_fd);
+      g_sockets[socket_index].listen_fd = -1;
+      framework_close_port(socket_index);
+   }
+
+   return this_ret_val;
+}
@@ -0,0 +1,478 @@
+// This load tests my_C_TCPIP_framework_host.c over loopback.  The
+// application side is the usual board-style main loop: open a port per
+// client, call TCPIP_keep_stack_alive(), and echo whatever arrives with
+// TCPIP_basic_receive() and TCPIP_basic_send().  The clients are ordinary
+// non-blocking Linux sockets in the same process, each sending a request,
+// waiting for all of the echo and checking it, then sending the next one.
+//    gcc -O2 -DMAX_SOCKETS=1024 -o loopback_bench my_C_TCPIP_loopback_bench_host.c my_C_TCPIP_framework_common.c my_C_TCPIP_framework_host.c my_function_queue.c
+//    ./loopback_bench [-c clients] [-p ports] [-b base_port] [-t seconds]
+//       [-n request_bytes] [-r requests_per_connection]
+// Note: Client i connects to port base_port + (i % ports).  With fewer ports
+// than clients, the extra clients wait in the listen backlog (as they would
+// in the board's SYN queue) until the client ahead of them hangs up, so use
+// -r to make clients take turns.  -r 0 keeps every connection open.
+// Note: The framework and this file must be built with the same MAX_SOCKETS,
+// and ports can't be more than that.
+// Note: Everything runs on one thread, so the latency includes the time it
+// takes the main loop to get around to each port, just as on the board.
+// Note: The run fails if any echoed byte is wrong or no request completes.
+
+// for the framework under test
+#include "my_C_TCPIP_framework.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Note: Same default as in my_C_TCPIP_framework_host.c.
+#ifndef MAX_SOCKETS
+#define MAX_SOCKETS 5
+#endif
+
+// the largest request, so one fits in a port's 200 byte FIFOs
+#define MAX_REQUEST_BYTES 200
+
+// the most clients
+#define MAX_CLIENTS 4096
+
+// how long a client waits for a connection or an echo before giving up
+#define CLIENT_TIMEOUT_NS 5000000000ull
+
+// latency is counted in buckets of this many nanoseconds, up to one second
+#define LATENCY_BUCKET_NS 10000ull
+#define LATENCY_BUCKETS 100000u
+
+// what a client is doing
+typedef enum
+{
+   CLIENT_OPEN = 0,
+   CLIENT_CONNECTING,
+   CLIENT_SENDING,
+   CLIENT_RECEIVING
+} CLIENT_STATE;
+
+// one client's state
+typedef struct client
+{
+   int fd;
+   CLIENT_STATE state;
+   unsigned int port_num;
+   unsigned long request;
+   unsigned long requests_this_connection;
+   unsigned int bytes_done;
+   unsigned long long started_ns;
+   unsigned char request_bytes[MAX_REQUEST_BYTES];
+} CLIENT;
+
+static CLIENT g_clients[MAX_CLIENTS];
+static unsigned int g_client_count = 100;
+static unsigned int g_port_count = 0;
+static unsigned int g_base_port = 9760;
+static unsigned int g_request_bytes = 64;
+static unsigned long g_requests_per_connection = 0;
+static int g_client_epoll_fd = -1;
+
+// totals
+static unsigned long g_completed = 0;
+static unsigned long g_connections = 0;
+static unsigned long g_timeouts = 0;
+static unsigned long g_resets = 0;
+static unsigned long g_bad_bytes = 0;
+static unsigned long long g_latency_total_ns = 0;
+static unsigned long long g_latency_max_ns = 0;
+static unsigned long g_latency_buckets[LATENCY_BUCKETS];
+
+static unsigned long long get_time_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return ((unsigned long long)now.tv_sec * 1000000000ull) + (unsigned long long)now.tv_nsec;
+}
+
+// the byte at offset of a client's request
+// Note: Different for every client and request, so a crossed connection or
+// a stale echo shows up as bad bytes.
+static unsigned char request_byte(unsigned int client, unsigned long request, unsigned int offset)
+{
+   return (unsigned char)((client * 131u) + (request * 29u) + (offset * 7u) + 1u);
+}
+
+// the application: echo everything on every port
+static void server_task(void)
+{
+   static unsigned char buffer[MAX_REQUEST_BYTES * 2 + 1];
+   unsigned int port = 0;
+   int RX_bytes = 0;
+   int TX_space = 0;
+   int received = 0;
+
+   for (port = 0; port < g_port_count; port += 1)
+   {
+      RX_bytes = TCPIP_bytes_in_RX_FIFO(g_base_port + port);
+      if (RX_bytes <= 0)
+      {
+         continue;
+      }
+
+      // Note: TCPIP_basic_send(...) won't take part of a buffer, so only
+      // read what can be echoed right away.  Like TCPIsPutReady(...),
+      // TCPIP_bytes_in_TX_FIFO(...) is the free space.
+      TX_space = TCPIP_bytes_in_TX_FIFO(g_base_port + port);
+      if (RX_bytes > TX_space)
+      {
+         continue;
+      }
+
+      received = TCPIP_basic_receive(g_base_port + port, buffer, sizeof(buffer));
+      if (received > 0)
+      {
+         TCPIP_basic_send(g_base_port + port, buffer, (unsigned int)received);
+      }
+   }
+}
+
+static void client_watch(CLIENT *client_ptr, unsigned int client, unsigned int events)
+{
+   struct epoll_event event;
+
+   memset((void*)&event, 0x00, sizeof(event));
+   event.events = events;
+   event.data.u32 = client;
+   epoll_ctl(g_client_epoll_fd, EPOLL_CTL_MOD, client_ptr->fd, &event);
+}
+
+static void client_close(CLIENT *client_ptr)
+{
+   if (client_ptr->fd >= 0)
+   {
+      // Note: Closing removes the socket from the epoll set.
+      close(client_ptr->fd);
+      client_ptr->fd = -1;
+   }
+   client_ptr->state = CLIENT_OPEN;
+}
+
+static void client_open(CLIENT *client_ptr, unsigned int client, unsigned long long now_ns)
+{
+   struct sockaddr_in address;
+   struct epoll_event event;
+   int flag = 1;
+
+   client_ptr->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if (client_ptr->fd < 0)
+   {
+      return;
+   }
+   setsockopt(client_ptr->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+   memset((void*)&address, 0x00, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons((unsigned short)client_ptr->port_num);
+
+   memset((void*)&event, 0x00, sizeof(event));
+   event.events = EPOLLOUT;
+   event.data.u32 = client;
+   if (((connect(client_ptr->fd, (struct sockaddr*)&address, sizeof(address)) < 0) && (EINPROGRESS != errno)) ||
+      (epoll_ctl(g_client_epoll_fd, EPOLL_CTL_ADD, client_ptr->fd, &event) < 0))
+   {
+      client_close(client_ptr);
+      return;
+   }
+
+   client_ptr->state = CLIENT_CONNECTING;
+   client_ptr->requests_this_connection = 0;
+   client_ptr->started_ns = now_ns;
+}
+
+static void client_start_request(CLIENT *client_ptr, unsigned int client, unsigned long long now_ns)
+{
+   unsigned int offset = 0;
+
+   for (offset = 0; offset < g_request_bytes; offset += 1)
+   {
+      client_ptr->request_bytes[offset] = request_byte(client, client_ptr->request, offset);
+   }
+   client_ptr->bytes_done = 0;
+   client_ptr->started_ns = now_ns;
+   client_ptr->state = CLIENT_SENDING;
+   client_watch(client_ptr, client, EPOLLOUT);
+}
+
+static void client_finish_request(CLIENT *client_ptr, unsigned int client, unsigned long long now_ns)
+{
+   unsigned long long latency_ns = now_ns - client_ptr->started_ns;
+   unsigned long long bucket = latency_ns / LATENCY_BUCKET_NS;
+
+   g_completed += 1;
+   g_latency_total_ns += latency_ns;
+   if (latency_ns > g_latency_max_ns)
+   {
+      g_latency_max_ns = latency_ns;
+   }
+   g_latency_buckets[(bucket < LATENCY_BUCKETS) ? bucket : (LATENCY_BUCKETS - 1)] += 1;
+
+   client_ptr->request += 1;
+   client_ptr->requests_this_connection += 1;
+   if ((g_requests_per_connection != 0) &&
+      (client_ptr->requests_this_connection >= g_requests_per_connection))
+   {
+      client_close(client_ptr);
+   }
+   else
+   {
+      client_start_request(client_ptr, client, now_ns);
+   }
+}
+
+static void client_event(unsigned int client, unsigned int events, unsigned long long now_ns)
+{
+   CLIENT *client_ptr = &g_clients[client];
+   unsigned char buffer[MAX_REQUEST_BYTES];
+   socklen_t length = sizeof(int);
+   int error = 0;
+   ssize_t bytes = 0;
+   ssize_t count = 0;
+
+   switch (client_ptr->state)
+   {
+   case CLIENT_CONNECTING:
+      getsockopt(client_ptr->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      if ((error != 0) || (events & (EPOLLERR | EPOLLHUP)))
+      {
+         g_resets += 1;
+         client_close(client_ptr);
+         break;
+      }
+      g_connections += 1;
+      client_start_request(client_ptr, client, now_ns);
+      break;
+
+   case CLIENT_SENDING:
+      bytes = send(client_ptr->fd, client_ptr->request_bytes + client_ptr->bytes_done,
+         g_request_bytes - client_ptr->bytes_done, MSG_NOSIGNAL);
+      if (bytes < 0)
+      {
+         if ((EAGAIN != errno) && (EINTR != errno))
+         {
+            g_resets += 1;
+            client_close(client_ptr);
+         }
+         break;
+      }
+      client_ptr->bytes_done += (unsigned int)bytes;
+      if (client_ptr->bytes_done >= g_request_bytes)
+      {
+         client_ptr->bytes_done = 0;
+         client_ptr->state = CLIENT_RECEIVING;
+         client_watch(client_ptr, client, EPOLLIN);
+      }
+      break;
+
+   case CLIENT_RECEIVING:
+      bytes = recv(client_ptr->fd, buffer, g_request_bytes - client_ptr->bytes_done, 0);
+      if (bytes <= 0)
+      {
+         if ((0 == bytes) || ((EAGAIN != errno) && (EINTR != errno)))
+         {
+            // the board hung up or reset the connection mid request
+            g_resets += 1;
+            client_close(client_ptr);
+         }
+         break;
+      }
+      for (count = 0; count < bytes; count += 1)
+      {
+         if (buffer[count] != client_ptr->request_bytes[client_ptr->bytes_done + count])
+         {
+            g_bad_bytes += 1;
+         }
+      }
+      client_ptr->bytes_done += (unsigned int)bytes;
+      if (client_ptr->bytes_done >= g_request_bytes)
+      {
+         client_finish_request(client_ptr, client, now_ns);
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+// run the clients for one pass of the main loop
+static void client_task(unsigned long long now_ns)
+{
+   static unsigned int next_timeout_check = 0;
+   struct epoll_event events[256];
+   CLIENT *client_ptr = 0;
+   int event_count = 0;
+   int count = 0;
+   unsigned int client = 0;
+
+   event_count = epoll_wait(g_client_epoll_fd, events, 256, 0);
+   for (count = 0; count < event_count; count += 1)
+   {
+      if (g_clients[events[count].data.u32].fd >= 0)
+      {
+         client_event(events[count].data.u32, events[count].events, now_ns);
+      }
+   }
+
+   // Note: Only a slice of the clients is checked for timeouts and reopened
+   // on each pass, so that a large fleet doesn't slow down the main loop.
+   for (count = 0; count < 16; count += 1)
+   {
+      client = next_timeout_check;
+      next_timeout_check = (next_timeout_check + 1) % g_client_count;
+      client_ptr = &g_clients[client];
+
+      if (CLIENT_OPEN == client_ptr->state)
+      {
+         client_open(client_ptr, client, now_ns);
+      }
+      else if ((now_ns - client_ptr->started_ns) > CLIENT_TIMEOUT_NS)
+      {
+         g_timeouts += 1;
+         client_close(client_ptr);
+      }
+   }
+}
+
+// the latency below which the given fraction of requests completed
+static double latency_percentile_ms(double fraction)
+{
+   unsigned long long target = (unsigned long long)((double)g_completed * fraction);
+   unsigned long long seen = 0;
+   unsigned int bucket = 0;
+
+   for (bucket = 0; bucket < LATENCY_BUCKETS; bucket += 1)
+   {
+      seen += g_latency_buckets[bucket];
+      if (seen > target)
+      {
+         break;
+      }
+   }
+   return (double)((unsigned long long)(bucket + 1) * LATENCY_BUCKET_NS) / 1e6;
+}
+
+static void print_usage(const char *program_name_ptr)
+{
+   fprintf(stderr, "usage: %s [-c clients] [-p ports] [-b base_port] [-t seconds]\n"
+      "   [-n request_bytes] [-r requests_per_connection]\n", program_name_ptr);
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long long run_ns = 10000000000ull;
+   unsigned long long start_ns = 0;
+   unsigned long long now_ns = 0;
+   unsigned long long loops = 0;
+   double wall_s = 0.0;
+   struct rlimit limit;
+   unsigned int i = 0;
+   int option = 0;
+
+   while ((option = getopt(argc, argv, "c:p:b:t:n:r:")) != -1)
+   {
+      switch (option)
+      {
+      case 'c':
+         g_client_count = strtoul(optarg, NULL, 0);
+         break;
+      case 'p':
+         g_port_count = strtoul(optarg, NULL, 0);
+         break;
+      case 'b':
+         g_base_port = strtoul(optarg, NULL, 0);
+         break;
+      case 't':
+         run_ns = strtoull(optarg, NULL, 0) * 1000000000ull;
+         break;
+      case 'n':
+         g_request_bytes = strtoul(optarg, NULL, 0);
+         break;
+      case 'r':
+         g_requests_per_connection = strtoul(optarg, NULL, 0);
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+   if (0 == g_port_count)
+   {
+      g_port_count = g_client_count;
+   }
+   if ((g_client_count == 0) || (g_client_count > MAX_CLIENTS) ||
+      (g_port_count > MAX_SOCKETS) || ((g_base_port + g_port_count) > 0xFFFF) ||
+      (g_request_bytes == 0) || (g_request_bytes > MAX_REQUEST_BYTES) || (run_ns == 0))
+   {
+      fprintf(stderr, "clients must be 1 to %u, ports 1 to MAX_SOCKETS (%u), request bytes 1 to %u, "
+         "and seconds more than 0\n", MAX_CLIENTS, MAX_SOCKETS, MAX_REQUEST_BYTES);
+      return 2;
+   }
+
+   // Note: Each client needs a socket on both ends, plus one listener per
+   // port, which is more than the usual limit of 1024 files.
+   if (0 == getrlimit(RLIMIT_NOFILE, &limit))
+   {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+   }
+
+   TCPIP_and_wifi_stack_init("", "");
+   for (i = 0; i < g_port_count; i += 1)
+   {
+      if (TCPIP_open_socket(g_base_port + i) != 0)
+      {
+         fprintf(stderr, "can't open port %u\n", g_base_port + i);
+         return 2;
+      }
+   }
+   g_client_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   for (i = 0; i < g_client_count; i += 1)
+   {
+      g_clients[i].fd = -1;
+      g_clients[i].state = CLIENT_OPEN;
+      g_clients[i].port_num = g_base_port + (i % g_port_count);
+   }
+
+   printf("%u clients on %u ports, %u byte requests, %lu per connection, %llu s\n",
+      g_client_count, g_port_count, g_request_bytes, g_requests_per_connection, run_ns / 1000000000ull);
+
+   start_ns = get_time_ns();
+   do
+   {
+      TCPIP_keep_stack_alive();
+      server_task();
+      now_ns = get_time_ns();
+      client_task(now_ns);
+      loops += 1;
+   } while ((now_ns - start_ns) < run_ns);
+   wall_s = (double)(now_ns - start_ns) / 1e9;
+
+   printf("requests %lu, connections %lu, timeouts %lu, resets %lu, bad bytes %lu\n",
+      g_completed, g_connections, g_timeouts, g_resets, g_bad_bytes);
+   printf("throughput %.0f requests/s, %.3f MB/s each way, %.0f main loop passes/s\n",
+      (double)g_completed / wall_s, (double)g_completed * (double)g_request_bytes / wall_s / 1e6,
+      (double)loops / wall_s);
+   printf("latency avg %.3f ms, p50 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.3f ms\n",
+      g_completed ? (double)g_latency_total_ns / (double)g_completed / 1e6 : 0.0,
+      latency_percentile_ms(0.50), latency_percentile_ms(0.99), latency_percentile_ms(0.999),
+      (double)g_latency_max_ns / 1e6);
+
+   return (g_bad_bytes || (g_completed == 0)) ? 1 : 0;
+}
@@ -0,0 +1,1702 @@
+// This benchmarks the Microchip TCPIP stack, built as an ordinary Linux
+// process, over simulated links with delay, jitter, loss, duplication,
+// reordering and limited bandwidth, and reports goodput and request latency
+// for each scenario.  The stack's MAC is "TCPIP Stack/HostMAC.c" on a port
+// of the simulated network in "TCPIP Stack/HostNetSim.c", and the other port
+// is a small reference TCP client written here, so both ends of every
+// connection are in this process and run in virtual time.
+//    gcc -O2 -no-pie [-DTCP_LARGE_FIFOS] [-DTCP_NO_CONGESTION_CONTROL] [-DSTACK_USE_TCP_STATS] -o netsim_bench my_C_TCPIP_netsim_bench_host.c "TCPIP Stack/"{IP,TCP,UDP,ARP,ICMP,DNS,DHCP,AutoIP,Helpers,Tick,HostMAC,HostNetSim}.c
+//    ./netsim_bench [-s seed] [-n requests] [-b request_bytes] [-d depth]
+//       [-t step_us] [scenario]...
+// Note: The stack runs an echo server.  The client sends requests of
+// request_bytes, with at most depth of them outstanding, and a request's
+// latency is the virtual time from it being written to the whole echo
+// arriving.  Goodput counts echoed bytes only.
+// Note: The "bulk", "bulk-" and "sack-" scenarios ignore -n, -b and -d.  They echo 256 KiB,
+// written all at once in BULK_CHUNK_BYTES requests, through the host build's
+// bulk socket (TCP_HOST_BULK_FIFO_SIZE in TCPIPConfig.h), with both sides
+// offering window scaling.  Its FIFOs are 32 KiB, or 256 KiB when built with
+// -DTCP_LARGE_FIFOS, so the window really is the limit in the first case.
+// Note: The other "bulk-" scenarios lose frames on the way to the client
+// only, at random or by tail drop from a short queue, so they measure the
+// stack's congestion window and loss recovery.  Each "sack-" scenario is the
+// same with the client offering SACK.  Build with
+// -DTCP_NO_CONGESTION_CONTROL as well for the numbers without a congestion
+// window or fast recovery, where SACK makes no difference.
+// Note: Virtual time moves in steps of step_us, and both ends are polled once
+// per step, the way the board's main loop polls StackTask().  The same seed,
+// workload and step give exactly the same results on any PC, so a change to
+// TCP.c's timers or recovery can be compared with the numbers from before it.
+// Note: The client checks every byte it gets back and the TCP checksum of
+// every segment.  The run fails if either is ever wrong.
+// Note: The "iov-" scenarios ignore -n, -b and -d too.  They echo whole
+// requests, half as big again as the TX FIFO of the echo socket or, for
+// "iov-bulk", the bulk socket, by reference with TCPPutIov().  Requests
+// alternate between a RAM buffer the request was read into and a read-only
+// copy of the stream.  The board side checks that the buffers are released
+// in order, once each, only after the client has all of their bytes, that
+// TCPIsPutReady() stays 0 while any of them is still waiting for FIFO
+// space, and at the end that resizing the FIFOs and closing the connection
+// release what is still queued.  RAM buffers are overwritten as soon as
+// they are released, so a retransmission read from one too late shows up
+// as a corrupted byte at the client.
+// Note: Built with -DSTACK_USE_TCP_STATS, each row is followed by the
+// stack's own TCPGetStats() counters for the echo socket: retransmissions,
+// duplicate ACKs and zero windows it saw, and how long it spent in each
+// state.  The row fails if they contradict the simulated network, by
+// counting no retransmission although the client lost frames from the
+// stack, or no time in TCP_ESTABLISHED although every request was echoed.
+// Note: The "cork", "nodelay" and "quickack" scenarios ignore -n, -b and -d
+// as well.  The board sets that TCPSetOption() option right after
+// TCPOpen(), and each request is echoed on its own.  With cork the board
+// writes the echo at once but holds it for OPTION_HOLD_MS, and the client
+// must get none of it before the board calls TCPFlush(), or uncorks and
+// corks again, on alternate requests.  With nodelay the echo is written a
+// poll after the request is read and never flushed, so it has to go out
+// without waiting for the auto-transmit timer.  With quickack the board
+// leaves each request unread for OPTION_HOLD_MS, so the client's RTT
+// estimate only stays near the path's round trip if the stack ACKs without
+// delay.
+
+// for linking with the stack's declarations
+#include "TCPIP Stack/includes/TCPIP.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// TCP port the stack's echo server listens on
+#define ECHO_PORT 9760
+
+// the most requests in one scenario
+#define MAX_REQUESTS 100000
+
+// what the "bulk" scenarios echo, and the size of the requests it's written in
+#define BULK_BYTES (256ul * 1024ul)
+#define BULK_CHUNK_BYTES 16384ul
+
+// largest frame either end sends or receives
+#define MAX_FRAME 1514
+
+// TCP header flags and options (TCP.c keeps its own to itself)
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+#define TCP_FLAG_PSH 0x08
+#define TCP_FLAG_ACK 0x10
+#define TCP_OPTION_MSS 2
+#define TCP_OPTION_WINDOW_SCALE 3
+#define TCP_OPTION_SACK_PERMITTED 4
+#define TCP_OPTION_SACK 5
+
+// window scale shift the client offers, which it can always honour since it
+// keeps no receive buffer
+#define PEER_WINDOW_SHIFT 4
+
+// how the client behaves (the "peer options" of a scenario)
+#define PEER_OFFER_WINDOW_SCALE 0x01   // offer window scaling in the SYN
+#define PEER_KEEP_OUT_OF_ORDER 0x02    // keep data that arrives after a hole
+#define PEER_OFFER_SACK 0x04           // offer SACK, and report kept data with it
+
+// what the "iov-" scenarios echo (see above), through the echo socket or
+// the bulk socket
+#define IOV_REQUEST_BYTES 1000ul
+#define IOV_BULK_REQUEST_BYTES (TCP_HOST_BULK_FIFO_SIZE * 3ul / 2ul)
+#define IOV_REQUEST_COUNT 100ul
+#define IOV_DEPTH 6ul
+
+// RAM buffers the "iov-" echo reads requests into, used round robin for
+// every other request
+#define IOV_RAM_BUFFERS 8
+
+// what the "cork", "nodelay" and "quickack" scenarios echo, how long the
+// board holds a request or its echo back, and how much longer than the
+// path's round trip a request or an ACK may take
+#define OPTION_REQUEST_BYTES 100ul
+#define OPTION_REQUEST_COUNT 20ul
+#define OPTION_HOLD_MS 200ul
+#define OPTION_SLACK_MS 10ul
+
+// stream_byte() repeats after this many bytes
+#define STREAM_PERIOD 65536ul
+
+// the most out of order ranges the client keeps, and SACK blocks per ACK
+#define PEER_MAX_OOO_RANGES 16
+#define PEER_MAX_SACK_BLOCKS 3
+
+// the client's RTO limits, in ns (the same as RFC 6298 and Linux use)
+#define PEER_INITIAL_RTO_NS 1000000000ull
+#define PEER_MIN_RTO_NS 200000000ull
+#define PEER_MAX_RTO_NS 60000000000ull
+
+// Note: The real StackTsk.c isn't built into the host version, so AppConfig
+// is defined here.
+APP_CONFIG AppConfig;
+
+// what the application on the board does with the requests
+typedef enum
+{
+   APP_ECHO = 0,   // echo whatever arrives, as space allows
+   APP_IOV,        // echo whole requests by reference with TCPPutIov()
+   APP_CORK,       // hold each corked echo back, then flush or uncork
+   APP_NODELAY,    // write each echo a poll late and never flush it
+   APP_QUICKACK    // leave each request unread for a while
+} STACK_APP;
+
+// a row of the scenario table
+typedef struct scenario
+{
+   const char *name_ptr;
+   NETSIM_LINK_CONFIG link;   // used for both directions...
+   unsigned long timeout_s;   // virtual seconds before giving up
+   int bulk;                  // echo BULK_BYTES through the bulk socket
+   unsigned int peer_options; // PEER_* flags
+   int client_link_only;      // ...or, if set, the stack's link has only the delay
+   STACK_APP app;
+} SCENARIO;
+
+// Note: Delays and jitter are one way, so a round trip takes twice as long.
+static const SCENARIO g_scenarios[] =
+{
+   //  name         delay  jitter  loss   dup    reorder  by     bps       queue  timeout bulk peer options, client link only, app
+   { "clean",     {     0,     0,     0,     0,      0,      0,        0,  0 },  60, 0, 0, 0, APP_ECHO },
+   { "lan",       {   250,    50,     0,     0,      0,      0, 10000000,  0 },  60, 0, 0, 0, APP_ECHO },
+   { "wan",       { 20000,  2000,     0,     0,      0,      0,  1000000,  0 }, 120, 0, 0, 0, APP_ECHO },
+   { "loss-1%",   { 20000,  2000, 10000,     0,      0,      0,  1000000,  0 }, 300, 0, 0, 0, APP_ECHO },
+   { "loss-5%",   { 20000,  2000, 50000,     0,      0,      0,  1000000,  0 }, 600, 0, 0, 0, APP_ECHO },
+   { "reorder",   { 20000,     0,     0,     0,  50000,  10000,  1000000,  0 }, 120, 0, 0, 0, APP_ECHO },
+   { "duplicate", { 20000,  2000,     0, 20000,      0,      0,  1000000,  0 }, 120, 0, 0, 0, APP_ECHO },
+   { "slow",      {  5000,     0,     0,     0,      0,      0,    64000,  8 }, 600, 0, 0, 0, APP_ECHO },
+   { "hostile",   { 30000, 10000, 30000, 10000,  20000,  20000,   256000, 16 }, 600, 0, 0, 0, APP_ECHO },
+   { "bulk",      { 20000,     0,     0,     0,      0,      0, 10000000, 256 }, 120, 1, PEER_OFFER_WINDOW_SCALE, 0, APP_ECHO },
+   { "bulk-1%",   { 20000,     0, 10000,     0,      0,      0, 10000000, 256 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_KEEP_OUT_OF_ORDER, 1, APP_ECHO },
+   { "sack-1%",   { 20000,     0, 10000,     0,      0,      0, 10000000, 256 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_OFFER_SACK, 1, APP_ECHO },
+   { "bulk-2%",   { 20000,     0, 20000,     0,      0,      0, 10000000, 256 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_KEEP_OUT_OF_ORDER, 1, APP_ECHO },
+   { "sack-2%",   { 20000,     0, 20000,     0,      0,      0, 10000000, 256 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_OFFER_SACK, 1, APP_ECHO },
+   { "bulk-q16",  { 20000,     0,     0,     0,      0,      0, 10000000,  16 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_KEEP_OUT_OF_ORDER, 1, APP_ECHO },
+   { "sack-q16",  { 20000,     0,     0,     0,      0,      0, 10000000,  16 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_OFFER_SACK, 1, APP_ECHO },
+   { "bulk-q32",  { 20000,     0,     0,     0,      0,      0, 10000000,  32 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_KEEP_OUT_OF_ORDER, 1, APP_ECHO },
+   { "sack-q32",  { 20000,     0,     0,     0,      0,      0, 10000000,  32 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_OFFER_SACK, 1, APP_ECHO },
+   { "iov-5%",    { 20000,  2000, 50000,     0,      0,      0,  1000000,  0 }, 600, 0, 0, 0, APP_IOV },
+   { "iov-bulk",  { 20000,     0, 20000,     0,      0,      0, 10000000, 256 }, 300, 1, PEER_OFFER_WINDOW_SCALE | PEER_OFFER_SACK, 1, APP_IOV },
+   { "cork",      { 20000,     0,     0,     0,      0,      0,  1000000,  0 },  60, 0, 0, 0, APP_CORK },
+   { "nodelay",   { 20000,     0,     0,     0,      0,      0,  1000000,  0 },  60, 0, 0, 0, APP_NODELAY },
+   { "quickack",  { 20000,     0,     0,     0,      0,      0,  1000000,  0 },  60, 0, 0, 0, APP_QUICKACK },
+};
+
+#define SCENARIO_COUNT (sizeof(g_scenarios) / sizeof(g_scenarios[0]))
+
+// the client's connection state
+typedef enum
+{
+   PEER_SYN_SENT = 0,
+   PEER_ESTABLISHED,
+   PEER_RESET
+} PEER_STATE;
+
+// the reference TCP client
+// Note: It does just enough TCP to push data through the stack under loss:
+// an RFC 6298 RTO with Karn's rule, go-back-N after a timeout, fast
+// retransmit after three duplicate ACKs, zero window probes, and a Reno
+// congestion window so the bulk scenarios don't flood the link.  It ACKs
+// every segment and, unless the scenario says otherwise, keeps only
+// in-order data, so what is measured is the stack's behaviour, not a clever
+// peer's.
+// Note: With PEER_KEEP_OUT_OF_ORDER or PEER_OFFER_SACK it keeps data past a
+// hole the way a Linux receiver does, checking its bytes on arrival, and
+// with SACK it reports that data in SACK blocks (RFC 2018) so the stack's
+// scoreboard is exercised.  It ignores SACK blocks from the stack.
+typedef struct peer
+{
+   BYTE port;
+   MAC_ADDR MAC;
+   BYTE IP[4];
+   BYTE stack_IP[4];
+   WORD local_port;
+   WORD IP_ID;
+   PEER_STATE state;
+
+   // send side (stream offset 0 is sequence number iss + 1)
+   DWORD iss;
+   DWORD snd_una;
+   DWORD snd_nxt;
+   DWORD snd_max;
+   DWORD snd_wnd;
+   DWORD cwnd;
+   DWORD ssthresh;
+   WORD mss;
+   BYTE snd_shift;       // applied to windows from the stack
+   unsigned int options;  // PEER_* flags
+   int sack;              // both sides offered SACK
+   unsigned int dup_acks;
+   unsigned long long app_bytes;   // bytes written to the stream so far
+
+   // retransmission timer
+   unsigned long long rto_ns;
+   unsigned long long srtt_ns;
+   unsigned long long rttvar_ns;
+   unsigned long long rto_deadline_ns;   // 0 when stopped
+   int timing;
+   DWORD timed_seq;
+   unsigned long long timed_at_ns;
+
+   // receive side
+   DWORD irs;
+   DWORD rcv_nxt;
+   int ack_pending;
+   DWORD ooo_left[PEER_MAX_OOO_RANGES];    // kept data past rcv_nxt, most
+   DWORD ooo_right[PEER_MAX_OOO_RANGES];   // recently extended range first
+   unsigned int ooo_count;
+
+   // counters
+   unsigned long retransmits;
+   unsigned long timeouts;
+   unsigned long fast_retransmits;
+   unsigned long probes;
+   unsigned long stale_segments;   // duplicate or out of order data from the stack
+   unsigned long bad_checksums;
+   unsigned long bad_bytes;
+} PEER;
+
+// the workload and what came of it
+typedef struct workload
+{
+   unsigned long request_bytes;
+   unsigned long request_count;
+   unsigned long depth;
+   unsigned long issued;
+   unsigned long completed;
+   unsigned long long first_issue_ns;
+   unsigned long long last_completion_ns;
+   unsigned long long issue_ns[MAX_REQUESTS];
+   unsigned long long latency_ns[MAX_REQUESTS];
+} WORKLOAD;
+
+// what the application on the board keeps track of, and what it found wrong
+typedef struct stack_app
+{
+   unsigned long failures;
+
+   // the "iov-" echo
+   TCP_FIFO_SIZE empty_TX_space;   // TCPIsPutReady() before anything was queued
+   unsigned long read_bytes;       // request bytes taken from the RX FIFO
+   unsigned long queued;           // requests queued with TCPPutIov()
+   unsigned long released;         // release callbacks so far
+   int RAM_in_use[IOV_RAM_BUFFERS];
+   int finishing;                  // in stack_finish_iov(), where nothing is ACKed
+
+   // the "cork", "nodelay" and "quickack" echoes
+   int holding;                    // a request or its echo is being held back
+   DWORD held_at;                  // TickGet() when it started
+   unsigned long flushed;          // corked echoes let go of
+} STACK_APP_STATE;
+
+static PEER g_peer;
+static WORKLOAD g_work;
+static STACK_APP_STATE g_app;
+
+// Note: The "iov-" echo never writes to g_stream_copy[] after main() fills
+// it, so it stands in for a table in flash.
+static BYTE g_IOV_RAM[IOV_RAM_BUFFERS][IOV_BULK_REQUEST_BYTES];
+static BYTE g_stream_copy[STREAM_PERIOD + IOV_BULK_REQUEST_BYTES];
+static BYTE g_frame[MAX_FRAME];
+
+
+static void put16(BYTE *ptr, unsigned int value)
+{
+   ptr[0] = (BYTE)(value >> 8);
+   ptr[1] = (BYTE)value;
+}
+
+static void put32(BYTE *ptr, DWORD value)
+{
+   put16(ptr, (unsigned int)(value >> 16));
+   put16(ptr + 2, (unsigned int)(value & 0xFFFF));
+}
+
+static unsigned int get16(const BYTE *ptr)
+{
+   return ((unsigned int)ptr[0] << 8) | ptr[1];
+}
+
+static DWORD get32(const BYTE *ptr)
+{
+   return ((DWORD)get16(ptr) << 16) | get16(ptr + 2);
+}
+
+// Note: The client has its own checksum rather than the stack's
+// CalcIPChecksum(), so that it really is a second opinion.
+static unsigned long checksum_add(unsigned long sum, const BYTE *data_ptr, unsigned int length)
+{
+   unsigned int i;
+
+   for (i = 0; i + 1 < length; i += 2)
+   {
+      sum += get16(&data_ptr[i]);
+   }
+   if (length & 1)
+   {
+      sum += (unsigned long)data_ptr[length - 1] << 8;
+   }
+   return sum;
+}
+
+static unsigned int checksum_fold(unsigned long sum)
+{
+   while (sum >> 16)
+   {
+      sum = (sum & 0xFFFF) + (sum >> 16);
+   }
+   return (unsigned int)(~sum & 0xFFFF);
+}
+
+// TCP checksum of a segment (header and data) between two addresses
+static unsigned int TCP_checksum(const BYTE *source_IP_ptr, const BYTE *dest_IP_ptr, const BYTE *segment_ptr, unsigned int length)
+{
+   BYTE pseudo_header[12];
+
+   memcpy(pseudo_header, source_IP_ptr, 4);
+   memcpy(pseudo_header + 4, dest_IP_ptr, 4);
+   pseudo_header[8] = 0;
+   pseudo_header[9] = IP_PROT_TCP;
+   put16(&pseudo_header[10], length);
+   return checksum_fold(checksum_add(checksum_add(0, pseudo_header, sizeof(pseudo_header)), segment_ptr, length));
+}
+
+// the byte at an offset of the request stream, which the echo must match
+static BYTE stream_byte(DWORD offset)
+{
+   return (BYTE)((offset * 31u) + (offset >> 8));
+}
+
+static void app_config_init(void)
+{
+   memset((void *)&AppConfig, 0, sizeof(AppConfig));
+   AppConfig.MyIPAddr.Val = MY_DEFAULT_IP_ADDR_BYTE1 | MY_DEFAULT_IP_ADDR_BYTE2 << 8ul | MY_DEFAULT_IP_ADDR_BYTE3 << 16ul | MY_DEFAULT_IP_ADDR_BYTE4 << 24ul;
+   AppConfig.MyMask.Val = MY_DEFAULT_MASK_BYTE1 | MY_DEFAULT_MASK_BYTE2 << 8ul | MY_DEFAULT_MASK_BYTE3 << 16ul | MY_DEFAULT_MASK_BYTE4 << 24ul;
+   AppConfig.MyGateway.Val = MY_DEFAULT_GATE_BYTE1 | MY_DEFAULT_GATE_BYTE2 << 8ul | MY_DEFAULT_GATE_BYTE3 << 16ul | MY_DEFAULT_GATE_BYTE4 << 24ul;
+   AppConfig.DefaultIPAddr.Val = AppConfig.MyIPAddr.Val;
+   AppConfig.DefaultMask.Val = AppConfig.MyMask.Val;
+   AppConfig.MyMACAddr.v[0] = MY_DEFAULT_MAC_BYTE1;
+   AppConfig.MyMACAddr.v[1] = MY_DEFAULT_MAC_BYTE2;
+   AppConfig.MyMACAddr.v[2] = MY_DEFAULT_MAC_BYTE3;
+   AppConfig.MyMACAddr.v[3] = MY_DEFAULT_MAC_BYTE4;
+   AppConfig.MyMACAddr.v[4] = MY_DEFAULT_MAC_BYTE5;
+   AppConfig.MyMACAddr.v[5] = MY_DEFAULT_MAC_BYTE6;
+
+   // Note: There's no DHCP server on the simulated network.
+   AppConfig.Flags.bIsDHCPEnabled = 0;
+   AppConfig.Flags.bInConfigMode = 0;
+}
+
+// does what StackTask() does with each received frame
+static void stack_receive(void)
+{
+   NODE_INFO remote_node;
+   IP_ADDR local_IP;
+   BYTE frame_type;
+   BYTE IP_frame_type;
+   WORD data_count;
+
+   for (;;)
+   {
+      UDPDiscard();
+      if (!MACGetHeader(&remote_node.MACAddr, &frame_type))
+      {
+         return;
+      }
+      if (frame_type == MAC_ARP)
+      {
+         ARPProcess();
+         continue;
+      }
+      if ((frame_type != MAC_IP) || !IPGetHeader(&local_IP, &remote_node, &IP_frame_type, &data_count))
+      {
+         continue;
+      }
+      if (IP_frame_type == IP_PROT_ICMP)
+      {
+         ICMPProcess(&remote_node, data_count);
+      }
+      else if (IP_frame_type == IP_PROT_TCP)
+      {
+         TCPProcess(&remote_node, &local_IP, data_count);
+      }
+      else if (IP_frame_type == IP_PROT_UDP)
+      {
+         UDPProcess(&remote_node, &local_IP, data_count);
+      }
+   }
+}
+
+// the application on the board: echo whatever arrives, as space allows
+static void stack_echo(TCP_SOCKET socket)
+{
+   BYTE buffer[256];
+   TCP_FIFO_SIZE count;
+   TCP_FIFO_SIZE space;
+   TCP_FIFO_SIZE moved = 0;
+
+   for (;;)
+   {
+      count = TCPIsGetReady(socket);
+      space = TCPIsPutReady(socket);
+      if (count > space)
+      {
+         count = space;
+      }
+      if (count > sizeof(buffer))
+      {
+         count = sizeof(buffer);
+      }
+      if (count == 0)
+      {
+         break;
+      }
+      TCPGetArray(socket, buffer, count);
+      TCPPutArray(socket, buffer, count);
+      moved += count;
+   }
+   if (moved)
+   {
+      TCPFlush(socket);
+   }
+}
+
+// reports something the stack did that its API says it doesn't; the
+// scenario fails
+static void app_fail(const char *what_ptr, unsigned long detail)
+{
+   if (g_app.failures++ < 5)
+   {
+      fprintf(stderr, "   %s (%lu)\n", what_ptr, detail);
+   }
+}
+
+// how many bytes of the echo the client has in order
+// Note: This is how the bench checks the board; the board itself can't know.
+static DWORD app_bytes_at_client(void)
+{
+   return (g_peer.state == PEER_ESTABLISHED) ? g_peer.rcv_nxt - g_peer.irs - 1 : 0;
+}
+
+// called by the stack when it's done with a TCPPutIov() buffer
+// Note: The context is the request's number.  A RAM buffer is overwritten
+// as soon as it's released, so anything the stack reads from it later
+// reaches the client as a corrupted byte.
+static void iov_release(TCP_SOCKET socket, void *context_ptr)
+{
+   unsigned long request = (unsigned long)(size_t)context_ptr;
+   int buffer = (int)((request / 2) % IOV_RAM_BUFFERS);
+
+   (void)socket;
+   if (request != g_app.released)
+   {
+      app_fail("TCPPutIov() buffer released out of order", request);
+   }
+   if (!g_app.finishing && (app_bytes_at_client() < (request + 1) * g_work.request_bytes))
+   {
+      app_fail("TCPPutIov() buffer released before the client had all of it", request);
+   }
+   g_app.released++;
+   if ((request & 1) == 0)
+   {
+      memset(g_IOV_RAM[buffer], 0xEE, sizeof(g_IOV_RAM[buffer]));
+      g_app.RAM_in_use[buffer] = 0;
+   }
+}
+
+// queues a request's echo with TCPPutIov(); even requests are sent from the
+// RAM buffer they were read into, and odd ones from the read-only copy
+static BYTE iov_queue(TCP_SOCKET socket, unsigned long request)
+{
+   TCP_IOV iov;
+
+   if (request & 1)
+   {
+      iov.pData = (ROM BYTE *)&g_stream_copy[(request * g_work.request_bytes) % STREAM_PERIOD];
+   }
+   else
+   {
+      iov.pData = g_IOV_RAM[(request / 2) % IOV_RAM_BUFFERS];
+   }
+   iov.dwLen = g_work.request_bytes;
+   iov.fRelease = iov_release;
+   iov.pContext = (void *)(size_t)request;
+   return TCPPutIov(socket, &iov, 1);
+}
+
+// the application on the board for the "iov-" scenarios: echo each request
+// by reference once all of it has arrived
+static void stack_echo_iov(TCP_SOCKET socket)
+{
+   TCP_FIFO_SIZE count;
+   unsigned long request;
+   unsigned long offset;
+   int buffer;
+
+   if (!TCPIsConnected(socket))
+   {
+      return;
+   }
+   if (g_app.empty_TX_space == 0)
+   {
+      g_app.empty_TX_space = TCPIsPutReady(socket);
+   }
+
+   while ((count = TCPIsGetReady(socket)) != 0)
+   {
+      request = g_app.read_bytes / g_work.request_bytes;
+      offset = g_app.read_bytes % g_work.request_bytes;
+      buffer = (int)((request / 2) % IOV_RAM_BUFFERS);
+      if (count > g_work.request_bytes - offset)
+      {
+         count = (TCP_FIFO_SIZE)(g_work.request_bytes - offset);
+      }
+      if (request & 1)
+      {
+         TCPGetArray(socket, NULL, count);
+      }
+      else
+      {
+         if ((offset == 0) && g_app.RAM_in_use[buffer]++)
+         {
+            app_fail("RAM buffer needed again before it was released", request);
+         }
+         TCPGetArray(socket, &g_IOV_RAM[buffer][offset], count);
+      }
+      g_app.read_bytes += count;
+   }
+
+   while ((g_app.queued < g_app.read_bytes / g_work.request_bytes) && iov_queue(socket, g_app.queued))
+   {
+      g_app.queued++;
+   }
+
+   // Note: The client has at least every byte the stack has seen ACKed, so
+   // if more is queued than the FIFO holds plus what the client has, some
+   // of it has no FIFO space yet.
+   if ((g_app.queued * g_work.request_bytes > app_bytes_at_client() + g_app.empty_TX_space) && TCPIsPutReady(socket))
+   {
+      app_fail("TCPIsPutReady() wasn't 0 with a TCPPutIov() buffer waiting for space", g_app.queued);
+   }
+}
+
+// the end of an "iov-" scenario: every echo has been ACKed, so every buffer
+// must have been released, and resizing the FIFOs or closing the connection
+// must release whatever is queued after that
+// Note: Nothing is polled from here on, so the client never gets what
+// these last buffers send.
+static void stack_finish_iov(TCP_SOCKET socket)
+{
+   unsigned long request;
+
+   g_app.finishing = 1;
+   if (g_app.released != g_app.queued)
+   {
+      app_fail("TCPPutIov() buffers not released once ACKed", g_app.queued - g_app.released);
+   }
+   if (TCPIsPutReady(socket) != g_app.empty_TX_space)
+   {
+      app_fail("TX FIFO space not all back once every buffer was released", TCPIsPutReady(socket));
+   }
+
+   for (request = g_app.queued; request < g_app.queued + 4; request += 2)
+   {
+      memcpy(g_IOV_RAM[(request / 2) % IOV_RAM_BUFFERS], &g_stream_copy[(request * g_work.request_bytes) % STREAM_PERIOD], g_work.request_bytes);
+   }
+   if (iov_queue(socket, g_app.queued) + iov_queue(socket, g_app.queued + 1) != 2)
+   {
+      app_fail("TCPPutIov() refused buffers with the queue empty", g_app.queued);
+   }
+   g_app.queued += 2;
+   TCPAdjustFIFOSize(socket, 100, 100, TCP_ADJUST_GIVE_REST_TO_TX);
+   if (g_app.released != g_app.queued)
+   {
+      app_fail("TCPPutIov() buffers not released by TCPAdjustFIFOSize()", g_app.queued - g_app.released);
+   }
+
+   if (iov_queue(socket, g_app.queued) + iov_queue(socket, g_app.queued + 1) != 2)
+   {
+      app_fail("TCPPutIov() refused buffers after TCPAdjustFIFOSize()", g_app.queued);
+   }
+   g_app.queued += 2;
+   TCPDisconnect(socket);
+   TCPDisconnect(socket);
+   if (g_app.released != g_app.queued)
+   {
+      app_fail("TCPPutIov() buffers not released by closing the connection", g_app.queued - g_app.released);
+   }
+}
+
+// the TCPSetOption() option an application on the board sets, or 0
+static BYTE app_option(STACK_APP app)
+{
+   switch (app)
+   {
+      case APP_CORK:
+         return TCP_OPT_CORK;
+      case APP_NODELAY:
+         return TCP_OPT_NODELAY;
+      case APP_QUICKACK:
+         return TCP_OPT_QUICKACK;
+      default:
+         return 0;
+   }
+}
+
+// sets an option and checks that TCPGetOption() reads it back
+static void app_set_option(TCP_SOCKET socket, BYTE option, WORD value)
+{
+   if (!TCPSetOption(socket, option, value) || (TCPGetOption(socket, option) != value))
+   {
+      app_fail("TCPGetOption() didn't read back what TCPSetOption() set", option);
+   }
+}
+
+// the application on the board for the "cork", "nodelay" and "quickack"
+// scenarios: echo one request at a time, late in the way the scenario's
+// option is meant to make up for
+// Note: Reading all of a request schedules a window update, which sends
+// any unflushed data with it, so nodelay writes the echo a poll later.
+static void stack_echo_option(TCP_SOCKET socket, STACK_APP app)
+{
+   BYTE *request_ptr = g_IOV_RAM[0];
+
+   if (!TCPIsConnected(socket))
+   {
+      return;
+   }
+
+   if (app == APP_CORK)
+   {
+      // Note: Echoes are whole requests, and the client has the earlier
+      // ones, so it must have no more than the flushed ones.
+      if (app_bytes_at_client() > g_app.flushed * OPTION_REQUEST_BYTES)
+      {
+         app_fail("corked data sent before TCPFlush() or uncorking", g_app.flushed);
+      }
+      if (!g_app.holding && (TCPIsGetReady(socket) >= OPTION_REQUEST_BYTES))
+      {
+         TCPGetArray(socket, request_ptr, OPTION_REQUEST_BYTES);
+         TCPPutArray(socket, request_ptr, OPTION_REQUEST_BYTES);
+         g_app.holding = 1;
+         g_app.held_at = TickGet();
+      }
+      else if (g_app.holding && (TickGet() - g_app.held_at >= OPTION_HOLD_MS * TICK_SECOND / 1000ul))
+      {
+         if (g_app.flushed & 1)
+         {
+            app_set_option(socket, TCP_OPT_CORK, 0);
+            app_set_option(socket, TCP_OPT_CORK, 1);
+         }
+         else
+         {
+            TCPFlush(socket);
+         }
+         g_app.flushed++;
+         g_app.holding = 0;
+      }
+   }
+   else if (app == APP_NODELAY)
+   {
+      if (g_app.holding)
+      {
+         TCPPutArray(socket, request_ptr, OPTION_REQUEST_BYTES);
+         g_app.holding = 0;
+      }
+      else if (TCPIsGetReady(socket) >= OPTION_REQUEST_BYTES)
+      {
+         TCPGetArray(socket, request_ptr, OPTION_REQUEST_BYTES);
+         g_app.holding = 1;
+      }
+   }
+   else
+   {
+      if (!g_app.holding && (TCPIsGetReady(socket) >= OPTION_REQUEST_BYTES))
+      {
+         g_app.holding = 1;
+         g_app.held_at = TickGet();
+      }
+      else if (g_app.holding && (TickGet() - g_app.held_at >= OPTION_HOLD_MS * TICK_SECOND / 1000ul))
+      {
+         TCPGetArray(socket, request_ptr, OPTION_REQUEST_BYTES);
+         TCPPutArray(socket, request_ptr, OPTION_REQUEST_BYTES);
+         TCPFlush(socket);
+         g_app.holding = 0;
+      }
+   }
+}
+
+// the end of a "cork", "nodelay" or "quickack" scenario: check the times
+// the option is meant to keep short
+static void stack_finish_option(const SCENARIO *scenario_ptr)
+{
+   unsigned long long round_trip_ns = 2ull * scenario_ptr->link.dwDelayUs * 1000ull;
+   unsigned long long limit_ns = round_trip_ns + OPTION_SLACK_MS * 1000000ull;
+   unsigned long long max_ns = 0;
+   unsigned long i;
+
+   for (i = 0; i < g_work.completed; i++)
+   {
+      if (g_work.latency_ns[i] > max_ns)
+      {
+         max_ns = g_work.latency_ns[i];
+      }
+   }
+
+   if (scenario_ptr->app == APP_CORK)
+   {
+      if (max_ns > limit_ns + OPTION_HOLD_MS * 1000000ull)
+      {
+         app_fail("corked echo slow to go once flushed, in us", (unsigned long)(max_ns / 1000ull));
+      }
+   }
+   else if (scenario_ptr->app == APP_NODELAY)
+   {
+      if (max_ns > limit_ns)
+      {
+         app_fail("echo waited for the auto-transmit timer, in us", (unsigned long)(max_ns / 1000ull));
+      }
+   }
+   else if (g_peer.srtt_ns > limit_ns)
+   {
+      app_fail("client's smoothed RTT includes a delayed ACK, in us", (unsigned long)(g_peer.srtt_ns / 1000ull));
+   }
+}
+
+#if defined(STACK_USE_TCP_STATS)
+// names for the TCPGetStats() line, in TCP_STATE order
+static const char * const g_TCP_state_names[TCP_CLOSED_BUT_RESERVED + 1] =
+{
+   "GET_DNS_MODULE", "DNS_RESOLVE", "GATEWAY_SEND_ARP", "GATEWAY_GET_ARP",
+   "LISTEN", "SYN_SENT", "SYN_RECEIVED", "ESTABLISHED", "FIN_WAIT_1",
+   "FIN_WAIT_2", "CLOSING", "CLOSE_WAIT", "LAST_ACK", "CLOSED",
+   "CLOSED_BUT_RESERVED"
+};
+
+// checks the stack's counters for the echo socket against what the
+// simulated network did to the frames it sent
+// Note: In these scenarios nearly every frame from the stack carries echo
+// data, so a lost one has to be sent again.
+static void stack_check_stats(const TCP_SOCKET_STATS *stats_ptr, const NETSIM_PORT_STATS *peer_stats_ptr)
+{
+   if (g_work.completed != g_work.request_count)
+   {
+      return;
+   }
+   if ((peer_stats_ptr->dwLost + peer_stats_ptr->dwQueueDrops) && (stats_ptr->dwRetransmits == 0))
+   {
+      app_fail("TCPGetStats() counted no retransmission after frames were lost", peer_stats_ptr->dwLost + peer_stats_ptr->dwQueueDrops);
+   }
+   if (stats_ptr->dwStateTicks[TCP_ESTABLISHED] == 0)
+   {
+      app_fail("TCPGetStats() counted no time in TCP_ESTABLISHED", 0);
+   }
+}
+
+// prints the stack's counters for the echo socket under its row
+static void print_TCP_stats(const TCP_SOCKET_STATS *stats_ptr)
+{
+   int i;
+
+   printf("           TCP: %lu retransmits, %lu dup ACKs, %lu zero windows; ms in",
+      (unsigned long)stats_ptr->dwRetransmits, (unsigned long)stats_ptr->dwDupACKs,
+      (unsigned long)stats_ptr->dwZeroWindows);
+   for (i = 0; i <= TCP_CLOSED_BUT_RESERVED; i++)
+   {
+      if (stats_ptr->dwStateTicks[i])
+      {
+         printf(" %s %.1f", g_TCP_state_names[i], (double)stats_ptr->dwStateTicks[i] * 1000.0 / (double)TICK_SECOND);
+      }
+   }
+   printf("\n");
+}
+#endif
+
+// sends a TCP segment from the client to the stack
+// Note: Data always comes from the request stream, so retransmissions need
+// no send buffer.
+static void peer_send(PEER *peer_ptr, BYTE flags, DWORD seq, unsigned int data_length)
+{
+   BYTE *IP_ptr = &g_frame[14];
+   BYTE *TCP_ptr = &g_frame[34];
+   unsigned int header_length = 20;
+   unsigned int SACK_blocks = 0;
+   unsigned int frame_length;
+   unsigned int i;
+
+   if (flags & TCP_FLAG_SYN)
+   {
+      header_length += 4;
+      if (peer_ptr->options & PEER_OFFER_WINDOW_SCALE)
+      {
+         header_length += 4;
+      }
+      if (peer_ptr->options & PEER_OFFER_SACK)
+      {
+         header_length += 4;
+      }
+   }
+   else if ((flags & TCP_FLAG_ACK) && peer_ptr->sack)
+   {
+      SACK_blocks = (peer_ptr->ooo_count < PEER_MAX_SACK_BLOCKS) ? peer_ptr->ooo_count : PEER_MAX_SACK_BLOCKS;
+      if (SACK_blocks)
+      {
+         header_length += 4 + 8 * SACK_blocks;
+      }
+   }
+
+   memcpy(&g_frame[0], AppConfig.MyMACAddr.v, 6);
+   memcpy(&g_frame[6], peer_ptr->MAC.v, 6);
+   put16(&g_frame[12], 0x0800);
+
+   IP_ptr[0] = 0x45;
+   IP_ptr[1] = 0;
+   put16(&IP_ptr[2], 20 + header_length + data_length);
+   put16(&IP_ptr[4], peer_ptr->IP_ID++);
+   put16(&IP_ptr[6], 0x4000);
+   IP_ptr[8] = 64;
+   IP_ptr[9] = IP_PROT_TCP;
+   put16(&IP_ptr[10], 0);
+   memcpy(&IP_ptr[12], peer_ptr->IP, 4);
+   memcpy(&IP_ptr[16], peer_ptr->stack_IP, 4);
+   put16(&IP_ptr[10], checksum_fold(checksum_add(0, IP_ptr, 20)));
+
+   put16(&TCP_ptr[0], peer_ptr->local_port);
+   put16(&TCP_ptr[2], ECHO_PORT);
+   put32(&TCP_ptr[4], seq);
+   put32(&TCP_ptr[8], (flags & TCP_FLAG_ACK) ? peer_ptr->rcv_nxt : 0);
+   TCP_ptr[12] = (BYTE)((header_length / 4) << 4);
+   TCP_ptr[13] = flags;
+   put16(&TCP_ptr[14], 65535);
+   put16(&TCP_ptr[16], 0);
+   put16(&TCP_ptr[18], 0);
+   if (flags & TCP_FLAG_SYN)
+   {
+      unsigned int option_offset = 24;
+
+      TCP_ptr[20] = TCP_OPTION_MSS;
+      TCP_ptr[21] = 4;
+      put16(&TCP_ptr[22], 1460);
+      if (peer_ptr->options & PEER_OFFER_WINDOW_SCALE)
+      {
+         TCP_ptr[option_offset++] = 1;   // no-op, to keep the next option aligned
+         TCP_ptr[option_offset++] = TCP_OPTION_WINDOW_SCALE;
+         TCP_ptr[option_offset++] = 3;
+         TCP_ptr[option_offset++] = PEER_WINDOW_SHIFT;
+      }
+      if (peer_ptr->options & PEER_OFFER_SACK)
+      {
+         TCP_ptr[option_offset++] = 1;
+         TCP_ptr[option_offset++] = 1;
+         TCP_ptr[option_offset++] = TCP_OPTION_SACK_PERMITTED;
+         TCP_ptr[option_offset++] = 2;
+      }
+   }
+   else if (SACK_blocks)
+   {
+      // Note: The first block must be the one holding the segment that
+      // arrived last (RFC 2018), which is why the ranges are kept in that
+      // order.
+      TCP_ptr[20] = 1;
+      TCP_ptr[21] = 1;
+      TCP_ptr[22] = TCP_OPTION_SACK;
+      TCP_ptr[23] = (BYTE)(2 + 8 * SACK_blocks);
+      for (i = 0; i < SACK_blocks; i++)
+      {
+         put32(&TCP_ptr[24 + 8 * i], peer_ptr->ooo_left[i]);
+         put32(&TCP_ptr[28 + 8 * i], peer_ptr->ooo_right[i]);
+      }
+   }
+   for (i = 0; i < data_length; i++)
+   {
+      TCP_ptr[header_length + i] = stream_byte(seq - peer_ptr->iss - 1 + i);
+   }
+   put16(&TCP_ptr[16], TCP_checksum(peer_ptr->IP, peer_ptr->stack_IP, TCP_ptr, header_length + data_length));
+
+   // Note: Ethernet pads short frames, so the stack must cope with that.
+   frame_length = 34 + header_length + data_length;
+   if (frame_length < 60)
+   {
+      memset(&g_frame[frame_length], 0, 60 - frame_length);
+      frame_length = 60;
+   }
+   HostNetSimSend(peer_ptr->port, g_frame, (WORD)frame_length);
+
+   if (flags & TCP_FLAG_ACK)
+   {
+      peer_ptr->ack_pending = 0;
+   }
+}
+
+static void peer_reply_ARP(PEER *peer_ptr, const BYTE *request_ptr)
+{
+   BYTE *ARP_ptr = &g_frame[14];
+
+   memcpy(&g_frame[0], &request_ptr[6], 6);
+   memcpy(&g_frame[6], peer_ptr->MAC.v, 6);
+   put16(&g_frame[12], 0x0806);
+   put16(&ARP_ptr[0], 1);
+   put16(&ARP_ptr[2], 0x0800);
+   ARP_ptr[4] = 6;
+   ARP_ptr[5] = 4;
+   put16(&ARP_ptr[6], 2);
+   memcpy(&ARP_ptr[8], peer_ptr->MAC.v, 6);
+   memcpy(&ARP_ptr[14], peer_ptr->IP, 4);
+   memcpy(&ARP_ptr[18], &request_ptr[22], 10);
+   memset(&g_frame[42], 0, 60 - 42);
+   HostNetSimSend(peer_ptr->port, g_frame, 60);
+}
+
+static void peer_start(PEER *peer_ptr, BYTE port, DWORD iss, unsigned int options)
+{
+   memset((void *)peer_ptr, 0, sizeof(*peer_ptr));
+   peer_ptr->port = port;
+   memcpy(peer_ptr->MAC.v, "\x02\x00\x00\x00\x00\x01", 6);
+   memcpy(peer_ptr->stack_IP, AppConfig.MyIPAddr.v, 4);
+   memcpy(peer_ptr->IP, AppConfig.MyIPAddr.v, 4);
+   peer_ptr->IP[3]++;
+   peer_ptr->local_port = 49152;
+   peer_ptr->state = PEER_SYN_SENT;
+   peer_ptr->iss = iss;
+   peer_ptr->snd_una = iss;
+   peer_ptr->snd_nxt = iss + 1;
+   peer_ptr->snd_max = iss + 1;
+   peer_ptr->mss = 536;
+   peer_ptr->options = options;
+   peer_ptr->rto_ns = PEER_INITIAL_RTO_NS;
+}
+
+// RFC 6298 estimator
+static void peer_RTT_sample(PEER *peer_ptr, unsigned long long RTT_ns)
+{
+   if (peer_ptr->srtt_ns == 0)
+   {
+      peer_ptr->srtt_ns = RTT_ns;
+      peer_ptr->rttvar_ns = RTT_ns / 2;
+   }
+   else
+   {
+      unsigned long long error_ns = (RTT_ns > peer_ptr->srtt_ns) ? RTT_ns - peer_ptr->srtt_ns : peer_ptr->srtt_ns - RTT_ns;
+
+      peer_ptr->rttvar_ns = (3 * peer_ptr->rttvar_ns + error_ns) / 4;
+      peer_ptr->srtt_ns = (7 * peer_ptr->srtt_ns + RTT_ns) / 8;
+   }
+   peer_ptr->rto_ns = peer_ptr->srtt_ns + 4 * peer_ptr->rttvar_ns;
+   if (peer_ptr->rto_ns < PEER_MIN_RTO_NS)
+   {
+      peer_ptr->rto_ns = PEER_MIN_RTO_NS;
+   }
+   if (peer_ptr->rto_ns > PEER_MAX_RTO_NS)
+   {
+      peer_ptr->rto_ns = PEER_MAX_RTO_NS;
+   }
+}
+
+// marks requests whose echo has fully arrived as done
+static void work_check_completions(const PEER *peer_ptr, WORKLOAD *work_ptr, unsigned long long now_ns)
+{
+   unsigned long long echoed = (DWORD)(peer_ptr->rcv_nxt - peer_ptr->irs - 1);
+
+   while ((work_ptr->completed < work_ptr->issued) &&
+      (echoed >= (unsigned long long)(work_ptr->completed + 1) * work_ptr->request_bytes))
+   {
+      work_ptr->latency_ns[work_ptr->completed] = now_ns - work_ptr->issue_ns[work_ptr->completed];
+      work_ptr->last_completion_ns = now_ns;
+      work_ptr->completed++;
+   }
+}
+
+// handles an ACK that may move snd_una
+static void peer_process_ACK(PEER *peer_ptr, DWORD ack, DWORD window, int has_data, unsigned long long now_ns)
+{
+   DWORD in_flight = peer_ptr->snd_max - peer_ptr->snd_una;
+   DWORD acked = ack - peer_ptr->snd_una;
+
+   if (((LONG)(ack - peer_ptr->snd_una) > 0) && ((LONG)(ack - peer_ptr->snd_max) <= 0))
+   {
+      // slow start, then congestion avoidance (RFC 5681)
+      if (peer_ptr->cwnd < peer_ptr->ssthresh)
+      {
+         peer_ptr->cwnd += (acked < peer_ptr->mss) ? acked : peer_ptr->mss;
+      }
+      else
+      {
+         peer_ptr->cwnd += ((DWORD)peer_ptr->mss * peer_ptr->mss) / peer_ptr->cwnd + 1;
+      }
+
+      peer_ptr->snd_una = ack;
+      if ((LONG)(peer_ptr->snd_nxt - ack) < 0)
+      {
+         peer_ptr->snd_nxt = ack;
+      }
+      peer_ptr->dup_acks = 0;
+      if (peer_ptr->timing && ((LONG)(ack - peer_ptr->timed_seq) > 0))
+      {
+         peer_RTT_sample(peer_ptr, now_ns - peer_ptr->timed_at_ns);
+         peer_ptr->timing = 0;
+      }
+      peer_ptr->rto_deadline_ns = (ack != peer_ptr->snd_max) ? now_ns + peer_ptr->rto_ns : 0;
+   }
+   else if ((ack == peer_ptr->snd_una) && in_flight && !has_data && (window == peer_ptr->snd_wnd))
+   {
+      if (++peer_ptr->dup_acks == 3)
+      {
+         DWORD length = peer_ptr->snd_max - peer_ptr->snd_una;
+
+         peer_ptr->ssthresh = (in_flight / 2 > 2 * (DWORD)peer_ptr->mss) ? in_flight / 2 : 2 * (DWORD)peer_ptr->mss;
+         peer_ptr->cwnd = peer_ptr->ssthresh;
+
+         if (length > peer_ptr->mss)
+         {
+            length = peer_ptr->mss;
+         }
+         peer_send(peer_ptr, TCP_FLAG_ACK | TCP_FLAG_PSH, peer_ptr->snd_una, length);
+         peer_ptr->fast_retransmits++;
+         peer_ptr->retransmits++;
+         peer_ptr->timing = 0;
+      }
+   }
+
+   if ((LONG)(ack - peer_ptr->snd_una) >= 0)
+   {
+      peer_ptr->snd_wnd = window;
+   }
+}
+
+// keeps data from left up to right that arrived after a hole, merging it
+// with the ranges it touches and moving the result to the front
+// Note: If all PEER_MAX_OOO_RANGES are in use, the oldest range is
+// forgotten (reneging, which RFC 2018 allows), and the stack will resend it.
+static void peer_keep_range(PEER *peer_ptr, DWORD left, DWORD right)
+{
+   unsigned int i = 0;
+
+   while (i < peer_ptr->ooo_count)
+   {
+      if (((LONG)(peer_ptr->ooo_left[i] - right) <= 0) && ((LONG)(left - peer_ptr->ooo_right[i]) <= 0))
+      {
+         if ((LONG)(peer_ptr->ooo_left[i] - left) < 0)
+         {
+            left = peer_ptr->ooo_left[i];
+         }
+         if ((LONG)(peer_ptr->ooo_right[i] - right) > 0)
+         {
+            right = peer_ptr->ooo_right[i];
+         }
+         peer_ptr->ooo_count--;
+         memmove(&peer_ptr->ooo_left[i], &peer_ptr->ooo_left[i + 1], (peer_ptr->ooo_count - i) * sizeof(peer_ptr->ooo_left[0]));
+         memmove(&peer_ptr->ooo_right[i], &peer_ptr->ooo_right[i + 1], (peer_ptr->ooo_count - i) * sizeof(peer_ptr->ooo_right[0]));
+      }
+      else
+      {
+         i++;
+      }
+   }
+   if (peer_ptr->ooo_count == PEER_MAX_OOO_RANGES)
+   {
+      peer_ptr->ooo_count--;
+   }
+   memmove(&peer_ptr->ooo_left[1], &peer_ptr->ooo_left[0], peer_ptr->ooo_count * sizeof(peer_ptr->ooo_left[0]));
+   memmove(&peer_ptr->ooo_right[1], &peer_ptr->ooo_right[0], peer_ptr->ooo_count * sizeof(peer_ptr->ooo_right[0]));
+   peer_ptr->ooo_left[0] = left;
+   peer_ptr->ooo_right[0] = right;
+   peer_ptr->ooo_count++;
+}
+
+// handles one frame that arrived at the client
+static void peer_receive(PEER *peer_ptr, WORKLOAD *work_ptr, const BYTE *frame_ptr, unsigned int frame_length, unsigned long long now_ns)
+{
+   const BYTE *IP_ptr = &frame_ptr[14];
+   const BYTE *TCP_ptr;
+   unsigned int IP_header_length;
+   unsigned int IP_length;
+   unsigned int TCP_header_length;
+   unsigned int data_length;
+   unsigned int i;
+   DWORD seq;
+   BYTE flags;
+
+   if (frame_length < 42)
+   {
+      return;
+   }
+   if ((get16(&frame_ptr[12]) == 0x0806) && (get16(&IP_ptr[6]) == 1) && !memcmp(&IP_ptr[24], peer_ptr->IP, 4))
+   {
+      peer_reply_ARP(peer_ptr, frame_ptr);
+      return;
+   }
+   if ((get16(&frame_ptr[12]) != 0x0800) || (IP_ptr[9] != IP_PROT_TCP) || memcmp(&IP_ptr[16], peer_ptr->IP, 4))
+   {
+      return;
+   }
+   IP_header_length = (IP_ptr[0] & 0x0F) * 4;
+   IP_length = get16(&IP_ptr[2]);
+   if ((IP_length < IP_header_length + 20) || (14 + IP_length > frame_length))
+   {
+      return;
+   }
+   TCP_ptr = &IP_ptr[IP_header_length];
+   if ((get16(&TCP_ptr[0]) != ECHO_PORT) || (get16(&TCP_ptr[2]) != peer_ptr->local_port))
+   {
+      return;
+   }
+   if (TCP_checksum(&IP_ptr[12], &IP_ptr[16], TCP_ptr, IP_length - IP_header_length) != 0)
+   {
+      peer_ptr->bad_checksums++;
+      return;
+   }
+
+   TCP_header_length = (TCP_ptr[12] >> 4) * 4;
+   data_length = IP_length - IP_header_length - TCP_header_length;
+   seq = get32(&TCP_ptr[4]);
+   flags = TCP_ptr[13];
+
+   if (flags & TCP_FLAG_RST)
+   {
+      peer_ptr->state = PEER_RESET;
+      return;
+   }
+
+   if (peer_ptr->state == PEER_SYN_SENT)
+   {
+      if ((flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) != (TCP_FLAG_SYN | TCP_FLAG_ACK) || (get32(&TCP_ptr[8]) != peer_ptr->iss + 1))
+      {
+         return;
+      }
+      for (i = 20; (i < TCP_header_length) && (TCP_ptr[i] != 0); i += (TCP_ptr[i] == 1) ? 1 : TCP_ptr[i + 1])
+      {
+         if ((TCP_ptr[i] != 1) && ((i + 2 > TCP_header_length) || (TCP_ptr[i + 1] < 2) ||
+            (i + TCP_ptr[i + 1] > TCP_header_length)))
+         {
+            break;
+         }
+         if ((TCP_ptr[i] == TCP_OPTION_MSS) && (TCP_ptr[i + 1] == 4))
+         {
+            peer_ptr->mss = (WORD)get16(&TCP_ptr[i + 2]);
+         }
+         // Note: Windows are only scaled if both sides sent the option.
+         if ((TCP_ptr[i] == TCP_OPTION_WINDOW_SCALE) && (TCP_ptr[i + 1] == 3) &&
+            (peer_ptr->options & PEER_OFFER_WINDOW_SCALE))
+         {
+            peer_ptr->snd_shift = TCP_ptr[i + 2];
+         }
+         if ((TCP_ptr[i] == TCP_OPTION_SACK_PERMITTED) && (TCP_ptr[i + 1] == 2) &&
+            (peer_ptr->options & PEER_OFFER_SACK))
+         {
+            peer_ptr->sack = 1;
+         }
+      }
+      peer_ptr->irs = seq;
+      peer_ptr->rcv_nxt = seq + 1;
+      peer_ptr->snd_una = peer_ptr->iss + 1;
+      peer_ptr->snd_wnd = get16(&TCP_ptr[14]);
+      peer_ptr->cwnd = 4 * (DWORD)peer_ptr->mss;
+      peer_ptr->ssthresh = 0xFFFFFFFFu;
+      peer_ptr->state = PEER_ESTABLISHED;
+      if (peer_ptr->timing)
+      {
+         peer_RTT_sample(peer_ptr, now_ns - peer_ptr->timed_at_ns);
+         peer_ptr->timing = 0;
+      }
+      peer_ptr->rto_deadline_ns = 0;
+      peer_ptr->ack_pending = 1;
+      return;
+   }
+   if (peer_ptr->state != PEER_ESTABLISHED)
+   {
+      return;
+   }
+
+   // a repeated SYN+ACK means our ACK of it was lost
+   if (flags & TCP_FLAG_SYN)
+   {
+      peer_ptr->ack_pending = 1;
+      return;
+   }
+
+   if (flags & TCP_FLAG_ACK)
+   {
+      peer_process_ACK(peer_ptr, get32(&TCP_ptr[8]), (DWORD)get16(&TCP_ptr[14]) << peer_ptr->snd_shift, data_length != 0, now_ns);
+   }
+
+   if (data_length == 0)
+   {
+      return;
+   }
+   peer_ptr->ack_pending = 1;
+   if (peer_ptr->options & (PEER_KEEP_OUT_OF_ORDER | PEER_OFFER_SACK))
+   {
+      if ((LONG)(seq + data_length - peer_ptr->rcv_nxt) <= 0)
+      {
+         peer_ptr->stale_segments++;
+         return;
+      }
+   }
+   else if (seq != peer_ptr->rcv_nxt)
+   {
+      peer_ptr->stale_segments++;
+      return;
+   }
+   for (i = 0; i < data_length; i++)
+   {
+      if (TCP_ptr[TCP_header_length + i] != stream_byte(seq - peer_ptr->irs - 1 + i))
+      {
+         peer_ptr->bad_bytes++;
+      }
+   }
+   if ((LONG)(seq - peer_ptr->rcv_nxt) > 0)
+   {
+      peer_keep_range(peer_ptr, seq, seq + data_length);
+      return;
+   }
+   peer_ptr->rcv_nxt = seq + data_length;
+
+   // fill in from kept data the segment has now joined up with
+   for (i = 0; i < peer_ptr->ooo_count; )
+   {
+      if ((LONG)(peer_ptr->ooo_left[i] - peer_ptr->rcv_nxt) <= 0)
+      {
+         if ((LONG)(peer_ptr->ooo_right[i] - peer_ptr->rcv_nxt) > 0)
+         {
+            peer_ptr->rcv_nxt = peer_ptr->ooo_right[i];
+         }
+         peer_ptr->ooo_count--;
+         memmove(&peer_ptr->ooo_left[i], &peer_ptr->ooo_left[i + 1], (peer_ptr->ooo_count - i) * sizeof(peer_ptr->ooo_left[0]));
+         memmove(&peer_ptr->ooo_right[i], &peer_ptr->ooo_right[i + 1], (peer_ptr->ooo_count - i) * sizeof(peer_ptr->ooo_right[0]));
+         i = 0;
+      }
+      else
+      {
+         i++;
+      }
+   }
+   work_check_completions(peer_ptr, work_ptr, now_ns);
+}
+
+// runs the client's timers and sends whatever it can
+static void peer_output(PEER *peer_ptr, WORKLOAD *work_ptr, unsigned long long now_ns)
+{
+   DWORD stream_end;
+
+   if (peer_ptr->state == PEER_SYN_SENT)
+   {
+      if (now_ns >= peer_ptr->rto_deadline_ns)
+      {
+         if (peer_ptr->rto_deadline_ns)
+         {
+            peer_ptr->retransmits++;
+            peer_ptr->timeouts++;
+            peer_ptr->rto_ns = (peer_ptr->rto_ns * 2 > PEER_MAX_RTO_NS) ? PEER_MAX_RTO_NS : peer_ptr->rto_ns * 2;
+            peer_ptr->timing = 0;
+         }
+         else
+         {
+            peer_ptr->timing = 1;
+            peer_ptr->timed_at_ns = now_ns;
+         }
+         peer_send(peer_ptr, TCP_FLAG_SYN, peer_ptr->iss, 0);
+         peer_ptr->rto_deadline_ns = now_ns + peer_ptr->rto_ns;
+      }
+      return;
+   }
+   if (peer_ptr->state != PEER_ESTABLISHED)
+   {
+      return;
+   }
+
+   // the application writes requests as the pipeline depth allows
+   while ((work_ptr->issued < work_ptr->request_count) && (work_ptr->issued < work_ptr->completed + work_ptr->depth))
+   {
+      if (work_ptr->issued == 0)
+      {
+         work_ptr->first_issue_ns = now_ns;
+      }
+      work_ptr->issue_ns[work_ptr->issued++] = now_ns;
+      peer_ptr->app_bytes += work_ptr->request_bytes;
+   }
+   stream_end = peer_ptr->iss + 1 + (DWORD)peer_ptr->app_bytes;
+
+   if (peer_ptr->rto_deadline_ns && (now_ns >= peer_ptr->rto_deadline_ns))
+   {
+      peer_ptr->rto_ns = (peer_ptr->rto_ns * 2 > PEER_MAX_RTO_NS) ? PEER_MAX_RTO_NS : peer_ptr->rto_ns * 2;
+      peer_ptr->rto_deadline_ns = now_ns + peer_ptr->rto_ns;
+      peer_ptr->timing = 0;
+      peer_ptr->dup_acks = 0;
+      if (peer_ptr->snd_max != peer_ptr->snd_una)
+      {
+         DWORD in_flight = peer_ptr->snd_max - peer_ptr->snd_una;
+
+         // go back N, from one segment
+         peer_ptr->ssthresh = (in_flight / 2 > 2 * (DWORD)peer_ptr->mss) ? in_flight / 2 : 2 * (DWORD)peer_ptr->mss;
+         peer_ptr->cwnd = peer_ptr->mss;
+         peer_ptr->snd_nxt = peer_ptr->snd_una;
+         peer_ptr->timeouts++;
+      }
+      else if ((peer_ptr->snd_wnd == 0) && (stream_end != peer_ptr->snd_una))
+      {
+         // the persist timer: one byte past a zero window
+         peer_send(peer_ptr, TCP_FLAG_ACK | TCP_FLAG_PSH, peer_ptr->snd_una, 1);
+         peer_ptr->snd_nxt = peer_ptr->snd_una + 1;
+         peer_ptr->snd_max = peer_ptr->snd_nxt;
+         peer_ptr->probes++;
+      }
+   }
+
+   for (;;)
+   {
+      DWORD window_end = peer_ptr->snd_una + ((peer_ptr->snd_wnd < peer_ptr->cwnd) ? peer_ptr->snd_wnd : peer_ptr->cwnd);
+      DWORD length;
+
+      if (((LONG)(stream_end - peer_ptr->snd_nxt) <= 0) || ((LONG)(window_end - peer_ptr->snd_nxt) <= 0))
+      {
+         break;
+      }
+      length = stream_end - peer_ptr->snd_nxt;
+      if (length > window_end - peer_ptr->snd_nxt)
+      {
+         length = window_end - peer_ptr->snd_nxt;
+      }
+      if (length > peer_ptr->mss)
+      {
+         length = peer_ptr->mss;
+      }
+
+      if ((LONG)(peer_ptr->snd_nxt - peer_ptr->snd_max) < 0)
+      {
+         // Karn's rule: nothing resent is timed
+         peer_ptr->retransmits++;
+         peer_ptr->timing = 0;
+      }
+      else if (!peer_ptr->timing)
+      {
+         peer_ptr->timing = 1;
+         peer_ptr->timed_seq = peer_ptr->snd_nxt;
+         peer_ptr->timed_at_ns = now_ns;
+      }
+      peer_send(peer_ptr, TCP_FLAG_ACK | TCP_FLAG_PSH, peer_ptr->snd_nxt, length);
+      peer_ptr->snd_nxt += length;
+      if ((LONG)(peer_ptr->snd_nxt - peer_ptr->snd_max) > 0)
+      {
+         peer_ptr->snd_max = peer_ptr->snd_nxt;
+      }
+      if (peer_ptr->rto_deadline_ns == 0)
+      {
+         peer_ptr->rto_deadline_ns = now_ns + peer_ptr->rto_ns;
+      }
+   }
+
+   // start the persist timer when a zero window holds data back
+   if ((peer_ptr->snd_wnd == 0) && (peer_ptr->snd_max == peer_ptr->snd_una) &&
+      (stream_end != peer_ptr->snd_una) && (peer_ptr->rto_deadline_ns == 0))
+   {
+      peer_ptr->rto_deadline_ns = now_ns + peer_ptr->rto_ns;
+   }
+
+   if (peer_ptr->ack_pending)
+   {
+      peer_send(peer_ptr, TCP_FLAG_ACK, peer_ptr->snd_nxt, 0);
+   }
+}
+
+static int compare_ns(const void *a_ptr, const void *b_ptr)
+{
+   unsigned long long a = *(const unsigned long long *)a_ptr;
+   unsigned long long b = *(const unsigned long long *)b_ptr;
+
+   return (a > b) - (a < b);
+}
+
+// runs one scenario and prints its row; returns 0 if the client saw any
+// corrupted data or the board's application caught the stack out
+static int run_scenario(const SCENARIO *scenario_ptr, unsigned long long seed, unsigned long long step_ns)
+{
+   NETSIM_LINK_CONFIG link = scenario_ptr->link;
+   NETSIM_LINK_CONFIG stack_link = scenario_ptr->link;
+   unsigned long saved_request_bytes = g_work.request_bytes;
+   unsigned long saved_request_count = g_work.request_count;
+   unsigned long saved_depth = g_work.depth;
+   NETSIM_PORT_STATS stack_stats;
+   NETSIM_PORT_STATS peer_stats;
+   TCP_SOCKET socket;
+   BYTE stack_port;
+   BYTE peer_port;
+   MAC_ADDR peer_MAC;
+   unsigned long long timeout_ns = (unsigned long long)scenario_ptr->timeout_s * 1000000000ull;
+   unsigned long long elapsed_ns;
+   const char *result_ptr;
+   WORD length;
+#if defined(STACK_USE_TCP_STATS)
+   TCP_SOCKET_STATS TCP_stats;
+#endif
+
+   // Note: Seeding the stack's own generator too makes its SYN cookie
+   // secret, and so its ISN, the same every run.
+   HostNetSimInit(seed);
+   LFSRSeedRand((DWORD)seed);
+
+   // Note: Impairing only the client's link puts every loss in the data the
+   // stack sends, so the stack's own recovery is all that's measured.
+   if (scenario_ptr->client_link_only)
+   {
+      stack_link.dwLossPPM = 0;
+      stack_link.dwDuplicatePPM = 0;
+      stack_link.dwReorderPPM = 0;
+      stack_link.dwBandwidthBps = 0;
+      stack_link.wQueueFrames = 0;
+   }
+
+   memcpy(peer_MAC.v, "\x02\x00\x00\x00\x00\x01", 6);
+   stack_port = HostNetSimAddPort(&AppConfig.MyMACAddr, &stack_link);
+   peer_port = HostNetSimAddPort(&peer_MAC, &link);
+   HostMACOpenNetSim(stack_port);
+
+   // Note: Same order as StackInit(), for the modules that are built.
+   TickInit();
+   MACInit();
+   ARPInit();
+   UDPInit();
+   TCPInit();
+   socket = TCPOpen(0, TCP_OPEN_SERVER, ECHO_PORT,
+      scenario_ptr->bulk ? TCP_PURPOSE_HOST_BULK_SERVER : TCP_PURPOSE_GENERIC_TCP_SERVER);
+   if (socket == INVALID_SOCKET)
+   {
+      fprintf(stderr, "no TCP socket for the echo server; add one to TCPSocketInitializer[]\n");
+      return 0;
+   }
+
+   if (scenario_ptr->app == APP_IOV)
+   {
+      g_work.request_bytes = scenario_ptr->bulk ? IOV_BULK_REQUEST_BYTES : IOV_REQUEST_BYTES;
+      g_work.request_count = IOV_REQUEST_COUNT;
+      g_work.depth = IOV_DEPTH;
+   }
+   else if (scenario_ptr->app != APP_ECHO)
+   {
+      g_work.request_bytes = OPTION_REQUEST_BYTES;
+      g_work.request_count = OPTION_REQUEST_COUNT;
+      g_work.depth = 1;
+   }
+   else if (scenario_ptr->bulk)
+   {
+      g_work.request_bytes = BULK_CHUNK_BYTES;
+      g_work.request_count = BULK_BYTES / BULK_CHUNK_BYTES;
+      g_work.depth = g_work.request_count;
+   }
+   memset((void *)&g_app, 0, sizeof(g_app));
+   if (app_option(scenario_ptr->app))
+   {
+      app_set_option(socket, app_option(scenario_ptr->app), 1);
+   }
+   peer_start(&g_peer, peer_port, (DWORD)(seed * 2654435761u), scenario_ptr->peer_options);
+   g_work.issued = 0;
+   g_work.completed = 0;
+   g_work.first_issue_ns = 0;
+   g_work.last_completion_ns = 0;
+
+   // Note: The "iov-" echo also waits for the stack to see its last bytes
+   // ACKed.
+   while (((g_work.completed < g_work.request_count) || (g_app.released < g_app.queued)) &&
+      (g_peer.state != PEER_RESET) && (HostNetSimGetTime() < timeout_ns))
+   {
+      stack_receive();
+      if (scenario_ptr->app == APP_IOV)
+      {
+         stack_echo_iov(socket);
+      }
+      else if (scenario_ptr->app != APP_ECHO)
+      {
+         stack_echo_option(socket, scenario_ptr->app);
+      }
+      else
+      {
+         stack_echo(socket);
+      }
+      TCPTick();
+
+      while ((length = HostNetSimReceive(peer_port, g_frame, sizeof(g_frame))) != 0)
+      {
+         static BYTE received[MAX_FRAME];
+
+         // Note: peer_receive() may send an ARP reply, which reuses g_frame.
+         memcpy(received, g_frame, length);
+         peer_receive(&g_peer, &g_work, received, length, HostNetSimGetTime());
+      }
+      peer_output(&g_peer, &g_work, HostNetSimGetTime());
+
+      HostNetSimAdvance(step_ns);
+   }
+
+   // Note: Before stack_finish_iov() closes the connection.
+#if defined(STACK_USE_TCP_STATS)
+   TCPGetStats(socket, &TCP_stats, NULL);
+#endif
+   if ((scenario_ptr->app == APP_IOV) && (g_work.completed == g_work.request_count))
+   {
+      stack_finish_iov(socket);
+   }
+   else if (app_option(scenario_ptr->app) && (g_work.completed == g_work.request_count))
+   {
+      stack_finish_option(scenario_ptr);
+   }
+
+   HostNetSimGetStats(stack_port, &stack_stats);
+   HostNetSimGetStats(peer_port, &peer_stats);
+   HostMACClose();
+#if defined(STACK_USE_TCP_STATS)
+   stack_check_stats(&TCP_stats, &peer_stats);
+#endif
+
+   if (g_app.failures)
+   {
+      result_ptr = "FAILED";
+   }
+   else if (g_work.completed == g_work.request_count)
+   {
+      result_ptr = "ok";
+   }
+   else if (g_peer.state == PEER_RESET)
+   {
+      result_ptr = "reset";
+   }
+   else
+   {
+      result_ptr = "timeout";
+   }
+   if (g_peer.bad_bytes || g_peer.bad_checksums)
+   {
+      result_ptr = "CORRUPT";
+   }
+
+   elapsed_ns = g_work.last_completion_ns - g_work.first_issue_ns;
+   printf("%-10s %7lu %9.2f", scenario_ptr->name_ptr, g_work.completed,
+      elapsed_ns ? (double)g_work.completed * g_work.request_bytes * 1e6 / (double)elapsed_ns : 0.0);
+   if (g_work.completed)
+   {
+      qsort(g_work.latency_ns, g_work.completed, sizeof(g_work.latency_ns[0]), compare_ns);
+      printf(" %9.2f %9.2f %9.2f",
+         (double)g_work.latency_ns[(g_work.completed - 1) * 50 / 100] / 1e6,
+         (double)g_work.latency_ns[(g_work.completed - 1) * 99 / 100] / 1e6,
+         (double)g_work.latency_ns[g_work.completed - 1] / 1e6);
+   }
+   else
+   {
+      printf(" %9s %9s %9s", "-", "-", "-");
+   }
+   printf(" %6lu %5lu %6lu %6lu %7lu %6lu  %s\n",
+      (unsigned long)(stack_stats.dwLost + peer_stats.dwLost),
+      (unsigned long)(stack_stats.dwDuplicated + peer_stats.dwDuplicated),
+      (unsigned long)(stack_stats.dwReordered + peer_stats.dwReordered),
+      (unsigned long)(stack_stats.dwQueueDrops + peer_stats.dwQueueDrops),
+      g_peer.retransmits, g_peer.stale_segments, result_ptr);
+#if defined(STACK_USE_TCP_STATS)
+   print_TCP_stats(&TCP_stats);
+#endif
+
+   g_work.request_bytes = saved_request_bytes;
+   g_work.request_count = saved_request_count;
+   g_work.depth = saved_depth;
+   return !(g_peer.bad_bytes || g_peer.bad_checksums || g_app.failures);
+}
+
+static void print_usage(const char *program_name_ptr)
+{
+   unsigned int i;
+
+   fprintf(stderr, "usage: %s [-s seed] [-n requests] [-b request_bytes] [-d depth] [-t step_us] [scenario]...\n", program_name_ptr);
+   fprintf(stderr, "scenarios:");
+   for (i = 0; i < SCENARIO_COUNT; i++)
+   {
+      fprintf(stderr, " %s", g_scenarios[i].name_ptr);
+   }
+   fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long long seed = 1;
+   unsigned long long step_ns = 50000;
+   int all_good = 1;
+   unsigned int i;
+   int option;
+
+   app_config_init();
+   for (i = 0; i < sizeof(g_stream_copy); i++)
+   {
+      g_stream_copy[i] = stream_byte(i);
+   }
+   g_work.request_bytes = 100;
+   g_work.request_count = 200;
+   g_work.depth = 2;
+
+   while ((option = getopt(argc, argv, "s:n:b:d:t:")) != -1)
+   {
+      switch (option)
+      {
+      case 's':
+         seed = strtoull(optarg, NULL, 0);
+         break;
+      case 'n':
+         g_work.request_count = strtoul(optarg, NULL, 0);
+         break;
+      case 'b':
+         g_work.request_bytes = strtoul(optarg, NULL, 0);
+         break;
+      case 'd':
+         g_work.depth = strtoul(optarg, NULL, 0);
+         break;
+      case 't':
+         step_ns = strtoull(optarg, NULL, 0) * 1000ull;
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+   if ((g_work.request_count == 0) || (g_work.request_count > MAX_REQUESTS) ||
+      (g_work.request_bytes == 0) || (g_work.depth == 0) || (step_ns == 0))
+   {
+      fprintf(stderr, "requests must be 1 to %u, and request bytes, depth and step more than 0\n", MAX_REQUESTS);
+      return 2;
+   }
+   for (i = optind; i < (unsigned int)argc; i++)
+   {
+      unsigned int j;
+
+      for (j = 0; (j < SCENARIO_COUNT) && strcmp(argv[i], g_scenarios[j].name_ptr); j++)
+      {
+      }
+      if (j == SCENARIO_COUNT)
+      {
+         fprintf(stderr, "unknown scenario: %s\n", argv[i]);
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+
+   printf("seed %llu, %lu requests of %lu bytes, depth %lu, step %llu us, bulk FIFOs %lu bytes\n",
+      seed, g_work.request_count, g_work.request_bytes, g_work.depth, step_ns / 1000ull,
+      (unsigned long)TCP_HOST_BULK_FIFO_SIZE);
+   printf("%-10s %7s %9s %9s %9s %9s %6s %5s %6s %6s %7s %6s  %s\n", "scenario", "done", "kB/s",
+      "p50 ms", "p99 ms", "max ms", "lost", "dup", "reord", "qdrop", "rexmit", "stale", "result");
+   for (i = 0; i < SCENARIO_COUNT; i++)
+   {
+      int j;
+      int selected = (optind >= argc);
+
+      for (j = optind; j < argc; j++)
+      {
+         if (strcmp(argv[j], g_scenarios[i].name_ptr) == 0)
+         {
+            selected = 1;
+         }
+      }
+      if (selected && !run_scenario(&g_scenarios[i], seed, step_ns))
+      {
+         all_good = 0;
+      }
+   }
+
+   return all_good ? 0 : 1;
+}
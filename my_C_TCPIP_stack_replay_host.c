@@ -0,0 +1,405 @@
+// This replays a pcap capture through the Microchip TCPIP stack, built as an
+// ordinary Linux process, and reports how long each layer took per packet.
+// The stack's MAC is "TCPIP Stack/HostMAC.c", which reads received frames
+// from the capture and writes every frame the stack transmits to an output
+// capture, so changes to TCP.c, UDP.c, etc. can be benchmarked on a PC and
+// their replies compared with a known good run (e.g. with "tcpdump -r").
+//    gcc -O2 -no-pie -o stack_replay my_C_TCPIP_stack_replay_host.c "TCPIP Stack/"{IP,TCP,UDP,ARP,ICMP,DNS,DHCP,AutoIP,Helpers,Tick,HostMAC,HostNetSim}.c
+//    ./stack_replay [-n loops] [-i our_ip] [-m our_mac] [-t tcp_port]...
+//       [-u udp_port]... in.pcap [out.pcap]
+// Note: The capture should be addressed to our IP and MAC address (defaults
+// are the ones in TCPIPConfig.h).  Frames for anyone else are processed and
+// dropped by the stack just as they would be on the board, which is still a
+// valid benchmark of the drop path.
+// Note: Replayed TCP segments are not re-sequenced.  The stack's initial
+// sequence numbers depend on the time (see TCPSYNCookie() in TCP.c), so once
+// a recorded handshake completes, the recorded ACKs won't match what the
+// stack sent and it answers with RSTs and challenge ACKs.  Handshakes,
+// checksums, socket lookup and the drop paths are all exercised, but a long
+// in-window transfer is not.
+// Note: Every heap allocation made while packets are being processed is
+// counted, and the run fails if there are any.  The stack is supposed to
+// never allocate.
+
+// for linking with the stack's declarations
+#include "TCPIP Stack/includes/TCPIP.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// the most listening TCP and UDP ports that can be given on the command line
+#define MAX_LISTEN_PORTS 8
+
+// Note: The real StackTsk.c isn't built into the host version, so AppConfig
+// is defined here.
+APP_CONFIG AppConfig;
+
+// timing for one layer of the stack
+typedef struct layer_stats
+{
+   const char *name_ptr;
+   unsigned long long packets;
+   unsigned long long total_ns;
+} LAYER_STATS;
+
+enum
+{
+   LAYER_MAC = 0,
+   LAYER_ARP,
+   LAYER_IP,
+   LAYER_ICMP,
+   LAYER_TCP,
+   LAYER_UDP,
+   LAYER_TCP_TICK,
+   LAYER_COUNT
+};
+
+static LAYER_STATS g_layers[LAYER_COUNT] =
+{
+   { "MACGetHeader", 0, 0 },
+   { "ARPProcess", 0, 0 },
+   { "IPGetHeader", 0, 0 },
+   { "ICMPProcess", 0, 0 },
+   { "TCPProcess", 0, 0 },
+   { "UDPProcess", 0, 0 },
+   { "TCPTick", 0, 0 },
+};
+
+// heap allocation counting
+// Note: These replace the C library's allocator for the whole program and
+// hand the real work to glibc's internal entry points.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+static int g_counting_allocations = 0;
+static unsigned long long g_allocation_count = 0;
+
+void *malloc(size_t size)
+{
+   if (g_counting_allocations)
+   {
+      g_allocation_count++;
+   }
+   return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+   if (g_counting_allocations)
+   {
+      g_allocation_count++;
+   }
+   return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+   if (g_counting_allocations)
+   {
+      g_allocation_count++;
+   }
+   return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+   __libc_free(ptr);
+}
+
+
+static unsigned long long get_time_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return ((unsigned long long)now.tv_sec * 1000000000ull) + (unsigned long long)now.tv_nsec;
+}
+
+// adds the time since start_ns to a layer and returns the time now, so that
+// the next layer can be timed from it
+static unsigned long long layer_done(unsigned int layer, unsigned long long start_ns)
+{
+   unsigned long long now_ns = get_time_ns();
+
+   g_layers[layer].packets++;
+   g_layers[layer].total_ns += now_ns - start_ns;
+   return now_ns;
+}
+
+static void app_config_init(void)
+{
+   memset((void *)&AppConfig, 0, sizeof(AppConfig));
+   AppConfig.MyIPAddr.Val = MY_DEFAULT_IP_ADDR_BYTE1 | MY_DEFAULT_IP_ADDR_BYTE2 << 8ul | MY_DEFAULT_IP_ADDR_BYTE3 << 16ul | MY_DEFAULT_IP_ADDR_BYTE4 << 24ul;
+   AppConfig.MyMask.Val = MY_DEFAULT_MASK_BYTE1 | MY_DEFAULT_MASK_BYTE2 << 8ul | MY_DEFAULT_MASK_BYTE3 << 16ul | MY_DEFAULT_MASK_BYTE4 << 24ul;
+   AppConfig.MyGateway.Val = MY_DEFAULT_GATE_BYTE1 | MY_DEFAULT_GATE_BYTE2 << 8ul | MY_DEFAULT_GATE_BYTE3 << 16ul | MY_DEFAULT_GATE_BYTE4 << 24ul;
+   AppConfig.DefaultIPAddr.Val = AppConfig.MyIPAddr.Val;
+   AppConfig.DefaultMask.Val = AppConfig.MyMask.Val;
+   AppConfig.MyMACAddr.v[0] = MY_DEFAULT_MAC_BYTE1;
+   AppConfig.MyMACAddr.v[1] = MY_DEFAULT_MAC_BYTE2;
+   AppConfig.MyMACAddr.v[2] = MY_DEFAULT_MAC_BYTE3;
+   AppConfig.MyMACAddr.v[3] = MY_DEFAULT_MAC_BYTE4;
+   AppConfig.MyMACAddr.v[4] = MY_DEFAULT_MAC_BYTE5;
+   AppConfig.MyMACAddr.v[5] = MY_DEFAULT_MAC_BYTE6;
+
+   // Note: There's no DHCP server in a capture (or, if there is, it isn't
+   // talking to us), so the static address is used from the start.
+   AppConfig.Flags.bIsDHCPEnabled = 0;
+   AppConfig.Flags.bInConfigMode = 0;
+}
+
+static int parse_mac(const char *text_ptr, MAC_ADDR *mac_ptr)
+{
+   unsigned int bytes[6];
+   unsigned int i;
+
+   if (sscanf(text_ptr, "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6)
+   {
+      return 0;
+   }
+   for (i = 0; i < 6; i++)
+   {
+      mac_ptr->v[i] = (BYTE)bytes[i];
+   }
+   return 1;
+}
+
+// does what StackTask() does with one received frame, timing each layer
+// Note: This mirrors the dispatch in StackTsk.c (minus the parts that only
+// apply to the board) so that the numbers are for the same calls the board
+// makes.
+static int replay_one_frame(void)
+{
+   NODE_INFO remote_node;
+   IP_ADDR local_IP;
+   BYTE frame_type;
+   BYTE IP_frame_type;
+   WORD data_count;
+   unsigned long long time_ns;
+
+   // Note: Any UDP data left over from the last frame is gone now.
+   UDPDiscard();
+
+   time_ns = get_time_ns();
+   if (!MACGetHeader(&remote_node.MACAddr, &frame_type))
+   {
+      return 0;
+   }
+   time_ns = layer_done(LAYER_MAC, time_ns);
+
+   if (frame_type == MAC_ARP)
+   {
+      ARPProcess();
+      layer_done(LAYER_ARP, time_ns);
+      return 1;
+   }
+   if (frame_type != MAC_IP)
+   {
+      return 1;
+   }
+
+   if (!IPGetHeader(&local_IP, &remote_node, &IP_frame_type, &data_count))
+   {
+      layer_done(LAYER_IP, time_ns);
+      return 1;
+   }
+   time_ns = layer_done(LAYER_IP, time_ns);
+
+   if (IP_frame_type == IP_PROT_ICMP)
+   {
+      if ((local_IP.Val == AppConfig.MyIPAddr.Val) ||
+         (local_IP.Val == 0xFFFFFFFF) ||
+         (local_IP.Val == ((AppConfig.MyIPAddr.Val & AppConfig.MyMask.Val) | ~AppConfig.MyMask.Val)))
+      {
+         ICMPProcess(&remote_node, data_count);
+         layer_done(LAYER_ICMP, time_ns);
+      }
+   }
+   else if (IP_frame_type == IP_PROT_TCP)
+   {
+      TCPProcess(&remote_node, &local_IP, data_count);
+      layer_done(LAYER_TCP, time_ns);
+   }
+   else if (IP_frame_type == IP_PROT_UDP)
+   {
+      UDPProcess(&remote_node, &local_IP, data_count);
+      layer_done(LAYER_UDP, time_ns);
+   }
+
+   return 1;
+}
+
+// plays the part of an application that reads everything it is sent, so that
+// the RX window never closes during a long capture
+static void drain_sockets(const TCP_SOCKET *TCP_sockets_ptr, unsigned int TCP_socket_count)
+{
+   unsigned int i;
+
+   for (i = 0; i < TCP_socket_count; i++)
+   {
+      if (TCPIsGetReady(TCP_sockets_ptr[i]))
+      {
+         TCPDiscard(TCP_sockets_ptr[i]);
+      }
+   }
+}
+
+static void print_report(unsigned long long frames, unsigned long long wall_ns)
+{
+   unsigned int i;
+
+   printf("%llu frames in %.3f ms (%.0f frames/s overall), %lu frames sent\n",
+      frames, (double)wall_ns / 1e6, frames ? (double)frames * 1e9 / (double)wall_ns : 0.0,
+      (unsigned long)HostMACGetTxCount());
+   printf("%-14s %10s %12s %14s\n", "layer", "packets", "ns/packet", "packets/s");
+   for (i = 0; i < LAYER_COUNT; i++)
+   {
+      double ns_per_packet;
+
+      if (g_layers[i].packets == 0)
+      {
+         continue;
+      }
+      ns_per_packet = (double)g_layers[i].total_ns / (double)g_layers[i].packets;
+      printf("%-14s %10llu %12.1f %14.0f\n", g_layers[i].name_ptr, g_layers[i].packets,
+         ns_per_packet, ns_per_packet > 0.0 ? 1e9 / ns_per_packet : 0.0);
+   }
+   printf("heap allocations during replay: %llu\n", g_allocation_count);
+}
+
+static void print_usage(const char *program_name_ptr)
+{
+   fprintf(stderr, "usage: %s [-n loops] [-i our_ip] [-m our_mac] [-t tcp_port]... [-u udp_port]... in.pcap [out.pcap]\n", program_name_ptr);
+}
+
+int main(int argc, char *argv[])
+{
+   TCP_SOCKET TCP_sockets[MAX_LISTEN_PORTS];
+   unsigned int TCP_socket_count = 0;
+   WORD TCP_ports[MAX_LISTEN_PORTS];
+   unsigned int TCP_port_count = 0;
+   WORD UDP_ports[MAX_LISTEN_PORTS];
+   unsigned int UDP_port_count = 0;
+   unsigned long loops = 1;
+   unsigned long loop;
+   unsigned long long frames = 0;
+   unsigned long long start_ns;
+   unsigned long long wall_ns;
+   unsigned int i;
+   int option;
+
+   app_config_init();
+
+   while ((option = getopt(argc, argv, "n:i:m:t:u:")) != -1)
+   {
+      switch (option)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 0);
+         break;
+      case 'i':
+         if (!StringToIPAddress((BYTE *)optarg, &AppConfig.MyIPAddr))
+         {
+            fprintf(stderr, "bad IP address: %s\n", optarg);
+            return 2;
+         }
+         AppConfig.DefaultIPAddr.Val = AppConfig.MyIPAddr.Val;
+         break;
+      case 'm':
+         if (!parse_mac(optarg, &AppConfig.MyMACAddr))
+         {
+            fprintf(stderr, "bad MAC address: %s\n", optarg);
+            return 2;
+         }
+         break;
+      case 't':
+      case 'u':
+         if ((option == 't' ? TCP_port_count : UDP_port_count) >= MAX_LISTEN_PORTS)
+         {
+            fprintf(stderr, "too many ports (at most %u of each kind)\n", MAX_LISTEN_PORTS);
+            return 2;
+         }
+         if (option == 't')
+         {
+            TCP_ports[TCP_port_count++] = (WORD)strtoul(optarg, NULL, 0);
+         }
+         else
+         {
+            UDP_ports[UDP_port_count++] = (WORD)strtoul(optarg, NULL, 0);
+         }
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+   if ((optind >= argc) || (argc - optind > 2))
+   {
+      print_usage(argv[0]);
+      return 2;
+   }
+
+   if (!HostMACOpenPcap(argv[optind], (optind + 1 < argc) ? argv[optind + 1] : NULL))
+   {
+      fprintf(stderr, "can't open %s (or the output capture), or it isn't an Ethernet pcap file\n", argv[optind]);
+      return 2;
+   }
+
+   // Note: Same order as StackInit(), for the modules that are built.
+   TickInit();
+   MACInit();
+   ARPInit();
+   UDPInit();
+   TCPInit();
+
+   for (i = 0; i < TCP_port_count; i++)
+   {
+      TCP_SOCKET socket = TCPOpen(0, TCP_OPEN_SERVER, TCP_ports[i], TCP_PURPOSE_GENERIC_TCP_SERVER);
+
+      if (socket == INVALID_SOCKET)
+      {
+         fprintf(stderr, "no TCP socket left for port %u; add more to TCPSocketInitializer[]\n", TCP_ports[i]);
+         return 2;
+      }
+      TCP_sockets[TCP_socket_count++] = socket;
+   }
+   for (i = 0; i < UDP_port_count; i++)
+   {
+      if (UDPOpenEx(0, UDP_OPEN_SERVER, UDP_ports[i], 0) == INVALID_UDP_SOCKET)
+      {
+         fprintf(stderr, "no UDP socket left for port %u; raise MAX_UDP_SOCKETS\n", UDP_ports[i]);
+         return 2;
+      }
+   }
+
+   g_counting_allocations = 1;
+   start_ns = get_time_ns();
+   for (loop = 0; loop < loops; loop++)
+   {
+      unsigned long long tick_ns;
+
+      if (loop)
+      {
+         HostMACRewind();
+      }
+      while (replay_one_frame())
+      {
+         frames++;
+         drain_sockets(TCP_sockets, TCP_socket_count);
+
+         tick_ns = get_time_ns();
+         TCPTick();
+         layer_done(LAYER_TCP_TICK, tick_ns);
+      }
+   }
+   wall_ns = get_time_ns() - start_ns;
+   g_counting_allocations = 0;
+
+   HostMACClose();
+   print_report(frames, wall_ns);
+
+   return (g_allocation_count == 0) ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+// This runs the whole Microchip TCPIP stack, StackInit(), StackTask() and
+// StackApplications() included, as an ordinary Linux process on a TAP
+// interface, with my_C_TCPIP_framework.c on top, exactly as main() on the
+// board uses them.  The application is an echo server on one port, so it
+// can be tried with ordinary clients and profiled with perf.
+//    ip tuntap add dev tap0 mode tap user $USER
+//    ip addr add 169.254.1.2/16 dev tap0
+//    ip link set tap0 up
+//    gcc -O2 -no-pie -o tap_echo my_C_TCPIP_tap_host.c my_C_TCPIP_framework_common.c my_C_TCPIP_framework.c my_function_queue.c "TCPIP Stack/"{StackTsk,Announce,NBNS,SNTP,DNS,DHCP,AutoIP,Helpers,Delay,Tick,IP,TCP,UDP,ARP,ICMP,HostMAC,HostNetSim}.c
+//    ./tap_echo [-i interface] [-p port]
+//    nc <the address it prints> 9760
+// Note: The stack starts with DHCP enabled, so it takes a few seconds to
+// fall back to AutoIP (or the default address) unless DHCP is served on the
+// interface.  The address is printed whenever it changes.
+// Note: -no-pie is not optional.  TCPOpen() and UDPOpenEx() keep pointers
+// in DWORDs, and stop the program if static data isn't below 4GB (see
+// "TCPIP Stack/includes/Compiler.h").
+
+// for the framework and the host MAC's extra calls
+#include "my_C_TCPIP_framework.h"
+#include "TCPIP Stack/includes/TCPIP.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// the largest echo done in one go, more than a socket's RX FIFO holds
+#define ECHO_BUFFER_BYTES 512
+
+static unsigned char g_echo_buffer[ECHO_BUFFER_BYTES];
+static unsigned int g_echo_bytes_pending = 0;
+
+static void print_usage(const char *program_name_ptr)
+{
+   fprintf(stderr, "usage: %s [-i interface] [-p port]\n", program_name_ptr);
+}
+
+int main(int argc, char *argv[])
+{
+   const char *interface_ptr = "tap0";
+   unsigned int port_num = 9760;
+   unsigned char ip[4] = {0, 0, 0, 0};
+   unsigned char last_ip[4] = {0, 0, 0, 0};
+   int option;
+
+   while ((option = getopt(argc, argv, "i:p:")) != -1)
+   {
+      switch (option)
+      {
+      case 'i':
+         interface_ptr = optarg;
+         break;
+      case 'p':
+         port_num = (unsigned int)strtoul(optarg, NULL, 0);
+         break;
+      default:
+         print_usage(argv[0]);
+         return 2;
+      }
+   }
+
+   // Note: Opened before the stack starts, so MACInit() uses it instead of
+   // HOST_MAC_TAP_NAME.
+   if (!HostMACOpenTap(interface_ptr))
+   {
+      fprintf(stderr, "can't open TAP interface %s\n", interface_ptr);
+      return 1;
+   }
+
+   // Note: The SSID and passphrase only matter to the MRF24WB.
+   TCPIP_and_wifi_stack_init("", "");
+   if (TCPIP_open_socket(port_num) < 0)
+   {
+      fprintf(stderr, "can't open port %u; check TCPSocketInitializer[] and MAX_SOCKETS\n", port_num);
+      return 1;
+   }
+   printf("echoing on %s port %u\n", interface_ptr, port_num);
+
+   while (1)
+   {
+      int bytes_received;
+      int bytes_sent;
+
+      TCPIP_keep_stack_alive();
+
+      TCPIP_get_IP_address(&ip[0], &ip[1], &ip[2], &ip[3]);
+      if (memcmp(ip, last_ip, sizeof(ip)))
+      {
+         memcpy(last_ip, ip, sizeof(ip));
+         printf("address %u.%u.%u.%u\n", ip[0], ip[1], ip[2], ip[3]);
+         fflush(stdout);
+      }
+
+      // Note: The RX FIFO can hold more than the TX FIFO ever has free (the
+      // TX FIFO keeps one byte empty), so what was read is echoed as space
+      // opens up instead of waiting for all of it to fit at once.
+      if (0 == g_echo_bytes_pending)
+      {
+         bytes_received = TCPIP_basic_receive(port_num, g_echo_buffer, sizeof(g_echo_buffer));
+         if (bytes_received > 0)
+         {
+            g_echo_bytes_pending = (unsigned int)bytes_received;
+         }
+      }
+      else
+      {
+         // Note: TCPIP_bytes_in_TX_FIFO(...) is the free space.
+         bytes_sent = TCPIP_bytes_in_TX_FIFO(port_num);
+         if (bytes_sent > (int)g_echo_bytes_pending)
+         {
+            bytes_sent = (int)g_echo_bytes_pending;
+         }
+         if (bytes_sent > 0)
+         {
+            bytes_sent = TCPIP_basic_send(port_num, g_echo_buffer, (unsigned int)bytes_sent);
+         }
+
+         if (bytes_sent > 0)
+         {
+            g_echo_bytes_pending -= (unsigned int)bytes_sent;
+            memmove(g_echo_buffer, g_echo_buffer + bytes_sent, g_echo_bytes_pending);
+         }
+         else if (!TCPIP_is_there_a_connection_on_port(port_num))
+         {
+            // the client is gone, and so is whatever it was owed
+            g_echo_bytes_pending = 0;
+         }
+      }
+   }
+
+   return 0;
+}